@@ -81,25 +81,41 @@
  */
 static int reg_stmt_to_entry(void* userdata, void** entry, void* stmt,
         void* calldata UNUSED, reg_error* errPtr UNUSED) {
-    int is_new;
     reg_registry* reg = (reg_registry*)userdata;
-    sqlite_int64 id = sqlite3_column_int64(stmt, 0);
+    reg_entry* e = reg_entry_for_id(reg, sqlite3_column_int64(stmt, 0));
+    if (!e) {
+        return 0;
+    }
+    *entry = e;
+    return 1;
+}
+
+/**
+ * Returns the entry with the given id, such as one returned by
+ * `reg_entry_owner_ids`. The id is not checked against the registry, so it
+ * must be that of an existing entry.
+ *
+ * @param [in] reg registry the entry is in
+ * @param [in] id  rowid of the entry
+ * @return         the entry if success; NULL if memory allocation failed
+ */
+reg_entry* reg_entry_for_id(reg_registry* reg, sqlite_int64 id) {
+    int is_new;
     Tcl_HashEntry* hash = Tcl_CreateHashEntry(&reg->open_entries,
             (const char*)&id, &is_new);
     if (is_new) {
         reg_entry* e = malloc(sizeof(reg_entry));
         if (!e) {
-            return 0;
+            Tcl_DeleteHashEntry(hash);
+            return NULL;
         }
         e->reg = reg;
         e->id = id;
         e->proc = NULL;
-        *entry = e;
         Tcl_SetHashValue(hash, e);
-    } else {
-        *entry = Tcl_GetHashValue(hash);
+        return e;
     }
-    return 1;
+    return Tcl_GetHashValue(hash);
 }
 
 /**
@@ -580,6 +596,198 @@ sqlite_int64 reg_entry_owner_id(reg_registry* reg, char* path, int cs) {
     return result;
 }
 
+/**
+ * Finds the owners of many files at once. This is equivalent to calling
+ * `reg_entry_owner_id` for each of the paths, but much faster for large
+ * numbers of files: the paths are loaded into a temporary table which is
+ * joined with registry.files in a single query using the index on
+ * actual_path.
+ *
+ * @param [in] reg          registry to find the files in
+ * @param [in] paths        paths of the files to get the owners of
+ * @param [in] path_count   number of paths
+ * @param [in] cs           false if check should be performed
+ *                          case-insensitive, true otherwise
+ * @param [out] ids         array of path_count ids; each is set to the id of
+ *                          the owner of the corresponding path, or 0 for none
+ * @param [out] actual_paths NULL, or array of path_count paths; each is set to
+ *                          the path the file is active as (which may differ
+ *                          from the given path in case if cs is false), or
+ *                          NULL if the file has no owner. Free with free(3).
+ * @param [out] image_paths NULL, or array of path_count paths; each is set to
+ *                          the path of the file in its port's image (which
+ *                          differs from the actual path if the file was
+ *                          activated under another name), or NULL if the
+ *                          file has no owner. Free with free(3).
+ * @param [out] errPtr      on error, a description of the error that occurred
+ * @return                  true if success; false if failure
+ */
+int reg_entry_owner_ids(reg_registry* reg, char** paths, int path_count,
+        int cs, sqlite_int64* ids, char** actual_paths, char** image_paths,
+        reg_error* errPtr) {
+    int result = 1;
+    int i;
+    sqlite3_stmt* stmt = NULL;
+    char* create_query = "CREATE TEMPORARY TABLE IF NOT EXISTS owner_paths ("
+        "idx INTEGER PRIMARY KEY, path TEXT)";
+    char* insert_query = "INSERT INTO temp.owner_paths (idx, path) "
+        "VALUES (?, ?)";
+    char* clear_query = "DELETE FROM temp.owner_paths";
+    char* select_query = NULL;
+
+    for (i = 0; i < path_count; i++) {
+        ids[i] = 0;
+        if (actual_paths) {
+            actual_paths[i] = NULL;
+        }
+        if (image_paths) {
+            image_paths[i] = NULL;
+        }
+    }
+    if (path_count == 0) {
+        return 1;
+    }
+
+    /* owner_paths is kept (but emptied) after use, so the schema does not
+     * change and invalidate prepared statements on every call */
+    if (sqlite3_exec(reg->db, create_query, NULL, NULL, NULL) != SQLITE_OK
+            || sqlite3_exec(reg->db, clear_query, NULL, NULL, NULL)
+                != SQLITE_OK) {
+        reg_sqlite_error(reg->db, errPtr, create_query);
+        return 0;
+    }
+
+    if (sqlite3_prepare_v2(reg->db, insert_query, -1, &stmt, NULL)
+            == SQLITE_OK) {
+        for (i = 0; i < path_count && result; i++) {
+            if ((sqlite3_bind_int(stmt, 1, i) == SQLITE_OK)
+                    && (sqlite3_bind_text(stmt, 2, paths[i], -1,
+                            SQLITE_STATIC) == SQLITE_OK)) {
+                int r;
+                do {
+                    r = sqlite3_step(stmt);
+                    switch (r) {
+                        case SQLITE_DONE:
+                            sqlite3_reset(stmt);
+                            break;
+                        case SQLITE_BUSY:
+                            break;
+                        default:
+                            reg_sqlite_error(reg->db, errPtr, insert_query);
+                            result = 0;
+                            break;
+                    }
+                } while (r == SQLITE_BUSY);
+            } else {
+                reg_sqlite_error(reg->db, errPtr, insert_query);
+                result = 0;
+            }
+        }
+    } else {
+        reg_sqlite_error(reg->db, errPtr, insert_query);
+        result = 0;
+    }
+    if (stmt) {
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+    }
+
+    if (result) {
+        /* CROSS JOIN makes SQLite loop over the given paths and look each of
+         * them up in the index on actual_path, rather than scanning the much
+         * larger files table */
+        asprintf(&select_query, "SELECT owner_paths.idx, files.id, "
+                "files.actual_path, files.path FROM temp.owner_paths "
+                "CROSS JOIN registry.files %s "
+                "ON (files.actual_path = owner_paths.path %s) "
+                "WHERE files.active",
+#if SQLITE_VERSION_NUMBER >= 3003013
+#if SQLITE_VERSION_NUMBER >= 3006004
+                cs ? "INDEXED BY file_actual" : "INDEXED BY file_actual_nocase",
+#else
+                "",
+#endif
+                cs ? "" : "COLLATE NOCASE");
+#else
+                "", "");
+#endif
+        if (!select_query) {
+            reg_throw(errPtr, REG_SQLITE_ERROR, "out of memory");
+            result = 0;
+        }
+    }
+
+    if (result) {
+        if (sqlite3_prepare_v2(reg->db, select_query, -1, &stmt, NULL)
+                == SQLITE_OK) {
+            int r;
+            do {
+                r = sqlite3_step(stmt);
+                switch (r) {
+                    case SQLITE_ROW:
+                        i = sqlite3_column_int(stmt, 0);
+                        /* if more than one file matches case-insensitively,
+                         * use the first one, like reg_entry_owner_id */
+                        if (i >= 0 && i < path_count && ids[i] == 0) {
+                            ids[i] = sqlite3_column_int64(stmt, 1);
+                            if (actual_paths) {
+                                const char* actual = (const char*)
+                                    sqlite3_column_text(stmt, 2);
+                                if (actual
+                                        && !(actual_paths[i] = strdup(actual))) {
+                                    reg_throw(errPtr, REG_SQLITE_ERROR,
+                                            "out of memory");
+                                    result = 0;
+                                }
+                            }
+                            if (image_paths) {
+                                const char* image = (const char*)
+                                    sqlite3_column_text(stmt, 3);
+                                if (image
+                                        && !(image_paths[i] = strdup(image))) {
+                                    reg_throw(errPtr, REG_SQLITE_ERROR,
+                                            "out of memory");
+                                    result = 0;
+                                }
+                            }
+                        }
+                        break;
+                    case SQLITE_DONE:
+                    case SQLITE_BUSY:
+                        break;
+                    default:
+                        reg_sqlite_error(reg->db, errPtr, select_query);
+                        result = 0;
+                        break;
+                }
+            } while (result && (r == SQLITE_ROW || r == SQLITE_BUSY));
+        } else {
+            reg_sqlite_error(reg->db, errPtr, select_query);
+            result = 0;
+        }
+        if (stmt) {
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    sqlite3_exec(reg->db, clear_query, NULL, NULL, NULL);
+    free(select_query);
+
+    if (!result) {
+        for (i = 0; i < path_count; i++) {
+            if (actual_paths) {
+                free(actual_paths[i]);
+                actual_paths[i] = NULL;
+            }
+            if (image_paths) {
+                free(image_paths[i]);
+                image_paths[i] = NULL;
+            }
+        }
+    }
+    return result;
+}
+
 /**
  * Gets a named property of an entry. That property can be set using
  * `reg_entry_propset`. The property named must be one that exists in the table
@@ -598,11 +806,13 @@ int reg_entry_propget(reg_entry* entry, char* key, char** value,
     sqlite3_stmt* stmt = NULL;
     char* query;
     const char *text;
-    query = sqlite3_mprintf("SELECT %q FROM registry.ports WHERE id=%lld", key,
-            entry->id);
-    if (sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) == SQLITE_OK) {
+    query = sqlite3_mprintf("SELECT %q FROM registry.ports WHERE id=?", key);
+    if (reg_prepare_cached(reg, query, &stmt, errPtr)) {
         int r;
-        do {
+        if (sqlite3_bind_int64(stmt, 1, entry->id) != SQLITE_OK) {
+            reg_sqlite_error(reg->db, errPtr, query);
+            r = SQLITE_ERROR;
+        } else do {
             r = sqlite3_step(stmt);
             switch (r) {
                 case SQLITE_ROW:
@@ -630,11 +840,85 @@ int reg_entry_propget(reg_entry* entry, char* key, char** value,
                     break;
             }
         } while (r == SQLITE_BUSY);
-    } else {
-        reg_sqlite_error(reg->db, errPtr, query);
+        reg_release_cached(reg, stmt);
     }
-    if (stmt) {
-        sqlite3_finalize(stmt);
+    sqlite3_free(query);
+    return result;
+}
+
+/**
+ * Gets several named properties of an entry at once. This is equivalent to
+ * calling `reg_entry_propget` for each of them, but reads them all with a
+ * single query. The same restrictions apply to the properties named. A
+ * property that isn't set is returned as NULL rather than as an error.
+ *
+ * @param [in] entry      entry to get properties from
+ * @param [in] keys       properties to get
+ * @param [in] key_count  number of properties
+ * @param [out] values    an array of the values of the properties, in the
+ *                        order of `keys`; the array and the values should be
+ *                        freed
+ * @param [out] errPtr    on error, a description of the error that occurred
+ * @return                true if success; false if failure
+ */
+int reg_entry_props(reg_entry* entry, char** keys, int key_count,
+        char*** values, reg_error* errPtr) {
+    reg_registry* reg = entry->reg;
+    int result = 0;
+    sqlite3_stmt* stmt = NULL;
+    char* query;
+    char* columns = NULL;
+    int i;
+    if (key_count <= 0) {
+        *values = NULL;
+        return 1;
+    }
+    for (i = 0; i < key_count; i++) {
+        if (columns) {
+            columns = sqlite3_mprintf("%z, %q", columns, keys[i]);
+        } else {
+            columns = sqlite3_mprintf("%q", keys[i]);
+        }
+    }
+    query = sqlite3_mprintf("SELECT %s FROM registry.ports WHERE id=?",
+            columns);
+    sqlite3_free(columns);
+    if (reg_prepare_cached(reg, query, &stmt, errPtr)) {
+        int r;
+        if (sqlite3_bind_int64(stmt, 1, entry->id) != SQLITE_OK) {
+            reg_sqlite_error(reg->db, errPtr, query);
+            r = SQLITE_ERROR;
+        } else do {
+            r = sqlite3_step(stmt);
+            switch (r) {
+                case SQLITE_ROW:
+                    *values = calloc(key_count, sizeof(char*));
+                    if (!*values) {
+                        reg_throw(errPtr, REG_SQLITE_ERROR, "out of memory");
+                        break;
+                    }
+                    result = 1;
+                    for (i = 0; i < key_count; i++) {
+                        const char* text =
+                            (const char*)sqlite3_column_text(stmt, i);
+                        if (text) {
+                            (*values)[i] = strdup(text);
+                        }
+                    }
+                    break;
+                case SQLITE_DONE:
+                    errPtr->code = REG_INVALID;
+                    errPtr->description = "an invalid entry was passed";
+                    errPtr->free = NULL;
+                    break;
+                case SQLITE_BUSY:
+                    continue;
+                default:
+                    reg_sqlite_error(reg->db, errPtr, query);
+                    break;
+            }
+        } while (r == SQLITE_BUSY);
+        reg_release_cached(reg, stmt);
     }
     sqlite3_free(query);
     return result;
@@ -660,11 +944,14 @@ int reg_entry_propset(reg_entry* entry, char* key, char* value,
     int result = 0;
     sqlite3_stmt* stmt = NULL;
     char* query;
-    query = sqlite3_mprintf("UPDATE registry.ports SET %q = '%q' WHERE id=%lld",
-            key, value, entry->id);
-    if (sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) == SQLITE_OK) {
+    query = sqlite3_mprintf("UPDATE registry.ports SET %q = ? WHERE id=?", key);
+    if (reg_prepare_cached(reg, query, &stmt, errPtr)) {
         int r;
-        do {
+        if ((sqlite3_bind_text(stmt, 1, value, -1, SQLITE_STATIC) != SQLITE_OK)
+                || (sqlite3_bind_int64(stmt, 2, entry->id) != SQLITE_OK)) {
+            reg_sqlite_error(reg->db, errPtr, query);
+            r = SQLITE_ERROR;
+        } else do {
             r = sqlite3_step(stmt);
             switch (r) {
                 case SQLITE_DONE:
@@ -683,11 +970,7 @@ int reg_entry_propset(reg_entry* entry, char* key, char* value,
                     break;
             }
         } while (r == SQLITE_BUSY);
-    } else {
-        reg_sqlite_error(reg->db, errPtr, query);
-    }
-    if (stmt) {
-        sqlite3_finalize(stmt);
+        reg_release_cached(reg, stmt);
     }
     sqlite3_free(query);
     return result;
@@ -53,6 +53,8 @@ int reg_entry_delete(reg_entry* entry, reg_error* errPtr);
 
 void reg_entry_free(reg_entry* entry);
 
+reg_entry* reg_entry_for_id(reg_registry* reg, sqlite_int64 id);
+
 int reg_entry_search(reg_registry* reg, const char** keys, const char** vals,
         int key_count, int* strategies, reg_entry*** entries, reg_error* errPtr);
 
@@ -63,11 +65,16 @@ int reg_entry_installed(reg_registry* reg, char* name, reg_entry*** entries,
         reg_error* errPtr);
 
 sqlite_int64 reg_entry_owner_id(reg_registry* reg, char* path, int cs);
+int reg_entry_owner_ids(reg_registry* reg, char** paths, int path_count,
+        int cs, sqlite_int64* ids, char** actual_paths, char** image_paths,
+        reg_error* errPtr);
 int reg_entry_owner(reg_registry* reg, char* path, int cs,
         reg_entry** entry, reg_error* errPtr);
 
 int reg_entry_propget(reg_entry* entry, char* key, char** value,
         reg_error* errPtr);
+int reg_entry_props(reg_entry* entry, char** keys, int key_count,
+        char*** values, reg_error* errPtr);
 int reg_entry_propset(reg_entry* entry, char* key, char* value,
         reg_error* errPtr);
 
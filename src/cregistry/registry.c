@@ -69,6 +69,9 @@ char *const registry_err_misuse         = "registry::misuse";
 char *const registry_err_cannot_init    = "registry::cannot-init";
 char *const registry_err_already_active = "registry::already-active";
 
+/* maximum number of statements kept by `reg_prepare_cached` */
+#define REG_STMT_CACHE_SIZE 64
+
 /**
  * Destroys a `reg_error` object. This should be called on any reg_error when a
  * registry function returns a failure condition; depending on the function,
@@ -135,6 +138,7 @@ int reg_open(reg_registry** regPtr, reg_error* errPtr) {
 
         if (init_db(reg->db, errPtr)) {
             reg->status = reg_none;
+            Tcl_InitHashTable(&reg->stmt_cache, TCL_STRING_KEYS);
             *regPtr = reg;
             return 1;
         }
@@ -146,6 +150,19 @@ int reg_open(reg_registry** regPtr, reg_error* errPtr) {
     return 0;
 }
 
+/**
+ * Finalizes all statements cached by `reg_prepare_cached`.
+ */
+static void clear_stmt_cache(reg_registry* reg) {
+    Tcl_HashEntry* curr;
+    Tcl_HashSearch search;
+    for (curr = Tcl_FirstHashEntry(&reg->stmt_cache, &search); curr != NULL;
+            curr = Tcl_NextHashEntry(&search)) {
+        sqlite3_finalize(Tcl_GetHashValue(curr));
+        Tcl_DeleteHashEntry(curr);
+    }
+}
+
 /**
  * Closes a registry object. Will detach if necessary.
  *
@@ -157,7 +174,9 @@ int reg_close(reg_registry* reg, reg_error* errPtr) {
     if ((reg->status & reg_attached) && !reg_detach(reg, errPtr)) {
         return 0;
     }
+    clear_stmt_cache(reg);
     if (sqlite3_close(reg->db) == SQLITE_OK) {
+        Tcl_DeleteHashTable(&reg->stmt_cache);
         free(reg);
         return 1;
     } else {
@@ -323,6 +342,8 @@ int reg_detach(reg_registry* reg, reg_error* errPtr) {
         reg_throw(errPtr,REG_MISUSE,"no database is attached to this registry");
         return 0;
     }
+    /* cached statements refer to the database being detached */
+    clear_stmt_cache(reg);
     if (sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) == SQLITE_OK) {
         int r;
         Tcl_HashEntry* curr;
@@ -387,6 +408,134 @@ int reg_detach(reg_registry* reg, reg_error* errPtr) {
     return result;
 }
 
+/**
+ * Opens a second registry object attached to the same database as a given
+ * one. The new object has its own connection to the database, which only
+ * allows reading, so it can be used to query the registry from a different
+ * thread than the one using the original object, concurrently with it.
+ *
+ * @param [out] regPtr address of the allocated registry
+ * @param [in] reg     an attached registry whose database should be opened
+ * @param [out] errPtr on error, a description of the error that occurred
+ * @return             true if success; false if failure
+ */
+int reg_open_readonly(reg_registry** regPtr, reg_registry* reg,
+        reg_error* errPtr) {
+#if SQLITE_VERSION_NUMBER >= 3007010
+    reg_registry* ro_reg;
+    const char* path;
+    char* query;
+    int result = 0;
+    if (!(reg->status & reg_attached)) {
+        reg_throw(errPtr, REG_MISUSE, "no database is attached to this registry");
+        return 0;
+    }
+    path = sqlite3_db_filename(reg->db, "registry");
+    if (!path || !*path) {
+        reg_throw(errPtr, REG_MISUSE, "the attached registry has no file name");
+        return 0;
+    }
+    if (!reg_open(&ro_reg, errPtr)) {
+        return 0;
+    }
+    query = sqlite3_mprintf("ATTACH DATABASE '%q' AS registry", path);
+    /* the database has already been created and updated when the original
+     * registry was attached, so there is no need to write to it */
+    if (sqlite3_exec(ro_reg->db, query, NULL, NULL, NULL) == SQLITE_OK
+            && sqlite3_exec(ro_reg->db, "PRAGMA query_only = 1", NULL, NULL,
+                NULL) == SQLITE_OK) {
+        Tcl_InitHashTable(&ro_reg->open_entries,
+                sizeof(sqlite_int64)/sizeof(int));
+        Tcl_InitHashTable(&ro_reg->open_files, TCL_STRING_KEYS);
+        Tcl_InitHashTable(&ro_reg->open_portgroups,
+                sizeof(sqlite_int64)/sizeof(int));
+        ro_reg->status |= reg_attached;
+        *regPtr = ro_reg;
+        result = 1;
+    } else {
+        /* like reg_close, without detaching */
+        reg_sqlite_error(ro_reg->db, errPtr, query);
+        clear_stmt_cache(ro_reg);
+        sqlite3_close(ro_reg->db);
+        Tcl_DeleteHashTable(&ro_reg->stmt_cache);
+        free(ro_reg);
+    }
+    sqlite3_free(query);
+    return result;
+#else
+    (void) regPtr;
+    (void) reg;
+    reg_throw(errPtr, REG_MISUSE, "read-only registry connections require "
+            "SQLite 3.7.10 or later");
+    return 0;
+#endif
+}
+
+/**
+ * Returns a prepared statement for a query, reusing the statement prepared the
+ * last time the same query was run on this registry. Queries should use
+ * parameters for values rather than including them in the text, so that the
+ * statement can be reused. The statement must be given back with
+ * `reg_release_cached` (and not finalized) when the caller is done with it.
+ *
+ * @param [in] reg      registry to prepare the statement for
+ * @param [in] query    the query
+ * @param [out] stmtPtr the prepared statement
+ * @param [out] errPtr  on error, a description of the error that occurred
+ * @return              true if success; false if failure
+ */
+int reg_prepare_cached(reg_registry* reg, const char* query,
+        sqlite3_stmt** stmtPtr, reg_error* errPtr) {
+    Tcl_HashEntry* entry = Tcl_FindHashEntry(&reg->stmt_cache, query);
+    sqlite3_stmt* stmt = NULL;
+    int is_new;
+    if (entry) {
+        stmt = Tcl_GetHashValue(entry);
+#if SQLITE_VERSION_NUMBER >= 3007010
+        /* the cached statement is still being stepped by a caller further up
+         * the stack; use a separate one */
+        if (sqlite3_stmt_busy(stmt)) {
+            stmt = NULL;
+        }
+#endif
+        if (stmt) {
+            *stmtPtr = stmt;
+            return 1;
+        }
+    }
+    if (sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) != SQLITE_OK) {
+        reg_sqlite_error(reg->db, errPtr, (char*)query);
+        if (stmt) {
+            sqlite3_finalize(stmt);
+        }
+        return 0;
+    }
+    if (!entry && reg->stmt_cache.numEntries < REG_STMT_CACHE_SIZE) {
+        entry = Tcl_CreateHashEntry(&reg->stmt_cache, query, &is_new);
+        Tcl_SetHashValue(entry, stmt);
+    }
+    *stmtPtr = stmt;
+    return 1;
+}
+
+/**
+ * Gives back a statement obtained from `reg_prepare_cached`. The statement is
+ * reset so it can be used again, or finalized if it isn't the cached one.
+ *
+ * @param [in] reg  registry the statement was prepared for
+ * @param [in] stmt the statement
+ */
+void reg_release_cached(reg_registry* reg, sqlite3_stmt* stmt) {
+    Tcl_HashEntry* entry = Tcl_FindHashEntry(&reg->stmt_cache,
+            sqlite3_sql(stmt));
+    if (entry && Tcl_GetHashValue(entry) == stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    } else {
+        sqlite3_finalize(stmt);
+    }
+}
+
 /**
  * Helper function for `reg_start_read` and `reg_start_write`.
  */
@@ -81,6 +81,7 @@ typedef struct {
     Tcl_HashTable open_entries;
     Tcl_HashTable open_files;
     Tcl_HashTable open_portgroups;
+    Tcl_HashTable stmt_cache;
 } reg_registry;
 
 int reg_open(reg_registry** regPtr, reg_error* errPtr);
@@ -89,6 +90,12 @@ int reg_configure(reg_registry* reg);
 
 int reg_attach(reg_registry* reg, const char* path, reg_error* errPtr);
 int reg_detach(reg_registry* reg, reg_error* errPtr);
+int reg_open_readonly(reg_registry** regPtr, reg_registry* reg,
+        reg_error* errPtr);
+
+int reg_prepare_cached(reg_registry* reg, const char* query,
+        sqlite3_stmt** stmtPtr, reg_error* errPtr);
+void reg_release_cached(reg_registry* reg, sqlite3_stmt* stmt);
 
 int reg_start_read(reg_registry* reg, reg_error* errPtr);
 int reg_start_write(reg_registry* reg, reg_error* errPtr);
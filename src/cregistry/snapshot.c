@@ -210,24 +210,22 @@ reg_snapshot* reg_snapshot_create(reg_registry* reg, char* note, reg_error* errP
 }
 
 /**
- * helper method for storing ports for this snapshot
+ * Executes a query that returns no rows.
  *
  * @param [in] reg          associated registry
- * @param [in] snapshot     reg_snapshot, its id to use for foreignkey'ing the ports
+ * @param [in] query        the query to execute
+ * @param [in] param        value for the parameter of the query, if it has one
  * @param [out] errPtr      on error, a description of the error that occurred
  * @return                  true if success; 0 if failure
  */
-int snapshot_store_ports(reg_registry* reg, reg_snapshot* snapshot, reg_error* errPtr) {
+static int snapshot_exec(reg_registry* reg, char* query, sqlite_int64 param,
+        reg_error* errPtr) {
     int result = 1;
     sqlite3_stmt* stmt = NULL;
 
-    char* query = "INSERT INTO registry.snapshot_ports "
-        "(snapshots_id, port_name, requested, state, variants, requested_variants) "
-        "SELECT ?, name, requested, state, variants, requested_variants "
-        "FROM registry.ports WHERE state='installed'";
-
     if ((sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) == SQLITE_OK)
-            && (sqlite3_bind_int64(stmt, 1, snapshot->id) == SQLITE_OK)) {
+            && (sqlite3_bind_parameter_count(stmt) == 0
+                || sqlite3_bind_int64(stmt, 1, param) == SQLITE_OK)) {
         int r;
         do {
             r = sqlite3_step(stmt);
@@ -250,52 +248,105 @@ int snapshot_store_ports(reg_registry* reg, reg_snapshot* snapshot, reg_error* e
         sqlite3_finalize(stmt);
     }
 
-    return result ? snapshot_store_files(reg, snapshot, errPtr) : result;
+    return result;
+}
+
+/**
+ * helper method for storing ports for this snapshot
+ *
+ * @param [in] reg          associated registry
+ * @param [in] snapshot     reg_snapshot, its id to use for foreignkey'ing the ports
+ * @param [out] errPtr      on error, a description of the error that occurred
+ * @return                  true if success; 0 if failure
+ */
+int snapshot_store_ports(reg_registry* reg, reg_snapshot* snapshot, reg_error* errPtr) {
+    /* the file lists have to exist before the ports can refer to them */
+    if (!snapshot_store_files(reg, snapshot, errPtr)) {
+        return 0;
+    }
+
+    char* query = "INSERT INTO registry.snapshot_ports "
+        "(snapshots_id, port_name, requested, state, variants, requested_variants, fileset_id) "
+        "SELECT ?, name, requested, state, variants, requested_variants, "
+            "(SELECT id FROM registry.snapshot_filesets "
+            "WHERE port_name = ports.name AND epoch IS ports.epoch "
+            "AND version IS ports.version AND revision IS ports.revision "
+            "AND variants IS ports.variants AND date IS ports.date) "
+        "FROM registry.ports WHERE state='installed'";
+
+    return snapshot_exec(reg, query, snapshot->id, errPtr);
 }
 
 /**
  * helper method for storing files for this snapshot
  *
+ * The files of a registry entry are fixed when it is installed, so the file
+ * lists are shared between snapshots: each installed port refers to the list
+ * stored for its name, epoch, version, revision, variants and install date,
+ * and only the ports installed since they were last snapshotted add a new
+ * list.
+ *
  * @param [in] reg          associated registry
- * @param [in] snapshot     reg_snapshot, its id to use for foreignkey'ing the files
+ * @param [in] snapshot     reg_snapshot the files are stored for
  * @param [out] errPtr      on error, a description of the error that occurred
  * @return                  true if success; 0 if failure
  */
-int snapshot_store_files(reg_registry* reg, reg_snapshot* snapshot, reg_error* errPtr) {
-    int result = 1;
+int snapshot_store_files(reg_registry* reg, reg_snapshot* snapshot UNUSED,
+        reg_error* errPtr) {
     sqlite3_stmt* stmt = NULL;
+    sqlite_int64 last_fileset = -1;
 
-    char* query = "INSERT INTO registry.snapshot_files (id, path) "
-        "SELECT snapshot_ports.id, files.path "
-        "FROM registry.ports INNER JOIN registry.files ON ports.id = files.id "
-        "INNER JOIN registry.snapshot_ports ON ports.name = snapshot_ports.port_name "
-        "WHERE snapshot_ports.snapshots_id = ? AND ports.state = 'installed'";
-
-    if ((sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) == SQLITE_OK)
-            && (sqlite3_bind_int64(stmt, 1, snapshot->id) == SQLITE_OK)) {
+    /* file lists with a higher id than this are new and need their files */
+    char* query = "SELECT COALESCE(MAX(id), 0) FROM registry.snapshot_filesets";
+    if (sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) == SQLITE_OK) {
         int r;
         do {
             r = sqlite3_step(stmt);
             switch (r) {
-                case SQLITE_DONE:
+                case SQLITE_ROW:
+                    last_fileset = sqlite3_column_int64(stmt, 0);
                     break;
                 case SQLITE_BUSY:
                     break;
                 default:
                     reg_sqlite_error(reg->db, errPtr, query);
-                    result = 0;
                     break;
             }
         } while (r == SQLITE_BUSY);
     } else {
         reg_sqlite_error(reg->db, errPtr, query);
-        result = 0;
     }
     if (stmt) {
         sqlite3_finalize(stmt);
     }
+    if (last_fileset < 0) {
+        return 0;
+    }
 
-    return result;
+    query = "INSERT INTO registry.snapshot_filesets "
+        "(port_name, epoch, version, revision, variants, date) "
+        "SELECT name, epoch, version, revision, variants, date "
+        "FROM registry.ports WHERE state = 'installed' "
+        "AND NOT EXISTS (SELECT 1 FROM registry.snapshot_filesets "
+            "WHERE port_name = ports.name AND epoch IS ports.epoch "
+            "AND version IS ports.version AND revision IS ports.revision "
+            "AND variants IS ports.variants AND date IS ports.date)";
+    if (!snapshot_exec(reg, query, last_fileset, errPtr)) {
+        return 0;
+    }
+
+    query = "INSERT INTO registry.snapshot_fileset_files (fileset_id, path) "
+        "SELECT snapshot_filesets.id, files.path "
+        "FROM registry.snapshot_filesets INNER JOIN registry.ports "
+            "ON ports.name = snapshot_filesets.port_name "
+            "AND ports.epoch IS snapshot_filesets.epoch "
+            "AND ports.version IS snapshot_filesets.version "
+            "AND ports.revision IS snapshot_filesets.revision "
+            "AND ports.variants IS snapshot_filesets.variants "
+            "AND ports.date IS snapshot_filesets.date "
+        "INNER JOIN registry.files ON ports.id = files.id "
+        "WHERE snapshot_filesets.id > ? AND ports.state = 'installed'";
+    return snapshot_exec(reg, query, last_fileset, errPtr);
 }
 
 /**
@@ -311,7 +362,9 @@ int reg_snapshot_ports_get(reg_snapshot* snapshot, port*** ports, reg_error* err
     reg_registry* reg = snapshot->reg;
     sqlite3_stmt* stmt = NULL;
 
-    char* query = "SELECT port_name, requested, state, variants, requested_variants "
+    /* variants of entries that never had them set are NULL */
+    char* query = "SELECT port_name, requested, state, COALESCE(variants, ''), "
+                  "COALESCE(requested_variants, '') "
                   "FROM registry.snapshot_ports WHERE snapshots_id=?";
 
     if ((sqlite3_prepare_v2(reg->db, query, -1, &stmt, NULL) == SQLITE_OK)
@@ -142,7 +142,7 @@ int create_tables(sqlite3* db, reg_error* errPtr) {
 
         /* metadata table */
         "CREATE TABLE registry.metadata (key UNIQUE, value)",
-        "INSERT INTO registry.metadata (key, value) VALUES ('version', '1.215')",
+        "INSERT INTO registry.metadata (key, value) VALUES ('version', '1.216')",
         "INSERT INTO registry.metadata (key, value) VALUES ('created', strftime('%s', 'now'))",
 
         /* ports table */
@@ -224,20 +224,34 @@ int create_tables(sqlite3* db, reg_error* errPtr) {
             ", state TEXT COLLATE NOCASE"
             ", variants TEXT"
             ", requested_variants TEXT"
+            ", fileset_id INTEGER"
             ", FOREIGN KEY(snapshots_id) REFERENCES snapshots(id)"
             " ON DELETE CASCADE"
+            ", FOREIGN KEY(fileset_id) REFERENCES snapshot_filesets(id)"
             ")",
+        "CREATE INDEX registry.snapshot_port_fileset ON snapshot_ports(fileset_id)",
 
-        /* Files registered to ports in snapshots.
+        /* Lists of files registered to ports in snapshots, shared by all
+           snapshots of the same installed port.
            Needed to resolve file-based dependencies. */
-        "CREATE TABLE registry.snapshot_files ("
-              "id INTEGER"
+        "CREATE TABLE registry.snapshot_filesets ("
+              "id INTEGER PRIMARY KEY"
+            ", port_name TEXT COLLATE NOCASE"
+            ", epoch INTEGER"
+            ", version TEXT"
+            ", revision INTEGER"
+            ", variants TEXT"
+            ", date DATETIME"
+            ", UNIQUE (port_name, epoch, version, revision, variants, date)"
+            ")",
+        "CREATE TABLE registry.snapshot_fileset_files ("
+              "fileset_id INTEGER"
             ", path TEXT"
-            ", FOREIGN KEY(id) REFERENCES snapshot_ports(id)"
+            ", FOREIGN KEY(fileset_id) REFERENCES snapshot_filesets(id)"
             " ON DELETE CASCADE"
             ")",
-        "CREATE INDEX registry.snapshot_file_path ON snapshot_files(path)",
-        "CREATE INDEX registry.snapshot_file_id ON snapshot_files(id)",
+        "CREATE INDEX registry.snapshot_fileset_file_path ON snapshot_fileset_files(path)",
+        "CREATE INDEX registry.snapshot_fileset_file_id ON snapshot_fileset_files(fileset_id)",
 
         "COMMIT",
         NULL
@@ -969,6 +983,61 @@ int update_db(sqlite3* db, reg_error* errPtr) {
             continue;
         }
 
+        if (sql_version(NULL, -1, version, -1, "1.216") < 0) {
+            /* Share the file lists of snapshots between all snapshots of the
+               same installed port. The lists of existing snapshots are kept
+               as they are, one per snapshot port. */
+
+            static char* version_1_216_queries[] = {
+                "CREATE TABLE registry.snapshot_filesets ("
+                      "id INTEGER PRIMARY KEY"
+                    ", port_name TEXT COLLATE NOCASE"
+                    ", epoch INTEGER"
+                    ", version TEXT"
+                    ", revision INTEGER"
+                    ", variants TEXT"
+                    ", date DATETIME"
+                    ", UNIQUE (port_name, epoch, version, revision, variants, date)"
+                    ")",
+                "CREATE TABLE registry.snapshot_fileset_files ("
+                      "fileset_id INTEGER"
+                    ", path TEXT"
+                    ", FOREIGN KEY(fileset_id) REFERENCES snapshot_filesets(id)"
+                    " ON DELETE CASCADE"
+                    ")",
+                "ALTER TABLE registry.snapshot_ports ADD COLUMN fileset_id INTEGER"
+                    " REFERENCES snapshot_filesets(id)",
+
+                "INSERT INTO registry.snapshot_filesets (id, port_name, variants)"
+                    " SELECT id, port_name, variants FROM registry.snapshot_ports"
+                    " WHERE id IN (SELECT id FROM registry.snapshot_files)",
+                "INSERT INTO registry.snapshot_fileset_files (fileset_id, path)"
+                    " SELECT id, path FROM registry.snapshot_files",
+                "UPDATE registry.snapshot_ports SET fileset_id = id"
+                    " WHERE id IN (SELECT id FROM registry.snapshot_filesets)",
+                "DROP TABLE registry.snapshot_files",
+
+                "CREATE INDEX registry.snapshot_port_fileset ON snapshot_ports(fileset_id)",
+                "CREATE INDEX registry.snapshot_fileset_file_path ON snapshot_fileset_files(path)",
+                "CREATE INDEX registry.snapshot_fileset_file_id ON snapshot_fileset_files(fileset_id)",
+
+                /* Update version and commit */
+                "UPDATE registry.metadata SET value = '1.216' WHERE key = 'version'",
+                "COMMIT",
+                NULL
+            };
+
+            sqlite3_finalize(stmt);
+            stmt = NULL;
+
+            if (!do_queries(db, version_1_216_queries, errPtr)) {
+                rollback_db(db);
+                return 0;
+            }
+
+            did_update = 1;
+            continue;
+        }
 
         /* add new versions here, but remember to:
          *  - finalize the version query statement and set stmt to NULL
@@ -979,7 +1048,7 @@ int update_db(sqlite3* db, reg_error* errPtr) {
          *  - update the current version number below
          */
 
-        if (sql_version(NULL, -1, version, -1, "1.215") > 0) {
+        if (sql_version(NULL, -1, version, -1, "1.216") > 0) {
             /* the registry was already upgraded to a newer version and cannot be used anymore */
             reg_throw(errPtr, REG_INVALID, "Version number in metadata table is newer than expected.");
             sqlite3_finalize(stmt);
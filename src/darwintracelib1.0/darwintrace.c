@@ -36,7 +36,9 @@
 #define DARWINTRACE_USE_PRIVATE_API 1
 #include "darwintrace.h"
 #include "sandbox_actions.h"
+#include "sandbox_trie.h"
 #include "strlcpy.h"
+#include "verdict_cache.h"
 
 #ifdef HAVE_STDATOMIC_H
 #include <stdatomic.h>
@@ -52,6 +54,7 @@
 #include <pthread.h>
 #include <string.h>
 #include <sys/attr.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -89,6 +92,7 @@ volatile int __darwintrace_close_sock = -1;
 FILE *__darwintrace_stderr = NULL;
 
 static inline void __darwintrace_log_op(const char *op, const char *path);
+static inline void __darwintrace_log_violation(const char *path);
 static char *__send(const char *buf, uint32_t len, int answer);
 
 /**
@@ -105,13 +109,31 @@ pthread_key_t sock_key;
 #define BUFFER_SIZE 4096
 
 /**
- * Variable holding the sandbox bounds in the following format:
- *  <filemap>       :: (<spec> '\0')+ '\0'
- *  <spec>          :: <path> '\0' <operation> <additional_data>?
- *  <operation>     :: '0' | '1' | '2'
- * where
+ * size of the per-thread buffer for outgoing messages; must hold at least one
+ * message of BUFFER_SIZE bytes with its length prefix
+ */
+#define SEND_BUFFER_SIZE (4 * BUFFER_SIZE)
+
+/**
+ * Per-thread buffer of messages to tracelib that do not expect an answer,
+ * such as reports of unknown files. They are sent in one write(2) together
+ * with the next request that does expect an answer, when the buffer is full,
+ * or when the socket is closed, i.e. at exec(2), thread exit and process exit.
+ * Sandbox violations are sent right away, since a process leaving through
+ * _exit(2) or a fatal signal would lose them.
+ */
+typedef struct {
+	size_t len;
+	char buf[SEND_BUFFER_SIZE];
+} send_buffer_t;
+
+static pthread_key_t send_buffer_key;
+
+/**
+ * Variable holding the sandbox bounds compiled into a prefix tree by tracelib
+ * using \c sandbox_trie_compile. Each path that is a prefix in the tree is
+ * associated with one of the following operations:
  *  0: allow
- *  1: map the path to the one given in additional_data (currently unsupported)
  *  2: check for a dependency using the socket
  *  3: deny access to the path and stop processing
  */
@@ -121,6 +143,22 @@ static _Atomic(char *) filemap;
 static char *filemap;
 #endif
 
+/**
+ * Read-only mapping of the cache of dependency check verdicts published by
+ * tracelib, or \c NULL if it is unavailable. See verdict_cache.h for the
+ * format.
+ */
+#ifdef HAVE_STDATOMIC_H
+static _Atomic(char *) verdict_cache;
+#else
+static char *verdict_cache;
+#endif
+
+/**
+ * Writable mapping of the hit and miss counters of the verdict cache, or \c
+ * NULL if they are unavailable.
+ */
+static verdict_cache_stats_t *verdict_stats;
 
 volatile bool __darwintrace_initialized = false;
 
@@ -142,7 +180,14 @@ void __darwintrace_run_constructors(void) {
 	__darwintrace_initialized = true;
 }
 
+static void __darwintrace_flush_buffer(send_buffer_t *sendbuf);
+static void __darwintrace_send_buffer_destructor(send_buffer_t *sendbuf);
+
 static void __darwintrace_sock_destructor(FILE *dtsock) {
+	/* the socket in TLS has already been cleared, put it back while sending
+	 * the remaining messages */
+	__darwintrace_sock_set(dtsock);
+	__darwintrace_flush_buffer(pthread_getspecific(send_buffer_key));
 	__darwintrace_close_sock = fileno(dtsock);
 	fclose(dtsock);
 	__darwintrace_close_sock = -1;
@@ -162,6 +207,10 @@ void __darwintrace_setup_tls(void) {
 		perror("darwintrace: pthread_key_create");
 		abort();
 	}
+	if (0 != (errno = pthread_key_create(&send_buffer_key, (void (*)(void *)) __darwintrace_send_buffer_destructor))) {
+		perror("darwintrace: pthread_key_create");
+		abort();
+	}
 }
 
 /**
@@ -183,119 +232,12 @@ static inline void __darwintrace_tid_set(void) {
 	}
 }
 
-/**
- * Return false if str doesn't begin with prefix, true otherwise. Note that
- * this is not a simple string comparison, but works on a path component level.
- * A prefix of /var/tmp will not match a string of /var/tmpfoo.
- */
-static inline bool __darwintrace_pathbeginswith(const char *str, const char *prefix) {
-	char s;
-	char p;
-
-	/* '/' is the allow all wildcard */
-	if (prefix[0] == '\0' || (prefix[0] == '/' && prefix[1] == '\0')) {
-		return 1;
-	}
-
-	do {
-		s = *str++;
-		p = *prefix++;
-	} while (p && (p == s));
-	return (p == '\0' && (s == '/' || s == '\0'));
-}
-
-/*
- * Data structures and functions to iterate over the filemap received from
- * tracelib code.
- */
-
-/**
- * \c filemap_iterator_t is an (opaque) iterator type that keeps the state
- * required to iterate through the filemap. Create a new filemap_iterator_t on
- * stack, initialize it using \c __darwintrace_filemap_iterator_init and pass
- * it to \c __darwintrace_filemap_iter to iterate over the filemap.
- */
-typedef struct filemap_iterator {
-	char *next;
-} filemap_iterator_t;
-
-/**
- * Initialize a given \c filemap_iterator_t. Calling this function again will
- * rewind the iterator.
- *
- * \param[in] it pointer to the iterator to be initialized
- */
-static inline void __darwintrace_filemap_iterator_init(filemap_iterator_t *it) {
-	it->next = filemap;
-}
-
-/**
- * Iterate through the filemap passed from tracelib code. Call this multiple
- * times with the same iterator object until it returns \c NULL to iterate
- * through the filemap.
- *
- * \param[out] command location for the command specified for this filemap
- *                     entry
- * \param[in]  it pointer to a \c filemap_iterator_t keeping the state of this
- *                iteration
- * \return string containing the path this filemap entry corresponds to, or \c
- *         NULL if the end of the filemap was reached
- */
-static inline char *__darwintrace_filemap_iter(char *command, filemap_iterator_t *it) {
-	enum { PATH, COMMAND, DONE } state = PATH;
-	char *t;
-	char *path;
-
-	if (it == NULL || it->next == NULL || *it->next == '\0') {
-		return NULL;
-	}
-
-	path = t = it->next;
-
-	/* advance the cursor: if the number after the string is not 1, there's no
-	 * path behind it and we can advance by strlen(t) + 3. If it is 1, make
-	 * sure to skip the path, too.
-	 */
-	state = PATH;
-	while (state != DONE) {
-		switch (state) {
-			case DONE:
-				/* unreachable */
-				break;
-			case PATH:
-				if (*t == '\0') {
-					state = COMMAND;
-				}
-				break;
-			case COMMAND:
-				*command = *t;
-				if (*t == 1) {
-					fprintf(stderr, "darwintrace: unsupported state REPLACEPATH in dfa in " __FILE__ ":%d\n", __LINE__);
-					abort();
-				}
-				state = DONE;
-				/* the byte after the status code is '\0', if the status code
-				 * isn't 1 (which is no longer supported) */
-				t++;
-				break;
-		}
-		t++;
-	}
-
-	it->next = t;
-	return path;
-}
-
 /**
  * Request sandbox boundaries from tracelib (the MacPorts base-controlled side
  * of the trace setup) and store it.
  */
 static void __darwintrace_get_filemap(void) {
 	char *newfilemap;
-#if DARWINTRACE_DEBUG && 0
-	filemap_iterator_t it;
-	char *path, command;
-#endif
 
 #if HAVE_DECL_ATOMIC_COMPARE_EXCHANGE_STRONG_EXPLICIT   /* HAVE_DECL_* is always defined and set to 1 or 0 */
 #	define CAS(old, new, mem) atomic_compare_exchange_strong_explicit(mem, old, new, memory_order_relaxed, memory_order_relaxed)
@@ -331,13 +273,93 @@ static void __darwintrace_get_filemap(void) {
 			break;
 		newfilemap = __send("filemap\t", 8, 1);
 	} while (!CAS(&nullpointer, newfilemap, &filemap));
+}
+
+/**
+ * Map the counters of verdict cache hits and misses. Lookups are not counted
+ * if they cannot be mapped.
+ */
+static void __darwintrace_get_verdict_stats(void) {
+	char statspath[MAXPATHLEN];
+	struct stat st;
+	void *map;
+	int fd;
+	int flags = O_RDWR;
 
-#if DARWINTRACE_DEBUG && 0
-	for (__darwintrace_filemap_iterator_init(&it);
-	        (path = __darwintrace_filemap_iter(&command, &it));) {
-		debug_printf("filemap: {cmd=%d, path=%s}\n", command, path);
+	if ((size_t) snprintf(statspath, sizeof(statspath), "%s%s", __env_darwintrace_log, VERDICT_CACHE_STATS_SUFFIX) >= sizeof(statspath)) {
+		return;
 	}
+#ifdef O_CLOEXEC
+	flags |= O_CLOEXEC;
 #endif
+	if (-1 == (fd = open(statspath, flags))) {
+		return;
+	}
+	if (-1 == fstat(fd, &st) || (size_t) st.st_size < sizeof(verdict_cache_stats_t)) {
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, sizeof(verdict_cache_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map != MAP_FAILED) {
+		verdict_stats = map;
+	}
+}
+
+/**
+ * Map the verdict cache tracelib publishes next to its socket. tracelib
+ * creates the cache before answering the first filemap request, so call this
+ * after \c __darwintrace_get_filemap. If the cache cannot be mapped, all
+ * dependency checks are sent to tracelib.
+ */
+static void __darwintrace_get_verdict_cache(void) {
+	char cachepath[MAXPATHLEN];
+	verdict_cache_header_t header;
+	struct stat st;
+	char *map;
+	size_t size;
+	int fd;
+	int flags = O_RDONLY;
+
+	if (verdict_cache != NULL) {
+		return;
+	}
+
+	if ((size_t) snprintf(cachepath, sizeof(cachepath), "%s%s", __env_darwintrace_log, VERDICT_CACHE_SUFFIX) >= sizeof(cachepath)) {
+		return;
+	}
+#ifdef O_CLOEXEC
+	flags |= O_CLOEXEC;
+#endif
+	if (-1 == (fd = open(cachepath, flags))) {
+		debug_printf("no verdict cache at %s: %s\n", cachepath, strerror(errno));
+		return;
+	}
+
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+			|| header.magic != VERDICT_CACHE_MAGIC
+			|| header.version != VERDICT_CACHE_VERSION
+			|| header.slots == 0
+			|| (header.slots & (header.slots - 1)) != 0
+			|| -1 == fstat(fd, &st)
+			|| (size_t) st.st_size < (size = verdict_cache_size(header.slots, header.entries_size))) {
+		close(fd);
+		return;
+	}
+
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return;
+	}
+
+	char *nullpointer = NULL;
+	if (!CAS(&nullpointer, map, &verdict_cache)) {
+		/* another thread was faster */
+		munmap(map, size);
+		return;
+	}
+	__darwintrace_get_verdict_stats();
 }
 
 /**
@@ -349,6 +371,7 @@ static void __darwintrace_get_filemap(void) {
 void __darwintrace_close(void) {
 	FILE *dtsock = __darwintrace_sock();
 	if (dtsock) {
+		__darwintrace_flush_buffer(pthread_getspecific(send_buffer_key));
 		__darwintrace_close_sock = fileno(dtsock);
 		fclose(dtsock);
 		__darwintrace_close_sock = -1;
@@ -450,6 +473,7 @@ void __darwintrace_setup(void) {
 
 		/* request sandbox bounds */
 		__darwintrace_get_filemap();
+		__darwintrace_get_verdict_cache();
 	}
 }
 
@@ -473,19 +497,34 @@ static inline void __darwintrace_log_op(const char *op, const char *path) {
 	}
 }
 
+/**
+ * Report a sandbox violation for a path to tracelib. Unlike other reports,
+ * violations are not left in the send buffer, but sent immediately together
+ * with anything queued before them.
+ *
+ * \param[in] path the path access to which was denied
+ */
+static inline void __darwintrace_log_violation(const char *path) {
+	__darwintrace_log_op("sandbox_violation", path);
+	__darwintrace_flush_buffer(pthread_getspecific(send_buffer_key));
+}
+
 /**
  * Check whether the port currently being installed declares a dependency on
  * a given file. Communicates with MacPorts tracelib, which uses the registry
  * database to answer this question. Returns 1, if a dependency was declared,
  * 0, if the file belongs to a port and no dependency was declared and -1 if
- * the file isnt't registered to any port.
+ * the file isnt't registered to any port. Paths tracelib has answered before
+ * are looked up in the shared verdict cache instead.
  *
  * \param[in] path the path to send to MacPorts for dependency info
  * \return 1, if access should be granted, 0, if access should be denied, and
  *         -1 if MacPorts doesn't know about the file.
  */
 static int dependency_check(const char *path) {
-	char buffer[BUFFER_SIZE], *p;
+	char buffer[BUFFER_SIZE], *p = NULL;
+	char verdict = '\0';
+	char *cache = verdict_cache;
 	uint32_t len;
 	int result = 0;
 	struct stat st;
@@ -498,18 +537,33 @@ static int dependency_check(const char *path) {
 		return 1;
 	}
 
-	len = snprintf(buffer, sizeof(buffer), "dep_check\t%s", path);
-	if (len >= sizeof(buffer)) {
-		fprintf(stderr, "darwintrace: truncating buffer length from %" PRIu32 " to %zu.", len, sizeof(buffer) - 1);
-		len = sizeof(buffer) - 1;
+	if (cache) {
+		verdict_cache_stats_t *stats = verdict_stats;
+		verdict = verdict_cache_lookup(cache, path);
+		if (stats) {
+			if (verdict != '\0') {
+				VERDICT_CACHE_COUNT(stats->hits);
+			} else {
+				VERDICT_CACHE_COUNT(stats->misses);
+			}
+		}
 	}
-	p = __send(buffer, len, 1);
-	if (!p) {
-		fprintf(stderr, "darwintrace: dependency check failed for %s\n", path);
-		abort();
+
+	if (verdict == '\0') {
+		len = snprintf(buffer, sizeof(buffer), "dep_check\t%s", path);
+		if (len >= sizeof(buffer)) {
+			fprintf(stderr, "darwintrace: truncating buffer length from %" PRIu32 " to %zu.", len, sizeof(buffer) - 1);
+			len = sizeof(buffer) - 1;
+		}
+		p = __send(buffer, len, 1);
+		if (!p) {
+			fprintf(stderr, "darwintrace: dependency check failed for %s\n", path);
+			abort();
+		}
+		verdict = *p;
 	}
 
-	switch (*p) {
+	switch (verdict) {
 		case '+':
 			result = 1;
 			break;
@@ -520,7 +574,7 @@ static int dependency_check(const char *path) {
 			result = -1;
 			break;
 		default:
-			fprintf(stderr, "darwintrace: unexpected answer from tracelib: '%c' (0x%x)\n", *p, *p);
+			fprintf(stderr, "darwintrace: unexpected answer from tracelib: '%c' (0x%x)\n", verdict, verdict);
 			abort();
 			/*NOTREACHED*/
 	}
@@ -533,12 +587,15 @@ static int dependency_check(const char *path) {
 
 /**
  * Helper function to receive a number of bytes from the tracelib communication
- * socket and deal with any errors that might occur.
+ * socket and deal with any errors that might occur. Reads at least \c min
+ * bytes, and at most \c max bytes if more data is available.
  *
  * \param[out] buf buffer to hold received data
- * \param[in]  size number of bytes to read from the socket
+ * \param[in]  min number of bytes to read from the socket
+ * \param[in]  max size of \c buf
+ * \return the number of bytes read
  */
-static void frecv(void *restrict buf, size_t size) {
+static size_t frecv_some(void *restrict buf, size_t min, size_t max) {
 	/* We cannot safely use fread(3) here, because we're not in control of the
 	 * application's signal handling settings (which means we must assume
 	 * SA_RESTART isn't set) and fread(3) may return short without giving us
@@ -547,8 +604,8 @@ static void frecv(void *restrict buf, size_t size) {
 	 * implementation on macOS, we'll just use read(2) here. */
 	int fd = fileno(__darwintrace_sock());
 	size_t count = 0;
-	while (count < size) {
-		ssize_t res = read(fd, buf + count, size - count);
+	while (count < min) {
+		ssize_t res = read(fd, buf + count, max - count);
 		if (res < 0) {
 			if (errno == EINTR) {
 				continue;
@@ -564,6 +621,18 @@ static void frecv(void *restrict buf, size_t size) {
 
 		count += res;
 	}
+	return count;
+}
+
+/**
+ * Helper function to receive a number of bytes from the tracelib communication
+ * socket and deal with any errors that might occur.
+ *
+ * \param[out] buf buffer to hold received data
+ * \param[in]  size number of bytes to read from the socket
+ */
+static void frecv(void *restrict buf, size_t size) {
+	frecv_some(buf, size, size);
 }
 
 /**
@@ -606,10 +675,55 @@ retry:
 	}
 }
 
+/**
+ * Send the messages collected in a send buffer and empty it. Messages
+ * collected before a fork(2) are dropped in the child, since the parent will
+ * send them.
+ *
+ * \param[in] sendbuf the buffer to flush; may be \c NULL
+ */
+static void __darwintrace_flush_buffer(send_buffer_t *sendbuf) {
+	size_t len;
+
+	if (sendbuf == NULL || sendbuf->len == 0) {
+		return;
+	}
+
+	len = sendbuf->len;
+	sendbuf->len = 0;
+	if (__darwintrace_sock() == NULL || __darwintrace_pid != getpid()) {
+		return;
+	}
+	fsend(sendbuf->buf, len);
+}
+
+/**
+ * Destructor for the thread-local send buffer. Sends the remaining messages
+ * if the socket is still open.
+ */
+static void __darwintrace_send_buffer_destructor(send_buffer_t *sendbuf) {
+	__darwintrace_flush_buffer(sendbuf);
+	free(sendbuf);
+}
+
+/**
+ * Send the messages buffered by the thread calling exit(3). Thread-specific
+ * data destructors do not run for that thread.
+ */
+__attribute__((destructor)) static void __darwintrace_flush_at_exit(void) {
+	if (__darwintrace_initialized) {
+		__darwintrace_flush_buffer(pthread_getspecific(send_buffer_key));
+	}
+}
+
 /**
  * Communication wrapper targeting tracelib. Automatically enforces the on-wire
  * protocol and supports reading and returning an answer.
  *
+ * Messages that do not expect an answer are buffered and sent together with
+ * the next message that does, so a dependency check usually costs a single
+ * write(2) and a single read(2).
+ *
  * \param[in] buf buffer to send to tracelib
  * \param[in] len size of the buffer to send
  * \param[in] answer boolean indicating whether an answer is expected and
@@ -618,8 +732,30 @@ retry:
  *         answer was not requested, \c NULL.
  */
 static char *__send(const char *buf, uint32_t len, int answer) {
-	fsend(&len, sizeof(len));
-	fsend(buf, len);
+	send_buffer_t *sendbuf = pthread_getspecific(send_buffer_key);
+	if (sendbuf == NULL && NULL != (sendbuf = malloc(sizeof(*sendbuf)))) {
+		sendbuf->len = 0;
+		if (0 != pthread_setspecific(send_buffer_key, sendbuf)) {
+			free(sendbuf);
+			sendbuf = NULL;
+		}
+	}
+
+	if (sendbuf != NULL && sizeof(len) + len <= sizeof(sendbuf->buf)) {
+		if (sendbuf->len + sizeof(len) + len > sizeof(sendbuf->buf)) {
+			__darwintrace_flush_buffer(sendbuf);
+		}
+		memcpy(sendbuf->buf + sendbuf->len, &len, sizeof(len));
+		memcpy(sendbuf->buf + sendbuf->len + sizeof(len), buf, len);
+		sendbuf->len += sizeof(len) + len;
+		if (answer) {
+			__darwintrace_flush_buffer(sendbuf);
+		}
+	} else {
+		__darwintrace_flush_buffer(sendbuf);
+		fsend(&len, sizeof(len));
+		fsend(buf, len);
+	}
 
 	if (!answer) {
 		return NULL;
@@ -627,18 +763,34 @@ static char *__send(const char *buf, uint32_t len, int answer) {
 
 	uint32_t recv_len = 0;
 	char *recv_buf;
-
-	frecv(&recv_len, sizeof(recv_len));
+	char head[BUFFER_SIZE];
+	size_t have, offset;
+
+	/* There is never more than one outstanding request on a socket, so
+	 * everything available is part of this answer; small answers (e.g. the
+	 * result of a dependency check) are received in a single read(2). */
+	have = frecv_some(head, sizeof(recv_len), sizeof(head));
+	memcpy(&recv_len, head, sizeof(recv_len));
+	have -= sizeof(recv_len);
+	if (have > recv_len) {
+		fprintf(stderr, "darwintrace: received %zu bytes more than expected from tracelib\n", have - recv_len);
+		abort();
+	}
 	if (recv_len == 0) {
 		return 0;
 	}
 
 	recv_buf = malloc(recv_len + 1);
 	if (recv_buf == NULL) {
-		return NULL;
+		perror("darwintrace: malloc");
+		abort();
 	}
+	memcpy(recv_buf, head + sizeof(recv_len), have);
+	offset = have;
 	recv_buf[recv_len] = '\0';
-	frecv(recv_buf, recv_len);
+	if (offset < recv_len) {
+		frecv(recv_buf + offset, recv_len - offset);
+	}
 
 	return recv_buf;
 }
@@ -662,10 +814,7 @@ static char *__send(const char *buf, uint32_t len, int answer) {
  *         should be denied
  */
 static inline bool __darwintrace_sandbox_check(const char *path, int flags) {
-	filemap_iterator_t filemap_it;
-
 	char command = -1;
-	char *t;
 
 	if (path[0] == '/' && path[1] == '\0') {
 		// Always allow access to /. Strange things start to happen if you deny this.
@@ -679,47 +828,44 @@ static inline bool __darwintrace_sandbox_check(const char *path, int flags) {
 		}
 	}
 
-	// Iterate over the sandbox bounds and try to find a directive matching this path
-	for (__darwintrace_filemap_iterator_init(&filemap_it);
-	        (t = __darwintrace_filemap_iter(&command, &filemap_it));) {
-		if (__darwintrace_pathbeginswith(path, t)) {
-			switch (command) {
-				case FILEMAP_ALLOW:
-					return true;
-				case FILEMAP_ASK:
-					// ask the socket whether this file is OK
-					switch (dependency_check(path)) {
-						case 1:
-							return true;
-						case -1:
-							// if the file isn't known to MacPorts, allow
-							// access anyway, but report a sandbox violation.
-							// TODO find a better solution
-							if ((flags & DT_REPORT) > 0) {
-								__darwintrace_log_op("sandbox_unknown", path);
-							}
-							return true;
-						case 0:
-							// file belongs to a foreign port, deny access
-							if ((flags & DT_REPORT) > 0) {
-								__darwintrace_log_op("sandbox_violation", path);
-							}
-							return false;
-					}
-				case FILEMAP_DENY:
-					if ((flags & DT_REPORT) > 0) {
-						__darwintrace_log_op("sandbox_violation", path);
-					}
-					return false;
-				default:
-					fprintf(stderr, "darwintrace: error: unexpected byte in file map: `%x'\n", *t);
-					abort();
-			}
+	// Find the first directive in the sandbox bounds matching this path
+	if (sandbox_trie_lookup(filemap, path, &command)) {
+		switch (command) {
+			case FILEMAP_ALLOW:
+				return true;
+			case FILEMAP_ASK:
+				// ask the socket whether this file is OK
+				switch (dependency_check(path)) {
+					case 1:
+						return true;
+					case -1:
+						// if the file isn't known to MacPorts, allow
+						// access anyway, but report a sandbox violation.
+						// TODO find a better solution
+						if ((flags & DT_REPORT) > 0) {
+							__darwintrace_log_op("sandbox_unknown", path);
+						}
+						return true;
+					case 0:
+						// file belongs to a foreign port, deny access
+						if ((flags & DT_REPORT) > 0) {
+							__darwintrace_log_violation(path);
+						}
+						return false;
+				}
+			case FILEMAP_DENY:
+				if ((flags & DT_REPORT) > 0) {
+					__darwintrace_log_violation(path);
+				}
+				return false;
+			default:
+				fprintf(stderr, "darwintrace: error: unexpected byte in file map: `%x'\n", command);
+				abort();
 		}
 	}
 
 	if ((flags & DT_REPORT) > 0) {
-		__darwintrace_log_op("sandbox_violation", path);
+		__darwintrace_log_violation(path);
 	}
 	return false;
 }
@@ -0,0 +1,187 @@
+#include "../sandbox_actions.h"
+#include "../sandbox_trie.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Compare looking up paths in a sandbox compiled by sandbox_trie_compile to
+ * walking the sandbox bounds as a list, which is how darwintrace used to check
+ * paths. Exits with a failure status if the two disagree on any path.
+ */
+
+/* sandbox bounds similar to those set up by porttrace.tcl */
+static const char *bounds[][2] = {
+	{"/opt/local/var/macports/build/_opt_bblocal_var_buildworker_ports_build_ports_devel_foo/foo/work", "+"},
+	{"/opt/local/var/macports/sources/rsync.macports.org/macports/release/tarballs/ports/devel/foo", "+"},
+	{"/opt/local/var/macports/distfiles/foo", "+"},
+	{"/bin", "+"},
+	{"/sbin", "+"},
+	{"/dev", "+"},
+	{"/usr/bin", "+"},
+	{"/usr/sbin", "+"},
+	{"/usr/include", "+"},
+	{"/usr/lib", "+"},
+	{"/usr/libexec", "+"},
+	{"/usr/share", "+"},
+	{"/System/Library", "+"},
+	{"/Library", "+"},
+	{"/etc", "+"},
+	{"/private/etc", "+"},
+	{"/tmp", "+"},
+	{"/private/tmp", "+"},
+	{"/var/tmp", "+"},
+	{"/private/var/tmp", "+"},
+	{"/var/folders", "+"},
+	{"/private/var/folders", "+"},
+	{"/var/empty", "+"},
+	{"/var/run", "+"},
+	{"/var/db/timezone/zoneinfo", "+"},
+	{"/var/db/mds/system", "+"},
+	{"/Library/Developer/CommandLineTools/SDKs/MacOSX.sdk", "+"},
+	{"/Applications/Xcode.app/Contents/Developer/usr/bin/xcodebuild", "+"},
+	{"/Applications/Xcode.app", "-"},
+	{"/var/db/launchd.db", "+"},
+	{"/Users/macports/.ccache", "+"},
+	{"/opt/local/var/macports/sip-workaround", "+"},
+	{"/opt/local", "?"},
+};
+
+static const char *paths[] = {
+	"/opt/local/var/macports/build/_opt_bblocal_var_buildworker_ports_build_ports_devel_foo/foo/work/foo-1.0/src/main.c",
+	"/opt/local/var/macports/distfiles/foo/foo-1.0.tar.xz",
+	"/opt/local/include/zlib.h",
+	"/opt/local/lib/libz.1.dylib",
+	"/opt/local/bin/pkg-config",
+	"/opt/localfoo/bin/bar",
+	"/usr/bin/clang",
+	"/usr/lib/libSystem.B.dylib",
+	"/usr/local/include/stdio.h",
+	"/usr/local/lib/libintl.dylib",
+	"/System/Library/Frameworks/CoreFoundation.framework/CoreFoundation",
+	"/Library/Developer/CommandLineTools/SDKs/MacOSX.sdk/usr/include/stdio.h",
+	"/Applications/Xcode.app/Contents/Developer/usr/bin/xcodebuild",
+	"/Applications/Xcode.app/Contents/Developer/usr/bin/make",
+	"/private/var/folders/xy/abcdef/T/cc12345.o",
+	"/var/db/timezone/zoneinfo/UTC",
+	"/var/db/other",
+	"/Users/macports/.ccache/tmp/foo.stdout",
+	"/Users/macports/.profile",
+	"/etc/hosts",
+	"/sw/lib/libfoo.dylib",
+	"/",
+};
+
+/* the path prefix check darwintrace used for every entry in the list */
+static bool pathbeginswith(const char *str, const char *prefix) {
+	char s;
+	char p;
+
+	if (prefix[0] == '\0' || (prefix[0] == '/' && prefix[1] == '\0')) {
+		return true;
+	}
+
+	do {
+		s = *str++;
+		p = *prefix++;
+	} while (p && (p == s));
+	return (p == '\0' && (s == '/' || s == '\0'));
+}
+
+static bool list_lookup(const char *filemap, const char *path, char *action) {
+	for (const char *t = filemap; *t != '\0'; t += strlen(t) + 3) {
+		if (pathbeginswith(path, t)) {
+			*action = t[strlen(t) + 1];
+			return true;
+		}
+	}
+	return false;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	size_t npaths = sizeof(paths) / sizeof(*paths);
+	size_t nbounds = sizeof(bounds) / sizeof(*bounds);
+	long iterations = 200000;
+	char filemap[4096];
+	size_t len = 0;
+	uint32_t trie_size;
+	char *trie;
+	unsigned long matches = 0;
+	double start, list_time, trie_time;
+
+	if (argc > 1) {
+		iterations = strtol(argv[1], NULL, 10);
+	}
+
+	for (size_t i = 0; i < nbounds; ++i) {
+		size_t plen = strlen(bounds[i][0]);
+		memcpy(filemap + len, bounds[i][0], plen + 1);
+		len += plen + 1;
+		switch (bounds[i][1][0]) {
+			case '+':
+				filemap[len++] = FILEMAP_ALLOW;
+				break;
+			case '-':
+				filemap[len++] = FILEMAP_DENY;
+				break;
+			case '?':
+				filemap[len++] = FILEMAP_ASK;
+				break;
+		}
+		filemap[len++] = '\0';
+	}
+	filemap[len] = '\0';
+
+	trie = sandbox_trie_compile(filemap, &trie_size);
+	if (!trie) {
+		perror("sandbox_trie_compile");
+		return EXIT_FAILURE;
+	}
+
+	for (size_t i = 0; i < npaths; ++i) {
+		char list_action = 0, trie_action = 0;
+		bool list_match = list_lookup(filemap, paths[i], &list_action);
+		bool trie_match = sandbox_trie_lookup(trie, paths[i], &trie_action);
+		if (list_match != trie_match || list_action != trie_action) {
+			fprintf(stderr, "mismatch for %s: list %d/%d, trie %d/%d\n",
+					paths[i], list_match, list_action, trie_match, trie_action);
+			return EXIT_FAILURE;
+		}
+	}
+
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		for (size_t i = 0; i < npaths; ++i) {
+			char action;
+			matches += list_lookup(filemap, paths[i], &action);
+		}
+	}
+	list_time = now() - start;
+
+	start = now();
+	for (long n = 0; n < iterations; ++n) {
+		for (size_t i = 0; i < npaths; ++i) {
+			char action;
+			matches += sandbox_trie_lookup(trie, paths[i], &action);
+		}
+	}
+	trie_time = now() - start;
+
+	printf("%zu sandbox entries (%zu bytes as list, %" PRIu32 " bytes as trie), %ld lookups (%lu matched)\n",
+			nbounds, len + 1, trie_size, iterations * (long) npaths, matches / 2);
+	printf("list: %.3f s, %.1f ns/lookup\n", list_time, list_time * 1e9 / (iterations * (double) npaths));
+	printf("trie: %.3f s, %.1f ns/lookup\n", trie_time, trie_time * 1e9 / (iterations * (double) npaths));
+
+	free(trie);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * @APPLE_BSD_LICENSE_HEADER_START@
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1.  Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ * 2.  Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ * 3.  Neither the name of Apple Inc. ("Apple") nor the names of
+ *     its contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY APPLE AND ITS CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL APPLE OR ITS CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @APPLE_BSD_LICENSE_HEADER_END@
+ */
+
+/*
+ * Layout of the dependency check verdict cache shared between tracelib and
+ * darwintrace.
+ *
+ * tracelib creates the file <socket path>.verdicts at the start of its event
+ * loop and is its only writer. Every answer to a dep_check request that
+ * tracelib would also cache in its own path cache is published here. Traced
+ * processes, which may run as another user, can only read the file; they map
+ * it and consult it before sending a dep_check request over the socket.
+ * tracelib keeps its own copy of the table and never reads the file back.
+ *
+ * The file consists of
+ *  - a header of VERDICT_CACHE_HEADER_SIZE bytes,
+ *  - an open-addressing hash table of verdict_cache_slot_t with linear
+ *    probing, and
+ *  - the entries the slots point to, each consisting of the verdict
+ *    character ('+', '!' or '?') followed by the '\0'-terminated path.
+ *
+ * Entries are never modified or removed once published. The writer stores
+ * the entry and the hash of a slot before setting its offset, so a reader
+ * that sees a non-zero offset (followed by a barrier) sees a complete entry.
+ *
+ * Clients count cache hits and misses in the separate, world-writable file
+ * <socket path>.verdict-stats, which holds a verdict_cache_stats_t. tracelib
+ * only reads the counters to report the hit rate.
+ */
+
+#ifndef _VERDICT_CACHE_H
+#define _VERDICT_CACHE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/* _Atomic is C11, and pextlib is built as C99 */
+#if defined(HAVE_STDATOMIC_H) && defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#include <stdatomic.h>
+typedef _Atomic(uint64_t) verdict_cache_counter_t;
+#define VERDICT_CACHE_COUNT(counter) atomic_fetch_add_explicit(&(counter), 1, memory_order_relaxed)
+#define VERDICT_CACHE_COUNTER_GET(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+#define VERDICT_CACHE_BARRIER() atomic_thread_fence(memory_order_seq_cst)
+#elif defined(HAVE_LIBKERN_OSATOMIC_H)
+#include <libkern/OSAtomic.h>
+typedef volatile int64_t verdict_cache_counter_t;
+#define VERDICT_CACHE_COUNT(counter) OSAtomicIncrement64(&(counter))
+#define VERDICT_CACHE_COUNTER_GET(counter) ((uint64_t) (counter))
+#define VERDICT_CACHE_BARRIER() OSMemoryBarrier()
+#else
+typedef volatile int64_t verdict_cache_counter_t;
+#define VERDICT_CACHE_COUNT(counter) __sync_fetch_and_add(&(counter), 1)
+#define VERDICT_CACHE_COUNTER_GET(counter) ((uint64_t) (counter))
+#define VERDICT_CACHE_BARRIER() __sync_synchronize()
+#endif
+
+#define VERDICT_CACHE_SUFFIX ".verdicts"
+#define VERDICT_CACHE_STATS_SUFFIX ".verdict-stats"
+#define VERDICT_CACHE_MAGIC (0x4d505643u) /* MPVC */
+#define VERDICT_CACHE_VERSION (2)
+
+/* a multiple of the page size on all supported platforms */
+#define VERDICT_CACHE_HEADER_SIZE (16 * 1024)
+/* must be a power of two */
+#define VERDICT_CACHE_SLOTS (1 << 17)
+#define VERDICT_CACHE_ENTRIES_SIZE (16 * 1024 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t entries_size;
+} verdict_cache_header_t;
+
+typedef struct {
+    /* number of lookups answered by the cache */
+    verdict_cache_counter_t hits;
+    /* number of lookups that had to ask tracelib */
+    verdict_cache_counter_t misses;
+} verdict_cache_stats_t;
+
+typedef struct {
+    uint32_t hash;
+    /* offset of the entry in the entries area; 0 for empty slots */
+    volatile uint32_t offset;
+} verdict_cache_slot_t;
+
+/**
+ * Return the size of a verdict cache file with the given number of slots
+ * and entries area size.
+ */
+static inline size_t verdict_cache_size(uint32_t slots, uint32_t entries_size) {
+    return VERDICT_CACHE_HEADER_SIZE + (size_t) slots * sizeof(verdict_cache_slot_t) + entries_size;
+}
+
+/**
+ * Hash a path for the verdict cache (32-bit FNV-1a).
+ */
+static inline uint32_t verdict_cache_hash(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (; *path; path++) {
+        hash ^= (unsigned char) *path;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Look up the verdict for a path in a mapped verdict cache.
+ *
+ * \param[in] cache start of the mapped cache file; its header must have been
+ *                  validated
+ * \param[in] path the path to look up, exactly as it would be sent to tracelib
+ * \return the verdict character, or '\0' if the path is not in the cache
+ */
+static inline char verdict_cache_lookup(const char *cache, const char *path) {
+    const verdict_cache_header_t *header = (const verdict_cache_header_t *) cache;
+    const verdict_cache_slot_t *slots = (const verdict_cache_slot_t *) (cache + VERDICT_CACHE_HEADER_SIZE);
+    const char *entries = (const char *) (slots + header->slots);
+    uint32_t mask = header->slots - 1;
+    uint32_t hash = verdict_cache_hash(path);
+
+    for (uint32_t i = hash & mask, probes = 0; probes < header->slots; i = (i + 1) & mask, probes++) {
+        uint32_t offset = slots[i].offset;
+        if (offset == 0) {
+            return '\0';
+        }
+        VERDICT_CACHE_BARRIER();
+        if (slots[i].hash == hash && strcmp(entries + offset + 1, path) == 0) {
+            return entries[offset];
+        }
+    }
+    return '\0';
+}
+
+#endif /* _VERDICT_CACHE_H */
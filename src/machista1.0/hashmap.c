@@ -285,6 +285,21 @@ void hashMapClear(HashMap *map) {
 }
 
 
+/* Calls a function for each entry of a hash map. */
+void hashMapForEach(HashMap *map,
+                    void (*func)(const char key[], const void *value,
+                                 void *data),
+                    void *data) {
+  size_t i;
+  for (i = 0; i < map->capacity; ++i) {
+    HashMapEntry *e;
+    for (e = map->table[i]; e != NULL; e = e->next) {
+      func(e->key, e->value, data);
+    }
+  }
+}
+
+
 /* Destroys a hash map. */
 void hashMapDestroy(HashMap *map) {
   if (map == NULL)
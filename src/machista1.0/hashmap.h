@@ -125,6 +125,19 @@ int hashMapIsEmpty(const HashMap *map);
  */
 void hashMapClear(HashMap *map);
 
+/**
+ * @brief Calls a function for each entry of a hash map.
+ * The map must not be modified by the function.
+ * @param map  Hash map.
+ * @param func Function called with the key and value of each entry and
+ *             @c data.
+ * @param data Passed to @c func.
+ */
+void hashMapForEach(HashMap *map,
+                    void (*func)(const char key[], const void *value,
+                                 void *data),
+                    void *data);
+
 /**
  * @brief Destroys a hash map.
  * @param map Hash map to be destroyed.
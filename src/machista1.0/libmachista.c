@@ -43,6 +43,7 @@
 #include <stdlib.h>
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -51,31 +52,139 @@
 #include <string.h>
 #include <strings.h>
 
-#ifdef __MACH__
 #include <ar.h>
 
+#ifdef __MACH__
 #include <mach-o/dyld.h>
 #include <mach-o/fat.h>
 #include <mach-o/loader.h>
 
 #include <libkern/OSByteOrder.h>
+#else
+#include <arpa/inet.h>
+
+/* The parts of <mach-o/loader.h> and <mach-o/fat.h> used by the parser, so that Mach-O files (e.g.
+ * the test fixtures) can also be read on other systems */
+#define MH_MAGIC            0xfeedface
+#define MH_CIGAM            0xcefaedfe
+#define MH_MAGIC_64         0xfeedfacf
+#define MH_CIGAM_64         0xcffaedfe
+#define FAT_MAGIC           0xcafebabe
+#define FAT_CIGAM           0xbebafeca
+
+#define LC_REQ_DYLD         0x80000000
+#define LC_LOAD_DYLIB       0xc
+#define LC_ID_DYLIB         0xd
+#define LC_LOAD_WEAK_DYLIB  (0x18 | LC_REQ_DYLD)
+#define LC_RPATH            (0x1c | LC_REQ_DYLD)
+#define LC_REEXPORT_DYLIB   (0x1f | LC_REQ_DYLD)
+
+#define CPU_ARCH_ABI64      0x01000000
+#define CPU_TYPE_X86        7
+#define CPU_TYPE_ARM        12
+#define CPU_TYPE_POWERPC    18
+
+struct mach_header {
+    uint32_t magic;
+    int32_t cputype;
+    int32_t cpusubtype;
+    uint32_t filetype;
+    uint32_t ncmds;
+    uint32_t sizeofcmds;
+    uint32_t flags;
+};
+
+struct mach_header_64 {
+    uint32_t magic;
+    int32_t cputype;
+    int32_t cpusubtype;
+    uint32_t filetype;
+    uint32_t ncmds;
+    uint32_t sizeofcmds;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+struct fat_header {
+    uint32_t magic;
+    uint32_t nfat_arch;
+};
+
+struct fat_arch {
+    int32_t cputype;
+    int32_t cpusubtype;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t align;
+};
+
+struct load_command {
+    uint32_t cmd;
+    uint32_t cmdsize;
+};
+
+struct dylib {
+    uint32_t name;
+    uint32_t timestamp;
+    uint32_t current_version;
+    uint32_t compatibility_version;
+};
+
+struct dylib_command {
+    uint32_t cmd;
+    uint32_t cmdsize;
+    struct dylib dylib;
+};
+
+struct rpath_command {
+    uint32_t cmd;
+    uint32_t cmdsize;
+    uint32_t path;
+};
+
+#define OSSwapInt32(x) ((((x) & 0xff) << 24) | (((x) & 0xff00) << 8) | (((x) >> 8) & 0xff00) | (((x) >> 24) & 0xff))
+#define OSSwapBigToHostInt32(x) ntohl(x)
+#endif
+
+/* BSD ar(1) extended name format, not defined by all <ar.h> */
+#ifndef AR_EFMT1
+#define AR_EFMT1 "#1/"
 #endif
 
 #include "libmachista.h"
 #include "hashmap.h"
 #include "strlcpy.h"
 
+/* upper bound for the number of threads macho_parse_files starts by default */
+#define MACHO_MAX_JOBS 16
+
 typedef struct macho_input {
     const void *data;
     size_t length;
 } macho_input_t;
 
+/* A result of macho_parse_file remembered in the persistent cache, together with the identity of
+ * the file it was computed for */
+typedef struct macho_cache_entry {
+    uint64_t mce_dev;
+    uint64_t mce_ino;
+    uint64_t mce_size;
+    int64_t mce_mtime;
+    int64_t mce_mtime_nsec;
+    int mce_status;                 /* MACHO_SUCCESS or MACHO_EMAGIC */
+    macho_t *mce_macho;             /* the result if mce_status is MACHO_SUCCESS */
+    bool mce_owned;                 /* whether mce_macho is owned by this entry rather than by the
+                                       handle's result_map */
+    bool mce_used;                  /* whether the entry was validated while this handle was open */
+} macho_cache_entry_t;
+
 /* This is macho_handle_t. The corresponding typedef is in the header */
 struct macho_handle {
     HashMap *result_map;
+    HashMap *cache_map;             /* path -> macho_cache_entry_t, NULL if there is no cache */
+    char *cache_path;
 };
 
-#ifdef __MACH__
 /* Verify that the given range is within bounds. */
 static const void *macho_read (macho_input_t *input, const void *address, size_t length) {
     if ((((uint8_t *) address) - ((uint8_t *) input->data)) + length > input->length) {
@@ -91,7 +200,6 @@ static const void *macho_offset (macho_input_t *input, const void *address, size
     void *result = ((uint8_t *) address) + offset;
     return macho_read(input, result, length);
 }
-#endif
 
 /* return a human readable formatted version number. the result must be free()'d. */
 char *macho_format_dylib_version (uint32_t version) {
@@ -108,12 +216,26 @@ const char *macho_get_arch_name (cpu_type_t cputype) {
     }
     return archInfo->name;
 #else
-const char *macho_get_arch_name (cpu_type_t cputype UNUSED) {
-    return NULL;
+const char *macho_get_arch_name (cpu_type_t cputype) {
+    switch (cputype) {
+        case CPU_TYPE_X86:
+            return "i386";
+        case CPU_TYPE_X86 | CPU_ARCH_ABI64:
+            return "x86_64";
+        case CPU_TYPE_ARM:
+            return "arm";
+        case CPU_TYPE_ARM | CPU_ARCH_ABI64:
+            return "arm64";
+        case CPU_TYPE_POWERPC:
+            return "ppc";
+        case CPU_TYPE_POWERPC | CPU_ARCH_ABI64:
+            return "ppc64";
+        default:
+            return NULL;
+    }
 #endif
 }
 
-#ifdef __MACH__
 /* Some byteswap wrappers */
 static uint32_t macho_swap32 (uint32_t input) {
     return OSSwapInt32(input);
@@ -155,7 +277,6 @@ static macho_loadcmd_t *create_macho_loadcmd_t (void) {
     memset(mlt, 0, sizeof(macho_loadcmd_t));
     return mlt;
 }
-#endif
 
 /* Frees a previously allocated macho_loadcmd_t and all it's associated resources */
 static void free_macho_loadcmd_t (macho_loadcmd_t *mlt) {
@@ -198,7 +319,6 @@ static void free_macho_t (macho_t *mt) {
     free(mt);
 }
 
-#ifdef __MACH__
 /* Creates a new element in the architecture list of a macho_t (mt_archs), increases the counter of
  * architectures (mt_arch_count) and returns a pointer to the newly allocated element or NULL on
  * error */
@@ -228,10 +348,8 @@ static macho_loadcmd_t *macho_loadcmdlist_append (macho_arch_t *mat) {
 
     return mat->mat_loadcmds;
 }
-#endif
 
 /* Parse a Mach-O header */
-#ifdef __MACH__
 static int parse_ar (macho_t *mt, macho_input_t *input);
 
 static int parse_macho (macho_t *mt, macho_input_t *input) {
@@ -437,10 +555,8 @@ static int parse_macho (macho_t *mt, macho_input_t *input) {
 
     return MACHO_SUCCESS;
 }
-#endif
 
 /* Parse a static archive, collecting the architectures of its Mach-O members */
-#ifdef __MACH__
 static int parse_ar (macho_t *mt, macho_input_t *input) {
     /* Skip over the "!<arch>\n" magic */
     size_t offset = SARMAG;
@@ -510,15 +626,67 @@ static int parse_ar (macho_t *mt, macho_input_t *input) {
 
     return MACHO_SUCCESS;
 }
+
+/* Record the identity of the version of a file a cache entry is computed for */
+static void cache_entry_set_stat(macho_cache_entry_t *entry, const struct stat *st) {
+    entry->mce_dev = (uint64_t) st->st_dev;
+    entry->mce_ino = (uint64_t) st->st_ino;
+    entry->mce_size = (uint64_t) st->st_size;
+    entry->mce_mtime = (int64_t) st->st_mtime;
+#ifdef __APPLE__
+    entry->mce_mtime_nsec = (int64_t) st->st_mtimespec.tv_nsec;
+#else
+    entry->mce_mtime_nsec = (int64_t) st->st_mtim.tv_nsec;
 #endif
+}
 
-/* Parse a (possible Mach-O) file. For a more detailed description, see the header */
-#ifdef __MACH__
-int macho_parse_file(macho_handle_t *handle, const char *filepath, const macho_t **res) {
-    int fd;
+/* Check whether a cache entry is still valid for the file described by st */
+static bool cache_entry_matches(const macho_cache_entry_t *entry, const struct stat *st) {
+    macho_cache_entry_t current;
+    cache_entry_set_stat(&current, st);
+    return entry->mce_dev == current.mce_dev
+        && entry->mce_ino == current.mce_ino
+        && entry->mce_size == current.mce_size
+        && entry->mce_mtime == current.mce_mtime
+        && entry->mce_mtime_nsec == current.mce_mtime_nsec;
+}
+
+/* Frees a cache entry and the result it holds, unless that is owned by the result map */
+static void free_cache_entry (const void *ptr) {
+    macho_cache_entry_t *entry = (macho_cache_entry_t *) ptr;
+    if (entry == NULL)
+        return;
+
+    if (entry->mce_owned)
+        free_macho_t(entry->mce_macho);
+    free(entry);
+}
+
+/* Remember the result of parsing a file in the cache. Returns false if memory could not be
+ * allocated. */
+static bool cache_store(macho_handle_t *handle, const char *filepath, const struct stat *st, int status, const macho_t *mt) {
+    macho_cache_entry_t *entry = calloc(1, sizeof(macho_cache_entry_t));
+    if (entry == NULL)
+        return false;
+
+    cache_entry_set_stat(entry, st);
+    entry->mce_status = status;
+    /* the result itself is owned by result_map */
+    entry->mce_macho = (macho_t *) mt;
+    entry->mce_owned = false;
+    entry->mce_used = true;
+    if (0 == hashMapPut(handle->cache_map, filepath, entry, NULL)) {
+        free(entry);
+        return false;
+    }
+    return true;
+}
+
+/* Look up the result for a file in the result map and the persistent cache. Returns the status of
+ * a known result, which is stored in *res if it is MACHO_SUCCESS, or -1 if the file needs to be
+ * parsed. */
+static int lookup_result(macho_handle_t *handle, const char *filepath, const macho_t **res) {
     struct stat st;
-    void *data;
-    macho_input_t input_file;
 
     /* Check hashmap for precomputed results */
     const macho_t *cached_res = hashMapGet(handle->result_map, filepath);
@@ -527,7 +695,38 @@ int macho_parse_file(macho_handle_t *handle, const char *filepath, const macho_t
         return MACHO_SUCCESS;
     }
 
-    
+    /* Check the persistent cache for results of an earlier run, which are valid as long as the
+     * file has not been modified or replaced */
+    if (handle->cache_map != NULL && stat(filepath, &st) == 0) {
+        macho_cache_entry_t *entry = (macho_cache_entry_t *) hashMapGet(handle->cache_map, filepath);
+        if (entry != NULL && cache_entry_matches(entry, &st)) {
+            entry->mce_used = true;
+            if (entry->mce_status != MACHO_SUCCESS)
+                return entry->mce_status;
+            if (entry->mce_owned) {
+                /* hand the result over to result_map, which owns all results returned */
+                if (0 == hashMapPut(handle->result_map, filepath, entry->mce_macho, NULL))
+                    return MACHO_EMEM;
+                entry->mce_owned = false;
+            }
+            *res = entry->mce_macho;
+            return MACHO_SUCCESS;
+        }
+    }
+
+    return -1;
+}
+
+/* Open, map and parse a file. This does not use a handle and can thus run on any thread. On
+ * success, *res is set to a new macho_t the caller is responsible for. *st describes the file that
+ * was parsed if the file could be opened. */
+static int parse_path(const char *filepath, macho_t **res, struct stat *st) {
+    int fd;
+    void *data;
+    macho_input_t input_file;
+
+    *res = NULL;
+
     /* Open input file */
     if ((fd = open(filepath, O_RDONLY)) < 0) {
 #ifdef HAVE__DYLD_SHARED_CACHE_CONTAINS_PATH
@@ -543,50 +742,460 @@ int macho_parse_file(macho_handle_t *handle, const char *filepath, const macho_t
     }
 
     /* Get file length */
-    if (fstat(fd, &st) != 0) {
+    if (fstat(fd, st) != 0) {
         close(fd);
         return MACHO_EFILE;
     }
 
     /* Map file into address space */
-    if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+    if ((data = mmap(NULL, st->st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
         close(fd);
         return MACHO_EMMAP;
     }
 
     /* Parse file */
     input_file.data = data;
-    input_file.length = st.st_size;
+    input_file.length = st->st_size;
 
+    int ret = MACHO_EMEM;
     *res = create_macho_t();
-    if (*res == NULL)
-        return MACHO_EMEM;
+    if (*res != NULL) {
+        ret = parse_macho(*res, &input_file);
+        if (ret != MACHO_SUCCESS) {
+            /* An error occurred, free mt */
+            free_macho_t(*res);
+            *res = NULL;
+        }
+    }
+
+    /* Cleanup */
+    munmap(data, st->st_size);
+    close(fd);
 
-    /* The output parameter *res should be read-only for the user of the lib only, but writable for
-     * us */
-    int ret = parse_macho((macho_t *)*res, &input_file);
+    return ret;
+}
+
+/* Store the outcome of parse_path in a handle, which takes over mt. If the file has been parsed
+ * with this handle before, the earlier result is kept and returned in *res instead. */
+static int record_result(macho_handle_t *handle, const char *filepath, const struct stat *st, int ret, macho_t *mt, const macho_t **res) {
     if (ret == MACHO_SUCCESS) {
+        const macho_t *known = hashMapGet(handle->result_map, filepath);
+        if (known != NULL) {
+            free_macho_t(mt);
+            *res = known;
+            return MACHO_SUCCESS;
+        }
         /* Insert into hashmap for caching */
-        if (0 == hashMapPut(handle->result_map, filepath, *res, NULL)) {
-            free_macho_t((macho_t *)*res);
-            *res = NULL;
+        if (0 == hashMapPut(handle->result_map, filepath, mt, NULL)) {
+            free_macho_t(mt);
+            return MACHO_EMEM;
+        }
+        *res = mt;
+    }
+
+    /* Remember the result for the next run; other errors may be temporary */
+    if (handle->cache_map != NULL && (ret == MACHO_SUCCESS || ret == MACHO_EMAGIC)) {
+        if (!cache_store(handle, filepath, st, ret, mt))
             ret = MACHO_EMEM;
+    }
+
+    return ret;
+}
+
+/* Parse a (possible Mach-O) file. For a more detailed description, see the header */
+int macho_parse_file(macho_handle_t *handle, const char *filepath, const macho_t **res) {
+    struct stat st;
+    macho_t *mt;
+    int ret;
+
+    if ((ret = lookup_result(handle, filepath, res)) >= 0)
+        return ret;
+
+    ret = parse_path(filepath, &mt, &st);
+    return record_result(handle, filepath, &st, ret, mt, res);
+}
+
+/* A file to be parsed by macho_parse_files on one of the worker threads */
+typedef struct macho_job {
+    const char *mj_path;
+    macho_t *mj_macho;
+    struct stat mj_stat;
+    int mj_status;                  /* -1 until the file has been parsed */
+} macho_job_t;
+
+typedef struct macho_job_queue {
+    macho_job_t *jobs;
+    size_t count;
+    size_t next;                    /* next job to be taken by a worker */
+    pthread_mutex_t mutex;
+} macho_job_queue_t;
+
+static void *parse_worker_main(void *arg) {
+    macho_job_queue_t *queue = arg;
+
+    for (;;) {
+        macho_job_t *job;
+
+        pthread_mutex_lock(&queue->mutex);
+        job = queue->next < queue->count ? &queue->jobs[queue->next++] : NULL;
+        pthread_mutex_unlock(&queue->mutex);
+        if (job == NULL)
+            break;
+        job->mj_status = parse_path(job->mj_path, &job->mj_macho, &job->mj_stat);
+    }
+    return NULL;
+}
+
+/* Parse a list of files on several threads. For a more detailed description, see the header */
+int macho_parse_files(macho_handle_t *handle, const char *const *filepaths, size_t count, int jobs, const macho_t **results, int *statuses) {
+    macho_job_queue_t queue;
+    pthread_t *threads;
+    int started;
+
+    /* results that are already known don't need a thread, and looking them up touches the
+     * handle, which is only ever used from the calling thread */
+    queue.jobs = calloc(count, sizeof(macho_job_t));
+    if (count > 0 && queue.jobs == NULL)
+        return MACHO_EMEM;
+    queue.count = 0;
+    queue.next = 0;
+    for (size_t i = 0; i < count; i++) {
+        results[i] = NULL;
+        statuses[i] = lookup_result(handle, filepaths[i], &results[i]);
+        if (statuses[i] < 0) {
+            queue.jobs[queue.count].mj_path = filepaths[i];
+            queue.jobs[queue.count].mj_status = -1;
+            queue.count++;
         }
-    } else {
-        /* An error occurred, free mt */
-        free_macho_t((macho_t *)*res);
-        *res = NULL;
     }
 
-    /* Cleanup */
-    munmap(data, st.st_size);
+    if (jobs <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = ncpu > 0 ? (int) (ncpu < MACHO_MAX_JOBS ? ncpu : MACHO_MAX_JOBS) : 1;
+    }
+    if ((size_t) jobs > queue.count)
+        jobs = (int) queue.count;
+
+    /* the calling thread is one of the workers, which also covers failures to start threads */
+    pthread_mutex_init(&queue.mutex, NULL);
+    threads = jobs > 1 ? calloc((size_t) jobs - 1, sizeof(pthread_t)) : NULL;
+    for (started = 0; threads != NULL && started < jobs - 1; started++) {
+        if (pthread_create(&threads[started], NULL, parse_worker_main, &queue) != 0)
+            break;
+    }
+    parse_worker_main(&queue);
+    while (started > 0)
+        pthread_join(threads[--started], NULL);
+    free(threads);
+    pthread_mutex_destroy(&queue.mutex);
+
+    /* merge the results into the handle in input order, so that a path given more than once
+     * yields the same result every time */
+    size_t next = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (statuses[i] >= 0)
+            continue;
+        macho_job_t *job = &queue.jobs[next++];
+        statuses[i] = record_result(handle, job->mj_path, &job->mj_stat, job->mj_status, job->mj_macho, &results[i]);
+    }
+    free(queue.jobs);
+
+    return MACHO_SUCCESS;
+}
+
+/* The cache file starts with a signature and a version number, which is written in host byte
+ * order so that a cache written on a host with a different byte order is discarded. The header is
+ * followed by one record per file: its path, the identity of the file as in macho_cache_entry_t,
+ * the status and, for MACHO_SUCCESS, the parsed architectures and load commands. Strings are
+ * stored as a length (UINT32_MAX for NULL) followed by the characters. */
+static const char cache_signature[16] = "machista cache\n";
+#define MACHO_CACHE_VERSION 1
+#define MACHO_CACHE_NULL UINT32_MAX
+
+typedef struct cache_reader {
+    const uint8_t *pos;
+    const uint8_t *end;
+} cache_reader_t;
+
+static bool cache_read(cache_reader_t *reader, void *out, size_t length) {
+    if ((size_t) (reader->end - reader->pos) < length)
+        return false;
+    memcpy(out, reader->pos, length);
+    reader->pos += length;
+    return true;
+}
+
+/* Read a string; *out is set to a newly allocated copy, or NULL if NULL was stored */
+static bool cache_read_string(cache_reader_t *reader, char **out) {
+    uint32_t length;
+    *out = NULL;
+    if (!cache_read(reader, &length, sizeof(length)))
+        return false;
+    if (length == MACHO_CACHE_NULL)
+        return true;
+    if ((size_t) (reader->end - reader->pos) < length)
+        return false;
+    *out = malloc((size_t) length + 1);
+    if (*out == NULL)
+        return false;
+    memcpy(*out, reader->pos, length);
+    (*out)[length] = '\0';
+    reader->pos += length;
+    return true;
+}
+
+/* Read the architectures of a cached result. Returns NULL if the data is truncated or memory could
+ * not be allocated. */
+static macho_t *cache_read_macho(cache_reader_t *reader) {
+    uint32_t narchs;
+    macho_arch_t **archtail;
+    macho_t *mt = create_macho_t();
+    if (mt == NULL)
+        return NULL;
+
+    if (!cache_read(reader, &narchs, sizeof(narchs)))
+        goto error_out;
+    archtail = &mt->mt_archs;
+    for (uint32_t i = 0; i < narchs; i++) {
+        uint32_t nloadcmds;
+        macho_loadcmd_t **cmdtail;
+        macho_arch_t *mat = create_macho_arch_t();
+        if (mat == NULL)
+            goto error_out;
+        /* keep the order of the list as it was written */
+        *archtail = mat;
+        archtail = &mat->next;
+
+        if (!cache_read(reader, &mat->mat_arch, sizeof(mat->mat_arch))
+                || !cache_read(reader, &mat->mat_comp_version, sizeof(mat->mat_comp_version))
+                || !cache_read(reader, &mat->mat_version, sizeof(mat->mat_version))
+                || !cache_read_string(reader, &mat->mat_install_name)
+                || !cache_read_string(reader, &mat->mat_rpath)
+                || !cache_read(reader, &nloadcmds, sizeof(nloadcmds)))
+            goto error_out;
+        cmdtail = &mat->mat_loadcmds;
+        for (uint32_t j = 0; j < nloadcmds; j++) {
+            macho_loadcmd_t *mlt = create_macho_loadcmd_t();
+            if (mlt == NULL)
+                goto error_out;
+            *cmdtail = mlt;
+            cmdtail = &mlt->next;
+
+            if (!cache_read(reader, &mlt->mlt_type, sizeof(mlt->mlt_type))
+                    || !cache_read(reader, &mlt->mlt_comp_version, sizeof(mlt->mlt_comp_version))
+                    || !cache_read(reader, &mlt->mlt_version, sizeof(mlt->mlt_version))
+                    || !cache_read_string(reader, &mlt->mlt_install_name))
+                goto error_out;
+        }
+    }
+    return mt;
+
+error_out:
+    free_macho_t(mt);
+    return NULL;
+}
+
+/* Read the records of a cache file into handle->cache_map. Reading stops at the first record that
+ * is incomplete. Returns false if memory could not be allocated. */
+static bool cache_load(macho_handle_t *handle, const uint8_t *data, size_t length) {
+    cache_reader_t reader = { data, data + length };
+    char signature[sizeof(cache_signature)];
+    uint32_t version;
+
+    if (!cache_read(&reader, signature, sizeof(signature))
+            || memcmp(signature, cache_signature, sizeof(signature)) != 0
+            || !cache_read(&reader, &version, sizeof(version))
+            || version != MACHO_CACHE_VERSION)
+        return true;
+
+    while (reader.pos < reader.end) {
+        char *path;
+        uint32_t status;
+        macho_cache_entry_t *entry;
+
+        if (!cache_read_string(&reader, &path) || path == NULL) {
+            free(path);
+            break;
+        }
+        entry = calloc(1, sizeof(macho_cache_entry_t));
+        if (entry == NULL) {
+            free(path);
+            return false;
+        }
+        if (!cache_read(&reader, &entry->mce_dev, sizeof(entry->mce_dev))
+                || !cache_read(&reader, &entry->mce_ino, sizeof(entry->mce_ino))
+                || !cache_read(&reader, &entry->mce_size, sizeof(entry->mce_size))
+                || !cache_read(&reader, &entry->mce_mtime, sizeof(entry->mce_mtime))
+                || !cache_read(&reader, &entry->mce_mtime_nsec, sizeof(entry->mce_mtime_nsec))
+                || !cache_read(&reader, &status, sizeof(status))
+                || (status != MACHO_SUCCESS && status != MACHO_EMAGIC)) {
+            free(entry);
+            free(path);
+            break;
+        }
+        entry->mce_status = (int) status;
+        if (status == MACHO_SUCCESS) {
+            entry->mce_macho = cache_read_macho(&reader);
+            if (entry->mce_macho == NULL) {
+                free(entry);
+                free(path);
+                break;
+            }
+            entry->mce_owned = true;
+        }
+        if (0 == hashMapPut(handle->cache_map, path, entry, NULL)) {
+            free_cache_entry(entry);
+            free(path);
+            return false;
+        }
+        free(path);
+    }
+    return true;
+}
+
+/* Associate a cache file with a handle. For a more detailed description, see the header */
+int macho_cache_open(macho_handle_t *handle, const char *cachepath) {
+    int fd;
+    struct stat st;
+    int ret = MACHO_SUCCESS;
+
+    /* start over if a cache was already open */
+    hashMapDestroy(handle->cache_map);
+    free(handle->cache_path);
+    handle->cache_path = strdup(cachepath);
+    handle->cache_map = hashMapCreate(free_cache_entry);
+    if (handle->cache_path == NULL || handle->cache_map == NULL) {
+        hashMapDestroy(handle->cache_map);
+        handle->cache_map = NULL;
+        free(handle->cache_path);
+        handle->cache_path = NULL;
+        return MACHO_EMEM;
+    }
+
+    /* a missing or unreadable cache is an empty one */
+    if ((fd = open(cachepath, O_RDONLY)) < 0)
+        return MACHO_SUCCESS;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            if (!cache_load(handle, data, st.st_size))
+                ret = MACHO_EMEM;
+            munmap(data, st.st_size);
+        }
+    }
     close(fd);
 
     return ret;
-#else
-int macho_parse_file(macho_handle_t *handle UNUSED, const char *filepath UNUSED, const macho_t **res UNUSED) {
-    return 0;
-#endif
+}
+
+static bool cache_write(FILE *file, const void *data, size_t length) {
+    return fwrite(data, 1, length, file) == length;
+}
+
+static bool cache_write_string(FILE *file, const char *str) {
+    uint32_t length = str == NULL ? MACHO_CACHE_NULL : (uint32_t) strlen(str);
+    return cache_write(file, &length, sizeof(length))
+        && (str == NULL || cache_write(file, str, length));
+}
+
+static bool cache_write_macho(FILE *file, const macho_t *mt) {
+    uint32_t narchs = 0;
+    for (macho_arch_t *mat = mt->mt_archs; mat != NULL; mat = mat->next)
+        narchs++;
+    if (!cache_write(file, &narchs, sizeof(narchs)))
+        return false;
+
+    for (macho_arch_t *mat = mt->mt_archs; mat != NULL; mat = mat->next) {
+        uint32_t nloadcmds = 0;
+        for (macho_loadcmd_t *mlt = mat->mat_loadcmds; mlt != NULL; mlt = mlt->next)
+            nloadcmds++;
+        if (!cache_write(file, &mat->mat_arch, sizeof(mat->mat_arch))
+                || !cache_write(file, &mat->mat_comp_version, sizeof(mat->mat_comp_version))
+                || !cache_write(file, &mat->mat_version, sizeof(mat->mat_version))
+                || !cache_write_string(file, mat->mat_install_name)
+                || !cache_write_string(file, mat->mat_rpath)
+                || !cache_write(file, &nloadcmds, sizeof(nloadcmds)))
+            return false;
+
+        for (macho_loadcmd_t *mlt = mat->mat_loadcmds; mlt != NULL; mlt = mlt->next) {
+            if (!cache_write(file, &mlt->mlt_type, sizeof(mlt->mlt_type))
+                    || !cache_write(file, &mlt->mlt_comp_version, sizeof(mlt->mlt_comp_version))
+                    || !cache_write(file, &mlt->mlt_version, sizeof(mlt->mlt_version))
+                    || !cache_write_string(file, mlt->mlt_install_name))
+                return false;
+        }
+    }
+    return true;
+}
+
+typedef struct cache_writer {
+    FILE *file;
+    bool ok;
+} cache_writer_t;
+
+/* hashMapForEach callback writing a single cache record */
+static void cache_write_entry(const char *path, const void *value, void *data) {
+    const macho_cache_entry_t *entry = value;
+    cache_writer_t *writer = data;
+    uint32_t status = (uint32_t) entry->mce_status;
+
+    if (!writer->ok)
+        return;
+    if (!entry->mce_used) {
+        /* drop entries of files that have since been removed or modified */
+        struct stat st;
+        if (stat(path, &st) != 0 || !cache_entry_matches(entry, &st))
+            return;
+    }
+
+    writer->ok = cache_write_string(writer->file, path)
+        && cache_write(writer->file, &entry->mce_dev, sizeof(entry->mce_dev))
+        && cache_write(writer->file, &entry->mce_ino, sizeof(entry->mce_ino))
+        && cache_write(writer->file, &entry->mce_size, sizeof(entry->mce_size))
+        && cache_write(writer->file, &entry->mce_mtime, sizeof(entry->mce_mtime))
+        && cache_write(writer->file, &entry->mce_mtime_nsec, sizeof(entry->mce_mtime_nsec))
+        && cache_write(writer->file, &status, sizeof(status))
+        && (entry->mce_status != MACHO_SUCCESS || cache_write_macho(writer->file, entry->mce_macho));
+}
+
+/* Write the cache of a handle back to disk. For a more detailed description, see the header */
+int macho_cache_save(macho_handle_t *handle) {
+    char *tmppath;
+    int fd;
+    uint32_t version = MACHO_CACHE_VERSION;
+    cache_writer_t writer;
+
+    if (handle->cache_map == NULL)
+        return MACHO_SUCCESS;
+
+    /* write a new file and move it into place, so that readers never see a partial cache */
+    if (asprintf(&tmppath, "%s.XXXXXX", handle->cache_path) < 0)
+        return MACHO_EMEM;
+    if ((fd = mkstemp(tmppath)) < 0) {
+        free(tmppath);
+        return MACHO_EFILE;
+    }
+    writer.file = fdopen(fd, "w");
+    if (writer.file == NULL) {
+        close(fd);
+        unlink(tmppath);
+        free(tmppath);
+        return MACHO_EFILE;
+    }
+
+    writer.ok = cache_write(writer.file, cache_signature, sizeof(cache_signature))
+        && cache_write(writer.file, &version, sizeof(version));
+    hashMapForEach(handle->cache_map, cache_write_entry, &writer);
+    if (fclose(writer.file) != 0)
+        writer.ok = false;
+    if (!writer.ok || rename(tmppath, handle->cache_path) != 0) {
+        unlink(tmppath);
+        free(tmppath);
+        return MACHO_EFILE;
+    }
+
+    free(tmppath);
+    return MACHO_SUCCESS;
 }
 
 /* Create a new macho_handle_t. More information on this function is available in the header */
@@ -599,6 +1208,8 @@ macho_handle_t *macho_create_handle (void) {
         free(mht);
         return NULL;
     }
+    mht->cache_map = NULL;
+    mht->cache_path = NULL;
     return mht;
 }
 
@@ -607,6 +1218,9 @@ void macho_destroy_handle(macho_handle_t *handle) {
     if (handle == NULL)
         return;
     
+    /* cache entries may refer to results owned by result_map, so destroy them first */
+    hashMapDestroy(handle->cache_map);
+    free(handle->cache_path);
     hashMapDestroy(handle->result_map);
 
     free(handle);
@@ -614,8 +1228,10 @@ void macho_destroy_handle(macho_handle_t *handle) {
 
 /* Returns string representation of the MACHO_* error code constants */
 const char *macho_strerror(int err) {
-#ifdef __MACH__
-    int num = fls(err);
+    /* index of the highest bit set, like fls(3) */
+    size_t num = 0;
+    for (unsigned int bits = (unsigned int) err; bits != 0; bits >>= 1)
+        num++;
 
     static char *errors[] = {
         /* 0x00 */ "Success",
@@ -626,9 +1242,7 @@ const char *macho_strerror(int err) {
         /* 0x10 */ "Not a Mach-O file",
         /* 0x20 */ "Shared cache only",
     };
+    if (num >= sizeof(errors) / sizeof(errors[0]))
+        return "Unknown error";
     return errors[num];
-#else
-    return "";
-#endif
 }
-
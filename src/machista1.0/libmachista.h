@@ -43,6 +43,7 @@
 typedef int cpu_type_t;
 #endif
 #include <inttypes.h>
+#include <stddef.h>
 
 #define MACHO_SUCCESS   (0x00)
 #define MACHO_EFILE     (0x01)
@@ -139,6 +140,41 @@ const char *macho_get_arch_name(cpu_type_t cputype);
  */
 int macho_parse_file(macho_handle_t *handle, const char *filepath, const macho_t **res);
 
+/**
+ * Parses count files like macho_parse_file, reading and parsing those whose results are not yet
+ * known on up to jobs threads (including the calling thread; the number of online CPUs, but at
+ * most 16, if jobs is 0 or less). The result and error code for filepaths[i] are stored in
+ * results[i] and statuses[i], with the same meaning as for macho_parse_file. The results are
+ * owned by the handle as with macho_parse_file, and the handle must not be used by other threads
+ * during the call.
+ *
+ * Returns MACHO_SUCCESS if all files have been attempted, or MACHO_EMEM if memory for the call
+ * could not be allocated, in which case results and statuses are undefined.
+ */
+int macho_parse_files(macho_handle_t *handle, const char *const *filepaths, size_t count, int jobs, const macho_t **results, int *statuses);
+
+/**
+ * Associates the cache file at cachepath with a handle. Subsequent calls to macho_parse_file with
+ * this handle use the results stored in the cache for files whose device, inode, size and
+ * modification time are unchanged instead of reading them again, and add the results for other
+ * files (including the fact that they are not Mach-O files) to the cache. Use macho_cache_save to
+ * write the cache back to disk. A missing, unreadable or invalid cache file is treated like an
+ * empty one.
+ *
+ * Returns MACHO_SUCCESS on success or MACHO_EMEM if memory could not be allocated.
+ */
+int macho_cache_open(macho_handle_t *handle, const char *cachepath);
+
+/**
+ * Writes the cache associated with a handle by macho_cache_open back to disk, replacing the cache
+ * file atomically. Entries for files that have been removed or modified since they were cached are
+ * dropped. Does nothing if no cache is associated with the handle.
+ *
+ * Returns MACHO_SUCCESS on success, MACHO_EFILE if the cache file could not be written (errno will
+ * be set) or MACHO_EMEM if memory could not be allocated.
+ */
+int macho_cache_save(macho_handle_t *handle);
+
 /**
  * Returns a string representation of the MACHO_* error code constants
  */
@@ -137,6 +137,85 @@ void macho_destroy_handle(struct macho_handle *INPUT);
 %rename(parse_file) macho_parse_file;
 int macho_parse_file(struct macho_handle *handle, const char *filename, const struct macho **result);
 
+/**
+ * Parse a list of files on several threads using macho_parse_files(). Since
+ * this takes and returns lists, it is a native command, which returns a list
+ * with a {returncode result} pair like the one returned by parse_file for each
+ * of the files, in the same order.
+ */
+%wrapper %{
+/* parse_files handle paths ?jobs?
+ * Parses the files in the list paths using macho_parse_files and returns a
+ * list with a {returncode result} pair as returned by parse_file for each of
+ * them, in the same order. */
+SWIGINTERN int
+machista_parse_files(ClientData clientData SWIGUNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+  struct macho_handle *handle;
+  void *argp1 = 0;
+  Tcl_Obj **pathv;
+  Tcl_Size count;
+  int jobs = 0;
+  const char **paths;
+  const struct macho **results;
+  int *statuses;
+  int ret;
+
+  if (objc != 3 && objc != 4) {
+    Tcl_WrongNumArgs(interp, 1, objv, "handle paths ?jobs?");
+    return TCL_ERROR;
+  }
+  if (!SWIG_IsOK(SWIG_ConvertPtr(objv[1], &argp1, SWIGTYPE_p_macho_handle, 0))) {
+    Tcl_SetObjResult(interp, Tcl_NewStringObj("in method 'parse_files', argument 1 of type 'struct macho_handle *'", -1));
+    return TCL_ERROR;
+  }
+  handle = (struct macho_handle *)argp1;
+  if (Tcl_ListObjGetElements(interp, objv[2], &count, &pathv) != TCL_OK) {
+    return TCL_ERROR;
+  }
+  if (objc == 4 && Tcl_GetIntFromObj(interp, objv[3], &jobs) != TCL_OK) {
+    return TCL_ERROR;
+  }
+
+  paths = (const char **)Tcl_Alloc(sizeof(*paths) * (count + 1));
+  results = (const struct macho **)Tcl_Alloc(sizeof(*results) * (count + 1));
+  statuses = (int *)Tcl_Alloc(sizeof(*statuses) * (count + 1));
+  for (Tcl_Size i = 0; i < count; i++) {
+    paths[i] = Tcl_GetString(pathv[i]);
+  }
+
+  ret = macho_parse_files(handle, paths, (size_t)count, jobs, results, statuses);
+  if (ret == MACHO_SUCCESS) {
+    Tcl_Obj *list = Tcl_NewListObj(0, NULL);
+    for (Tcl_Size i = 0; i < count; i++) {
+      Tcl_Obj *pair[2];
+      pair[0] = SWIG_From_int(statuses[i]);
+      pair[1] = SWIG_NewInstanceObj(SWIG_as_voidptr(statuses[i] == MACHO_SUCCESS ? results[i] : NULL), SWIGTYPE_p_macho, 0);
+      Tcl_ListObjAppendElement(interp, list, Tcl_NewListObj(2, pair));
+    }
+    Tcl_SetObjResult(interp, list);
+  } else {
+    Tcl_SetObjResult(interp, Tcl_NewStringObj(macho_strerror(ret), -1));
+  }
+
+  Tcl_Free((char *)statuses);
+  Tcl_Free((char *)results);
+  Tcl_Free((char *)paths);
+  return ret == MACHO_SUCCESS ? TCL_OK : TCL_ERROR;
+}
+%}
+%native(parse_files) int machista_parse_files(ClientData, Tcl_Interp *, int, Tcl_Obj *const []);
+
+/**
+ * Keep the results of parse_file in a cache file across runs. See
+ * macho_cache_open() and macho_cache_save() in libmachista.h. Both return one
+ * of the error codes.
+ */
+%rename(cache_open) macho_cache_open;
+int macho_cache_open(struct macho_handle *handle, const char *cachepath);
+
+%rename(cache_save) macho_cache_save;
+int macho_cache_save(struct macho_handle *handle);
+
 /**
  * Returns an error string for the error code returned by macho_parse_file. This
  * is not an allocated string and must thus not be free()'d after copying it to
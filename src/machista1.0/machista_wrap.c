@@ -2446,6 +2446,120 @@ fail:
 }
 
 
+/* parse_files handle paths ?jobs?
+ * Parses the files in the list paths using macho_parse_files and returns a
+ * list with a {returncode result} pair as returned by parse_file for each of
+ * them, in the same order. */
+SWIGINTERN int
+machista_parse_files(ClientData clientData SWIGUNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+  struct macho_handle *handle;
+  void *argp1 = 0;
+  Tcl_Obj **pathv;
+  Tcl_Size count;
+  int jobs = 0;
+  const char **paths;
+  const struct macho **results;
+  int *statuses;
+  int ret;
+
+  if (objc != 3 && objc != 4) {
+    Tcl_WrongNumArgs(interp, 1, objv, "handle paths ?jobs?");
+    return TCL_ERROR;
+  }
+  if (!SWIG_IsOK(SWIG_ConvertPtr(objv[1], &argp1, SWIGTYPE_p_macho_handle, 0))) {
+    Tcl_SetObjResult(interp, Tcl_NewStringObj("in method 'parse_files', argument 1 of type 'struct macho_handle *'", -1));
+    return TCL_ERROR;
+  }
+  handle = (struct macho_handle *)argp1;
+  if (Tcl_ListObjGetElements(interp, objv[2], &count, &pathv) != TCL_OK) {
+    return TCL_ERROR;
+  }
+  if (objc == 4 && Tcl_GetIntFromObj(interp, objv[3], &jobs) != TCL_OK) {
+    return TCL_ERROR;
+  }
+
+  paths = (const char **)Tcl_Alloc(sizeof(*paths) * (count + 1));
+  results = (const struct macho **)Tcl_Alloc(sizeof(*results) * (count + 1));
+  statuses = (int *)Tcl_Alloc(sizeof(*statuses) * (count + 1));
+  for (Tcl_Size i = 0; i < count; i++) {
+    paths[i] = Tcl_GetString(pathv[i]);
+  }
+
+  ret = macho_parse_files(handle, paths, (size_t)count, jobs, results, statuses);
+  if (ret == MACHO_SUCCESS) {
+    Tcl_Obj *list = Tcl_NewListObj(0, NULL);
+    for (Tcl_Size i = 0; i < count; i++) {
+      Tcl_Obj *pair[2];
+      pair[0] = SWIG_From_int(statuses[i]);
+      pair[1] = SWIG_NewInstanceObj(SWIG_as_voidptr(statuses[i] == MACHO_SUCCESS ? results[i] : NULL), SWIGTYPE_p_macho, 0);
+      Tcl_ListObjAppendElement(interp, list, Tcl_NewListObj(2, pair));
+    }
+    Tcl_SetObjResult(interp, list);
+  } else {
+    Tcl_SetObjResult(interp, Tcl_NewStringObj(macho_strerror(ret), -1));
+  }
+
+  Tcl_Free((char *)statuses);
+  Tcl_Free((char *)results);
+  Tcl_Free((char *)paths);
+  return ret == MACHO_SUCCESS ? TCL_OK : TCL_ERROR;
+}
+
+
+
+SWIGINTERN int
+_wrap_cache_open(ClientData clientData SWIGUNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+  struct macho_handle *arg1 = 0 ;
+  char *arg2 = 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  int res2 ;
+  char *buf2 = 0 ;
+  int alloc2 = 0 ;
+  int result;
+  
+  if (SWIG_GetArgs(interp, objc, objv,"oo:machista::cache_open handle cachepath ",(void *)0,(void *)0) == TCL_ERROR) SWIG_fail;
+  res1 = SWIG_ConvertPtr(objv[1], &argp1,SWIGTYPE_p_macho_handle, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "cache_open" "', argument " "1"" of type '" "struct macho_handle *""'"); 
+  }
+  arg1 = (struct macho_handle *)(argp1);
+  res2 = SWIG_AsCharPtrAndSize(objv[2], &buf2, NULL, &alloc2);
+  if (!SWIG_IsOK(res2)) {
+    SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "cache_open" "', argument " "2"" of type '" "char const *""'");
+  }
+  arg2 = (char *)(buf2);
+  result = (int)macho_cache_open(arg1,(char const *)arg2);
+  Tcl_SetObjResult(interp,SWIG_From_int((int)(result)));
+  if (alloc2 == SWIG_NEWOBJ) free((char*)buf2);
+  return TCL_OK;
+fail:
+  if (alloc2 == SWIG_NEWOBJ) free((char*)buf2);
+  return TCL_ERROR;
+}
+
+
+SWIGINTERN int
+_wrap_cache_save(ClientData clientData SWIGUNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+  struct macho_handle *arg1 = 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  int result;
+  
+  if (SWIG_GetArgs(interp, objc, objv,"o:machista::cache_save handle ",(void *)0) == TCL_ERROR) SWIG_fail;
+  res1 = SWIG_ConvertPtr(objv[1], &argp1,SWIGTYPE_p_macho_handle, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "cache_save" "', argument " "1"" of type '" "struct macho_handle *""'"); 
+  }
+  arg1 = (struct macho_handle *)(argp1);
+  result = (int)macho_cache_save(arg1);
+  Tcl_SetObjResult(interp,SWIG_From_int((int)(result)));
+  return TCL_OK;
+fail:
+  return TCL_ERROR;
+}
+
+
 SWIGINTERN int
 _wrap_strerror(ClientData clientData SWIGUNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
   int arg1 ;
@@ -2534,6 +2648,9 @@ static swig_command_info swig_commands[] = {
     { SWIG_prefix "create_handle", (swig_wrapper_func) _wrap_create_handle, NULL},
     { SWIG_prefix "destroy_handle", (swig_wrapper_func) _wrap_destroy_handle, NULL},
     { SWIG_prefix "parse_file", (swig_wrapper_func) _wrap_parse_file, NULL},
+    { SWIG_prefix "parse_files", (swig_wrapper_func) machista_parse_files, NULL},
+    { SWIG_prefix "cache_open", (swig_wrapper_func) _wrap_cache_open, NULL},
+    { SWIG_prefix "cache_save", (swig_wrapper_func) _wrap_cache_save, NULL},
     { SWIG_prefix "strerror", (swig_wrapper_func) _wrap_strerror, NULL},
     { SWIG_prefix "get_arch_name", (swig_wrapper_func) _wrap_get_arch_name, NULL},
     { SWIG_prefix "format_dylib_version", (swig_wrapper_func) _wrap_format_dylib_version, NULL},
@@ -0,0 +1,114 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Writes the Mach-O files used by libmachista-test and libmachista-bench,
+# which can be parsed on any host. They only contain the headers and load
+# commands libmachista looks at.
+# Syntax:
+# tclsh mkfixtures.tcl ?directory?
+
+set CPU_ARCH_ABI64 0x01000000
+set CPU_TYPE_X86_64 [expr {7 | $CPU_ARCH_ABI64}]
+set CPU_TYPE_ARM64 [expr {12 | $CPU_ARCH_ABI64}]
+set CPU_TYPE_POWERPC 18
+
+set LC_LOAD_DYLIB 0xc
+set LC_ID_DYLIB 0xd
+set LC_RPATH 0x8000001c
+
+# 32 bit integers in the byte order of the file; "i" is little, "I" big endian
+proc u32 {order args} {
+    return [binary format ${order}[llength $args] $args]
+}
+
+# pad a NUL-terminated string to a multiple of 8 bytes
+proc lcstr {str} {
+    set data [encoding convertto utf-8 $str]\0
+    return $data[string repeat \0 [expr {(8 - [string length $data] % 8) % 8}]]
+}
+
+proc version {major minor patch} {
+    return [expr {($major << 16) | ($minor << 8) | $patch}]
+}
+
+proc dylib_cmd {order cmd name current compat} {
+    set name [lcstr $name]
+    return [u32 $order $cmd [expr {24 + [string length $name]}] 24 2 $current $compat]$name
+}
+
+proc rpath_cmd {order path} {
+    set path [lcstr $path]
+    return [u32 $order $::LC_RPATH [expr {12 + [string length $path]}] 12]$path
+}
+
+# a thin Mach-O file of the given file type (6 is MH_DYLIB, 1 MH_OBJECT)
+proc macho {order cputype filetype cmds} {
+    set is64 [expr {($cputype & $::CPU_ARCH_ABI64) != 0}]
+    set data [join $cmds {}]
+    set header [u32 $order [expr {$is64 ? 0xfeedfacf : 0xfeedface}] $cputype 0 \
+        $filetype [llength $cmds] [string length $data] 0]
+    if {$is64} {
+        append header [u32 $order 0]
+    }
+    return $header$data
+}
+
+# a universal file of the given slices
+proc fat {slices} {
+    set count [expr {[llength $slices] / 2}]
+    set offset [expr {8 + 20 * $count}]
+    set header [u32 I 0xcafebabe $count]
+    set body {}
+    foreach {cputype slice} $slices {
+        append header [u32 I $cputype 0 $offset [string length $slice] 0]
+        append body $slice
+        incr offset [string length $slice]
+    }
+    return $header$body
+}
+
+# a BSD ar(1) archive of name/data pairs, using the extended format for long
+# names
+proc archive {members} {
+    set data "!<arch>\n"
+    foreach {name member} $members {
+        if {[string length $name] > 16} {
+            set member $name$member
+            set name "#1/[string length $name]"
+        }
+        append data [format "%-16s%-12s%-6s%-6s%-8s%-10s`\n" $name 0 0 0 644 [string length $member]]
+        append data $member
+        if {[string length $member] % 2 != 0} {
+            append data \n
+        }
+    }
+    return $data
+}
+
+proc dylib {order cputype} {
+    return [macho $order $cputype 6 [list \
+        [dylib_cmd $order $::LC_ID_DYLIB /opt/local/lib/libfixture.1.dylib [version 1 2 3] [version 1 0 0]] \
+        [dylib_cmd $order $::LC_LOAD_DYLIB /opt/local/lib/libz.1.dylib [version 1 3 1] [version 1 0 0]] \
+        [dylib_cmd $order $::LC_LOAD_DYLIB /usr/lib/libSystem.B.dylib [version 1311 0 0] [version 1 0 0]] \
+        [rpath_cmd $order @loader_path/../lib]]]
+}
+
+proc write {path data} {
+    set chan [open $path w]
+    fconfigure $chan -translation binary
+    puts -nonewline $chan $data
+    close $chan
+}
+
+set dir [expr {$argc > 0 ? [lindex $argv 0] : [file dirname [info script]]}]
+
+write $dir/x86_64.dylib [dylib i $CPU_TYPE_X86_64]
+write $dir/ppc.dylib [dylib I $CPU_TYPE_POWERPC]
+write $dir/universal.dylib [fat [list \
+    $CPU_TYPE_X86_64 [dylib i $CPU_TYPE_X86_64] \
+    $CPU_TYPE_ARM64 [dylib i $CPU_TYPE_ARM64]]]
+write $dir/archive.a [archive [list \
+    "__.SYMDEF SORTED" [string repeat \0 8] \
+    first.o [macho i $CPU_TYPE_X86_64 1 {}] \
+    an-object-with-a-long-name.o [macho i $CPU_TYPE_X86_64 1 {}]]]
+write $dir/truncated.dylib [string range [dylib i $CPU_TYPE_X86_64] 0 99]
+write $dir/not-macho.txt "This is not a Mach-O file.\n"
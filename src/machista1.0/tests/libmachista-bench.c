@@ -0,0 +1,123 @@
+/*
+ * Benchmark for libmachista: times parsing many files one by one against
+ * parsing them with macho_parse_files on several threads, and parsing them
+ * with an empty cache (a cold run, which also saves the cache) against
+ * parsing them again with the saved cache (a warm run).
+ * Syntax:
+ * libmachista-bench <fixtures dir> ?number of copies? ?number of threads?
+ */
+
+#include <libmachista.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define BENCH_DIR "/tmp/macports-machista-bench"
+
+static const char *fixtures[] = { "x86_64.dylib", "ppc.dylib", "universal.dylib", "archive.a", "not-macho.txt" };
+#define FIXTURE_COUNT (sizeof(fixtures) / sizeof(*fixtures))
+
+static double now(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int copy_file(const char *from, const char *to) {
+	char buf[4096];
+	size_t len;
+	FILE *in = fopen(from, "rb");
+	FILE *out = fopen(to, "wb");
+	int ok = in && out;
+	while (ok && (len = fread(buf, 1, sizeof(buf), in)) > 0) {
+		ok = fwrite(buf, 1, len, out) == len;
+	}
+	if (in)
+		fclose(in);
+	if (out && fclose(out) != 0)
+		ok = 0;
+	return ok;
+}
+
+// parse all copies with a new handle, one by one if jobs is 1, returns the time it took
+static double run(char **paths, size_t count, int jobs, const char *cachepath, size_t *parsed) {
+	double start = now();
+	const macho_t *result;
+	const macho_t **results = calloc(count, sizeof(*results));
+	int *statuses = calloc(count, sizeof(*statuses));
+	macho_handle_t *handle = macho_create_handle();
+
+	*parsed = 0;
+	if (!handle || !results || !statuses)
+		return -1;
+	if (cachepath)
+		macho_cache_open(handle, cachepath);
+	if (jobs == 1) {
+		for (size_t i = 0; i < count; i++) {
+			if (macho_parse_file(handle, paths[i], &result) == MACHO_SUCCESS)
+				(*parsed)++;
+		}
+	} else if (macho_parse_files(handle, (const char *const *) paths, count, jobs, results, statuses) == MACHO_SUCCESS) {
+		for (size_t i = 0; i < count; i++) {
+			if (statuses[i] == MACHO_SUCCESS)
+				(*parsed)++;
+		}
+	}
+	if (cachepath && macho_cache_save(handle) != MACHO_SUCCESS)
+		fprintf(stderr, "saving %s failed\n", cachepath);
+	macho_destroy_handle(handle);
+	free(statuses);
+	free(results);
+	return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+	size_t copies = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000;
+	int jobs = argc > 3 ? atoi(argv[3]) : 0;
+	size_t count = copies * FIXTURE_COUNT;
+	char **paths;
+	char cachepath[] = BENCH_DIR "/cache";
+	char from[1024];
+	size_t parsed_single, parsed_threads, parsed_cold, parsed_warm;
+	double single, threads, cold, warm;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <fixtures dir> ?number of copies? ?number of threads?\n", argv[0]);
+		return 1;
+	}
+
+	if (system("rm -rf " BENCH_DIR " && mkdir " BENCH_DIR) != 0)
+		return 1;
+	paths = calloc(count, sizeof(*paths));
+	if (!paths)
+		return 1;
+	for (size_t i = 0; i < count; i++) {
+		const char *name = fixtures[i % FIXTURE_COUNT];
+		snprintf(from, sizeof(from), "%s/%s", argv[1], name);
+		paths[i] = malloc(sizeof(from));
+		if (!paths[i])
+			return 1;
+		snprintf(paths[i], sizeof(from), BENCH_DIR "/%zu-%s", i / FIXTURE_COUNT, name);
+		if (!copy_file(from, paths[i])) {
+			fprintf(stderr, "copying %s failed\n", from);
+			return 1;
+		}
+	}
+
+	single = run(paths, count, 1, NULL, &parsed_single);
+	threads = run(paths, count, jobs, NULL, &parsed_threads);
+	cold = run(paths, count, jobs, cachepath, &parsed_cold);
+	warm = run(paths, count, jobs, cachepath, &parsed_warm);
+	printf("machista %zu files (%zu Mach-O): one by one %.1f ms, threaded %.1f ms\n",
+			count, parsed_single, single * 1000, threads * 1000);
+	printf("threaded with cache: cold %.1f ms, warm %.1f ms\n", cold * 1000, warm * 1000);
+	if (parsed_threads != parsed_single || parsed_cold != parsed_single || parsed_warm != parsed_single)
+		fprintf(stderr, "runs disagree: %zu, %zu, %zu, %zu\n", parsed_single, parsed_threads, parsed_cold, parsed_warm);
+
+	for (size_t i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+	return system("rm -rf " BENCH_DIR) != 0;
+}
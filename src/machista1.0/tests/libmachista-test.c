@@ -1,14 +1,17 @@
-#ifdef __MACH__
-
 #include <libmachista.h>
 #include <limits.h>
-#include <mach-o/arch.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <utime.h>
+
+#ifdef __MACH__
+#include <mach-o/arch.h>
+#endif
 
 #define TEST_LIB_PATH "tests/libmachista-test-lib.dylib"
 #define TEST_ARCHIVE_PATH "tests/libmachista-test-archive.a"
@@ -23,6 +26,8 @@ static bool check(bool condition, char *msg) {
 
 // forking helper
 static bool fork_test(void (*fp)(void), char *msg) {
+	// don't let the child print what's still buffered again
+	fflush(stdout);
 	pid_t p = fork();
 
 	switch (p) {
@@ -53,6 +58,7 @@ static bool fork_test(void (*fp)(void), char *msg) {
 	return true;
 }
 
+#ifdef __MACH__
 #define nullterminate(x) do { \
 	x[sizeof(x) - 1] = '\0'; \
 } while (false);
@@ -386,17 +392,282 @@ error_out:
 }
 #endif
 
-int main(void) {
-#ifdef __MACH__
+/*
+ * The following tests use the files in tests/fixtures, which are written by
+ * tests/fixtures/mkfixtures.tcl and can be parsed on any host.
+ */
+
+#define TEST_CACHE_PATH "tests/libmachista-test.cache"
+#define TEST_COPY_PATH "tests/libmachista-test-copy.dylib"
+
+static const char *fixtures_dir = "tests/fixtures";
+
+static const char *fixture(const char *name) {
+	static char path[_POSIX_PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", fixtures_dir, name);
+	return path;
+}
+
+static size_t count_archs(const macho_t *mt) {
+	size_t count = 0;
+	for (macho_arch_t *mat = mt->mt_archs; mat; mat = mat->next) {
+		count++;
+	}
+	return count;
+}
+
+// check the contents of a dylib written by mkfixtures.tcl
+static bool check_fixture_arch(const macho_arch_t *mat, const char *arch) {
+	bool ok = true;
+	const char *name = macho_get_arch_name(mat->mat_arch);
+	ok &= check(name != NULL && strcmp(name, arch) == 0, "unexpected architecture");
+	ok &= check(mat->mat_install_name != NULL && strcmp(mat->mat_install_name, "/opt/local/lib/libfixture.1.dylib") == 0, "unexpected install name");
+	ok &= check(mat->mat_rpath != NULL && strcmp(mat->mat_rpath, "@loader_path/../lib") == 0, "unexpected rpath");
+	ok &= check(mat->mat_version == 0x010203 && mat->mat_comp_version == 0x010000, "unexpected version");
+
+	size_t loadcmds = 0;
+	bool found_libz = false;
+	for (macho_loadcmd_t *mlt = mat->mat_loadcmds; mlt; mlt = mlt->next) {
+		loadcmds++;
+		if (strcmp(mlt->mlt_install_name, "/opt/local/lib/libz.1.dylib") == 0) {
+			found_libz = mlt->mlt_version == 0x010301 && mlt->mlt_comp_version == 0x010000;
+		}
+	}
+	ok &= check(loadcmds == 2, "expected two load commands");
+	ok &= check(found_libz, "load command for libz missing or wrong");
+	return ok;
+}
+
+static void copy_file(const char *from, const char *to) {
+	char buf[4096];
+	size_t len;
+	FILE *in = fopen(from, "rb");
+	FILE *out = fopen(to, "wb");
+	if (in == NULL || out == NULL) {
+		perror("	fopen");
+		exit(EXIT_FAILURE);
+	}
+	while ((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+		fwrite(buf, 1, len, out);
+	}
+	fclose(in);
+	fclose(out);
+}
+
+/**
+ * Test parsing the fixtures
+ */
+static void forked_test_fixtures(void) {
+	macho_handle_t *handle = macho_create_handle();
+	const macho_t *result;
+	int ret;
+	bool ok = true;
+
+	ret = macho_parse_file(handle, fixture("x86_64.dylib"), &result);
+	if (check(ret == MACHO_SUCCESS, "parsing x86_64.dylib failed")) {
+		ok &= check(count_archs(result) == 1, "expected one arch in x86_64.dylib");
+		ok &= check_fixture_arch(result->mt_archs, "x86_64");
+	} else {
+		ok = false;
+	}
+
+	// the header and load commands of this file are big endian
+	ret = macho_parse_file(handle, fixture("ppc.dylib"), &result);
+	if (check(ret == MACHO_SUCCESS, "parsing ppc.dylib failed")) {
+		ok &= check(count_archs(result) == 1, "expected one arch in ppc.dylib");
+		ok &= check_fixture_arch(result->mt_archs, "ppc");
+	} else {
+		ok = false;
+	}
+
+	ret = macho_parse_file(handle, fixture("universal.dylib"), &result);
+	if (check(ret == MACHO_SUCCESS, "parsing universal.dylib failed")) {
+		ok &= check(count_archs(result) == 2, "expected two archs in universal.dylib");
+		for (macho_arch_t *mat = result->mt_archs; mat; mat = mat->next) {
+			const char *name = macho_get_arch_name(mat->mat_arch);
+			ok &= check_fixture_arch(mat, name != NULL && strcmp(name, "arm64") == 0 ? "arm64" : "x86_64");
+		}
+	} else {
+		ok = false;
+	}
+
+	ret = macho_parse_file(handle, fixture("archive.a"), &result);
+	if (check(ret == MACHO_SUCCESS, "parsing archive.a failed")) {
+		ok &= check(count_archs(result) == 1, "expected one (deduplicated) arch in archive.a");
+	} else {
+		ok = false;
+	}
+
+	ok &= check(macho_parse_file(handle, fixture("truncated.dylib"), &result) == MACHO_ERANGE, "truncated.dylib should fail with MACHO_ERANGE");
+	ok &= check(macho_parse_file(handle, fixture("not-macho.txt"), &result) == MACHO_EMAGIC, "not-macho.txt should fail with MACHO_EMAGIC");
+	ok &= check(macho_parse_file(handle, fixture("missing"), &result) == MACHO_EFILE, "a missing file should fail with MACHO_EFILE");
+
+	macho_destroy_handle(handle);
+	exit(!ok);
+}
+static bool test_fixtures(void) {
+	puts("Testing parsing the fixtures");
+	if (fork_test(forked_test_fixtures, "Error parsing the fixtures")) {
+		puts("\tOK");
+		return true;
+	}
+	puts("\tError");
+	return false;
+}
+
+/**
+ * Test parsing several files at once: the results are in input order and the same as those of
+ * parsing the files one by one.
+ */
+static void forked_test_parse_files(void) {
+	const char *names[] = { "x86_64.dylib", "not-macho.txt", "universal.dylib", "missing", "ppc.dylib", "x86_64.dylib", "truncated.dylib", "archive.a" };
+	const size_t count = sizeof(names) / sizeof(*names);
+	const char *paths[sizeof(names) / sizeof(*names)];
+	const macho_t *results[sizeof(names) / sizeof(*names)];
+	int statuses[sizeof(names) / sizeof(*names)];
+	macho_handle_t *handle, *single;
+	const macho_t *result;
+	bool ok = true;
+
+	for (size_t i = 0; i < count; i++) {
+		char *path = malloc(_POSIX_PATH_MAX);
+		if (path == NULL)
+			exit(EXIT_FAILURE);
+		snprintf(path, _POSIX_PATH_MAX, "%s", fixture(names[i]));
+		paths[i] = path;
+	}
+
+	handle = macho_create_handle();
+	single = macho_create_handle();
+	ok &= check(macho_parse_files(handle, paths, count, 4, results, statuses) == MACHO_SUCCESS, "macho_parse_files failed");
+	for (size_t i = 0; i < count; i++) {
+		int ret = macho_parse_file(single, paths[i], &result);
+		if (!check(statuses[i] == ret, "status differs from macho_parse_file")) {
+			printf("\t%s: %d vs. %d\n", names[i], statuses[i], ret);
+			ok = false;
+		} else if (ret == MACHO_SUCCESS) {
+			size_t archs = count_archs(result);
+			ok &= check(count_archs(results[i]) == archs, "result differs from macho_parse_file");
+		}
+	}
+	ok &= check(results[0] == results[5], "a file given twice has different results");
+
+	// known results are returned without parsing the files again
+	ok &= check(macho_parse_file(handle, paths[2], &result) == MACHO_SUCCESS && result == results[2], "result not reused by macho_parse_file");
+	ok &= check(macho_parse_files(handle, paths, count, 0, results, statuses) == MACHO_SUCCESS && results[2] == result, "result not reused by macho_parse_files");
+	ok &= check(macho_parse_files(handle, paths, 0, 0, results, statuses) == MACHO_SUCCESS, "parsing no files failed");
+
+	macho_destroy_handle(single);
+	macho_destroy_handle(handle);
+	for (size_t i = 0; i < count; i++)
+		free((char *) paths[i]);
+	exit(!ok);
+}
+static bool test_parse_files(void) {
+	puts("Testing parsing several files at once");
+	if (fork_test(forked_test_parse_files, "Error parsing several files at once")) {
+		puts("\tOK");
+		return true;
+	}
+	puts("\tError");
+	return false;
+}
+
+/**
+ * Test the persistent cache: results are reused as long as the file is
+ * unchanged, even if its contents have changed behind the cache's back.
+ */
+static void forked_test_cache(void) {
+	macho_handle_t *handle;
+	const macho_t *result;
+	struct utimbuf times = { 1000000000, 1000000000 };
+	bool ok = true;
+	FILE *f;
+
+	unlink(TEST_CACHE_PATH);
+	copy_file(fixture("x86_64.dylib"), TEST_COPY_PATH);
+	// whole seconds, so that utime(3) can restore the exact time below
+	utime(TEST_COPY_PATH, &times);
+
+	// a cold run fills the cache
+	handle = macho_create_handle();
+	ok &= check(macho_cache_open(handle, TEST_CACHE_PATH) == MACHO_SUCCESS, "opening a missing cache failed");
+	ok &= check(macho_parse_file(handle, TEST_COPY_PATH, &result) == MACHO_SUCCESS, "parsing the copy failed");
+	ok &= check(macho_parse_file(handle, fixture("not-macho.txt"), &result) == MACHO_EMAGIC, "not-macho.txt should fail with MACHO_EMAGIC");
+	ok &= check(macho_cache_save(handle) == MACHO_SUCCESS, "saving the cache failed");
+	macho_destroy_handle(handle);
+
+	// overwrite the copy in place without changing its size or time
+	f = fopen(TEST_COPY_PATH, "r+b");
+	for (int i = 0; f && i < 32; i++) {
+		fputc('x', f);
+	}
+	if (f) {
+		fclose(f);
+	}
+	utime(TEST_COPY_PATH, &times);
+
+	// a warm run uses the cached results without reading the file
+	handle = macho_create_handle();
+	ok &= check(macho_cache_open(handle, TEST_CACHE_PATH) == MACHO_SUCCESS, "opening the cache failed");
+	if (check(macho_parse_file(handle, TEST_COPY_PATH, &result) == MACHO_SUCCESS, "cached result not used")) {
+		ok &= check(count_archs(result) == 1 && check_fixture_arch(result->mt_archs, "x86_64"), "cached result differs");
+		const macho_t *again;
+		ok &= check(macho_parse_file(handle, TEST_COPY_PATH, &again) == MACHO_SUCCESS && again == result, "result not reused within a handle");
+	} else {
+		ok = false;
+	}
+	ok &= check(macho_parse_file(handle, fixture("not-macho.txt"), &result) == MACHO_EMAGIC, "cached MACHO_EMAGIC not used");
+	macho_destroy_handle(handle);
+
+	// once the time changes, the file is parsed again
+	times.modtime++;
+	utime(TEST_COPY_PATH, &times);
+	handle = macho_create_handle();
+	ok &= check(macho_cache_open(handle, TEST_CACHE_PATH) == MACHO_SUCCESS, "opening the cache failed");
+	ok &= check(macho_parse_file(handle, TEST_COPY_PATH, &result) == MACHO_EMAGIC, "modified file not parsed again");
+	macho_destroy_handle(handle);
+
+	// a corrupt cache is ignored
+	f = fopen(TEST_CACHE_PATH, "r+b");
+	if (f) {
+		fputs("garbage", f);
+		fclose(f);
+	}
+	handle = macho_create_handle();
+	ok &= check(macho_cache_open(handle, TEST_CACHE_PATH) == MACHO_SUCCESS, "opening a corrupt cache failed");
+	ok &= check(macho_parse_file(handle, fixture("x86_64.dylib"), &result) == MACHO_SUCCESS, "parsing with a corrupt cache failed");
+	macho_destroy_handle(handle);
+
+	unlink(TEST_CACHE_PATH);
+	unlink(TEST_COPY_PATH);
+	exit(!ok);
+}
+static bool test_cache(void) {
+	puts("Testing the persistent cache");
+	if (fork_test(forked_test_cache, "Error using the persistent cache")) {
+		puts("\tOK");
+		return true;
+	}
+	puts("\tError");
+	return false;
+}
+
+int main(int argc, char *argv[]) {
 	bool result = true;
+	if (argc > 1) {
+		fixtures_dir = argv[1];
+	}
+#ifdef __MACH__
 	result &= test_destroy_null();
 	result &= test_handle();
 	result &= test_format_dylib_version();
 	result &= test_libsystem();
 	result &= test_archive();
-	return !result;
-#else
-	return 0;
 #endif
+	result &= test_fixtures();
+	result &= test_parse_files();
+	result &= test_cache();
+	return !result;
 }
 
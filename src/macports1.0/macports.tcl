@@ -53,6 +53,7 @@ namespace eval macports {
         universal_archs build_arch macosx_sdk_version macosx_deployment_target \
         macportsuser proxy_override_env proxy_http proxy_https proxy_ftp proxy_rsync proxy_skip \
         master_site_local patch_site_local archive_site_local fetch_credentials fetch_threads \
+        fetch_segments parallel_builds \
         buildfromsource revupgrade_autorun revupgrade_mode revupgrade_check_id_loadcmds \
         host_blacklist preferred_hosts sandbox_enable sandbox_network delete_la_files cxx_stdlib \
         default_compilers pkg_post_unarchive_deletions ui_interactive] {
@@ -75,6 +76,7 @@ namespace eval macports {
         rsync_server rsync_options rsync_dir startupitem_autostart startupitem_type startupitem_install \
         place_worksymlink macportsuser sudo_user \
         configureccache ccache_dir ccache_size configuredistcc configurepipe buildnicevalue buildmakejobs \
+        fetch_segments \
         applications_dir applications_dir_frozen current_phase frameworks_dir frameworks_dir_frozen \
         developer_dir universal_archs build_arch os_arch os_endian os_version os_major os_minor \
         os_platform os_subplatform macos_version macos_version_major macosx_version macosx_sdk_version \
@@ -103,6 +105,13 @@ namespace eval macports {
     # maps porturls to the list of open mports with each url
     variable open_mports [dict create]
 
+    # Worker interpreters with port1.0 loaded that mportclose has reset
+    # for reuse by mportopen, at most worker_pool_size of them, and the
+    # configuration each pooled or open worker was initialised with
+    variable worker_pool [list]
+    variable worker_pool_size 4
+    variable worker_signatures [dict create]
+
     variable ui_priorities [list error warn msg notice info debug any]
     variable ui_priority_prefixes [dict create]
     variable current_phase main
@@ -117,6 +126,8 @@ namespace eval macports {
     variable pending_pings [dict create]
     variable tool_path_cache [dict create]
     variable variant_descriptions [dict create]
+    # PortIndex files for which no binary index is available
+    variable binindex_unavailable [dict create]
 
     variable getprotocol_re {(?x)([^:]+)://.+}
     variable file_porturl_re {^file://(.*)}
@@ -1073,6 +1084,8 @@ proc mportinit {{up_ui_options {}} {up_options {}} {up_variations {}}} {
         macports::preferred_hosts \
         macports::fetch_credentials \
         macports::fetch_threads \
+        macports::fetch_segments \
+        macports::parallel_builds \
         macports::keeplogs \
         macports::place_worksymlink \
         macports::revupgrade_autorun \
@@ -1917,6 +1930,22 @@ match macports.conf.default."
         set fetch_threads 2
     }
 
+    if {[info exists fetch_segments] && (![string is integer -strict $fetch_segments] || $fetch_segments < 1)} {
+        ui_error "fetch_segments must be a positive integer"
+        unset fetch_segments
+    }
+    if {![info exists fetch_segments]} {
+        set fetch_segments 1
+    }
+
+    if {[info exists parallel_builds] && (![string is integer -strict $parallel_builds] || $parallel_builds < 1)} {
+        ui_error "parallel_builds must be a positive integer"
+        unset parallel_builds
+    }
+    if {![info exists parallel_builds]} {
+        set parallel_builds 1
+    }
+
     # Proxy handling (done this late since Pextlib is needed)
     if {![info exists proxy_override_env] || ![string is true -strict $proxy_override_env]} {
         set proxy_override_env no
@@ -2034,6 +2063,13 @@ proc mportshutdown {} {
     global macports::portdbpath
     # close the registry down so the cleanup stuff is called, e.g. vacuuming the db
     registry::close
+    # delete the pooled worker interpreters
+    global macports::worker_pool macports::worker_signatures
+    foreach workername $worker_pool {
+        interp delete $workername
+    }
+    set worker_pool [list]
+    set worker_signatures [dict create]
     # save cached values
     if {[file writable $portdbpath]} {
         global macports::ping_cache macports::compiler_version_cache \
@@ -2107,6 +2143,14 @@ proc macports::copy_xcode_plist {target_homedir} {
 }
 
 proc macports::worker_init {workername portpath porturl portbuildpath options variations} {
+    worker_setup $workername
+    worker_set_options $workername $portpath $porturl $portbuildpath $options $variations
+}
+
+# Set up everything in a worker interpreter that does not depend on the
+# port opened in it. The portinterp_options portpath, porturl and
+# portbuildpath are set by worker_set_options.
+proc macports::worker_setup {workername} {
     variable portinterp_options; variable portinterp_deferred_options
     variable portinterp_private_options
     variable ui_priorities; variable ui_options
@@ -2347,6 +2391,15 @@ proc macports::worker_init {workername portpath porturl portbuildpath options va
             $workername eval [list set system_options($opt) [set $opt]]
         }
     }
+}
+
+# Pass the paths, options and variations of the port opened in a worker
+# interpreter to it.
+proc macports::worker_set_options {workername portpath porturl portbuildpath options variations} {
+    foreach opt {portpath porturl portbuildpath} {
+        $workername eval [list set system_options($opt) [set $opt]]
+        $workername eval [list set $opt [set $opt]]
+    }
 
     foreach {opt val} $options {
         $workername eval [list set user_options($opt) $val]
@@ -2359,6 +2412,102 @@ proc macports::worker_init {workername portpath porturl portbuildpath options va
     }
 }
 
+# The configuration that worker_setup passes to a worker interpreter.
+# Pooled workers can only be reused while it stays the same.
+proc macports::worker_signature {} {
+    variable portinterp_options; variable portinterp_private_options
+    variable ui_options
+    set signature [list]
+    foreach opt [concat $portinterp_options $portinterp_private_options] {
+        variable $opt
+        if {[info exists $opt]} {
+            lappend signature $opt [set $opt]
+        }
+    }
+    if {[info exists ui_options(notifications_append)]} {
+        lappend signature notifications_append $ui_options(notifications_append)
+    }
+    return $signature
+}
+
+# Return a worker interpreter for opening a port with the given options
+# and variations, reusing one from the pool if possible. Pooled workers
+# have port1.0 loaded already, which is most of the cost of setting up
+# a new one.
+proc macports::worker_acquire {portpath porturl portbuildpath options variations} {
+    variable worker_pool; variable worker_signatures
+    set signature [worker_signature]
+    set workername ""
+    while {$workername eq "" && [llength $worker_pool] > 0} {
+        set workername [lindex $worker_pool end]
+        set worker_pool [lrange $worker_pool 0 end-1]
+        if {[dict get $worker_signatures $workername] ne $signature} {
+            dict unset worker_signatures $workername
+            interp delete $workername
+            set workername ""
+        }
+    }
+    if {$workername eq ""} {
+        set workername [interp create]
+        worker_setup $workername
+        if {[catch {$workername eval {
+                package require port 1.0
+                portutil::_snapshot_state
+            }}]} {
+            # Let sourcing the Portfile report the problem.
+            ui_debug "Not pooling worker: $::errorInfo"
+            interp delete $workername
+            set workername [interp create]
+            worker_init $workername $portpath $porturl $portbuildpath $options $variations
+            return $workername
+        }
+        dict set worker_signatures $workername $signature
+    }
+
+    # Setting an option that has an option_proc after port1.0 is loaded
+    # runs the option_proc, which does not happen when it is set before
+    # the Portfile loads port1.0, so use a new worker for those.
+    if {[$workername eval [list apply {{options} {
+            global option_procs
+            foreach opt [dict keys $options] {
+                if {[info exists option_procs($opt)]} {
+                    return 1
+                }
+            }
+            return 0
+        }} $options]]} {
+        worker_release $workername
+        set workername [interp create]
+        worker_init $workername $portpath $porturl $portbuildpath $options $variations
+        return $workername
+    }
+    # portmain.tcl records the ids that the port starts with when port1.0
+    # is loaded, which can differ by now for a pooled worker.
+    $workername eval {
+        set euid [geteuid]
+        set egid [getegid]
+    }
+    worker_set_options $workername $portpath $porturl $portbuildpath $options $variations
+    return $workername
+}
+
+# Reset a worker interpreter that is no longer used and return it to the
+# pool, or delete it if it can not be reused.
+proc macports::worker_release {workername} {
+    variable worker_pool; variable worker_pool_size; variable worker_signatures
+    catch {$workername eval [list portutil::_async_cleanup]}
+    if {[dict exists $worker_signatures $workername]
+            && [llength $worker_pool] < $worker_pool_size
+            && [dict get $worker_signatures $workername] eq [worker_signature]
+            && ![catch {$workername eval [list portutil::_restore_state]} restored]
+            && $restored} {
+        lappend worker_pool $workername
+        return
+    }
+    dict unset worker_signatures $workername
+    interp delete $workername
+}
+
 # Create a thread with most configuration options set.
 # The newly created thread is sent portinterp_options vars and knows where to
 # find all packages we know.
@@ -2730,7 +2879,7 @@ proc mportopen {porturl {options {}} {variations {}} {nocache {}}} {
         return -code error "Could not find Portfile in $portpath"
     }
 
-    set workername [interp create]
+    set workername [macports::worker_acquire $portpath $porturl [macports::getportbuildpath $portpath] $options $variations]
 
     set mport [ditem_create]
     dict lappend open_mports $porturl $mport
@@ -2741,8 +2890,6 @@ proc mportopen {porturl {options {}} {variations {}} {nocache {}}} {
     ditem_key $mport variations $variations
     ditem_key $mport refcnt 1
 
-    macports::worker_init $workername $portpath $porturl [macports::getportbuildpath $portpath] $options $variations
-
     if {[catch {$workername eval [list source $portfilepath]} result]} {
         mportclose $mport
         ui_debug $::errorInfo
@@ -3113,6 +3260,272 @@ proc macports::async_fetch_mport {target mport} {
     }
 }
 
+# Install the ports in dlist, building up to $jobs of them at the same time
+# once their dependencies are active. The phases up to destroot of each port
+# run in a child process, since they change the working directory, the
+# environment and the effective user of the process they run in. Installing
+# and activating write to the registry and the prefix and are serialized in
+# this process, as are ports that don't need to be built at all (e.g.
+# because an archive is available). The build logs end up in the usual
+# per-port main.log.
+# Returns like dlist_eval with the handler _mportexec activate: the list of
+# ditems that were not installed, with the reason in the variable named by
+# reason_var.
+proc macports::_mportexec_parallel {dlist jobs {reason_var dlist_eval_reason}} {
+    upvar $reason_var reason
+    set reason ""
+    variable build_jobs [dict create] build_chans [dict create]
+    array set statusdict [list]
+
+    foreach ditem $dlist {
+        if {[_mportactive $ditem] == 1} {
+            foreach token [ditem_key $ditem provides] {
+                set statusdict($token) 1
+            }
+            dlist_delete dlist $ditem
+        }
+    }
+
+    set building [list]
+    # An interrupt ends up as an error here, usually while waiting for a
+    # child, which must not be left running on its own.
+    try {
+        while {[llength $dlist] > 0} {
+            # Don't start anything new once something failed, but let the
+            # running builds finish.
+            set ditem {}
+            if {$reason eq ""} {
+                set ditem [_build_job_next $dlist statusdict $building]
+            }
+            if {$ditem ne {}} {
+                set workername [ditem_key $ditem workername]
+                if {![_target_needs_toolchain $workername activate]} {
+                    set result [_build_job_handler $ditem]
+                    foreach token [ditem_key $ditem provides] {
+                        set statusdict($token) [expr {$result == 0}]
+                    }
+                    if {$result == 0} {
+                        dlist_delete dlist $ditem
+                    } else {
+                        set reason handler
+                    }
+                    continue
+                }
+                if {[llength $building] < $jobs} {
+                    if {[_build_job_start $ditem] == 0} {
+                        lappend building $ditem
+                    } else {
+                        set reason handler
+                    }
+                    continue
+                }
+            }
+
+            if {[llength $building] == 0} {
+                if {$reason eq ""} {
+                    set reason unmet_deps
+                }
+                break
+            }
+
+            lassign [_build_job_wait] ditem status
+            set building [lsearch -all -inline -not -exact $building $ditem]
+            if {$status == 0 && $reason eq ""} {
+                # the statefile lets this skip the phases the child completed
+                set result [_build_job_handler $ditem]
+            } else {
+                set result 1
+            }
+            foreach token [ditem_key $ditem provides] {
+                set statusdict($token) [expr {$result == 0}]
+            }
+            if {$result == 0} {
+                dlist_delete dlist $ditem
+            } elseif {$reason eq ""} {
+                set reason handler
+            }
+        }
+    } on error {eMessage eOptions} {
+        _build_job_kill
+        return -options $eOptions $eMessage
+    }
+
+    return $dlist
+}
+
+# Select the next ditem for _mportexec_parallel, like dlist_get_next, but
+# skipping the ditems that are being built. Those still count as pending
+# for the soft dependencies of the others.
+proc macports::_build_job_next {dlist statusdict building} {
+    upvar $statusdict upstatus
+    foreach ditem $dlist {
+        if {$ditem in $building
+                || [dlist_count_unmet $dlist upstatus [ditem_key $ditem requires]]} {
+            continue
+        }
+        set uses [ditem_key $ditem uses]
+        if {[dlist_count_unmet $dlist upstatus $uses] > 0 && [dlist_has_pending $dlist $uses]} {
+            continue
+        }
+        return $ditem
+    }
+    return {}
+}
+
+# Run _mportexec activate on a ditem in this process, catching errors the
+# way dlist_eval does.
+proc macports::_build_job_handler {ditem} {
+    if {[catch {_mportexec activate $ditem} result]} {
+        ui_debug $::errorInfo
+        ui_error $result
+        return 1
+    }
+    if {$result eq {}} {
+        return 0
+    }
+    return $result
+}
+
+# Start a child process building the port in ditem up to destroot. Returns
+# 0 if the child was started.
+proc macports::_build_job_start {ditem} {
+    variable build_jobs; variable fetch_threads
+    set workername [ditem_key $ditem workername]
+
+    # Let the background downloads started by async_fetch_mport complete
+    # here, rather than having the child race them for the same files.
+    if {$fetch_threads > 0} {
+        push_log $ditem
+        if {[catch {$workername eval [list eval_targets fetch]} result] || $result != 0} {
+            variable logenabled; variable debuglogname
+            if {[info exists logenabled] && $logenabled && [info exists debuglogname]} {
+                ui_error "See $debuglogname for details."
+            }
+            pop_log
+            return 1
+        }
+        pop_log
+    }
+
+    variable ui_options; variable global_options; variable global_variations
+    set spec [dict create \
+        porturl [ditem_key $ditem porturl] \
+        options [ditem_key $ditem options] \
+        variations [ditem_key $ditem variations] \
+        ui_options [array get ui_options ports_*] \
+        global_options [dict replace [array get global_options] ports_autoclean no] \
+        global_variations [array get global_variations]]
+    set script [join [list \
+        [list chan configure stdout -buffering line] \
+        [list set auto_path $::auto_path] \
+        [list package require macports] \
+        [list macports::_build_job_run $spec]] \n]
+
+    # The child runs mportinit again, so give it the environment this
+    # process was started with rather than the one mportinit set up.
+    global env
+    variable user_home; variable user_path
+    set saved_env [list HOME $env(HOME) PATH $env(PATH)]
+    set env(HOME) $user_home
+    set env(PATH) $user_path
+    set saved_ids {}
+    if {[getuid] == 0 && [geteuid] != 0} {
+        set saved_ids [list [geteuid] [getegid]]
+        seteuid 0; setegid 0
+    }
+    try {
+        set fd [open |[list [info nameofexecutable] << $script 2>@1] r]
+    } on error {eMessage} {
+        ui_error "Failed to start building [ditem_key $ditem provides]: $eMessage"
+        return 1
+    } finally {
+        array set env $saved_env
+        if {$saved_ids ne {}} {
+            lassign $saved_ids euid egid
+            setegid $egid
+            seteuid $euid
+        }
+    }
+
+    ui_debug "Building [ditem_key $ditem provides] in process [pid $fd]"
+    chan configure $fd -blocking 0
+    variable build_chans
+    dict set build_jobs $ditem {}
+    dict set build_chans $ditem $fd
+    chan event $fd readable [list macports::_build_job_output $ditem $fd]
+    return 0
+}
+
+# Pass on the output of a child started by _build_job_start, and record its
+# exit status once it is done.
+proc macports::_build_job_output {ditem fd} {
+    if {[chan gets $fd line] >= 0} {
+        variable channels
+        foreach chan $channels(msg) {
+            puts $chan $line
+        }
+        return
+    }
+    if {[chan eof $fd]} {
+        variable build_jobs; variable build_chans
+        dict unset build_chans $ditem
+        chan configure $fd -blocking 1
+        dict set build_jobs $ditem [catch {chan close $fd}]
+    }
+}
+
+# Terminate the children started by _build_job_start that are still
+# running and wait for them to exit.
+proc macports::_build_job_kill {} {
+    variable build_chans
+    dict for {ditem fd} $build_chans {
+        ui_debug "Terminating build of [ditem_key $ditem provides] in process [pid $fd]"
+        catch {exec kill -TERM {*}[pid $fd]}
+    }
+    dict for {ditem fd} $build_chans {
+        chan event $fd readable {}
+        chan configure $fd -blocking 1
+        catch {chan close $fd}
+    }
+    set build_chans [dict create]
+}
+
+# Wait until one of the children started by _build_job_start exits. Returns
+# the ditem it was building and its exit status.
+proc macports::_build_job_wait {} {
+    variable build_jobs
+    while {1} {
+        dict for {ditem status} $build_jobs {
+            if {$status ne {}} {
+                dict unset build_jobs $ditem
+                return [list $ditem $status]
+            }
+        }
+        vwait macports::build_jobs
+    }
+}
+
+# Entry point of the children started by _build_job_start: open the port
+# described by spec and run it up to destroot, then exit with the result.
+proc macports::_build_job_run {spec} {
+    array set up_ui_options [dict get $spec ui_options]
+    array set up_options [dict get $spec global_options]
+    array set up_variations [dict get $spec global_variations]
+    set status 1
+    try {
+        mportinit up_ui_options up_options up_variations
+        set mport [mportopen [dict get $spec porturl] [dict get $spec options] [dict get $spec variations]]
+        set status [_mportexec destroot $mport]
+        mportclose $mport
+        mportshutdown
+    } on error {eMessage} {
+        ui_debug $::errorInfo
+        ui_error $eMessage
+        set status 1
+    }
+    exit $status
+}
+
 # mportexec
 # Execute the specified target of the given mport.
 proc mportexec {mport target} {
@@ -3225,7 +3638,12 @@ proc mportexec {mport target} {
         macports::async_fetch_mport $target $mport
 
         # install them
-        set result [dlist_eval $dlist _mportactive [list _mportexec activate]]
+        global macports::parallel_builds
+        if {$parallel_builds > 1 && ![macports::global_option_isset ports_dryrun]} {
+            set result [macports::_mportexec_parallel $dlist $parallel_builds]
+        } else {
+            set result [dlist_eval $dlist _mportactive [list _mportexec activate]]
+        }
 
         if {[getuid] == 0 && [geteuid] != 0} {
             seteuid 0; setegid 0
@@ -3544,6 +3962,40 @@ proc macports::getindex {source} {
     return [file join [macports::getsourcepath $source] PortIndex]
 }
 
+##
+# Returns the path of an up-to-date binary PortIndex for the given source,
+# generating it first if it is missing or outdated and the index directory is
+# writable. Private API of macports1.0, do not use this from outside
+# macports1.0.
+#
+# @param source the source URL
+# @return the path of the binary index, or an empty string if there is none
+proc macports::getbinindex {source} {
+    variable binindex_unavailable
+    set index [getindex $source]
+    if {[dict exists $binindex_unavailable $index]} {
+        return {}
+    }
+    set binindex ${index}.bin
+    if {![catch {portindex valid $binindex $index} valid] && $valid} {
+        return $binindex
+    }
+    set generated 0
+    if {[file isfile $index] && [file writable [file dirname $index]]} {
+        macports_try -pass_signal {
+            mports_generate_binindex $index
+            set generated 1
+        } on error {eMessage} {
+            ui_debug "Generating binary index for $index failed: $eMessage"
+        }
+    }
+    if {$generated} {
+        return $binindex
+    }
+    dict set binindex_unavailable $index 1
+    return {}
+}
+
 # macports::VCSPrepare
 #
 # Prepare to run a VCS command in the given directory, including
@@ -3792,8 +4244,10 @@ proc macports::delete_ports_not_in_tarball {extractdir tarball} {
     if {[file isfile $indexfile]} {
         file mkdir ${extractdir}/tmp
         file rename -force $indexfile ${extractdir}/tmp/
-        if {[file isfile ${indexfile}.quick]} {
-            file rename -force ${indexfile}.quick ${extractdir}/tmp/
+        foreach ext {quick bin} {
+            if {[file isfile ${indexfile}.${ext}]} {
+                file rename -force ${indexfile}.${ext} ${extractdir}/tmp/
+            }
         }
     }
     package require tar
@@ -3819,9 +4273,11 @@ proc macports::delete_ports_not_in_tarball {extractdir tarball} {
         set cur_uid [getuid]
         file rename -force ${extractdir}/tmp/PortIndex $indexfile
         chown $indexfile $cur_uid
-        if {[file isfile ${extractdir}/tmp/PortIndex.quick]} {
-            file rename -force ${extractdir}/tmp/PortIndex.quick ${indexfile}.quick
-            chown ${indexfile}.quick $cur_uid
+        foreach ext {quick bin} {
+            if {[file isfile ${extractdir}/tmp/PortIndex.${ext}]} {
+                file rename -force ${extractdir}/tmp/PortIndex.${ext} ${indexfile}.${ext}
+                chown ${indexfile}.${ext} $cur_uid
+            }
         }
     }
     file delete -force ${extractdir}/tmp
@@ -4062,6 +4518,9 @@ proc mportsync {{options {}}} {
                         }
                         if {$ok} {
                             mports_generate_quickindex $indexfile
+                            if {[catch {mports_generate_binindex $indexfile} result]} {
+                                ui_debug "Generating binary index for $indexfile failed: $result"
+                            }
                         }
                     } on error {} {
                         ui_debug "Synchronization of the PortIndex failed doing rsync"
@@ -4223,7 +4682,7 @@ proc mportsync {{options {}}} {
                 set group [file attributes $indexdir -group]
                 if {$cur_uid == 0} {
                     # Ensure any existing index can be read and written
-                    foreach f [list $indexfile ${indexfile}.quick] {
+                    foreach f [list $indexfile ${indexfile}.quick ${indexfile}.bin] {
                         if {[file isfile $f] && [file attributes $f -owner] ne $owner} {
                             file attributes $f -owner $owner
                             file attributes $f -permissions 0644
@@ -4306,6 +4765,13 @@ proc mportsearch {pattern {case_sensitive yes} {matchstyle regexp} {field name}}
     foreach source $sources {
         set source [lindex $source 0]
         set porturl_prefix [dict get $porturl_prefix_map $source]
+        set binindex [macports::getbinindex $source]
+        if {$binindex ne {} && ![catch {portindex search $binindex $pattern \
+                $case_sensitive $matchstyle $field $porturl_prefix} binmatches]} {
+            incr found 1
+            lappend matches {*}$binmatches
+            continue
+        }
         macports_try -pass_signal {
             set fd [open [macports::getindex $source] r]
 
@@ -4386,8 +4852,8 @@ proc mportsearch {pattern {case_sensitive yes} {matchstyle regexp} {field name}}
 # PortIndex, and name matching is case-insensitive. Unlike mportsearch, only
 # the first match is returned, but the return format is otherwise identical.
 # The advantage is that mportlookup is usually much faster than mportsearch,
-# due to the use of the quick index, which is a name-based index into the
-# PortIndex.
+# due to the use of the binary index or the quick index, which are name-based
+# indexes into the PortIndex.
 #
 # @param name name of the port to look up. Returns the first match while
 #             traversing the sources in-order.
@@ -4403,6 +4869,30 @@ proc mportlookup {name} {
     set matches [list]
     set normname [string tolower $name]
     foreach source $sources {
+        set binindex [macports::getbinindex [lindex $source 0]]
+        if {$binindex ne {}} {
+            if {![catch {portindex lookup $binindex $name \
+                    [dict get $porturl_prefix_map [lindex $source 0]]} matches]} {
+                incr sourceno 1
+                if {[llength $matches] > 0} {
+                    break
+                }
+                continue
+            }
+            set matches [list]
+        }
+        # the quick index is not loaded for sources that had a binary index
+        if {![dict exists $quick_index $sourceno]} {
+            set index [macports::getindex [lindex $source 0]]
+            dict set quick_index $sourceno [dict create]
+            if {[file exists $index]} {
+                macports_try -pass_signal {
+                    dict set quick_index $sourceno [_mports_read_quickindex $index]
+                } on error {} {
+                    ui_warn "Can't open quick index file for source: [lindex $source 0]"
+                }
+            }
+        }
         if {![dict exists $quick_index $sourceno $normname]} {
             # no entry in this source, advance to next source
             incr sourceno 1
@@ -4459,6 +4949,12 @@ proc mportlistall {} {
     foreach source $sources {
         set source [lindex $source 0]
         set porturl_prefix [dict get $porturl_prefix_map $source]
+        set binindex [macports::getbinindex $source]
+        if {$binindex ne {} && ![catch {portindex listall $binindex $porturl_prefix} binmatches]} {
+            incr found 1
+            lappend matches {*}$binmatches
+            continue
+        }
         macports_try -pass_signal {
             set fd [open [macports::getindex $source] r]
 
@@ -4502,45 +4998,30 @@ proc macports::load_quickindex {name1 name2 op} {
 
 ##
 # Loads PortIndex.quick from each source into the quick_index, generating it
-# first if necessary. Private API of macports1.0, do not use this from outside
-# macports1.0.
+# first if necessary. Sources with a binary index are looked up using that
+# instead and are skipped. Private API of macports1.0, do not use this from
+# outside macports1.0.
 proc _mports_load_quickindex {} {
-    global macports::quick_index macports::sources
+    global macports::quick_index macports::sources macports::binindex_unavailable
 
     set quick_index [dict create]
+    # indexes may have been regenerated since the last attempt
+    set binindex_unavailable [dict create]
 
     set sourceno 0
     foreach source $sources {
-        unset -nocomplain quicklist
         # chop off any tags
         set source [lindex $source 0]
         set index [macports::getindex $source]
-        if {![file exists $index]} {
+        if {![file exists $index] || [macports::getbinindex $source] ne {}} {
             incr sourceno
             continue
         }
-        if {![file exists ${index}.quick]} {
-            ui_warn "No quick index file found, attempting to generate one for source: $source"
-            macports_try -pass_signal {
-                set quicklist [mports_generate_quickindex $index]
-            } on error {} {
-                incr sourceno
-                continue
-            }
-        }
-        # only need to read the quick index file if we didn't just update it
-        if {![info exists quicklist]} {
-            macports_try -pass_signal {
-                set fd [open ${index}.quick r]
-            } on error {} {
-                ui_warn "Can't open quick index file for source: $source"
-                incr sourceno
-                continue
-            }
-            set quicklist [read -nonewline $fd]
-            close $fd
+        macports_try -pass_signal {
+            dict set quick_index ${sourceno} [_mports_read_quickindex $index]
+        } on error {} {
+            ui_warn "Can't open quick index file for source: $source"
         }
-        dict set quick_index ${sourceno} [dict create {*}$quicklist]
         incr sourceno
     }
     if {!$sourceno} {
@@ -4548,6 +5029,24 @@ proc _mports_load_quickindex {} {
     }
 }
 
+##
+# Reads the PortIndex.quick for a PortIndex, generating it first if necessary.
+# Private API of macports1.0, do not use this from outside macports1.0.
+#
+# @param index the PortIndex file
+# @return a dict mapping lowercase port names to offsets in the PortIndex
+# @throws if the quick index cannot be generated or read
+proc _mports_read_quickindex {index} {
+    if {![file exists ${index}.quick]} {
+        ui_warn "No quick index file found, attempting to generate one for index: $index"
+        return [dict create {*}[mports_generate_quickindex $index]]
+    }
+    set fd [open ${index}.quick r]
+    set quicklist [read -nonewline $fd]
+    close $fd
+    return [dict create {*}$quicklist]
+}
+
 ##
 # Generates a PortIndex.quick file from a PortIndex by using the name field as
 # key. This allows fast indexing into the PortIndex when using the port name as
@@ -4606,6 +5105,22 @@ proc mports_generate_quickindex {index} {
     }
 }
 
+##
+# Generates a binary index from a PortIndex, which allows looking up and
+# searching ports without parsing the PortIndex. It is only valid as long as
+# the PortIndex is not modified.
+#
+# @param index the PortIndex file to create the index for. The resulting binary
+#              index will be in a file named like \a index, but with ".bin"
+#              appended.
+# @throws if the given \a index cannot be read or is corrupt, or the binary
+#         index cannot be written.
+proc mports_generate_binindex {index} {
+    global macports::binindex_unavailable
+    portindex build $index ${index}.bin
+    dict unset binindex_unavailable $index
+}
+
 proc mportinfo {mport} {
     set workername [ditem_key $mport workername]
     return [dict create {*}[$workername eval [list array get PortInfo]]]
@@ -4628,9 +5143,7 @@ proc mportclose {mport} {
             }
         }
         dict unset pending_log_messages $mport
-        set workername [ditem_key $mport workername]
-        catch {$workername eval [list portutil::_async_cleanup]}
-        interp delete $workername
+        macports::worker_release [ditem_key $mport workername]
         #if {[info exists macports::extracted_portdirs($porturl)]} {
             # TODO port.tcl calls mportopen multiple times on the same port to
             # determine a number of attributes and will close the port after
@@ -6664,6 +7177,7 @@ proc macports::revupgrade_scanandrebuild {broken_port_counts_name options} {
     upvar $broken_port_counts_name broken_port_counts
     variable ui_options; variable ui_prefix
     variable cxx_stdlib; variable revupgrade_mode
+    variable portdbpath
 
     set fancy_output [expr {![macports::ui_isset ports_debug] && [info exists ui_options(progress_generic)]}]
     if {$fancy_output} {
@@ -6685,6 +7199,9 @@ proc macports::revupgrade_scanandrebuild {broken_port_counts_name options} {
         if {$handle eq "NULL"} {
             error "Error creating libmachista handle"
         }
+        # reuse what earlier runs found out about files that haven't changed
+        set machista_cache [file join $portdbpath cache machista]
+        machista::cache_open $handle $machista_cache
         array unset files_warned_about
         array set files_warned_about [list]
 
@@ -6693,82 +7210,61 @@ proc macports::revupgrade_scanandrebuild {broken_port_counts_name options} {
         }
 
         try {
+            # parse the binaries in batches on several threads, so that the
+            # progress display advances while they are parsed; each batch also
+            # covers most of the libraries its load commands refer to
+            set bpaths [lmap b $binaries {$b actual_path}]
+            set batch_size 256
             set i 1
-            foreach b $binaries {
-                if {$fancy_output} {
-                    if {$binary_count < 10000 || $i % 10 == 1} {
-                        $revupgrade_progress update $i $binary_count
+            for {set start 0} {$start < $binary_count} {incr start $batch_size} {
+                set batch [lrange $bpaths $start [expr {$start + $batch_size - 1}]]
+                set resultlists [machista::parse_files $handle $batch]
+
+                foreach bpath $batch resultlist $resultlists {
+                    if {$fancy_output} {
+                        if {$binary_count < 10000 || $i % 10 == 1} {
+                            $revupgrade_progress update $i $binary_count
+                        }
                     }
-                }
-                set bpath [$b actual_path]
-                #ui_debug "${i}/${binary_count}: $bpath"
-                incr i
+                    #ui_debug "${i}/${binary_count}: $bpath"
+                    incr i
 
-                set resultlist [machista::parse_file $handle $bpath]
-                set returncode [lindex $resultlist 0]
-                set result     [lindex $resultlist 1]
+                    lassign $resultlist returncode result
 
-                if {$returncode != $::machista::SUCCESS} {
-                    if {$returncode == $::machista::EMAGIC} {
-                        # not a Mach-O file
-                        # ignore silently, these are only static libs anyway
-                        #ui_debug "Error parsing file ${bpath}: [machista::strerror $returncode]"
-                    } else {
-                        if {$fancy_output} {
-                            $revupgrade_progress intermission
+                    if {$returncode != $::machista::SUCCESS} {
+                        if {$returncode == $::machista::EMAGIC} {
+                            # not a Mach-O file
+                            # ignore silently, these are only static libs anyway
+                            #ui_debug "Error parsing file ${bpath}: [machista::strerror $returncode]"
+                        } else {
+                            if {$fancy_output} {
+                                $revupgrade_progress intermission
+                            }
+                            ui_warn "Error parsing file ${bpath}: [machista::strerror $returncode]"
                         }
-                        ui_warn "Error parsing file ${bpath}: [machista::strerror $returncode]"
+                        continue;
                     }
-                    continue;
-                }
 
-                set architecture [$result cget -mt_archs]
-                while {$architecture ne "NULL"} {
-                    if {[dict exists $options ports_rev-upgrade_id-loadcmd-check] && [dict get $options ports_rev-upgrade_id-loadcmd-check]} {
-                        if {[$architecture cget -mat_install_name] ne "NULL" && [$architecture cget -mat_install_name] ne ""} {
-                            # check if this lib's install name actually refers to this file itself
-                            # if this is not the case software linking against this library might have erroneous load commands
-
-                            try {
-                                if {[catch {revupgrade_handle_special_paths $bpath [$architecture cget -mat_install_name]} idloadcmdpath]} {
-                                    set port [registry::entry owner $bpath]
-                                    if {$port ne ""} {
-                                        set portname [$port name]
-                                    } else {
-                                        set portname <unknown-port>
-                                    }
-                                    if {$fancy_output} {
-                                        $revupgrade_progress intermission
-                                    }
-                                    ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] (belonging to port $portname) contains a variable that could not be evaluated"
-                                } elseif {[string index $idloadcmdpath 0] ne "/"} {
-                                    set port [registry::entry owner $bpath]
-                                    if {$port ne ""} {
-                                        set portname [$port name]
-                                    } else {
-                                        set portname <unknown-port>
-                                    }
-                                    if {$fancy_output} {
-                                        $revupgrade_progress intermission
-                                    }
-                                    ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] (belonging to port $portname) contains relative path"
-                                } elseif {![file exists $idloadcmdpath]} {
-                                    set port [registry::entry owner $bpath]
-                                    if {$port ne ""} {
-                                        set portname [$port name]
-                                    } else {
-                                        set portname <unknown-port>
-                                    }
-                                    if {$fancy_output} {
-                                        $revupgrade_progress intermission
-                                    }
-                                    ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] refers to non-existent file $idloadcmdpath"
-                                    ui_warn "This is probably a bug in the $portname port and might cause problems in libraries linking against this file"
-                                } else {
-                                    set hash_this [sha256 file $bpath]
-                                    set hash_idloadcmd [sha256 file $idloadcmdpath]
+                    set architecture [$result cget -mt_archs]
+                    while {$architecture ne "NULL"} {
+                        if {[dict exists $options ports_rev-upgrade_id-loadcmd-check] && [dict get $options ports_rev-upgrade_id-loadcmd-check]} {
+                            if {[$architecture cget -mat_install_name] ne "NULL" && [$architecture cget -mat_install_name] ne ""} {
+                                # check if this lib's install name actually refers to this file itself
+                                # if this is not the case software linking against this library might have erroneous load commands
 
-                                    if {$hash_this ne $hash_idloadcmd} {
+                                try {
+                                    if {[catch {revupgrade_handle_special_paths $bpath [$architecture cget -mat_install_name]} idloadcmdpath]} {
+                                        set port [registry::entry owner $bpath]
+                                        if {$port ne ""} {
+                                            set portname [$port name]
+                                        } else {
+                                            set portname <unknown-port>
+                                        }
+                                        if {$fancy_output} {
+                                            $revupgrade_progress intermission
+                                        }
+                                        ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] (belonging to port $portname) contains a variable that could not be evaluated"
+                                    } elseif {[string index $idloadcmdpath 0] ne "/"} {
                                         set port [registry::entry owner $bpath]
                                         if {$port ne ""} {
                                             set portname [$port name]
@@ -6778,10 +7274,73 @@ proc macports::revupgrade_scanandrebuild {broken_port_counts_name options} {
                                         if {$fancy_output} {
                                             $revupgrade_progress intermission
                                         }
-                                        ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] refers to file ${idloadcmdpath}, which is a different file"
+                                        ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] (belonging to port $portname) contains relative path"
+                                    } elseif {![file exists $idloadcmdpath]} {
+                                        set port [registry::entry owner $bpath]
+                                        if {$port ne ""} {
+                                            set portname [$port name]
+                                        } else {
+                                            set portname <unknown-port>
+                                        }
+                                        if {$fancy_output} {
+                                            $revupgrade_progress intermission
+                                        }
+                                        ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] refers to non-existent file $idloadcmdpath"
                                         ui_warn "This is probably a bug in the $portname port and might cause problems in libraries linking against this file"
+                                    } else {
+                                        set hash_this [sha256 file $bpath]
+                                        set hash_idloadcmd [sha256 file $idloadcmdpath]
+
+                                        if {$hash_this ne $hash_idloadcmd} {
+                                            set port [registry::entry owner $bpath]
+                                            if {$port ne ""} {
+                                                set portname [$port name]
+                                            } else {
+                                                set portname <unknown-port>
+                                            }
+                                            if {$fancy_output} {
+                                                $revupgrade_progress intermission
+                                            }
+                                            ui_warn "ID load command in ${bpath}, arch [machista::get_arch_name [$architecture cget -mat_arch]] refers to file ${idloadcmdpath}, which is a different file"
+                                            ui_warn "This is probably a bug in the $portname port and might cause problems in libraries linking against this file"
+                                        }
+                                    }
+                                } trap {POSIX SIG SIGINT} {_ eOptions} {
+                                    if {$fancy_output} {
+                                        $revupgrade_progress intermission
                                     }
+                                    ui_debug [msgcat::mc "Aborted: SIGINT signal received"]
+                                    throw [dict get $eOptions -errorcode] [dict get $eOptions -errorinfo]
+                                } trap {POSIX SIG SIGTERM} {_ eOptions} {
+                                    if {$fancy_output} {
+                                        $revupgrade_progress intermission
+                                    }
+                                    ui_debug [msgcat::mc "Aborted: SIGTERM signal received"]
+                                    throw [dict get $eOptions -errorcode] [dict get $eOptions -errorinfo]
                                 }
+                            }
+                        }
+
+                        set archname [machista::get_arch_name [$architecture cget -mat_arch]]
+                        if {![arch_runnable $archname]} {
+                            ui_debug "skipping $archname in $bpath since this system can't run it anyway"
+                            set architecture [$architecture cget -next]
+                            continue
+                        }
+
+                        set loadcommand [$architecture cget -mat_loadcmds]
+
+                        while {$loadcommand ne "NULL"} {
+                            # see https://trac.macports.org/ticket/52700
+                            set LC_LOAD_WEAK_DYLIB 0x80000018
+                            if {[$loadcommand cget -mlt_type] == $LC_LOAD_WEAK_DYLIB} {
+                                ui_debug "[msgcat::mc "Skipping weakly-linked"] [$loadcommand cget -mlt_install_name]"
+                                set loadcommand [$loadcommand cget -next]
+                                continue
+                            }
+
+                            try {
+                                set filepath [revupgrade_handle_special_paths $bpath [$loadcommand cget -mlt_install_name]]
                             } trap {POSIX SIG SIGINT} {_ eOptions} {
                                 if {$fancy_output} {
                                     $revupgrade_progress intermission
@@ -6794,105 +7353,70 @@ proc macports::revupgrade_scanandrebuild {broken_port_counts_name options} {
                                 }
                                 ui_debug [msgcat::mc "Aborted: SIGTERM signal received"]
                                 throw [dict get $eOptions -errorcode] [dict get $eOptions -errorinfo]
+                            } on error {} {
+                                set loadcommand [$loadcommand cget -next]
+                                continue
                             }
-                        }
-                    }
-
-                    set archname [machista::get_arch_name [$architecture cget -mat_arch]]
-                    if {![arch_runnable $archname]} {
-                        ui_debug "skipping $archname in $bpath since this system can't run it anyway"
-                        set architecture [$architecture cget -next]
-                        continue
-                    }
 
-                    set loadcommand [$architecture cget -mat_loadcmds]
+                            set libresultlist [machista::parse_file $handle $filepath]
+                            set libreturncode [lindex $libresultlist 0]
+                            set libresult     [lindex $libresultlist 1]
 
-                    while {$loadcommand ne "NULL"} {
-                        # see https://trac.macports.org/ticket/52700
-                        set LC_LOAD_WEAK_DYLIB 0x80000018
-                        if {[$loadcommand cget -mlt_type] == $LC_LOAD_WEAK_DYLIB} {
-                            ui_debug "[msgcat::mc "Skipping weakly-linked"] [$loadcommand cget -mlt_install_name]"
-                            set loadcommand [$loadcommand cget -next]
-                            continue
-                        }
-
-                        try {
-                            set filepath [revupgrade_handle_special_paths $bpath [$loadcommand cget -mlt_install_name]]
-                        } trap {POSIX SIG SIGINT} {_ eOptions} {
-                            if {$fancy_output} {
-                                $revupgrade_progress intermission
-                            }
-                            ui_debug [msgcat::mc "Aborted: SIGINT signal received"]
-                            throw [dict get $eOptions -errorcode] [dict get $eOptions -errorinfo]
-                        } trap {POSIX SIG SIGTERM} {_ eOptions} {
-                            if {$fancy_output} {
-                                $revupgrade_progress intermission
+                            if {$libreturncode != $::machista::SUCCESS} {
+                                if {![info exists files_warned_about($filepath)] && $libreturncode != $::machista::ECACHE} {
+                                    if {$fancy_output} {
+                                        $revupgrade_progress intermission
+                                    }
+                                    ui_info "Could not open ${filepath}: [machista::strerror $libreturncode] (referenced from $bpath)"
+                                    if {[string first [file separator] $filepath] == -1} {
+                                        ui_info "${filepath} seems to be referenced using a relative path. This may be a problem with its canonical library name and require the use of install_name_tool(1) to fix."
+                                    }
+                                    set files_warned_about($filepath) yes
+                                }
+                                if {$libreturncode == $::machista::EFILE} {
+                                    ui_debug "Marking $bpath as broken"
+                                    lappend broken_files $bpath
+                                }
+                                set loadcommand [$loadcommand cget -next]
+                                continue;
                             }
-                            ui_debug [msgcat::mc "Aborted: SIGTERM signal received"]
-                            throw [dict get $eOptions -errorcode] [dict get $eOptions -errorinfo]
-                        } on error {} {
-                            set loadcommand [$loadcommand cget -next]
-                            continue
-                        }
-
-                        set libresultlist [machista::parse_file $handle $filepath]
-                        set libreturncode [lindex $libresultlist 0]
-                        set libresult     [lindex $libresultlist 1]
 
-                        if {$libreturncode != $::machista::SUCCESS} {
-                            if {![info exists files_warned_about($filepath)] && $libreturncode != $::machista::ECACHE} {
-                                if {$fancy_output} {
-                                    $revupgrade_progress intermission
+                            set libarchitecture [$libresult cget -mt_archs]
+                            set libarch_found false;
+                            while {$libarchitecture ne "NULL"} {
+                                if {[$architecture cget -mat_arch] ne [$libarchitecture cget -mat_arch]} {
+                                    set libarchitecture [$libarchitecture cget -next]
+                                    continue;
                                 }
-                                ui_info "Could not open ${filepath}: [machista::strerror $libreturncode] (referenced from $bpath)"
-                                if {[string first [file separator] $filepath] == -1} {
-                                    ui_info "${filepath} seems to be referenced using a relative path. This may be a problem with its canonical library name and require the use of install_name_tool(1) to fix."
+
+                                if {[$loadcommand cget -mlt_version] ne [$libarchitecture cget -mat_version] && [$loadcommand cget -mlt_comp_version] > [$libarchitecture cget -mat_comp_version]} {
+                                    if {$fancy_output} {
+                                        $revupgrade_progress intermission
+                                    }
+                                    ui_info "Incompatible library version: $bpath requires version [machista::format_dylib_version [$loadcommand cget -mlt_comp_version]] or later, but $filepath provides version [machista::format_dylib_version [$libarchitecture cget -mat_comp_version]]"
+                                    ui_debug "Marking $bpath as broken"
+                                    lappend broken_files $bpath
                                 }
-                                set files_warned_about($filepath) yes
-                            }
-                            if {$libreturncode == $::machista::EFILE} {
-                                ui_debug "Marking $bpath as broken"
-                                lappend broken_files $bpath
-                            }
-                            set loadcommand [$loadcommand cget -next]
-                            continue;
-                        }
 
-                        set libarchitecture [$libresult cget -mt_archs]
-                        set libarch_found false;
-                        while {$libarchitecture ne "NULL"} {
-                            if {[$architecture cget -mat_arch] ne [$libarchitecture cget -mat_arch]} {
-                                set libarchitecture [$libarchitecture cget -next]
-                                continue;
+                                set libarch_found true;
+                                break;
                             }
 
-                            if {[$loadcommand cget -mlt_version] ne [$libarchitecture cget -mat_version] && [$loadcommand cget -mlt_comp_version] > [$libarchitecture cget -mat_comp_version]} {
-                                if {$fancy_output} {
-                                    $revupgrade_progress intermission
+                            if {!$libarch_found} {
+                                ui_debug "Missing architecture [machista::get_arch_name [$architecture cget -mat_arch]] in file $filepath"
+                                if {[path_is_in_prefix $filepath]} {
+                                    ui_debug "Marking $bpath as broken"
+                                    lappend broken_files $bpath
+                                } else {
+                                    ui_debug "Missing architecture [machista::get_arch_name [$architecture cget -mat_arch]] in file outside prefix referenced from $bpath"
+                                    # ui_debug "   How did you get that compiled anyway?"
                                 }
-                                ui_info "Incompatible library version: $bpath requires version [machista::format_dylib_version [$loadcommand cget -mlt_comp_version]] or later, but $filepath provides version [machista::format_dylib_version [$libarchitecture cget -mat_comp_version]]"
-                                ui_debug "Marking $bpath as broken"
-                                lappend broken_files $bpath
                             }
-
-                            set libarch_found true;
-                            break;
+                            set loadcommand [$loadcommand cget -next]
                         }
 
-                        if {!$libarch_found} {
-                            ui_debug "Missing architecture [machista::get_arch_name [$architecture cget -mat_arch]] in file $filepath"
-                            if {[path_is_in_prefix $filepath]} {
-                                ui_debug "Marking $bpath as broken"
-                                lappend broken_files $bpath
-                            } else {
-                                ui_debug "Missing architecture [machista::get_arch_name [$architecture cget -mat_arch]] in file outside prefix referenced from $bpath"
-                                # ui_debug "   How did you get that compiled anyway?"
-                            }
-                        }
-                        set loadcommand [$loadcommand cget -next]
+                        set architecture [$architecture cget -next]
                     }
-
-                    set architecture [$architecture cget -next]
                 }
             }
         } on error {_ eOptions} {
@@ -6909,6 +7433,11 @@ proc macports::revupgrade_scanandrebuild {broken_port_counts_name options} {
             $revupgrade_progress finish
         }
 
+        if {[catch {file mkdir [file dirname $machista_cache]} result]} {
+            ui_debug "Error creating [file dirname $machista_cache]: $result"
+        } elseif {[set returncode [machista::cache_save $handle]] != $::machista::SUCCESS} {
+            ui_debug "Error writing ${machista_cache}: [machista::strerror $returncode]"
+        }
         machista::destroy_handle $handle
 
         set num_broken_files [llength $broken_files]
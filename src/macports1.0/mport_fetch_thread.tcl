@@ -38,6 +38,8 @@ package require Thread
 namespace eval mport_fetch_thread {
     variable active_requests [dict create]
     variable active_files [dict create]
+    # Requests answered by the management thread from a shared response
+    variable shared_requests [dict create]
     variable next_id 0
     variable management_thread
     trace add variable management_thread read mport_fetch_thread::init_management_thread
@@ -96,6 +98,41 @@ namespace eval mport_fetch_thread {
                 return $ret
             }
 
+            # Return the URL and validators (ETag and Last-Modified) saved
+            # with a cached response, or an empty dict if there are none.
+            proc read_validators {cachepath} {
+                set validators [dict create]
+                if {[file isfile $cachepath]} {
+                    catch {
+                        set fd [open ${cachepath}.info r]
+                        try {
+                            set validators [dict create {*}[gets $fd]]
+                        } finally {
+                            close $fd
+                        }
+                    }
+                }
+                return $validators
+            }
+
+            # Save the validators from the headers of a response that was
+            # just cached, so the next run can ask if it has changed.
+            proc write_validators {cachepath url headers} {
+                set validators [dict filter $headers key etag last-modified]
+                if {[dict size $validators] == 0} {
+                    return
+                }
+                # other processes may be saving the same response
+                set tmppath ${cachepath}.info.[pid].TMP
+                set fd [open $tmppath w]
+                try {
+                    puts $fd [dict create url $url {*}$validators]
+                } finally {
+                    close $fd
+                }
+                file rename -force $tmppath ${cachepath}.info
+            }
+
             # Perform a curl-based operation and return the result.
             # Result format: 2 element list: status, body
             # status = 0: success, body is the actual result
@@ -107,25 +144,29 @@ namespace eval mport_fetch_thread {
                     global ::pextlib::curl::cancelled
                     set cancelled 0
                     # Tell client which thread is handling this request, so it can send
-                    # cancellation requests.
-                    thread::send -async $result_tid [list set ${result_var}_tid [thread::id]]
+                    # cancellation requests. Shared transfers can't be cancelled.
+                    if {$op ne "fetch_cached"} {
+                        thread::send -async $result_tid [list set ${result_var}_tid [thread::id]]
+                    }
                     switch -- $op {
                         archive_exists {
                             # Check if an archive and matching signature exist at
-                            # any of the given URLs.
+                            # any of the given URLs. They are all probed at once,
+                            # sharing connections to the same server.
                             set result [list 0 0]
                             lassign $opargs fixed_args credential_args urls
-                            foreach {url sigurl} $urls {creds sigcreds} $credential_args {
-                                set proxy_args [get_proxy_args $url]
-                                # curl getsize can return -1 instead of throwing an error for
-                                # nonexistent files on FTP sites.
-                                if {![catch {curl getsize {*}$proxy_args {*}$creds {*}$fixed_args $url} size] && $size > 0
-                                      && ![catch {curl getsize {*}$proxy_args {*}$sigcreds {*}$fixed_args $sigurl} sigsize] && $sigsize > 0} {
-                                    set result [list 0 1]
-                                    break
-                                }
-                                if {$cancelled} {
-                                    break
+                            set probes [list]
+                            foreach url $urls creds $credential_args {
+                                lappend probes [list {*}[get_proxy_args $url] {*}$creds {*}$fixed_args $url]
+                            }
+                            if {[llength $probes] > 0} {
+                                # Failed probes have size -1, as do nonexistent
+                                # files on some FTP sites.
+                                foreach {size sigsize} [curl probe {*}$probes] {
+                                    if {$size > 0 && $sigsize > 0} {
+                                        set result [list 0 1]
+                                        break
+                                    }
                                 }
                             }
                         }
@@ -201,7 +242,8 @@ namespace eval mport_fetch_thread {
                         }
                         fetch_file {
                             # Try fetching the given URLs, saving the result to outpath, until
-                            # one of them succeeds.
+                            # one of them succeeds. The result is what curl fetch returned,
+                            # i.e. the digests if they were requested.
                             global show_progress progress_tid progress_inited progress_logid current_url
                             # Start silent, may be changed during the transfer.
                             set show_progress 0
@@ -219,9 +261,61 @@ namespace eval mport_fetch_thread {
                                         set current_url $url
                                     }
                                     progress_handler $msg_priority $logphase "Attempting to fetch $url"
-                                    curl fetch --progress progress_handler {*}[get_proxy_args $url] {*}$creds {*}$fixed_args $url ${outpath}.TMP
+                                    set digests [curl fetch --progress progress_handler {*}[get_proxy_args $url] {*}$creds {*}$fixed_args $url ${outpath}.TMP]
                                     set fetched 1
-                                    set result [list 0 1]
+                                    set result [list 0 $digests]
+                                    break
+                                } on error {eMessage} {
+                                    progress_handler debug $logphase "Fetching $url failed: $eMessage"
+                                    set result [list 1 $eMessage]
+                                    if {$cancelled} {
+                                        break
+                                    }
+                                }
+                            }
+                        }
+                        fetch_cached {
+                            # Like fetch_file, but saving the response to cachepath
+                            # for the management thread to pass on to every request
+                            # for the same URLs. A response kept from an earlier run
+                            # is revalidated with a conditional request and used
+                            # again if the server says it hasn't changed.
+                            global show_progress progress_tid progress_inited progress_logid
+                            set show_progress 0
+                            set progress_inited 0
+                            set progress_tid $result_tid
+                            lassign $opargs fixed_args credential_args urls cachepath progress_logid
+                            set validators [read_validators $cachepath]
+                            # other processes may be fetching the same URLs
+                            set tmppath ${cachepath}.[pid].TMP
+                            set logphase fetch
+                            foreach url $urls creds $credential_args {
+                                set conditional_args [list]
+                                if {[dict exists $validators url] && [dict get $validators url] eq $url} {
+                                    if {[dict exists $validators etag]} {
+                                        lappend conditional_args --append-http-header "If-None-Match: [dict get $validators etag]"
+                                    }
+                                    if {[dict exists $validators last-modified]} {
+                                        lappend conditional_args --append-http-header "If-Modified-Since: [dict get $validators last-modified]"
+                                    }
+                                }
+                                try {
+                                    progress_handler debug $logphase "Attempting to fetch $url"
+                                    curl fetch --progress progress_handler --response-code code --response-headers headers \
+                                        {*}$conditional_args {*}[get_proxy_args $url] {*}$creds {*}$fixed_args $url $tmppath
+                                    if {$code == 304 && $conditional_args ne {}} {
+                                        progress_handler debug $logphase "$url has not changed, using the cached copy"
+                                        file delete $tmppath
+                                        # keep it from being pruned, if we may
+                                        set now [clock seconds]
+                                        catch {file mtime $cachepath $now}
+                                        catch {file mtime ${cachepath}.info $now}
+                                    } else {
+                                        file delete ${cachepath}.info
+                                        file rename -force $tmppath $cachepath
+                                        write_validators $cachepath $url $headers
+                                    }
+                                    set result [list 0 {}]
                                     break
                                 } on error {eMessage} {
                                     progress_handler debug $logphase "Fetching $url failed: $eMessage"
@@ -231,6 +325,7 @@ namespace eval mport_fetch_thread {
                                     }
                                 }
                             }
+                            file delete $tmppath
                         }
                         default {
                             error "Unhandled curl op: $op"
@@ -239,10 +334,16 @@ namespace eval mport_fetch_thread {
                 } on error {err} {
                     set result [list 1 $err]
                 } finally {
-                    # Set the result in the thread that wants it
-                    thread::send -async $result_tid [list set $result_var $result]
+                    if {$op eq "fetch_cached"} {
+                        # The management thread passes it on to all requests
+                        # waiting for it
+                        thread::send -async $management_tid [list shared_response_done $result_var $result]
+                    } else {
+                        # Set the result in the thread that wants it
+                        thread::send -async $result_tid [list set $result_var $result]
+                    }
                     # Tell the management thread we're done
-                    set was_fetch [expr {$op in {fetch_archive fetch_file}}]
+                    set was_fetch [expr {$op in {fetch_archive fetch_file fetch_cached}}]
                     thread::send -async $management_tid [list thread_done [thread::id] $was_fetch]
                 }
             }
@@ -265,8 +366,8 @@ namespace eval mport_fetch_thread {
         }
         # End worker_init_script
 
-        proc init_globals {fetch_threads proxies_in no_proxy_in} {
-            global max_threads max_fetches proxies no_proxy
+        proc init_globals {fetch_threads proxies_in no_proxy_in cache_dir_in} {
+            global max_threads max_fetches proxies no_proxy cache_dir
             if {![catch {sysctl hw.activecpu} ncpus] && $ncpus > $fetch_threads} {
                 set max_threads [expr {$ncpus * 2}]
             } else {
@@ -280,6 +381,7 @@ namespace eval mport_fetch_thread {
             if {$no_proxy_in ne {}} {
                 set no_proxy $no_proxy_in
             }
+            set cache_dir $cache_dir_in
         }
         set available_threads [list]
         set thread_count 0
@@ -328,15 +430,179 @@ namespace eval mport_fetch_thread {
         # Map ops to their queue
         set queue_for_op [dict create fetch_archive fetch_request_queue \
                                       fetch_file fetch_request_queue \
+                                      fetch_cached fetch_request_queue \
                                       archive_exists exists_request_queue \
                                       ping ping_request_queue]
         # Variable waited on for events by the management thread.
         set main_wakeup {}
 
+        # Responses of fetch_cached requests. Maps the fixed args, credentials
+        # and URLs of a request to a dict of the path the response is saved
+        # to, whether it is kept for later runs, the id of the transfer, the
+        # requests waiting for it and, once the transfer is done, its result.
+        # Done entries answer later requests for the rest of the run.
+        set shared_responses [dict create]
+        # Maps the ids of transfers and waiting requests to their key in
+        # shared_responses.
+        set shared_transfers [dict create]
+        set shared_waiters [dict create]
+        # Whether cache_dir, where responses are kept between runs, has been
+        # checked to be usable.
+        set cache_checked 0
+
+        # Return the path to save the response for key to, and whether it
+        # is kept for later runs.
+        proc shared_response_path {key} {
+            global cache_dir cache_checked
+            if {!$cache_checked} {
+                set cache_checked 1
+                if {$cache_dir ne {} && ([catch {file mkdir $cache_dir}] || ![file writable $cache_dir])} {
+                    set cache_dir {}
+                }
+                if {$cache_dir ne {}} {
+                    prune_response_cache
+                }
+            }
+            if {$cache_dir ne {}} {
+                package require sha1
+                return [list [file join $cache_dir [::sha1::sha1 -hex -- $key]] 1]
+            }
+            close [file tempfile path mports.response]
+            return [list $path 0]
+        }
+
+        # Delete cached responses that haven't been used for a month.
+        proc prune_response_cache {} {
+            global cache_dir
+            set cutoff [expr {[clock seconds] - 30 * 24 * 60 * 60}]
+            foreach path [glob -nocomplain -directory $cache_dir -types f *] {
+                if {![catch {file mtime $path} mtime] && $mtime < $cutoff} {
+                    catch {file delete $path}
+                }
+            }
+        }
+
+        # Add a fetch_cached request to those waiting for the response for
+        # the same URLs, answering it right away if that is already known.
+        # Returns the args for the worker if a transfer has to be queued for
+        # it, or an empty list otherwise.
+        proc share_response {opargs result_tid result_var} {
+            global shared_responses shared_transfers shared_waiters
+            lassign $opargs fixed_args credential_args urls outpath progress_logid
+            set key [list $fixed_args $credential_args $urls]
+            set waiter [list $result_tid $result_var $outpath]
+            if {[dict exists $shared_responses $key]} {
+                set entry [dict get $shared_responses $key]
+                if {[dict exists $entry result]} {
+                    deliver_response $entry $waiter
+                } else {
+                    dict lappend entry waiters $waiter
+                    dict set shared_responses $key $entry
+                    dict set shared_waiters $result_var $key
+                }
+                return {}
+            }
+            lassign [shared_response_path $key] path persistent
+            dict set shared_responses $key [dict create path $path persistent $persistent \
+                                            transfer $result_var waiters [list $waiter]]
+            dict set shared_transfers $result_var $key
+            dict set shared_waiters $result_var $key
+            return [list $fixed_args $credential_args $urls $path $progress_logid]
+        }
+
+        # Copy a shared response to the file a request wants it in and send
+        # the request its result.
+        proc deliver_response {entry waiter} {
+            lassign $waiter result_tid result_var outpath
+            set result [dict get $entry result]
+            if {[lindex $result 0] == 0} {
+                # The requester created the file, possibly for another user,
+                # so write to it rather than replacing it.
+                try {
+                    set in [open [dict get $entry path] rb]
+                    try {
+                        set out [open ${outpath}.TMP wb]
+                        try {
+                            fcopy $in $out
+                        } finally {
+                            close $out
+                        }
+                    } finally {
+                        close $in
+                    }
+                } on error {eMessage} {
+                    set result [list 1 $eMessage]
+                }
+            }
+            thread::send -async $result_tid [list set $result_var $result]
+        }
+
+        # Forget a shared response whose file isn't kept for later runs.
+        proc drop_response {key} {
+            global shared_responses
+            set entry [dict get $shared_responses $key]
+            if {![dict get $entry persistent]} {
+                set path [dict get $entry path]
+                file delete $path ${path}.info
+            }
+            dict unset shared_responses $key
+        }
+
+        # Workers call this when a fetch_cached transfer is done.
+        proc shared_response_done {id result} {
+            global shared_responses shared_transfers shared_waiters
+            set key [dict get $shared_transfers $id]
+            dict unset shared_transfers $id
+            set entry [dict get $shared_responses $key]
+            dict set entry result $result
+            foreach waiter [dict get $entry waiters] {
+                deliver_response $entry $waiter
+                dict unset shared_waiters [lindex $waiter 1]
+            }
+            dict set entry waiters {}
+            dict set shared_responses $key $entry
+            if {![dict get $entry persistent]} {
+                drop_response $key
+            }
+        }
+
+        # Remove a request from those waiting for a shared response. Its
+        # transfer is dropped if it hasn't started and nobody else waits
+        # for it. Returns 1 if the request was waiting, 0 otherwise.
+        proc unshare_response {id} {
+            global shared_responses shared_transfers shared_waiters
+            if {![dict exists $shared_waiters $id]} {
+                return 0
+            }
+            set key [dict get $shared_waiters $id]
+            dict unset shared_waiters $id
+            set entry [dict get $shared_responses $key]
+            set waiters [lsearch -all -inline -exact -index 1 -not [dict get $entry waiters] $id]
+            dict set shared_responses $key waiters $waiters
+            if {[llength $waiters] == 0} {
+                global fetch_request_queue
+                set transfer [dict get $entry transfer]
+                set index [lsearch -exact -dictionary -sorted -index 3 $fetch_request_queue $transfer]
+                if {$index != -1} {
+                    lpop fetch_request_queue $index
+                    dict unset shared_transfers $transfer
+                    drop_response $key
+                }
+            }
+            return 1
+        }
+
         # Add a request to the appropriate queue and arrange for the
         # main loop to wake up and process it.
         proc queue_request {op opargs result_tid result_var} {
             global queue_for_op main_wakeup
+            if {$op eq "fetch_cached"} {
+                set opargs [share_response $opargs $result_tid $result_var]
+                if {$opargs eq {}} {
+                    # Answered, or waiting for a transfer already queued.
+                    return
+                }
+            }
             set request_queue [dict get $queue_for_op $op]
             global $request_queue
             lappend $request_queue [list $op $opargs $result_tid $result_var]
@@ -346,6 +612,9 @@ namespace eval mport_fetch_thread {
         # Remove a request from the queue.
         # Returns 1 if the request was in the queue, 0 otherwise.
         proc unqueue_request {id} {
+            if {[unshare_response $id]} {
+                return 1
+            }
             foreach qtype {fetch exists ping} {
                 set request_queue ${qtype}_request_queue
                 global $request_queue
@@ -414,14 +683,28 @@ proc mport_fetch_thread::init_management_thread {args} {
     trace remove variable management_thread read mport_fetch_thread::init_management_thread
     variable init_script
     set management_thread [thread::create -preserved $init_script]
-    global macports::fetch_threads macports::proxies macports::no_proxy
+    global macports::fetch_threads macports::proxies macports::no_proxy \
+           macports::portdbpath macports::macportsuser
     set max_fetches [expr {[info exists fetch_threads] && $fetch_threads > 1 ? $fetch_threads : 1}]
-    thread::send -async $management_thread [list init_globals $max_fetches $proxies $no_proxy]
+    # Responses of fetch_cached requests are kept here between runs. Make
+    # it writable for macportsuser, as privileges may be dropped later.
+    set cache_dir [file join $portdbpath cache responses]
+    if {![file isdirectory $cache_dir] && [getuid] == 0 && [geteuid] == 0} {
+        catch {
+            file mkdir $cache_dir
+            file attributes $cache_dir -owner $macportsuser
+        }
+    }
+    thread::send -async $management_thread [list init_globals $max_fetches $proxies $no_proxy $cache_dir]
 }
 
 proc mport_fetch_thread::record_request {op opargs id} {
     variable active_requests
-    if {$op in {fetch_archive fetch_file}} {
+    if {$op eq "fetch_cached"} {
+        variable shared_requests
+        dict set shared_requests $id 1
+    }
+    if {$op in {fetch_archive fetch_file fetch_cached}} {
         # record the file path
         set val [lindex $opargs 3]
         variable active_files
@@ -466,6 +749,8 @@ proc mport_fetch_thread::get_result {id} {
             dict unset active_files $filepath
         }
         dict unset active_requests $id
+        variable shared_requests
+        dict unset shared_requests $id
         variable $id
         if {![info exists $id]} {
             vwait $id
@@ -512,6 +797,11 @@ proc mport_fetch_thread::show_progress {id} {
     if {![dict exists $active_requests $id]} {
         error "No pending request with id $id"
     }
+    variable shared_requests
+    if {[dict exists $shared_requests $id]} {
+        # Shared transfers don't show progress for any one request.
+        return
+    }
     variable ${id}_tid
     if {![info exists ${id}_tid]} {
         # Wait for the worker thread to tell us its id
@@ -521,6 +811,11 @@ proc mport_fetch_thread::show_progress {id} {
     thread::send -async [set ${id}_tid] [list set show_progress 1]
 }
 
+# Variable trace removing the result of a cancelled request once it is set.
+proc mport_fetch_thread::drop_result {name1 name2 op} {
+    uplevel 1 [list unset -nocomplain $name1]
+}
+
 # Cancel the operation identified by id.
 proc mport_fetch_thread::cancel {id} {
     variable active_requests
@@ -534,6 +829,9 @@ proc mport_fetch_thread::cancel {id} {
         dict unset active_files $filepath
     }
     dict unset active_requests $id
+    variable shared_requests
+    set shared [dict exists $shared_requests $id]
+    dict unset shared_requests $id
     variable $id
     if {[info exists $id]} {
         # Already complete
@@ -546,6 +844,17 @@ proc mport_fetch_thread::cancel {id} {
     if {$was_unqueued} {
         return
     }
+    if {$shared} {
+        # The shared response is already on its way, and other requests
+        # may still want the transfer, so leave it alone and only get rid
+        # of the result when it arrives.
+        if {[info exists $id]} {
+            unset $id
+        } else {
+            trace add variable $id write mport_fetch_thread::drop_result
+        }
+        return
+    }
     # Already dispatched. Send cancellation request and wait for the result
     # (so we can clean up the result variable)
     variable ${id}_tid
@@ -365,6 +365,7 @@ namespace eval snapshot {
         global registry::tdbc_connection macports::ui_options
         variable import_snapshot_stmt
         variable import_port_stmt
+        variable import_fileset_stmt
         variable import_file_stmt
         if {![info exists import_snapshot_stmt]} {
             set import_snapshot_stmt [$tdbc_connection prepare {
@@ -386,6 +387,7 @@ namespace eval snapshot {
                     , state
                     , variants
                     , requested_variants
+                    , fileset_id
                 ) VALUES (
                       :snapshot_id
                     , :port_name
@@ -393,16 +395,28 @@ namespace eval snapshot {
                     , :state
                     , :variants
                     , :requested_variants
+                    , :fileset_id
+                )
+            }]
+        }
+        if {![info exists import_fileset_stmt]} {
+            set import_fileset_stmt [$tdbc_connection prepare {
+                INSERT INTO snapshot_filesets (
+                      port_name
+                    , variants
+                ) VALUES (
+                      :port_name
+                    , :variants
                 )
             }]
         }
         if {![info exists import_file_stmt]} {
             set import_file_stmt [$tdbc_connection prepare {
-                INSERT INTO snapshot_files (
-                      id
+                INSERT INTO snapshot_fileset_files (
+                      fileset_id
                     , path
                 ) VALUES (
-                      :port_id
+                      :fileset_id
                     , :path
                 )
             }]
@@ -436,13 +450,17 @@ namespace eval snapshot {
 
                 dict set port snapshot_id $snapshot_id
 
-                $import_port_stmt execute $port
-                set port_id [_last_insert_rowid $tdbc_connection]
-
+                # the imported ports don't say which version they are, so
+                # their file lists can't be shared with other snapshots
+                $import_fileset_stmt execute $port
+                set fileset_id [_last_insert_rowid $tdbc_connection]
                 foreach path [dict get $port port_files] {
                     $import_file_stmt execute
                 }
 
+                dict set port fileset_id $fileset_id
+                $import_port_stmt execute $port
+
                 $progress update $counter $total
             }
         }
@@ -498,11 +516,17 @@ namespace eval snapshot {
             ui_error "No such snapshot ID: $snapshot_id"
             return 1
         }
-        # relies on cascading delete to also remove snapshot ports and files
+        # relies on cascading delete to also remove snapshot ports, and the
+        # files of the file lists no other snapshot refers to
         set query {DELETE FROM snapshots WHERE id = :snapshot_id}
         set stmt [$tdbc_connection prepare $query]
+        set filesets_stmt [$tdbc_connection prepare {
+            DELETE FROM snapshot_filesets WHERE NOT EXISTS
+                (SELECT 1 FROM snapshot_ports WHERE snapshot_ports.fileset_id = snapshot_filesets.id)
+        }]
         $tdbc_connection transaction {
             set results [$stmt execute]
+            [$filesets_stmt execute] close
         }
         if {[$results rowcount] < 1} {
             ui_warn "delete_snapshot: no rows were deleted for snapshot ID: $snapshot_id"
@@ -511,6 +535,7 @@ namespace eval snapshot {
         }
         $results close
         $stmt close
+        $filesets_stmt close
         return 0
     }
 
@@ -520,8 +545,8 @@ namespace eval snapshot {
         variable file_owner_stmt
         if {![info exists file_owner_stmt]} {
             set query {SELECT snapshot_ports.port_name FROM snapshot_ports
-                    INNER JOIN snapshot_files ON snapshot_files.id = snapshot_ports.id
-                    WHERE snapshot_files.path = :path AND snapshot_ports.snapshots_id = :snapshot_id}
+                    INNER JOIN snapshot_fileset_files ON snapshot_fileset_files.fileset_id = snapshot_ports.fileset_id
+                    WHERE snapshot_fileset_files.path = :path AND snapshot_ports.snapshots_id = :snapshot_id}
             set file_owner_stmt [$tdbc_connection prepare $query]
         }
         $tdbc_connection transaction {
@@ -537,11 +562,11 @@ namespace eval snapshot {
         variable port_files_stmt
         if {![info exists port_files_stmt]} {
             set port_files_stmt [$tdbc_connection prepare {
-                    SELECT snapshot_files.path FROM snapshot_files
-                    INNER JOIN snapshot_ports ON snapshot_files.id = snapshot_ports.id
+                    SELECT snapshot_fileset_files.path FROM snapshot_fileset_files
+                    INNER JOIN snapshot_ports ON snapshot_fileset_files.fileset_id = snapshot_ports.fileset_id
                     WHERE snapshot_ports.port_name = :port_name
                     AND snapshot_ports.snapshots_id = :snapshot_id
-                    ORDER BY snapshot_files.path ASC
+                    ORDER BY snapshot_fileset_files.path ASC
             }]
         }
         $tdbc_connection transaction {
@@ -0,0 +1,39 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Benchmark for opening ports, timing mportopen and mportclose of the Portfile
+# in this directory, the way dependency resolution opens many ports in a row.
+# Syntax (from the tests directory):
+# tclsh mportopen-bench.tcl ?number of ports?
+
+# the test setup below would take the arguments for tcltest options
+set bench_args $argv
+set argv [list]
+
+package require tcltest 2
+namespace import tcltest::*
+
+set pwd [file dirname [file normalize $argv0]]
+
+source ../macports_test_autoconf.tcl
+source $macports::autoconf::top_srcdir/src/macports1.0/tests/test_setup.tcl
+
+proc main {{count 200}} {
+    global pwd
+
+    # the first port also loads the packages used by all ports
+    mportclose [mportopen file://${pwd}]
+
+    set start [clock microseconds]
+    for {set i 0} {$i < $count} {incr i} {
+        # different options, so that no open port is reused
+        set mport [mportopen file://${pwd} [list bench_iteration $i]]
+        mportclose $mport
+    }
+    set usec [expr {[clock microseconds] - $start}]
+
+    puts [format "mportopen/mportclose %d ports: %.2f ms per port, %.1f ports per second" \
+        $count [expr {$usec / 1000.0 / $count}] [expr {$count * 1e6 / $usec}]]
+}
+
+main {*}$bench_args
+file delete -force $pwd/tmpdir
@@ -133,7 +133,7 @@ proc fetchfiles {{async no} args} {
     global UI_PREFIX archivefetch.fulldestpath archivefetch.user \
            archivefetch.password archivefetch.use_epsv \
            archivefetch.ignore_sslcert archive.subdir portverbose \
-           ports_binary_only portdbpath force_archive_refresh
+           ports_binary_only portdbpath force_archive_refresh fetch_segments
     variable archivefetch_urls
     variable ::portfetch::urlmap
     variable async_job
@@ -195,6 +195,10 @@ proc fetchfiles {{async no} args} {
     if {${archivefetch.ignore_sslcert} ne "no"} {
         lappend fetch_options "--ignore-ssl-cert"
     }
+    if {$fetch_segments > 1} {
+        lappend fetch_options "--segments"
+        lappend fetch_options $fetch_segments
+    }
     if {!$async} {
         if {$portverbose eq "yes"} {
             lappend fetch_options "--progress"
@@ -94,8 +94,11 @@
 #include "rmd160cmd.h"
 #include "sha256cmd.h"
 #include "blake3cmd.h"
+#include "multichecksumcmd.h"
+#include "fs-manifest.h"
 #include "fs-traverse.h"
 #include "filemap.h"
+#include "portindex.h"
 #include "curl.h"
 #include "xinstall.h"
 #include "vercomp.h"
@@ -104,6 +107,7 @@
 #include "tracelib.h"
 #include "tty.h"
 #include "strsed.h"
+#include "sedfiles.h"
 #include "readdir.h"
 #include "pipe.h"
 #include "adv-flock.h"
@@ -132,6 +136,12 @@ static void ui_message(Tcl_Interp *interp, const char *severity, const char *for
         perror("vasprintf");
         return;
     }
+    if (!interp) {
+        /* called from a thread that has no interpreter */
+        fprintf(stderr, "%s: %s\n", severity, buf);
+        free(buf);
+        return;
+    }
     if (asprintf(&tclcmd, "ui_%s $warn", severity) < 0) {
         perror("asprintf");
         free(buf);
@@ -1225,6 +1235,7 @@ int Pextlib_Init(Tcl_Interp *interp)
 	Tcl_CreateObjCommand(interp, "readdir", ReaddirCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "dirempty", DiremptyCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "strsed", StrsedCmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "sedfiles", SedFilesCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "mktemp", MktempCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "mkdtemp", MkdtempCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "existsuser", ExistsuserCmd, NULL, NULL);
@@ -1234,12 +1245,15 @@ int Pextlib_Init(Tcl_Interp *interp)
 	Tcl_CreateObjCommand(interp, "md5", MD5Cmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "xinstall", InstallCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "fs-traverse", FsTraverseCmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "fs-manifest", FsManifestCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "filemap", FilemapCmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "portindex", PortindexCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "vercmp", VercompCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "rmd160", RMD160Cmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "sha256", SHA256Cmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "sha1", SHA1Cmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "blake3", BLAKE3Cmd, NULL, NULL);
+	Tcl_CreateObjCommand(interp, "multichecksum", MultichecksumCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "umask", UmaskCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "pipe", PipeCmd, NULL, NULL);
 	Tcl_CreateObjCommand(interp, "curl", CurlCmd, NULL, NULL);
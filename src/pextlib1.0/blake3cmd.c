@@ -33,55 +33,328 @@
 #include <config.h>
 #endif
 
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <tcl.h>
 
 #include "blake3cmd.h"
+#include "multichecksumcmd.h"
 #include "blake3/src/blake3.h"
+/* for the chunk and parent compression functions used by the parallel path */
+#include "blake3/src/blake3_impl.h"
 
 #define BLAKE3_DIGEST_LENGTH BLAKE3_OUT_LEN
 
-static char *BLAKE3_File(const char *filename, char *buf)
+/* Read size of the streaming path. Large enough that every update covers
+ * enough chunks to use the widest SIMD implementation. */
+#define BLAKE3_BUFSIZE (64 * 1024)
+/* Files at least this large are mapped and hashed by several threads. */
+#define BLAKE3_PARALLEL_THRESHOLD (8 * 1024 * 1024)
+/* Smallest amount of input handed to a thread at once. */
+#define BLAKE3_MIN_PIECE (1024 * 1024)
+#define BLAKE3_MAX_THREADS 16
+
+static char *BLAKE3_Hex(const uint8_t digest[BLAKE3_DIGEST_LENGTH], char *buf)
 {
-    unsigned char buffer[BUFSIZ];
-    blake3_hasher hasher;
-    unsigned char digest[BLAKE3_DIGEST_LENGTH];
     static const char hex[] = "0123456789abcdef";
-    int f, i, j;
+    int i;
+
+    for (i = 0; i < BLAKE3_DIGEST_LENGTH; i++) {
+        buf[i+i] = hex[digest[i] >> 4];
+        buf[i+i+1] = hex[digest[i] & 0x0f];
+    }
+    buf[i+i] = '\0';
+    return buf;
+}
 
+static char *BLAKE3_End(blake3_hasher *hasher, char *buf)
+{
+    unsigned char digest[BLAKE3_DIGEST_LENGTH];
+
+    blake3_hasher_finalize(hasher, digest, BLAKE3_DIGEST_LENGTH);
+    return BLAKE3_Hex(digest, buf);
+}
+
+static char *BLAKE3_Fd(int f, char *buf)
+{
+    unsigned char *buffer;
+    blake3_hasher hasher;
+    ssize_t i;
+
+    buffer = malloc(BLAKE3_BUFSIZE);
+    if (!buffer) return 0;
     blake3_hasher_init(&hasher);
+    while ((i = read(f, buffer, BLAKE3_BUFSIZE)) > 0 || (i < 0 && errno == EINTR)) {
+        if (i > 0) {
+            blake3_hasher_update(&hasher, buffer, i);
+        }
+    }
+    free(buffer);
+    if (i < 0) return 0;
+
+    return BLAKE3_End(&hasher, buf);
+}
+
+/*
+ * The parallel path splits the input into pieces whose length is a power of
+ * two multiple of the chunk length, so each piece is a complete subtree of
+ * the BLAKE3 tree. Threads compute the chaining values of the pieces, which
+ * are then merged into the root.
+ *
+ * Merging a row of chaining values pairwise, with an odd one out moving up
+ * unchanged, yields the same left-balanced tree as the reference
+ * implementation as long as each row starts at a subtree boundary.
+ */
+typedef struct {
+    const uint8_t *input;
+    size_t len;
+    size_t piece_len;
+    size_t npieces;
+    /* chaining values of the pieces */
+    uint8_t *cvs;
+    size_t next;
+    int failed;
+    pthread_mutex_t mutex;
+} blake3_job;
+
+/* Merge the n chaining values in cvs into one, stopping at two if root is
+ * set, using tmp as scratch space of the same size. Returns the buffer
+ * holding the result. */
+static uint8_t *blake3_merge(uint8_t *cvs, uint8_t *tmp, const uint8_t **ptrs, size_t n, int root)
+{
+    while (n > (root ? 2 : 1)) {
+        size_t pairs = n / 2, i;
+        uint8_t *swap;
+
+        for (i = 0; i < pairs; i++) {
+            ptrs[i] = cvs + 2 * i * BLAKE3_OUT_LEN;
+        }
+        blake3_hash_many(ptrs, pairs, 1, IV, 0, false, PARENT, 0, 0, tmp);
+        if (n % 2) {
+            memcpy(tmp + pairs * BLAKE3_OUT_LEN, cvs + (n - 1) * BLAKE3_OUT_LEN, BLAKE3_OUT_LEN);
+        }
+        n = pairs + n % 2;
+        swap = cvs;
+        cvs = tmp;
+        tmp = swap;
+    }
+    return cvs;
+}
+
+/* Compute the chaining value of a piece starting at the given chunk. */
+static int blake3_hash_piece(const uint8_t *input, size_t len, uint64_t chunk_counter, uint8_t out[BLAKE3_OUT_LEN])
+{
+    size_t full = len / BLAKE3_CHUNK_LEN;
+    size_t rest = len % BLAKE3_CHUNK_LEN;
+    size_t n = full + (rest ? 1 : 0), i;
+    uint8_t *cvs = malloc(2 * n * BLAKE3_OUT_LEN);
+    const uint8_t **ptrs = malloc(n * sizeof(*ptrs));
+
+    if (!cvs || !ptrs) {
+        free(cvs);
+        free(ptrs);
+        return 0;
+    }
+    for (i = 0; i < full; i++) {
+        ptrs[i] = input + i * BLAKE3_CHUNK_LEN;
+    }
+    blake3_hash_many(ptrs, full, BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, IV, chunk_counter,
+            true, 0, CHUNK_START, CHUNK_END, cvs);
+    if (rest) {
+        /* the partial chunk at the end of the file */
+        const uint8_t *p = input + full * BLAKE3_CHUNK_LEN;
+        uint32_t cv[8];
+        uint8_t block[BLAKE3_BLOCK_LEN];
+        size_t off;
+
+        memcpy(cv, IV, sizeof(cv));
+        for (off = 0; off < rest; off += BLAKE3_BLOCK_LEN) {
+            size_t block_len = rest - off < BLAKE3_BLOCK_LEN ? rest - off : BLAKE3_BLOCK_LEN;
+            uint8_t flags = (off == 0 ? CHUNK_START : 0) | (off + block_len == rest ? CHUNK_END : 0);
+
+            memset(block, 0, sizeof(block));
+            memcpy(block, p + off, block_len);
+            blake3_compress_in_place(cv, block, (uint8_t)block_len, chunk_counter + full, flags);
+        }
+        store_cv_words(cvs + full * BLAKE3_OUT_LEN, cv);
+    }
+    memcpy(out, blake3_merge(cvs, cvs + n * BLAKE3_OUT_LEN, ptrs, n, 0), BLAKE3_OUT_LEN);
+    free(cvs);
+    free(ptrs);
+    return 1;
+}
+
+static void *blake3_worker(void *arg)
+{
+    blake3_job *job = arg;
+
+    for (;;) {
+        size_t piece;
+        size_t off, len;
+
+        pthread_mutex_lock(&job->mutex);
+        piece = job->next++;
+        pthread_mutex_unlock(&job->mutex);
+        if (piece >= job->npieces) {
+            break;
+        }
+        off = piece * job->piece_len;
+        len = job->len - off < job->piece_len ? job->len - off : job->piece_len;
+        if (!blake3_hash_piece(job->input + off, len, off / BLAKE3_CHUNK_LEN,
+                    job->cvs + piece * BLAKE3_OUT_LEN)) {
+            pthread_mutex_lock(&job->mutex);
+            job->failed = 1;
+            pthread_mutex_unlock(&job->mutex);
+        }
+    }
+    return NULL;
+}
+
+/* Hash len bytes at input with up to nthreads threads. len must be larger
+ * than two chunks. */
+static char *BLAKE3_Parallel(const uint8_t *input, size_t len, long nthreads, char *buf)
+{
+    blake3_job job;
+    pthread_t threads[BLAKE3_MAX_THREADS];
+    long started = 0, i;
+    size_t target;
+    uint8_t *root_cvs, *tmp;
+    const uint8_t **ptrs;
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint32_t cv[8];
+    uint8_t digest[BLAKE3_DIGEST_LENGTH];
+    char *result = 0;
+
+    /* a few pieces per thread to even out the load, each at most half the
+     * input so there are always at least two */
+    target = len / (4 * (size_t)nthreads);
+    if (target < BLAKE3_MIN_PIECE) {
+        target = BLAKE3_MIN_PIECE;
+    }
+    if (target > len / 2) {
+        target = len / 2;
+    }
+    job.piece_len = BLAKE3_CHUNK_LEN;
+    while (job.piece_len * 2 <= target) {
+        job.piece_len *= 2;
+    }
+    job.input = input;
+    job.len = len;
+    job.npieces = (len + job.piece_len - 1) / job.piece_len;
+    job.next = 0;
+    job.failed = 0;
+    job.cvs = malloc(2 * job.npieces * BLAKE3_OUT_LEN);
+    ptrs = malloc(job.npieces * sizeof(*ptrs));
+    if (!job.cvs || !ptrs) {
+        free(job.cvs);
+        free(ptrs);
+        errno = ENOMEM;
+        return 0;
+    }
+    pthread_mutex_init(&job.mutex, NULL);
+
+    /* the calling thread works on the pieces, too */
+    for (i = 1; i < nthreads && (size_t)i < job.npieces; i++) {
+        if (pthread_create(&threads[started], NULL, blake3_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    blake3_worker(&job);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.mutex);
+
+    if (!job.failed) {
+        tmp = job.cvs + job.npieces * BLAKE3_OUT_LEN;
+        root_cvs = blake3_merge(job.cvs, tmp, ptrs, job.npieces, 1);
+        memcpy(block, root_cvs, BLAKE3_BLOCK_LEN);
+        memcpy(cv, IV, sizeof(cv));
+        blake3_compress_in_place(cv, block, BLAKE3_BLOCK_LEN, 0, PARENT | ROOT);
+        store_cv_words(digest, cv);
+        result = BLAKE3_Hex(digest, buf);
+    } else {
+        errno = ENOMEM;
+    }
+    free(job.cvs);
+    free(ptrs);
+    return result;
+}
+
+/* Hash a file, using nthreads threads if it is large enough, or as many
+ * as there are CPUs if nthreads is 0. */
+static char *BLAKE3_File(const char *filename, long nthreads, char *buf)
+{
+    struct stat st;
+    char *result = 0;
+    int f, j;
+
     f = open(filename, O_RDONLY);
     if (f < 0) return 0;
-    while ((i = read(f, buffer, sizeof buffer)) > 0) {
-        blake3_hasher_update(&hasher, buffer, i);
+
+    if (nthreads <= 0) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
     }
+    if (nthreads > BLAKE3_MAX_THREADS) {
+        nthreads = BLAKE3_MAX_THREADS;
+    }
+    if (nthreads > 1 && fstat(f, &st) == 0 && S_ISREG(st.st_mode)
+            && st.st_size >= BLAKE3_PARALLEL_THRESHOLD && (uint64_t)st.st_size <= SIZE_MAX) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+        if (map != MAP_FAILED) {
+            result = BLAKE3_Parallel(map, (size_t)st.st_size, nthreads, buf);
+            j = errno;
+            munmap(map, (size_t)st.st_size);
+            close(f);
+            errno = j;
+            return result;
+        }
+    }
+
+    result = BLAKE3_Fd(f, buf);
     j = errno;
     close(f);
     errno = j;
-    if (i < 0) return 0;
+    return result;
+}
 
-    blake3_hasher_finalize(&hasher, digest, BLAKE3_DIGEST_LENGTH);
-    for (i = 0; i < BLAKE3_DIGEST_LENGTH; i++) {
-        buf[i+i] = hex[digest[i] >> 4];
-        buf[i+i+1] = hex[digest[i] & 0x0f];
-    }
-    buf[i+i] = '\0';
-    return buf;
+static void blake3_init(void *ctx)
+{
+    blake3_hasher_init((blake3_hasher *)ctx);
+}
+
+static void blake3_update(void *ctx, const unsigned char *data, size_t len)
+{
+    blake3_hasher_update((blake3_hasher *)ctx, data, len);
+}
+
+static void blake3_end(void *ctx, char *buf)
+{
+    BLAKE3_End((blake3_hasher *)ctx, buf);
 }
 
+const checksum_algo blake3_algo = {
+    "blake3", sizeof(blake3_hasher), blake3_init, blake3_update, blake3_end, 2*BLAKE3_DIGEST_LENGTH
+};
+
 int BLAKE3Cmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
 	char *file, *action;
 	char buf[2*BLAKE3_DIGEST_LENGTH + 1];
 	const char usage_message[] = "Usage: blake3 file";
 	Tcl_Obj *tcl_result;
+	long nthreads = 0;
 
-	if (objc != 3) {
-		Tcl_WrongNumArgs(interp, 1, objv, "action ?file?");
+	if (objc != 3 && objc != 4) {
+		Tcl_WrongNumArgs(interp, 1, objv, "action ?file? ?threads?");
 		return TCL_ERROR;
 	}
 
@@ -95,8 +368,11 @@ int BLAKE3Cmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Ob
 		return TCL_ERROR;
 	}
 	file = Tcl_GetString(objv[2]);
+	if (objc == 4 && Tcl_GetLongFromObj(interp, objv[3], &nthreads) != TCL_OK) {
+		return TCL_ERROR;
+	}
 
-	if (!BLAKE3_File(file, buf)) {
+	if (!BLAKE3_File(file, nthreads, buf)) {
 		int errsave = errno;
 		Tcl_SetResult(interp, "Could not open file: ", TCL_STATIC);
 		Tcl_AppendResult(interp, file, ": ", strerror(errsave), NULL);
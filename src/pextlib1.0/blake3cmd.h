@@ -36,6 +36,12 @@
 
 /**
  * A native command for BLAKE3 checksums.
+ *
+ * The syntax is:
+ * blake3 file path ?threads?
+ *      Return the BLAKE3 digest of the file at path. Large files are hashed
+ *      by up to threads threads, which defaults to the number of CPUs; 1
+ *      always reads the file sequentially in a single thread.
  */
 int BLAKE3Cmd(ClientData, Tcl_Interp *, int, Tcl_Obj *const objv[]);
 
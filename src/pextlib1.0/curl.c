@@ -34,14 +34,22 @@
 #include <config.h>
 #endif
 
+/* required for pwrite(2), ftruncate(2) and fseeko(3) on Linux */
+#define _XOPEN_SOURCE 600L
+/* keep kqueue(2) and friends visible on macOS */
+#define _DARWIN_C_SOURCE
+
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #ifdef HAVE_KQUEUE
 #include <sys/event.h>
 #include <sys/time.h>
@@ -49,12 +57,14 @@
 #else
 #include <sys/select.h>
 #endif
+#include <unistd.h>
 #include <utime.h>
 
 #include <curl/curl.h>
 
 #include <tcl.h>
 
+#include "multichecksumcmd.h"
 #include "curl.h"
 
 /*
@@ -65,6 +75,8 @@
 #define _CURL_MINIMUM_XFER_SPEED	((long)1024)		/* 1KB/sec */
 #define _CURL_MINIMUM_XFER_TIMEOUT	((long)(60))		/* 1 minute */
 #define _CURL_MINIMUM_PROGRESS_INTERVAL ((double)(0.2)) /* 0.2 seconds */
+#define _CURL_MINIMUM_SEGMENT_SIZE	((curl_off_t)(512 * 1024))	/* 512 KiB */
+#define _CURL_MAXIMUM_SEGMENTS		16
 
 #if defined CURLOPT_ACCEPT_ENCODING
 #define _CURL_ENCODING CURLOPT_ACCEPT_ENCODING
@@ -108,6 +120,7 @@ static int SetResultFromCurlMErrorCode(Tcl_Interp* interp, CURLMcode inErrorCode
 int CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
 int CurlIsNewerCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
 int CurlGetSizeCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
+int CurlProbeCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
 int CurlPostCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
 int CurlVersionCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
 
@@ -115,6 +128,9 @@ typedef struct {
 	Tcl_Interp *interp;
 	const char *proc;
 	double prevcalltime;
+	/* handle whose transfer time paces the updates if it isn't the
+	 * interpreter's handle, see fetch_segmented */
+	CURL *timer;
 } tcl_callback_t;
 
 static int CurlProgressHandler(tcl_callback_t *callback, double dltotal, double dlnow, double ultotal, double ulnow);
@@ -252,6 +268,784 @@ static CURLMcode handle_poll_events(CURLM *theMHandle, curl_poll_info_t *poll_in
 }
 
 
+/**
+ * Run the transfers added to a multi handle until all of them are done.
+ * Checks for TclX signals and services pending Tcl events in between.
+ *
+ * @param interp		current interpreter
+ * @param theMHandle	multi handle with the transfers
+ * @param cancelled		set by the interpreter to cancel the transfers
+ * @return TCL_OK, or TCL_ERROR with the interpreter result set if the
+ *         transfers were cancelled or could not be driven
+ */
+static int run_multi(Tcl_Interp *interp, CURLM *theMHandle, const int *cancelled)
+{
+    int theResult = TCL_OK;
+    CURLMcode theCurlMCode;
+    curl_poll_info_t poll_info;
+    int running; /* number of running transfers */
+
+    /* Init I/O event polling info */
+    if ((theResult = init_polling(interp, theMHandle, &poll_info)) != TCL_OK) {
+        /* interp result set by init_polling */
+        return theResult;
+    }
+
+    /* wait for events on the file descriptors used by curl and
+     * interleave with checks for TclX signals */
+    theCurlMCode = curl_multi_socket_action(theMHandle, CURL_SOCKET_TIMEOUT,
+                                            0, &running);
+    if (theCurlMCode != CURLM_OK) {
+        theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
+        running = 0;
+    }
+    while (running > 0) {
+        int rc; /* select() or kevent() return code */
+
+        if (*cancelled) {
+            /* Something requested to cancel the transfer */
+            Tcl_SetResult(interp, "Transfer cancelled", TCL_STATIC);
+            theResult = TCL_ERROR;
+            break;
+        }
+
+#ifdef HAVE_KQUEUE
+        /* read and write events delivered separately */
+        struct kevent eventlist[2];
+        rc = kevent(poll_info.eventfd, NULL, 0,
+                    eventlist, 2, &(poll_info.timeout));
+#else
+        /* select() overwrites the sets with the ready descriptors, keep the
+         * ones curl asked for to wait for the others next time */
+        curl_poll_info_t ready = poll_info;
+        rc = select(ready.nfds, &(ready.readfds),
+                    &(ready.writefds), &(ready.errorfds),
+                    &(ready.timeout));
+#endif
+        if (-1 == rc && errno != EINTR) {
+            /* check for signals first to avoid breaking our special
+             * handling of SIGINT and SIGTERM */
+            if (Tcl_AsyncReady()) {
+                theResult = Tcl_AsyncInvoke(interp, theResult);
+                if (theResult != TCL_OK) {
+                    break;
+                }
+            }
+
+            /* select error */
+            Tcl_SetResult(interp, strerror(errno), TCL_VOLATILE);
+            theResult = TCL_ERROR;
+            break;
+        }
+
+        if (rc > 0) {
+            /* call curl_multi_socket_action for each event */
+#ifdef HAVE_KQUEUE
+            theCurlMCode = handle_poll_events(theMHandle, rc, eventlist, &running);
+#else
+            theCurlMCode = handle_poll_events(theMHandle, &ready, &running);
+#endif
+        } else {
+            theCurlMCode = curl_multi_socket_action(theMHandle, CURL_SOCKET_TIMEOUT,
+                                                    0, &running);
+        }
+        if (theCurlMCode != CURLM_OK) {
+            theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
+            break;
+        }
+
+        /* process signals from TclX */
+        if (Tcl_AsyncReady()) {
+            theResult = Tcl_AsyncInvoke(interp, theResult);
+            if (theResult != TCL_OK) {
+                break;
+            }
+        }
+        /* Service any pending events */
+        while (Tcl_DoOneEvent((TCL_ALL_EVENTS & ~TCL_IDLE_EVENTS)|TCL_DONT_WAIT)) {}
+    }
+
+    /* uninstall callbacks since the structure they use is not persistent */
+    curl_multi_setopt(theMHandle, CURLMOPT_SOCKETFUNCTION, NULL);
+    curl_multi_setopt(theMHandle, CURLMOPT_TIMERFUNCTION, NULL);
+    curl_multi_setopt(theMHandle, CURLMOPT_SOCKETDATA, NULL);
+    curl_multi_setopt(theMHandle, CURLMOPT_TIMERDATA, NULL);
+
+#ifdef HAVE_KQUEUE
+    /* close kqueue fd */
+    if (poll_info.eventfd >= 0) {
+        close(poll_info.eventfd);
+    }
+#endif
+
+    return theResult;
+}
+
+/* ------------------------------------------------------------------------- **
+ * Digests of downloaded files
+ * ------------------------------------------------------------------------- */
+/* Digests of the data written to a file, computed while it is downloaded. */
+typedef struct {
+    FILE *file;
+    /* the requested types, as given */
+    Tcl_Obj *types;
+    int nalgos;
+    const checksum_algo *algos[CHECKSUM_MAX_ALGOS];
+    void *ctxs[CHECKSUM_MAX_ALGOS];
+    curl_off_t size;
+} curl_digests_t;
+
+/* Look up the algorithms for the list of types, which may also contain
+ * "size". Sets the interpreter result on error. */
+static int digests_init(Tcl_Interp *interp, curl_digests_t *digests, Tcl_Obj *types)
+{
+    Tcl_Obj **typev;
+    Tcl_Size typec;
+
+    if (Tcl_ListObjGetElements(interp, types, &typec, &typev) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    for (Tcl_Size t = 0; t < typec; t++) {
+        const char *type = Tcl_GetString(typev[t]);
+        const checksum_algo *algo = checksum_find_algo(type);
+        int i;
+
+        if (algo == NULL) {
+            if (strcmp(type, "size") == 0) {
+                continue;
+            }
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("curl fetch: unknown digest type \"%s\"", type));
+            return TCL_ERROR;
+        }
+        for (i = 0; i < digests->nalgos; i++) {
+            if (digests->algos[i] == algo) {
+                break;
+            }
+        }
+        if (i == digests->nalgos) {
+            digests->algos[digests->nalgos] = algo;
+            digests->ctxs[digests->nalgos] = ckalloc(algo->ctx_size);
+            algo->init(digests->ctxs[digests->nalgos]);
+            digests->nalgos++;
+        }
+    }
+    digests->types = types;
+    Tcl_IncrRefCount(types);
+    digests->size = 0;
+    return TCL_OK;
+}
+
+/* Start over, for a transfer that rewrites the file from the beginning. */
+static void digests_reset(curl_digests_t *digests)
+{
+    for (int i = 0; i < digests->nalgos; i++) {
+        digests->algos[i]->init(digests->ctxs[i]);
+    }
+    digests->size = 0;
+}
+
+static void digests_update(curl_digests_t *digests, const unsigned char *data, size_t len)
+{
+    for (int i = 0; i < digests->nalgos; i++) {
+        digests->algos[i]->update(digests->ctxs[i], data, len);
+    }
+    digests->size += (curl_off_t)len;
+}
+
+/* Add the first len bytes of the file, for data that wasn't downloaded by
+ * the write callback. Returns 0 or an errno value. */
+static int digests_read(curl_digests_t *digests, int fd, curl_off_t len)
+{
+    const size_t bufsize = 1024 * 1024;
+    unsigned char *buf = malloc(bufsize);
+    curl_off_t offset = 0;
+
+    if (buf == NULL) {
+        return ENOMEM;
+    }
+    while (offset < len) {
+        size_t want = (len - offset) < (curl_off_t)bufsize ? (size_t)(len - offset) : bufsize;
+        ssize_t got = pread(fd, buf, want, (off_t)offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            int err = got < 0 ? errno : EIO;
+            free(buf);
+            return err;
+        }
+        digests_update(digests, buf, (size_t)got);
+        offset += got;
+    }
+    free(buf);
+    return 0;
+}
+
+/* Write callback passing the data on to the file. */
+static size_t digests_write(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    curl_digests_t *digests = userdata;
+    size_t written = fwrite(ptr, size, nmemb, digests->file);
+
+    digests_update(digests, (const unsigned char *)ptr, written * size);
+    return written * size;
+}
+
+/* Return a list of type/digest pairs in the order of the requested types. */
+static Tcl_Obj *digests_result(curl_digests_t *digests)
+{
+    Tcl_Obj *result = Tcl_NewListObj(0, NULL);
+    Tcl_Obj **typev;
+    Tcl_Size typec;
+    char hex[CHECKSUM_MAX_ALGOS][2*64 + 1];
+
+    for (int i = 0; i < digests->nalgos; i++) {
+        digests->algos[i]->end(digests->ctxs[i], hex[i]);
+        /* the contexts can't be used anymore */
+        ckfree(digests->ctxs[i]);
+    }
+    Tcl_ListObjGetElements(NULL, digests->types, &typec, &typev);
+    for (Tcl_Size t = 0; t < typec; t++) {
+        const char *type = Tcl_GetString(typev[t]);
+        Tcl_ListObjAppendElement(NULL, result, typev[t]);
+        if (strcmp(type, "size") == 0) {
+            Tcl_ListObjAppendElement(NULL, result, Tcl_NewWideIntObj((Tcl_WideInt)digests->size));
+            continue;
+        }
+        for (int i = 0; i < digests->nalgos; i++) {
+            if (strcmp(digests->algos[i]->name, type) == 0) {
+                Tcl_ListObjAppendElement(NULL, result,
+                    Tcl_NewStringObj(hex[i], (Tcl_Size)digests->algos[i]->hex_length));
+                break;
+            }
+        }
+    }
+    digests->nalgos = 0;
+    return result;
+}
+
+static void digests_free(curl_digests_t *digests)
+{
+    for (int i = 0; i < digests->nalgos; i++) {
+        ckfree(digests->ctxs[i]);
+    }
+    digests->nalgos = 0;
+    if (digests->types != NULL) {
+        Tcl_DecrRefCount(digests->types);
+        digests->types = NULL;
+    }
+}
+
+/* ------------------------------------------------------------------------- **
+ * Response headers
+ * ------------------------------------------------------------------------- */
+/* Collect the headers of the last response (after redirects) in a dict
+ * keyed by lowercase header name. */
+static size_t response_header(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    Tcl_Obj **headers = userdata;
+    size_t len = size * nitems;
+    const char *colonp;
+    size_t colon, start, end;
+
+    if (len >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        Tcl_DecrRefCount(*headers);
+        *headers = Tcl_NewDictObj();
+        Tcl_IncrRefCount(*headers);
+        return len;
+    }
+    colonp = memchr(buffer, ':', len);
+    if (colonp == NULL || colonp == buffer) {
+        return len;
+    }
+    colon = (size_t)(colonp - buffer);
+    start = colon + 1;
+    while (start < len && (buffer[start] == ' ' || buffer[start] == '\t')) {
+        start++;
+    }
+    end = len;
+    while (end > start && isspace((unsigned char)buffer[end - 1])) {
+        end--;
+    }
+
+    Tcl_DString name;
+    Tcl_DStringInit(&name);
+    Tcl_DStringAppend(&name, buffer, (Tcl_Size)colon);
+    Tcl_DStringSetLength(&name, Tcl_UtfToLower(Tcl_DStringValue(&name)));
+    Tcl_DictObjPut(NULL, *headers,
+        Tcl_NewStringObj(Tcl_DStringValue(&name), Tcl_DStringLength(&name)),
+        Tcl_NewStringObj(buffer + start, (Tcl_Size)(end - start)));
+    Tcl_DStringFree(&name);
+    return len;
+}
+
+/* Whether a 416 response to a request resuming at offset says that the file
+ * is already complete, i.e. its Content-Range is "bytes *\/offset". */
+static int resume_complete(Tcl_Obj *headers, curl_off_t offset)
+{
+    Tcl_Obj *rangeObj = NULL;
+    const char *range;
+    char *end;
+    long long total;
+
+    if (Tcl_DictObjGet(NULL, headers, Tcl_NewStringObj("content-range", -1), &rangeObj) != TCL_OK
+            || rangeObj == NULL) {
+        return 0;
+    }
+    range = Tcl_GetString(rangeObj);
+    if (strncmp(range, "bytes */", 8) != 0) {
+        return 0;
+    }
+    errno = 0;
+    total = strtoll(range + 8, &end, 10);
+    return errno == 0 && end != range + 8 && *end == '\0' && total == (long long)offset;
+}
+
+/* ------------------------------------------------------------------------- **
+ * Batch probes
+ * ------------------------------------------------------------------------- */
+/* One HEAD request of curl probe, with the options of its own that
+ * curl getsize would take. */
+typedef struct {
+    CURL *handle;
+    const char *url;
+    const char *userpass;
+    const char *proxy;
+    const char *noproxy;
+    int ignoresslcert;
+    int done;
+    CURLcode result;
+    char errorString[CURL_ERROR_SIZE];
+} curl_probe_t;
+
+/**
+ * Parse a probe given as a list of curl getsize arguments.
+ *
+ * @return TCL_OK, or TCL_ERROR with the interpreter result set
+ */
+static int parse_probe(Tcl_Interp *interp, Tcl_Obj *spec, curl_probe_t *probe)
+{
+    Tcl_Size argc;
+    Tcl_Obj **argv;
+
+    if (Tcl_ListObjGetElements(interp, spec, &argc, &argv) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    if (argc < 1) {
+        Tcl_SetResult(interp, "curl probe: empty probe", TCL_STATIC);
+        return TCL_ERROR;
+    }
+    for (Tcl_Size i = 0; i < argc - 1; i++) {
+        const char *theOption = Tcl_GetString(argv[i]);
+        const char **value = NULL;
+
+        if (strcmp(theOption, "--ignore-ssl-cert") == 0) {
+            probe->ignoresslcert = 1;
+            continue;
+        } else if (strcmp(theOption, "-u") == 0) {
+            value = &probe->userpass;
+        } else if (strcmp(theOption, "--proxy") == 0) {
+            value = &probe->proxy;
+        } else if (strcmp(theOption, "--no-proxy") == 0) {
+            value = &probe->noproxy;
+        } else {
+            Tcl_ResetResult(interp);
+            Tcl_AppendResult(interp, "curl probe: unknown option ", theOption, NULL);
+            return TCL_ERROR;
+        }
+        /* check we also have the parameter */
+        if (i + 1 >= argc - 1) {
+            Tcl_ResetResult(interp);
+            Tcl_AppendResult(interp, "curl probe: ", theOption,
+                " option requires a parameter", NULL);
+            return TCL_ERROR;
+        }
+        *value = Tcl_GetString(argv[++i]);
+    }
+    probe->url = Tcl_GetString(argv[argc - 1]);
+    return TCL_OK;
+}
+
+/**
+ * Set up the handle of a probe like curl getsize does, but for a transfer
+ * that shares its connection with the others if the server can multiplex.
+ */
+static CURLcode setup_probe(curl_probe_t *probe)
+{
+    CURL *handle = probe->handle;
+    CURLcode code;
+
+    if ((code = curl_easy_setopt(handle, CURLOPT_URL, probe->url)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_PRIVATE, (void *)probe)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_MAXREDIRS, 50L)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_COOKIEJAR, "/dev/null")) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, (long)_CURL_CONNECTION_TIMEOUT)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, (long)_CURL_MINIMUM_XFER_SPEED)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, (long)_CURL_MINIMUM_XFER_TIMEOUT)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_NOBODY, 1L)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L)) != CURLE_OK
+            || (code = curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, probe->errorString)) != CURLE_OK) {
+        return code;
+    }
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    /* wait for a connection to the same host that can be multiplexed rather
+     * than opening another one */
+    if ((code = curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L)) != CURLE_OK) {
+        return code;
+    }
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    if ((code = curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS)) != CURLE_OK) {
+        return code;
+    }
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071304 && LIBCURL_VERSION_NUM <= 0x071307
+    /* FTP_PROXY workaround for Snow Leopard */
+    if (probe->proxy == NULL && strncmp(probe->url, "ftp:", 4) == 0) {
+        probe->proxy = getenv("FTP_PROXY");
+    }
+#endif
+    if (probe->proxy != NULL
+            && (code = curl_easy_setopt(handle, CURLOPT_PROXY, probe->proxy)) != CURLE_OK) {
+        return code;
+    }
+    if (probe->noproxy != NULL
+            && (code = curl_easy_setopt(handle, CURLOPT_NOPROXY, probe->noproxy)) != CURLE_OK) {
+        return code;
+    }
+    if (probe->ignoresslcert
+            && ((code = curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L)) != CURLE_OK
+                || (code = curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L)) != CURLE_OK)) {
+        return code;
+    }
+    if (probe->userpass != NULL
+            && (code = curl_easy_setopt(handle, CURLOPT_USERPWD, probe->userpass)) != CURLE_OK) {
+        return code;
+    }
+    return CURLE_OK;
+}
+
+/* ------------------------------------------------------------------------- **
+ * Segmented downloads
+ * ------------------------------------------------------------------------- */
+/* Returned by fetch_segmented if the file has to be fetched in one piece. */
+#define SEGMENTS_UNSUPPORTED (-1)
+
+struct curl_download;
+
+/* One byte range of a segmented download, written straight to its place in
+ * the output file. */
+typedef struct {
+    struct curl_download *download;
+    CURL *handle;
+    curl_off_t start;
+    curl_off_t len;
+    curl_off_t written;
+    double dlnow;
+    /* the server sent more than the range, i.e. it ignored it */
+    int overflow;
+    int done;
+    CURLcode result;
+    char errorString[CURL_ERROR_SIZE];
+} curl_segment_t;
+
+typedef struct curl_download {
+    int fd;
+    curl_off_t total;
+    int nsegs;
+    curl_segment_t *segs;
+    tcl_callback_t *progress;
+} curl_download_t;
+
+static size_t segment_write(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    curl_segment_t *seg = userdata;
+    size_t len = size * nmemb;
+    size_t done = 0;
+
+    if ((curl_off_t)len > seg->len - seg->written) {
+        seg->overflow = 1;
+        return 0;
+    }
+    while (done < len) {
+        ssize_t n = pwrite(seg->download->fd, ptr + done, len - done,
+                           (off_t)(seg->start + seg->written) + (off_t)done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    seg->written += (curl_off_t)len;
+    return len;
+}
+
+/* Report the progress of all segments together to the Tcl callback. */
+static int segment_progress(void *clientp, double dltotal UNUSED, double dlnow,
+                            double ultotal UNUSED, double ulnow UNUSED)
+{
+    curl_segment_t *seg = clientp;
+    curl_download_t *download = seg->download;
+    double now = 0.0;
+
+    seg->dlnow = dlnow;
+    for (int i = 0; i < download->nsegs; i++) {
+        now += download->segs[i].dlnow;
+    }
+    return CurlProgressHandler(download->progress, (double)download->total, now, 0.0, 0.0);
+}
+
+/* Note whether the last response (after redirects) accepts byte ranges. */
+static size_t probe_header(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    int *acceptRanges = userdata;
+    size_t len = size * nitems;
+
+    if (len >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        *acceptRanges = 0;
+    } else if (len >= 14 && strncasecmp(buffer, "Accept-Ranges:", 14) == 0) {
+        size_t i = 14;
+        while (i < len && (buffer[i] == ' ' || buffer[i] == '\t')) {
+            i++;
+        }
+        if (len - i >= 5 && strncasecmp(buffer + i, "bytes", 5) == 0) {
+            *acceptRanges = 1;
+        }
+    }
+    return len;
+}
+
+/**
+ * Download the URL set on theHandle in up to nsegs byte ranges at once, on
+ * connections of their own, writing to the file fd. A HEAD request first
+ * checks that the server accepts ranges and tells the size.
+ *
+ * @param progress		Tcl progress callback or NULL
+ * @param fileTime		set to the remote time of the file if not NULL
+ * @param effectiveURL	set to a malloc'ed copy of the URL after redirects
+ * @return TCL_OK, TCL_ERROR with the interpreter result set, or
+ *         SEGMENTS_UNSUPPORTED if nothing was written and the file has to
+ *         be fetched in one piece. On error, the file is truncated to the
+ *         part that was downloaded without gaps, so it can be resumed.
+ */
+static int fetch_segmented(Tcl_Interp *interp, CURLM *theMHandle, CURL *theHandle,
+                           int nsegs, int fd, const int *cancelled,
+                           tcl_callback_t *progress, long *fileTime,
+                           char **effectiveURL)
+{
+    int theResult = SEGMENTS_UNSUPPORTED;
+    int acceptRanges = 0;
+    char probeError[CURL_ERROR_SIZE];
+    CURL *probe;
+    CURLMsg *info;
+    char *url = NULL;
+    long responseCode = 0;
+    curl_off_t total = -1;
+    curl_download_t download = {
+        .fd = fd,
+        .nsegs = 0,
+        .segs = NULL,
+        .progress = progress
+    };
+    int msgs;
+
+    probeError[0] = '\0';
+    probe = curl_easy_duphandle(theHandle);
+    if (probe == NULL) {
+        return SEGMENTS_UNSUPPORTED;
+    }
+    if (curl_easy_setopt(probe, CURLOPT_NOBODY, 1L) != CURLE_OK
+            || curl_easy_setopt(probe, CURLOPT_NOPROGRESS, 1L) != CURLE_OK
+            || curl_easy_setopt(probe, CURLOPT_HEADERFUNCTION, probe_header) != CURLE_OK
+            || curl_easy_setopt(probe, CURLOPT_HEADERDATA, &acceptRanges) != CURLE_OK
+            || curl_easy_setopt(probe, CURLOPT_ERRORBUFFER, probeError) != CURLE_OK
+            || curl_multi_add_handle(theMHandle, probe) != CURLM_OK) {
+        curl_easy_cleanup(probe);
+        return SEGMENTS_UNSUPPORTED;
+    }
+    if (run_multi(interp, theMHandle, cancelled) != TCL_OK) {
+        curl_multi_remove_handle(theMHandle, probe);
+        curl_easy_cleanup(probe);
+        return TCL_ERROR;
+    }
+    while ((info = curl_multi_info_read(theMHandle, &msgs)) != NULL) {
+        if (info->msg == CURLMSG_DONE && info->easy_handle == probe && info->data.result == CURLE_OK) {
+            char *probeURL = NULL;
+            curl_easy_getinfo(probe, CURLINFO_RESPONSE_CODE, &responseCode);
+#if LIBCURL_VERSION_NUM >= 0x073700
+            curl_easy_getinfo(probe, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &total);
+#else
+            double length = -1.0;
+            curl_easy_getinfo(probe, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length);
+            total = (curl_off_t)length;
+#endif
+            if (curl_easy_getinfo(probe, CURLINFO_EFFECTIVE_URL, &probeURL) == CURLE_OK && probeURL != NULL) {
+                url = strdup(probeURL);
+            }
+        }
+    }
+    curl_multi_remove_handle(theMHandle, probe);
+    curl_easy_cleanup(probe);
+
+    /* Errors are left to the normal transfer to report. */
+    if (url == NULL || responseCode != 200 || !acceptRanges
+            || total < 2 * _CURL_MINIMUM_SEGMENT_SIZE) {
+        free(url);
+        return SEGMENTS_UNSUPPORTED;
+    }
+
+    if (nsegs > total / _CURL_MINIMUM_SEGMENT_SIZE) {
+        nsegs = (int)(total / _CURL_MINIMUM_SEGMENT_SIZE);
+    }
+    if (nsegs > _CURL_MAXIMUM_SEGMENTS) {
+        nsegs = _CURL_MAXIMUM_SEGMENTS;
+    }
+    download.total = total;
+    download.segs = calloc((size_t)nsegs, sizeof(*download.segs));
+    if (download.segs == NULL) {
+        free(url);
+        return SEGMENTS_UNSUPPORTED;
+    }
+
+    theResult = TCL_OK;
+    for (int i = 0; i < nsegs; i++) {
+        curl_segment_t *seg = &download.segs[i];
+        char range[64];
+
+        seg->download = &download;
+        seg->start = i * (total / nsegs);
+        seg->len = (i == nsegs - 1) ? total - seg->start : total / nsegs;
+        snprintf(range, sizeof(range), "%" CURL_FORMAT_CURL_OFF_T "-%" CURL_FORMAT_CURL_OFF_T,
+                 seg->start, seg->start + seg->len - 1);
+
+        seg->handle = curl_easy_duphandle(theHandle);
+        if (seg->handle == NULL) {
+            Tcl_SetResult(interp, "error in curl_easy_duphandle", TCL_STATIC);
+            theResult = TCL_ERROR;
+            break;
+        }
+        download.nsegs++;
+        /* fetch from where the probe was redirected to */
+        CURLcode theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_URL, url);
+        if (theCurlCode == CURLE_OK) {
+            theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_RANGE, range);
+        }
+        if (theCurlCode == CURLE_OK) {
+            theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_WRITEFUNCTION, segment_write);
+        }
+        if (theCurlCode == CURLE_OK) {
+            theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_WRITEDATA, seg);
+        }
+        if (theCurlCode == CURLE_OK) {
+            theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_ERRORBUFFER, seg->errorString);
+        }
+        if (theCurlCode == CURLE_OK) {
+            /* curl's own progress meter can't show several transfers */
+            theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_NOPROGRESS, progress == NULL ? 1L : 0L);
+        }
+        if (theCurlCode == CURLE_OK && progress != NULL) {
+            theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_PROGRESSFUNCTION, segment_progress);
+            if (theCurlCode == CURLE_OK) {
+                theCurlCode = curl_easy_setopt(seg->handle, CURLOPT_PROGRESSDATA, seg);
+            }
+        }
+        if (theCurlCode != CURLE_OK) {
+            theResult = SetResultFromCurlErrorCode(interp, theCurlCode);
+            break;
+        }
+        CURLMcode theCurlMCode = curl_multi_add_handle(theMHandle, seg->handle);
+        if (theCurlMCode != CURLM_OK) {
+            theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
+            break;
+        }
+    }
+
+    if (theResult == TCL_OK) {
+        if (progress != NULL) {
+            progress->timer = download.segs[0].handle;
+        }
+        theResult = run_multi(interp, theMHandle, cancelled);
+        if (progress != NULL) {
+            progress->timer = NULL;
+        }
+    }
+    while ((info = curl_multi_info_read(theMHandle, &msgs)) != NULL) {
+        for (int i = 0; i < download.nsegs; i++) {
+            if (info->msg == CURLMSG_DONE && info->easy_handle == download.segs[i].handle) {
+                download.segs[i].done = 1;
+                download.segs[i].result = info->data.result;
+            }
+        }
+    }
+
+    if (theResult == TCL_OK) {
+        for (int i = 0; i < download.nsegs; i++) {
+            curl_segment_t *seg = &download.segs[i];
+            long segResponseCode = 0;
+
+            curl_easy_getinfo(seg->handle, CURLINFO_RESPONSE_CODE, &segResponseCode);
+            if (seg->overflow || (seg->done && seg->result == CURLE_OK && segResponseCode != 206)) {
+                /* ranges didn't work after all */
+                theResult = SEGMENTS_UNSUPPORTED;
+                if (ftruncate(fd, 0) != 0) {
+                    Tcl_SetResult(interp, strerror(errno), TCL_VOLATILE);
+                    theResult = TCL_ERROR;
+                }
+                break;
+            }
+        }
+    }
+    if (theResult == TCL_OK) {
+        for (int i = 0; i < download.nsegs; i++) {
+            curl_segment_t *seg = &download.segs[i];
+
+            if (!seg->done || seg->result != CURLE_OK || seg->written != seg->len) {
+                if (seg->errorString[0] != '\0') {
+                    Tcl_SetResult(interp, seg->errorString, TCL_VOLATILE);
+                } else if (seg->done && seg->result != CURLE_OK) {
+                    Tcl_SetResult(interp, (char *)curl_easy_strerror(seg->result), TCL_VOLATILE);
+                } else {
+                    Tcl_SetResult(interp, "segmented transfer incomplete", TCL_STATIC);
+                }
+                theResult = TCL_ERROR;
+                break;
+            }
+        }
+    }
+
+    if (theResult == TCL_ERROR && download.nsegs > 0) {
+        /* keep what can be resumed */
+        curl_off_t complete = 0;
+        for (int i = 0; i < download.nsegs; i++) {
+            complete = download.segs[i].start + download.segs[i].written;
+            if (download.segs[i].written < download.segs[i].len) {
+                break;
+            }
+        }
+        (void) ftruncate(fd, (off_t)complete);
+    } else if (theResult == TCL_OK) {
+        if (fileTime != NULL) {
+            curl_easy_getinfo(download.segs[0].handle, CURLINFO_FILETIME, fileTime);
+        }
+        *effectiveURL = url;
+        url = NULL;
+    }
+
+    for (int i = 0; i < download.nsegs; i++) {
+        curl_multi_remove_handle(theMHandle, download.segs[i].handle);
+        curl_easy_cleanup(download.segs[i].handle);
+    }
+    free(download.segs);
+    free(url);
+    return theResult;
+}
+
+
 /**
  * Set the result if a libcurl error occurred return TCL_ERROR.
  * Otherwise, set the result to "" and return TCL_OK.
@@ -373,7 +1167,7 @@ static void cleanup_handle_if_needed(const char *theURL, curl_interpdata_t *inte
 /**
  * curl fetch subcommand entry point.
  *
- * syntax: curl fetch [--disable-epsv] [--ignore-ssl-cert] [--remote-time] [-u userpass] [--effective-url lasturlvar] [--progress "builtin"|callback] [--enable-compression] url filename
+ * syntax: curl fetch [--disable-epsv] [--ignore-ssl-cert] [--remote-time] [--resume] [--segments n] [--digests types] [-u userpass] [--effective-url lasturlvar] [--response-code codevar] [--response-headers headersvar] [--progress "builtin"|callback] [--enable-compression] url filename
  *
  * @param interp		current interpreter
  * @param objc			number of parameters
@@ -386,6 +1180,12 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 	bool handleAdded = false;
 	FILE* theFile = NULL;
 	char theErrorString[CURL_ERROR_SIZE];
+	curl_digests_t digests = {
+		.nalgos = 0,
+		.types = NULL
+	};
+	Tcl_Obj *theDigests = NULL;
+	Tcl_Obj *responseHeaders = NULL;
 	curl_interpdata_t *interpdata = Tcl_GetAssocData(interp, "pextlib::curl::interpdata", NULL);
 
 	/* Always 0-initialize the error string, since older curl versions may not
@@ -398,14 +1198,20 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		int useepsv = 1;
 		int ignoresslcert = 0;
 		int remotetime = 0;
+		int resume = 0;
+		int segments = 1;
+		Tcl_Obj* digestTypes = NULL;
 		const char* theUserPassString = NULL;
 		const char* effectiveURLVarName = NULL;
+		const char* responseCodeVarName = NULL;
+		const char* responseHeadersVarName = NULL;
 		tcl_callback_t progressCallback = {
 			.interp = interp,
 			.proc = NULL,
 			.prevcalltime = 0.0
 		};
 		char* effectiveURL = NULL;
+		char* segmentedURL = NULL;
 		char* userAgent = PACKAGE_NAME "/" PACKAGE_VERSION " libcurl/" LIBCURL_VERSION;
 		const int MAXHTTPHEADERS = 100;
 		int numHTTPHeaders = 0;
@@ -423,7 +1229,10 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		struct CURLMsg *info = NULL;
 		int running; /* number of running transfers */
 		char* acceptEncoding = NULL;
-		curl_poll_info_t poll_info;
+		int theFileDescriptor;
+		curl_off_t resumeFrom = 0;
+		bool resumedComplete = false;
+		int segmentedResult = SEGMENTS_UNSUPPORTED;
 
         /* allow cancelling asynchronous transfers */
 		int cancelled = 0;
@@ -450,6 +1259,42 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 				ignoresslcert = 1;
 			} else if (strcmp(theOption, "--remote-time") == 0) {
 				remotetime = 1;
+			} else if (strcmp(theOption, "--resume") == 0) {
+				resume = 1;
+			} else if (strcmp(theOption, "--segments") == 0) {
+				/* check we also have the parameter */
+				if (optioncrsr < lastoption) {
+					optioncrsr++;
+					if (Tcl_GetIntFromObj(interp, objv[optioncrsr], &segments) != TCL_OK) {
+						theResult = TCL_ERROR;
+						break;
+					}
+					if (segments < 1) {
+						Tcl_SetResult(interp,
+							"curl fetch: --segments option requires a positive integer",
+							TCL_STATIC);
+						theResult = TCL_ERROR;
+						break;
+					}
+				} else {
+					Tcl_SetResult(interp,
+						"curl fetch: --segments option requires a parameter",
+						TCL_STATIC);
+					theResult = TCL_ERROR;
+					break;
+				}
+			} else if (strcmp(theOption, "--digests") == 0) {
+				/* check we also have the parameter */
+				if (optioncrsr < lastoption) {
+					optioncrsr++;
+					digestTypes = objv[optioncrsr];
+				} else {
+					Tcl_SetResult(interp,
+						"curl fetch: --digests option requires a parameter",
+						TCL_STATIC);
+					theResult = TCL_ERROR;
+					break;
+				}
 			} else if (strcmp(theOption, "-u") == 0) {
 				/* check we also have the parameter */
 				if (optioncrsr < lastoption) {
@@ -474,6 +1319,30 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 					theResult = TCL_ERROR;
 					break;
 				}
+			} else if (strcmp(theOption, "--response-code") == 0) {
+				/* check we also have the parameter */
+				if (optioncrsr < lastoption) {
+					optioncrsr++;
+					responseCodeVarName = Tcl_GetString(objv[optioncrsr]);
+				} else {
+					Tcl_SetResult(interp,
+						"curl fetch: --response-code option requires a parameter",
+						TCL_STATIC);
+					theResult = TCL_ERROR;
+					break;
+				}
+			} else if (strcmp(theOption, "--response-headers") == 0) {
+				/* check we also have the parameter */
+				if (optioncrsr < lastoption) {
+					optioncrsr++;
+					responseHeadersVarName = Tcl_GetString(objv[optioncrsr]);
+				} else {
+					Tcl_SetResult(interp,
+						"curl fetch: --response-headers option requires a parameter",
+						TCL_STATIC);
+					theResult = TCL_ERROR;
+					break;
+				}
 			} else if (strcmp(theOption, "--user-agent") == 0) {
 				/* check we also have the parameter */
 				if (optioncrsr < lastoption) {
@@ -575,8 +1444,24 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 			break;
 		}
 
-		/* Open the file */
-		theFile = fopen(theFilePath, "w");
+		if (digestTypes != NULL) {
+			if ((theResult = digests_init(interp, &digests, digestTypes)) != TCL_OK) {
+				break;
+			}
+		}
+
+		/* Open the file. Not in append mode, segments are written at their
+		 * offsets. Digests may need to read back what's already there. */
+		theFileDescriptor = open(theFilePath,
+			(digestTypes != NULL ? O_RDWR : O_WRONLY) | O_CREAT | (resume ? 0 : O_TRUNC), 0666);
+		if (theFileDescriptor != -1) {
+			theFile = fdopen(theFileDescriptor, digestTypes != NULL ? "r+" : "w");
+			if (theFile == NULL) {
+				int errsave = errno;
+				close(theFileDescriptor);
+				errno = errsave;
+			}
+		}
 		if (theFile == NULL) {
 			int errsave = errno;
 			Tcl_SetResult(interp, "Failed to open file ", TCL_STATIC);
@@ -585,6 +1470,23 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 			break;
 		}
 
+		/* continue after what a previous attempt left behind */
+		if (resume) {
+			if (fseeko(theFile, 0, SEEK_END) != 0 || (resumeFrom = ftello(theFile)) < 0) {
+				Tcl_SetResult(interp, strerror(errno), TCL_VOLATILE);
+				theResult = TCL_ERROR;
+				break;
+			}
+			if (digestTypes != NULL && resumeFrom > 0) {
+				int err = digests_read(&digests, theFileDescriptor, resumeFrom);
+				if (err != 0) {
+					Tcl_SetResult(interp, strerror(err), TCL_VOLATILE);
+					theResult = TCL_ERROR;
+					break;
+				}
+			}
+		}
+
 #if LIBCURL_VERSION_NUM >= 0x074d00
 		cleanup_handle_if_needed(theURL, interpdata);
 #endif
@@ -711,9 +1613,32 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 			theResult = SetResultFromCurlErrorCode(interp, theCurlCode);
 			break;
 		}
-
-		/* write to the file */
-		theCurlCode = curl_easy_setopt(theHandle, CURLOPT_WRITEDATA, theFile);
+
+		/* collect the response headers, which also tell whether a file
+		 * being resumed is complete already */
+		if (responseHeadersVarName != NULL || resumeFrom > 0) {
+			responseHeaders = Tcl_NewDictObj();
+			Tcl_IncrRefCount(responseHeaders);
+			theCurlCode = curl_easy_setopt(theHandle, CURLOPT_HEADERFUNCTION, response_header);
+			if (theCurlCode == CURLE_OK) {
+				theCurlCode = curl_easy_setopt(theHandle, CURLOPT_HEADERDATA, &responseHeaders);
+			}
+			if (theCurlCode != CURLE_OK) {
+				theResult = SetResultFromCurlErrorCode(interp, theCurlCode);
+				break;
+			}
+		}
+
+		/* write to the file */
+		if (digestTypes != NULL) {
+			digests.file = theFile;
+			theCurlCode = curl_easy_setopt(theHandle, CURLOPT_WRITEFUNCTION, digests_write);
+			if (theCurlCode == CURLE_OK) {
+				theCurlCode = curl_easy_setopt(theHandle, CURLOPT_WRITEDATA, &digests);
+			}
+		} else {
+			theCurlCode = curl_easy_setopt(theHandle, CURLOPT_WRITEDATA, theFile);
+		}
 		if (theCurlCode != CURLE_OK) {
 			theResult = SetResultFromCurlErrorCode(interp, theCurlCode);
 			break;
@@ -809,108 +1734,102 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 			break;
 		}
 
-        /* Init I/O event polling info */
-        if ((theResult = init_polling(interp, theMHandle, &poll_info)) != TCL_OK) {
-            /* interp result set by init_polling */
-            break;
-        }
-
-		/* add the easy handle to the multi handle */
-		theCurlMCode = curl_multi_add_handle(theMHandle, theHandle);
-		if (theCurlMCode != CURLM_OK) {
-			theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
-			break;
+		if (resumeFrom > 0) {
+			theCurlCode = curl_easy_setopt(theHandle, CURLOPT_RESUME_FROM_LARGE, resumeFrom);
+			if (theCurlCode != CURLE_OK) {
+				theResult = SetResultFromCurlErrorCode(interp, theCurlCode);
+				break;
+			}
 		}
-		handleAdded = true;
 
-        /* wait for events on the file descriptors used by curl and
-         * interleave with checks for TclX signals */
-        theCurlMCode = curl_multi_socket_action(theMHandle, CURL_SOCKET_TIMEOUT,
-                                                0, &running);
-        if (theCurlMCode != CURLM_OK) {
-            theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
-            break;
-        }
-		do {
-			int rc; /* select() or kevent() return code */
+		/* Fetch byte ranges over several connections at once if asked to.
+		 * Compressed transfers have no byte offsets to split at, and the
+		 * response of a single transfer is needed to report on it. */
+		if (segments > 1 && resumeFrom == 0 && acceptEncoding == NULL
+				&& responseCodeVarName == NULL && responseHeadersVarName == NULL) {
+			segmentedResult = fetch_segmented(interp, theMHandle, theHandle, segments,
+				theFileDescriptor, &cancelled,
+				(noprogress == 0 && strcmp(progressCallback.proc, "builtin") != 0) ? &progressCallback : NULL,
+				remotetime ? &theFileTime : NULL, &segmentedURL);
+			if (segmentedResult != SEGMENTS_UNSUPPORTED) {
+				theResult = segmentedResult;
+			}
+		}
 
-            if (cancelled) {
-                /* Something requested to cancel the transfer */
-                Tcl_SetResult(interp, "Transfer cancelled", TCL_STATIC);
-                theResult = TCL_ERROR;
+		while (segmentedResult == SEGMENTS_UNSUPPORTED) {
+			/* add the easy handle to the multi handle */
+			theCurlMCode = curl_multi_add_handle(theMHandle, theHandle);
+			if (theCurlMCode != CURLM_OK) {
+				theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
 				break;
-            }
-
-#ifdef HAVE_KQUEUE
-            /* read and write events delivered separately */
-            struct kevent eventlist[2];
-            rc = kevent(poll_info.eventfd, NULL, 0,
-                        eventlist, 2, &(poll_info.timeout));
-#else
-            rc = select(poll_info.nfds, &(poll_info.readfds),
-                        &(poll_info.writefds), &(poll_info.errorfds),
-                        &(poll_info.timeout));
-#endif
-			if (-1 == rc && errno != EINTR) {
-				/* check for signals first to avoid breaking our special
-				 * handling of SIGINT and SIGTERM */
-				if (Tcl_AsyncReady()) {
-					theResult = Tcl_AsyncInvoke(interp, theResult);
-					if (theResult != TCL_OK) {
-						break;
-					}
-				}
+			}
+			handleAdded = true;
 
-				/* select error */
-				Tcl_SetResult(interp, strerror(errno), TCL_VOLATILE);
-				theResult = TCL_ERROR;
+			theResult = run_multi(interp, theMHandle, &cancelled);
+			if (theResult != TCL_OK) {
 				break;
 			}
 
-            if (rc > 0) {
-                /* call curl_multi_socket_action for each event */
-#ifdef HAVE_KQUEUE
-                theCurlMCode = handle_poll_events(theMHandle, rc, eventlist, &running);
-#else
-                theCurlMCode = handle_poll_events(theMHandle, &poll_info, &running);
-#endif
-            } else {
-                theCurlMCode = curl_multi_socket_action(theMHandle, CURL_SOCKET_TIMEOUT,
-                                                        0, &running);
-            }
-            if (theCurlMCode != CURLM_OK) {
-                theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
-                break;
-            }
+			/* Find out whether the transfer succeeded or failed. */
+			info = curl_multi_info_read(theMHandle, &running);
+			if (running > 0) {
+				fprintf(stderr, "Warning: curl_multi_info_read has %d more structs available\n", running);
+			}
 
-			/* process signals from TclX */
-			if (Tcl_AsyncReady()) {
-				theResult = Tcl_AsyncInvoke(interp, theResult);
-				if (theResult != TCL_OK) {
+			if (info != NULL && info->msg == CURLMSG_DONE && resumeFrom > 0) {
+				long theResponseCode = 0;
+				bool restart = info->data.result == CURLE_RANGE_ERROR;
+
+				/* Asking for the bytes after the end of the file gets a 416,
+				 * which libcurl either fails with or passes on along with
+				 * the error page. */
+				if ((info->data.result == CURLE_OK || info->data.result == CURLE_HTTP_RETURNED_ERROR)
+						&& curl_easy_getinfo(theHandle, CURLINFO_RESPONSE_CODE, &theResponseCode) == CURLE_OK
+						&& theResponseCode == 416) {
+					if (!resume_complete(responseHeaders, resumeFrom)) {
+						restart = true;
+					} else {
+						/* drop whatever came after the end of the file */
+						int err = 0;
+						if (fflush(theFile) != 0 || ftruncate(theFileDescriptor, resumeFrom) != 0
+								|| fseeko(theFile, 0, SEEK_END) != 0) {
+							err = errno;
+						} else if (digestTypes != NULL && digests.size != resumeFrom) {
+							digests_reset(&digests);
+							err = digests_read(&digests, theFileDescriptor, resumeFrom);
+						}
+						if (err != 0) {
+							Tcl_SetResult(interp, strerror(err), TCL_VOLATILE);
+							theResult = TCL_ERROR;
+							break;
+						}
+						resumedComplete = true;
+					}
+				}
+				if (!restart) {
 					break;
 				}
-			}
-			/* Service any pending events */
-			while (Tcl_DoOneEvent((TCL_ALL_EVENTS & ~TCL_IDLE_EVENTS)|TCL_DONT_WAIT)) {}
-		} while (running > 0);
-
-        /* uninstall callbacks since the structure they use is not persistent */
-        curl_multi_setopt(theMHandle, CURLMOPT_SOCKETFUNCTION, NULL);
-        curl_multi_setopt(theMHandle, CURLMOPT_TIMERFUNCTION, NULL);
-        curl_multi_setopt(theMHandle, CURLMOPT_SOCKETDATA, NULL);
-        curl_multi_setopt(theMHandle, CURLMOPT_TIMERDATA, NULL);
-
-#ifdef HAVE_KQUEUE
-        /* close kqueue fd */
-        if (poll_info.eventfd >= 0) {
-            close(poll_info.eventfd);
-        }
-#endif
 
-		/* Find out whether the transfer succeeded or failed. */
-		info = curl_multi_info_read(theMHandle, &running);
-		if (running > 0) {
-			fprintf(stderr, "Warning: curl_multi_info_read has %d more structs available\n", running);
+				/* the server can't resume, start over */
+				curl_multi_remove_handle(theMHandle, theHandle);
+				handleAdded = false;
+				if (fflush(theFile) != 0 || ftruncate(theFileDescriptor, 0) != 0
+						|| fseeko(theFile, 0, SEEK_SET) != 0) {
+					Tcl_SetResult(interp, strerror(errno), TCL_VOLATILE);
+					theResult = TCL_ERROR;
+					break;
+				}
+				resumeFrom = 0;
+				digests_reset(&digests);
+				theCurlCode = curl_easy_setopt(theHandle, CURLOPT_RESUME_FROM_LARGE, resumeFrom);
+				if (theCurlCode != CURLE_OK) {
+					theResult = SetResultFromCurlErrorCode(interp, theCurlCode);
+					break;
+				}
+				theErrorString[0] = '\0';
+				continue;
+			}
+			break;
 		}
 
 		/* free header memory */
@@ -922,64 +1841,116 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		}
 
 		/* check for errors in the loop */
-		if (theResult != TCL_OK || theCurlMCode != CURLM_OK) {
-			break;
-		}
-
-		/* we should always get CURLMSG_DONE unless we aborted due to a Tcl
-		 * signal */
-		if (info == NULL) {
-			Tcl_SetResult(interp, "curl_multi_info_read() returned NULL", TCL_STATIC);
-			theResult = TCL_ERROR;
+		if (theResult != TCL_OK) {
 			break;
 		}
 
-		if (info->msg != CURLMSG_DONE) {
-			snprintf(theErrorString, sizeof(theErrorString), "curl_multi_info_read() returned unexpected {.msg = %d, .data.result = %d}", info->msg, info->data.result);
-			Tcl_SetResult(interp, theErrorString, TCL_VOLATILE);
-			theResult = TCL_ERROR;
-			break;
-		}
+		if (segmentedResult == SEGMENTS_UNSUPPORTED) {
+			/* we should always get CURLMSG_DONE unless we aborted due to
+			 * a Tcl signal */
+			if (info == NULL) {
+				Tcl_SetResult(interp, "curl_multi_info_read() returned NULL", TCL_STATIC);
+				theResult = TCL_ERROR;
+				break;
+			}
 
-		if (info->data.result != CURLE_OK) {
-			/* execution failed, use the error string if it is set */
-			if (theErrorString[0] != '\0') {
+			if (info->msg != CURLMSG_DONE) {
+				snprintf(theErrorString, sizeof(theErrorString), "curl_multi_info_read() returned unexpected {.msg = %d, .data.result = %d}", info->msg, info->data.result);
 				Tcl_SetResult(interp, theErrorString, TCL_VOLATILE);
-			} else {
-				/* When the error buffer does not hold useful information,
-				 * generate our own message. Use a larger buffer since we add
-				 * a significant amount of text. */
-				char errbuf[256 + CURL_ERROR_SIZE];
-				snprintf(errbuf, sizeof(errbuf),
-					"curl_multi_info_read() returned {.msg = CURLMSG_DONE, "
-					".data.result = %d (!= CURLE_OK)}, but the error buffer "
-					"is not set. curl_easy_strerror(.data.result): %s",
-					info->data.result, curl_easy_strerror(info->data.result));
-				Tcl_SetResult(interp, errbuf, TCL_VOLATILE);
+				theResult = TCL_ERROR;
+				break;
 			}
-			theResult = TCL_ERROR;
-			break;
+
+			if (info->data.result != CURLE_OK && !resumedComplete) {
+				/* execution failed, use the error string if it is set */
+				if (theErrorString[0] != '\0') {
+					Tcl_SetResult(interp, theErrorString, TCL_VOLATILE);
+				} else {
+					/* When the error buffer does not hold useful information,
+					 * generate our own message. Use a larger buffer since we
+					 * add a significant amount of text. */
+					char errbuf[256 + CURL_ERROR_SIZE];
+					snprintf(errbuf, sizeof(errbuf),
+						"curl_multi_info_read() returned {.msg = CURLMSG_DONE, "
+						".data.result = %d (!= CURLE_OK)}, but the error buffer "
+						"is not set. curl_easy_strerror(.data.result): %s",
+						info->data.result, curl_easy_strerror(info->data.result));
+					Tcl_SetResult(interp, errbuf, TCL_VOLATILE);
+				}
+				theResult = TCL_ERROR;
+				break;
+			}
+
+			if (remotetime) {
+				theCurlCode = curl_easy_getinfo(theHandle, CURLINFO_FILETIME, &theFileTime);
+				if (theCurlCode != CURLE_OK) {
+					theFileTime = 0;
+				}
+			}
+		} else if (digestTypes != NULL) {
+			/* segments arrive out of order, hash the file once it's
+			 * complete */
+			struct stat st;
+			int err = fstat(theFileDescriptor, &st) != 0 ? errno
+				: digests_read(&digests, theFileDescriptor, (curl_off_t)st.st_size);
+			if (err != 0) {
+				Tcl_SetResult(interp, strerror(err), TCL_VOLATILE);
+				theResult = TCL_ERROR;
+				break;
+			}
+		}
+
+		if (digestTypes != NULL) {
+			theDigests = digests_result(&digests);
 		}
 
 		/* close the file */
 		(void) fclose(theFile);
 		theFile = NULL;
 
-		if (remotetime) {
-			theCurlCode = curl_easy_getinfo(theHandle, CURLINFO_FILETIME, &theFileTime);
-			if (theCurlCode == CURLE_OK && theFileTime > 0) {
-				struct utimbuf times;
-				times.actime = (time_t)theFileTime;
-				times.modtime = (time_t)theFileTime;
-				utime(theFilePath, &times); /* set the time we got */
-			}
+		if (remotetime && theFileTime > 0) {
+			struct utimbuf times;
+			times.actime = (time_t)theFileTime;
+			times.modtime = (time_t)theFileTime;
+			utime(theFilePath, &times); /* set the time we got */
 		}
 
 		/* If --effective-url option was given, set given variable name to last effective url used by curl */
 		if (effectiveURLVarName != NULL) {
-			theCurlCode = curl_easy_getinfo(theHandle, CURLINFO_EFFECTIVE_URL, &effectiveURL);
+			if (segmentedURL != NULL) {
+				effectiveURL = segmentedURL;
+			} else {
+				theCurlCode = curl_easy_getinfo(theHandle, CURLINFO_EFFECTIVE_URL, &effectiveURL);
+				if (theCurlCode != CURLE_OK) {
+					effectiveURL = NULL;
+				}
+			}
 			Tcl_SetVar(interp, effectiveURLVarName,
-				(effectiveURL == NULL || theCurlCode != CURLE_OK) ? "" : effectiveURL, 0);
+				(effectiveURL == NULL) ? "" : effectiveURL, 0);
+		}
+		free(segmentedURL);
+
+		/* If --response-code option was given, set given variable name to
+		 * the status code of the last response, e.g. 304 for a conditional
+		 * request that found the file unchanged */
+		if (responseCodeVarName != NULL) {
+			long theResponseCode = 0;
+			theCurlCode = curl_easy_getinfo(theHandle, CURLINFO_RESPONSE_CODE, &theResponseCode);
+			if (theCurlCode != CURLE_OK) {
+				theResponseCode = 0;
+			}
+			Tcl_SetVar2Ex(interp, responseCodeVarName, NULL,
+				Tcl_NewIntObj((int)theResponseCode), 0);
+		}
+
+		/* If --response-headers option was given, set given variable name to
+		 * a dict of the headers of the last response */
+		if (responseHeadersVarName != NULL) {
+			Tcl_SetVar2Ex(interp, responseHeadersVarName, NULL, responseHeaders, 0);
+		}
+
+		if (theDigests != NULL) {
+			Tcl_SetObjResult(interp, theDigests);
 		}
 	} while (0);
 
@@ -999,6 +1970,10 @@ CurlFetchCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 	if (theFile != NULL) {
 		fclose(theFile);
 	}
+	digests_free(&digests);
+	if (responseHeaders != NULL) {
+		Tcl_DecrRefCount(responseHeaders);
+	}
 
 	return theResult;
 }
@@ -1731,6 +2706,184 @@ CurlGetSizeCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 	return theResult;
 }
 
+/**
+ * curl probe subcommand entry point.
+ *
+ * syntax: curl probe probe ?probe ...?
+ *
+ * Each probe is a list of the arguments curl getsize would take, i.e.
+ * options followed by a URL. The HEAD requests all run at once, on the
+ * connections of the other curl commands, and requests to the same server
+ * share a connection if it can multiplex them. Returns a list of sizes in
+ * the order of the probes, -1 for those that failed or have no size.
+ *
+ * @param interp		current interpreter
+ * @param objc			number of parameters
+ * @param objv			parameters
+ */
+int
+CurlProbeCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
+{
+	int theResult = TCL_OK;
+	int nprobes = objc - 2;
+	curl_probe_t *probes = NULL;
+	CURLM *privateMHandle = NULL;
+	CURLM *theMHandle = NULL;
+	curl_interpdata_t *interpdata = Tcl_GetAssocData(interp, "pextlib::curl::interpdata", NULL);
+
+	/* allow cancelling asynchronous transfers */
+	int cancelled = 0;
+	if ((theResult = Tcl_LinkVar(interp,
+								 "::pextlib::curl::cancelled",
+								 (char *)&cancelled,
+								 TCL_LINK_BOOLEAN)) != TCL_OK) {
+		/* Tcl_LinkVar already sets an error message */
+		return theResult;
+	}
+
+	do {
+		CURLcode theCurlCode;
+		CURLMcode theCurlMCode;
+		struct CURLMsg *info;
+		int remaining;
+		Tcl_Obj *sizes;
+
+		probes = calloc((size_t)nprobes, sizeof(curl_probe_t));
+		if (probes == NULL) {
+			Tcl_SetResult(interp, strerror(errno), TCL_VOLATILE);
+			theResult = TCL_ERROR;
+			break;
+		}
+		for (int i = 0; i < nprobes; i++) {
+			if ((theResult = parse_probe(interp, objv[i + 2], &probes[i])) != TCL_OK) {
+				break;
+			}
+		}
+		if (theResult != TCL_OK) {
+			break;
+		}
+
+#if LIBCURL_VERSION_NUM >= 0x074d00
+		/* The versions that cleanup_handle_if_needed works around can't
+		 * share connections between hosts and protocols either, so only
+		 * share them within the batch. */
+		set_curl_version_info();
+		if (libcurl_version_info == NULL
+				|| (libcurl_version_info->version_num >= 0x080600
+					&& libcurl_version_info->version_num < 0x080800)) {
+			privateMHandle = curl_multi_init();
+			if (privateMHandle == NULL) {
+				theResult = TCL_ERROR;
+				Tcl_SetResult(interp, "error in curl_multi_init", TCL_STATIC);
+				break;
+			}
+		}
+#endif
+		if (privateMHandle != NULL) {
+			theMHandle = privateMHandle;
+		} else {
+			if (interpdata->theMHandle == NULL) {
+				/* Re-use existing multi handle if theMHandle isn't NULL */
+				interpdata->theMHandle = curl_multi_init();
+				if (interpdata->theMHandle == NULL) {
+					theResult = TCL_ERROR;
+					Tcl_SetResult(interp, "error in curl_multi_init", TCL_STATIC);
+					break;
+				}
+			}
+			theMHandle = interpdata->theMHandle;
+		}
+
+#if LIBCURL_VERSION_NUM >= 0x072b00
+		/* the default since 7.62.0 */
+		theCurlMCode = curl_multi_setopt(theMHandle, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+		if (theCurlMCode != CURLM_OK) {
+			theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
+			break;
+		}
+#endif
+
+		for (int i = 0; i < nprobes; i++) {
+			probes[i].handle = curl_easy_init();
+			if (probes[i].handle == NULL) {
+				theResult = TCL_ERROR;
+				Tcl_SetResult(interp, "error in curl_easy_init", TCL_STATIC);
+				break;
+			}
+			theCurlCode = setup_probe(&probes[i]);
+			if (theCurlCode != CURLE_OK) {
+				theResult = SetResultFromCurlErrorCode(interp, theCurlCode);
+				break;
+			}
+			theCurlMCode = curl_multi_add_handle(theMHandle, probes[i].handle);
+			if (theCurlMCode != CURLM_OK) {
+				curl_easy_cleanup(probes[i].handle);
+				probes[i].handle = NULL;
+				theResult = SetResultFromCurlMErrorCode(interp, theCurlMCode);
+				break;
+			}
+		}
+		if (theResult != TCL_OK) {
+			break;
+		}
+
+		if ((theResult = run_multi(interp, theMHandle, &cancelled)) != TCL_OK) {
+			break;
+		}
+
+		/* Find out which probes succeeded. */
+		while ((info = curl_multi_info_read(theMHandle, &remaining)) != NULL) {
+			curl_probe_t *probe = NULL;
+			if (info->msg != CURLMSG_DONE
+					|| curl_easy_getinfo(info->easy_handle, CURLINFO_PRIVATE, (char **)&probe) != CURLE_OK
+					|| probe == NULL) {
+				continue;
+			}
+			probe->done = 1;
+			probe->result = info->data.result;
+		}
+
+		sizes = Tcl_NewListObj(0, NULL);
+		for (int i = 0; i < nprobes; i++) {
+			Tcl_WideInt size = -1;
+			if (probes[i].done && probes[i].result == CURLE_OK) {
+#if LIBCURL_VERSION_NUM >= 0x073700
+				curl_off_t length;
+				if (curl_easy_getinfo(probes[i].handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK) {
+					size = (Tcl_WideInt)length;
+				}
+#else
+				double length;
+				if (curl_easy_getinfo(probes[i].handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length) == CURLE_OK) {
+					size = (Tcl_WideInt)length;
+				}
+#endif
+			}
+			Tcl_ListObjAppendElement(NULL, sizes, Tcl_NewWideIntObj(size));
+		}
+		Tcl_SetObjResult(interp, sizes);
+	} while (0);
+
+	Tcl_UnlinkVar(interp, "::pextlib::curl::cancelled");
+
+	if (probes != NULL) {
+		for (int i = 0; i < nprobes; i++) {
+			if (probes[i].handle != NULL) {
+				/* ignore errors to avoid cluttering the real error info that
+				 * might be somewhere further up */
+				curl_multi_remove_handle(theMHandle, probes[i].handle);
+				curl_easy_cleanup(probes[i].handle);
+			}
+		}
+		free(probes);
+	}
+	if (privateMHandle != NULL) {
+		curl_multi_cleanup(privateMHandle);
+	}
+
+	return theResult;
+}
+
 /**
  * curl post postdata url
  *
@@ -2073,12 +3226,13 @@ CurlCmd(
 		kCurlFetch,
 		kCurlIsNewer,
 		kCurlGetSize,
+		kCurlProbe,
 		kCurlPost,
 		kCurlVersion
 	} EOption;
 
 	static const char *options[] = {
-		"fetch", "isnewer", "getsize", "post", "version", NULL
+		"fetch", "isnewer", "getsize", "probe", "post", "version", NULL
 	};
 	int theResult = TCL_OK;
 	EOption theOptionIndex;
@@ -2119,6 +3273,9 @@ CurlCmd(
 		case kCurlGetSize:
 			theResult = CurlGetSizeCmd(interp, objc, objv);
 			break;
+		case kCurlProbe:
+			theResult = CurlProbeCmd(interp, objc, objv);
+			break;
 		case kCurlPost:
 			theResult = CurlPostCmd(interp, objc, objv);
 			break;
@@ -2199,8 +3356,9 @@ static int CurlProgressHandler(
 	}
 
     curl_interpdata_t *interpdata = Tcl_GetAssocData(callback->interp, "pextlib::curl::interpdata", NULL);
+	CURL *timer = callback->timer != NULL ? callback->timer : interpdata->theHandle;
 	/* Only send updates once a second */
-	curl_easy_getinfo(interpdata->theHandle, CURLINFO_TOTAL_TIME, &curtime);
+	curl_easy_getinfo(timer, CURLINFO_TOTAL_TIME, &curtime);
 	if ((curtime - callback->prevcalltime) < _CURL_MINIMUM_PROGRESS_INTERVAL) {
 		return 0;
 	}
@@ -2233,7 +3391,10 @@ static int CurlProgressHandler(
 	callback->prevcalltime = curtime;
 
 	/* Get the average speed from curl */
-	if (transferType == DOWNLOAD) {
+	if (callback->timer != NULL) {
+		/* several transfers make up this one, see fetch_segmented */
+		speed = curtime > 0.0 ? now / curtime : 0.0;
+	} else if (transferType == DOWNLOAD) {
 		curl_easy_getinfo(interpdata->theHandle, CURLINFO_SPEED_DOWNLOAD, &speed);
 	} else {
 		curl_easy_getinfo(interpdata->theHandle, CURLINFO_SPEED_UPLOAD, &speed);
@@ -51,6 +51,10 @@
  * curl getsize url
  *	Determine the file size of some resource. Try to not fetch the resource
  *  if possible. The size returned is the number of bytes.
+ *
+ * curl probe probe ?probe ...?
+ *	Like curl getsize for each probe, a list of its arguments, but all at
+ *  once. Return the sizes in a list, -1 for those that couldn't be determined.
  */
 int CurlCmd(ClientData clientData, Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
 
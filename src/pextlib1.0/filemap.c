@@ -16,7 +16,7 @@
  * 3. Neither the name of MacPorts Team nor the names of its contributors
  *    may be used to endorse or promote products derived from this software
  *    without specific prior written permission.
- * 
+ *
  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
@@ -34,15 +34,19 @@
 #include <config.h>
 #endif
 
-/* needed for NAME_MAX and PATH_MAX on Linux */
-#define _XOPEN_SOURCE
+/* needed for PATH_MAX, ftruncate(2) and mmap(2) on Linux */
+#define _XOPEN_SOURCE 600L
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <tcl.h>
@@ -56,47 +60,39 @@
 /* ------------------------------------------------------------------------- **
  * Internal structures
  * ------------------------------------------------------------------------- */
-/* For the moment, we represent the map as a simple tree. */
-
-/** Constants saying whether a node is a leaf or not */
-typedef enum {
-	kNode,
-	kLeaf
-} ENodeType;
+/*
+ * The map is a tree with one node per path element. On disk, the nodes are
+ * stored as fixed size records; the subnodes of a directory are consecutive
+ * records sorted by name, and names and values are indexes in a table of
+ * unique strings. The database is mapped in memory and lookups read the
+ * records directly, so opening a map doesn't depend on its size.
+ *
+ * In memory, a directory is only turned into an SNode with an array of
+ * subnodes when it's changed. Changes are appended to a journal next to the
+ * database when saving, and the database is rewritten when the journal gets
+ * too big compared to it.
+ */
 
 /**
- * Structure for the header of a node.
+ * Structure for a node of the tree in memory.
  */
-typedef struct {
-	/** Kind for this node */
-	ENodeType		fNodeType;
+typedef struct SNode {
 	/** Name of the directory or of the file.
 	 The root has an empty string there. */
-	char			fKeySubpart[NAME_MAX+1];
-} SHeader;
-
-/**
- * Structure for a node with subnode (i.e. a directory node).
- */
-typedef struct {
-	/** Header common to nodes and leaves */
-	SHeader			fHeader;
+	const char*		fKeySubpart;
+	/** Value, i.e. port name, or NULL if this is a directory */
+	const char*		fValue;
+	/** Record of this directory in the database if its subnodes haven't been
+	 read yet, kNoRecord otherwise */
+	uint32_t		fRecord;
 	/** Number of subnodes */
 	unsigned int	fSubnodesCount;
-	/** Array of subnodes */
-	SHeader*		fSubnodes[1];
+	/** Size of the array of subnodes */
+	unsigned int	fSubnodesCapacity;
+	/** Array of subnodes, sorted by name */
+	struct SNode**	fSubnodes;
 } SNode;
 
-/**
- * Structure for a leaf (i.e. a file node).
- */
-typedef struct {
-	/** Header common to nodes and leaves */
-	SHeader			fHeader;
-	/** Value, i.e. port name */
-	char			fValue[NAME_MAX+1];
-} SLeaf;
-
 /**
  * Structure for the internal representation of filemaps.
  * We don't allow deep clones hence we're refcounting.
@@ -110,6 +106,25 @@ typedef struct {
 	int 	fLockFD;
 	/** Root of the filemap */
 	SNode*	fRoot;
+	/** Names and values of the nodes created in memory */
+	Tcl_HashTable	fStrings;
+	/** The database file mapped in memory, or NULL */
+	const unsigned char*	fMap;
+	/** Size of the mapping */
+	size_t	fMapSize;
+	/** Size of the database file, which is different from the mapping once
+	    the database was rewritten */
+	off_t	fDatabaseSize;
+	/** Number of records in the database */
+	uint32_t	fRecordsCount;
+	/** Size of the string table of the database */
+	uint32_t	fStringsSize;
+	/** Generation of the database, the journal must have the same */
+	uint32_t	fGeneration;
+	/** Size of the valid part of the journal */
+	off_t	fJournalSize;
+	/** Changes since the filemap was last saved, in journal format */
+	Tcl_DString	fChanges;
 	/** If the filemap is read only */
 	char	fIsReadOnly;
 	/** If the filemap was changed */
@@ -117,6 +132,9 @@ typedef struct {
 	/** If the filemap is RAM only (in which case fFilemapPath is just
 	    garbage) */
 	char	fIsRAMOnly;
+	/** If the next save must rewrite the database rather than append to
+	    the journal */
+	char	fNeedsRewrite;
 } SFilemapObject;
 
 /** Error codes */
@@ -125,41 +143,80 @@ enum {
 	kUnknownVersion_Err			= -100001,
 	kKeyNotFound_Err			= -100002,
 	kUnknownNodeKind_Err		= -100003,
-	kNameTooLong_Err			= -100004,
 	kEOFWhileLoadingDB_Err		= -100005,
-	kUnknownOption_Err			= -100006
+	kUnknownOption_Err			= -100006,
+	kCorruptedDB_Err			= -100007
 };
 
 /* Constants relative to the storage format. */
 /** Signature at the beginning of filemap in files */
 static const char kFilemapSignature[24] = "org.darwinports.filemap";
+/** Version of the tree format, which can still be read */
+static const char kFilemapLegacyVersion[4] = { 0x0, 0x1, 0x0, 0x0 };
 /** Version */
-static const char kFilemapVersion[4] = { 0x0, 0x1, 0x0, 0x0 };
+static const char kFilemapVersion[4] = { 0x0, 0x2, 0x0, 0x0 };
+/** Version of the journal */
+static const char kFilemapJournalVersion[4] = { 0x0, 0x2, 0x0, 0x1 };
+
+/*
+ * A database is:
+ *	signature, version,
+ *	generation, number of records, size of the string table (4 bytes each),
+ *	the records,
+ *	the string table (null terminated strings, starting with "").
+ * A record is the offsets of the name and of the value (kNoValue for a
+ * directory) in the string table, then the index of the first subnode and the
+ * number of subnodes. The root is the first record, and the subnodes of a
+ * directory always come after it.
+ *
+ * A journal is:
+ *	signature, journal version, generation of the database,
+ *	changes: 'S' key value or 'U' key (null terminated strings).
+ *
+ * All integers are big endian.
+ */
+#define kHeaderSize		(sizeof(kFilemapSignature) + sizeof(kFilemapVersion) + 12)
+#define kJournalHeaderSize	(sizeof(kFilemapSignature) + sizeof(kFilemapJournalVersion) + 4)
+#define kRecordSize		16
+#define kNoValue		0xFFFFFFFFU
+#define kNoRecord		0xFFFFFFFFU
+
+/** The journal is merged into the database when it gets bigger than the
+    database divided by this */
+#define kJournalRatio	4
 
 /* ------------------------------------------------------------------------- **
  * Prototypes
  * ------------------------------------------------------------------------- */
-int Load(const char* inDatabasePath, SNode** outTree);
-void Create(SNode** outTree);
-int LoadNode(
+int Load(SFilemapObject* ioObject);
+SNode* Create(void);
+int LoadLegacyNode(
+		SFilemapObject* ioObject,
 		char** const ioDatabaseBuffer,
-		SHeader** outNode, ssize_t* ioBytesLeft);
-int Save(const char* inDatabasePath, SNode* inTree);
-int SaveNode(int inDatabaseFd, SHeader* inNode);
-void Free(SNode** ioRoot);
-int Set(SNode** ioRoot, const char* inPath, const char* inValue);
-const char* Get(SNode* inRoot, const char* inPath);
-Tcl_Obj* List(SNode* inRoot, const char* inValue);
-void ListSubtree(
-		SHeader* inRoot, const char* inValue,
-		Tcl_Obj* outList, const char* inSubpath,
-		unsigned int inSubpathLen);
-int Delete(SNode** ioRoot, const char* inPath);
+		SNode** outNode, ssize_t* ioBytesLeft);
+int LoadJournal(SFilemapObject* ioObject);
+int Save(SFilemapObject* ioObject);
+int SaveDatabase(SFilemapObject* ioObject);
+int SaveJournal(SFilemapObject* ioObject);
+void Free(SFilemapObject* ioObject);
+void FreeNode(SNode* inNode);
+int Set(SFilemapObject* ioObject, const char* inPath, const char* inValue);
+const char* Get(SFilemapObject* inObject, const char* inPath);
+Tcl_Obj* List(SFilemapObject* inObject, const char* inValue);
+void ListNode(
+		SFilemapObject* inObject, SNode* inNode, const char* inValue,
+		Tcl_Obj* outList, Tcl_DString* ioPath);
+void ListRecord(
+		SFilemapObject* inObject, uint32_t inRecord, const char* inValue,
+		Tcl_Obj* outList, Tcl_DString* ioPath);
+int Delete(SFilemapObject* ioObject, const char* inPath);
+int DeleteInNode(SFilemapObject* ioObject, SNode* ioNode, const char* inPath);
 void FreeFilemapInternalRep(Tcl_Obj* inObjPtr);
 void DupFilemapInternalRep(Tcl_Obj* inSrcPtr, Tcl_Obj* inDupPtr);
 void UpdateStringOfFilemap(Tcl_Obj* inObjPtr);
 int SetFilemapFromAny(Tcl_Interp* inInterp, Tcl_Obj* inObjPtr);
 int SetResultFromErrorCode(Tcl_Interp* interp, int inErrorCode);
+SFilemapObject* NewFilemapObject(void);
 SFilemapObject* GetObjectFromVarName(Tcl_Interp* interp, Tcl_Obj* inVarName);
 int FilemapCloseCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
 int FilemapCreateCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
@@ -184,34 +241,509 @@ Tcl_ObjType tclFilemapType = {
 	SetFilemapFromAny
 };
 
+/* ========================================================================= **
+ * Helpers
+ * ========================================================================= */
+
+/**
+ * Read a big endian 4 bytes integer.
+ */
+static uint32_t
+ReadUInt32(const unsigned char* inBytes)
+{
+	return ((uint32_t) inBytes[0] << 24)
+		|	((uint32_t) inBytes[1] << 16)
+		|	((uint32_t) inBytes[2] << 8)
+		|	((uint32_t) inBytes[3]);
+}
+
+/**
+ * Append a big endian 4 bytes integer to a buffer.
+ */
+static void
+AppendUInt32(Tcl_DString* ioBuffer, uint32_t inValue)
+{
+	char theBytes[4];
+
+	theBytes[0] = (inValue >> 24) & 0xFF;
+	theBytes[1] = (inValue >> 16) & 0xFF;
+	theBytes[2] = (inValue >> 8) & 0xFF;
+	theBytes[3] = inValue & 0xFF;
+	Tcl_DStringAppend(ioBuffer, theBytes, sizeof(theBytes));
+}
+
+/**
+ * Write a whole buffer to a file.
+ *
+ * @return 0 or the error code.
+ */
+static int
+WriteAll(int inFD, const char* inBuffer, size_t inSize)
+{
+	while (inSize > 0)
+	{
+		ssize_t theWritten = write(inFD, inBuffer, inSize);
+		if (theWritten < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return errno;
+		}
+		inBuffer += theWritten;
+		inSize -= theWritten;
+	}
+
+	return 0;
+}
+
+/**
+ * Build the path of a file next to the database.
+ *
+ * @param outPath		buffer of PATH_MAX bytes for the path.
+ * @param inDatabasePath	path to the database file.
+ * @param inSuffix		suffix of the file.
+ * @return 0 or ENAMETOOLONG.
+ */
+static int
+MakeSiblingPath(char* outPath, const char* inDatabasePath, const char* inSuffix)
+{
+	int theLength = snprintf(outPath, PATH_MAX, "%s%s", inDatabasePath, inSuffix);
+
+	if ((theLength < 0) || (theLength >= PATH_MAX))
+	{
+		return ENAMETOOLONG;
+	}
+	return 0;
+}
+
+/**
+ * Keys are case insensitive. Only ASCII letters are folded, so that the order
+ * of the records doesn't depend on the locale.
+ */
+static int
+FoldCase(char inChar)
+{
+	unsigned char theChar = (unsigned char) inChar;
+	if (theChar >= 'A' && theChar <= 'Z')
+	{
+		theChar += 'a' - 'A';
+	}
+	return theChar;
+}
+
+/**
+ * Compare a key subpart with a path element.
+ *
+ * @param inKeySubpart	null terminated key subpart.
+ * @param inPart		path element (not null terminated).
+ * @param inLength		length of the path element.
+ * @return <0, 0 or >0 as strcasecmp.
+ */
+static int
+ComparePart(const char* inKeySubpart, const char* inPart, int inLength)
+{
+	int index;
+
+	for (index = 0; index < inLength; index++)
+	{
+		int theDiff = FoldCase(inKeySubpart[index]) - FoldCase(inPart[index]);
+		if (theDiff != 0)
+		{
+			return theDiff;
+		}
+	}
+
+	/* first inLength bytes are equal, we need to check that inKeySubpart
+		is not longer */
+	return (unsigned char) inKeySubpart[inLength];
+}
+
+/**
+ * Compare two keys or values.
+ *
+ * @return <0, 0 or >0 as strcasecmp.
+ */
+static int
+CompareKeys(const char* inLeft, const char* inRight)
+{
+	for (;; inLeft++, inRight++)
+	{
+		int theDiff = FoldCase(*inLeft) - FoldCase(*inRight);
+		if ((theDiff != 0) || (*inLeft == '\0'))
+		{
+			return theDiff;
+		}
+	}
+}
+
+/**
+ * qsort(3) callback to sort subnodes.
+ */
+static int
+CompareNodes(const void* inLeft, const void* inRight)
+{
+	return CompareKeys(
+			(*(SNode* const*) inLeft)->fKeySubpart,
+			(*(SNode* const*) inRight)->fKeySubpart);
+}
+
+/**
+ * Get the next element of a path.
+ *
+ * @param ioCursor		cursor in the path, moved after the element.
+ * @param outLength		on output, length of the element.
+ * @param outIsLast		on output, whether this is the last element. If the
+ *						path ends with a /, no element is the last one.
+ * @return the element or NULL if there are no more elements.
+ */
+static const char*
+NextPart(const char** ioCursor, int* outLength, int* outIsLast)
+{
+	const char* theCursor = *ioCursor;
+	const char* theStart;
+
+	/* jump to first non / character in the path */
+	while (*theCursor == '/')
+	{
+		theCursor++;
+	}
+	if (*theCursor == '\0')
+	{
+		*ioCursor = theCursor;
+		return NULL;
+	}
+
+	/* find end of path element */
+	theStart = theCursor;
+	while ((*theCursor != '/') && (*theCursor != '\0'))
+	{
+		theCursor++;
+	}
+	*outLength = theCursor - theStart;
+	*outIsLast = (*theCursor == '\0');
+	*ioCursor = theCursor;
+
+	return theStart;
+}
+
+/**
+ * Store a string in the strings of a filemap, if it's not already there.
+ *
+ * @param ioObject		the filemap.
+ * @param inString		the string (not null terminated).
+ * @param inLength		its length.
+ * @return the stored string, valid until the filemap is freed.
+ */
+static const char*
+Intern(SFilemapObject* ioObject, const char* inString, int inLength)
+{
+	Tcl_DString theKey;
+	Tcl_HashEntry* theEntry;
+	int isNew;
+
+	Tcl_DStringInit(&theKey);
+	Tcl_DStringAppend(&theKey, inString, inLength);
+	theEntry = Tcl_CreateHashEntry(
+			&ioObject->fStrings, Tcl_DStringValue(&theKey), &isNew);
+	Tcl_DStringFree(&theKey);
+
+	return Tcl_GetHashKey(&ioObject->fStrings, theEntry);
+}
+
+/**
+ * Get a record of the database.
+ *
+ * @return the record or NULL if it doesn't exist.
+ */
+static const unsigned char*
+GetRecord(SFilemapObject* inObject, uint32_t inRecord)
+{
+	if (inRecord >= inObject->fRecordsCount)
+	{
+		return NULL;
+	}
+	return inObject->fMap + kHeaderSize + (size_t) inRecord * kRecordSize;
+}
+
+/**
+ * Get a string of the database.
+ *
+ * @return the string or NULL if the offset is invalid.
+ */
+static const char*
+GetString(SFilemapObject* inObject, uint32_t inOffset)
+{
+	if (inOffset >= inObject->fStringsSize)
+	{
+		return NULL;
+	}
+	return (const char*) inObject->fMap + kHeaderSize
+		+ (size_t) inObject->fRecordsCount * kRecordSize + inOffset;
+}
+
+/**
+ * Get the range of subnodes of a record, checking that it's valid.
+ *
+ * @return 0 or kCorruptedDB_Err.
+ */
+static int
+GetSubrecords(
+		SFilemapObject* inObject, uint32_t inRecord,
+		uint32_t* outFirst, uint32_t* outCount)
+{
+	const unsigned char* theRecord = GetRecord(inObject, inRecord);
+	uint32_t theFirst;
+	uint32_t theCount;
+
+	if (theRecord == NULL)
+	{
+		return kCorruptedDB_Err;
+	}
+	theFirst = ReadUInt32(theRecord + 8);
+	theCount = ReadUInt32(theRecord + 12);
+	if (theCount == 0)
+	{
+		theFirst = 0;
+	} else if ((theFirst <= inRecord)
+			|| (theFirst > inObject->fRecordsCount)
+			|| (theCount > inObject->fRecordsCount - theFirst)) {
+		return kCorruptedDB_Err;
+	}
+	*outFirst = theFirst;
+	*outCount = theCount;
+
+	return 0;
+}
+
+/**
+ * Find a subnode of a record by binary search.
+ *
+ * @return the record of the subnode or kNoRecord.
+ */
+static uint32_t
+FindSubrecord(
+		SFilemapObject* inObject, uint32_t inRecord,
+		const char* inPart, int inLength)
+{
+	uint32_t theFirst;
+	uint32_t theCount;
+	uint32_t theLow;
+	uint32_t theHigh;
+
+	if (GetSubrecords(inObject, inRecord, &theFirst, &theCount) != 0)
+	{
+		return kNoRecord;
+	}
+
+	theLow = theFirst;
+	theHigh = theFirst + theCount;
+	while (theLow < theHigh)
+	{
+		uint32_t theMiddle = theLow + (theHigh - theLow) / 2;
+		const char* theName =
+				GetString(inObject, ReadUInt32(GetRecord(inObject, theMiddle)));
+		int theCompResult;
+
+		if (theName == NULL)
+		{
+			return kNoRecord;
+		}
+		theCompResult = ComparePart(theName, inPart, inLength);
+		if (theCompResult == 0)
+		{
+			return theMiddle;
+		} else if (theCompResult < 0) {
+			theLow = theMiddle + 1;
+		} else {
+			theHigh = theMiddle;
+		}
+	}
+
+	return kNoRecord;
+}
+
+/**
+ * Find a subnode of a node by binary search.
+ *
+ * @param inNode		the node, whose subnodes are in memory.
+ * @param outIndex		on output, index of the subnode or where it should be
+ *						inserted.
+ * @return the subnode or NULL.
+ */
+static SNode*
+FindSubnode(SNode* inNode, const char* inPart, int inLength, unsigned int* outIndex)
+{
+	unsigned int theLow = 0;
+	unsigned int theHigh = inNode->fSubnodesCount;
+
+	while (theLow < theHigh)
+	{
+		unsigned int theMiddle = theLow + (theHigh - theLow) / 2;
+		int theCompResult = ComparePart(
+				inNode->fSubnodes[theMiddle]->fKeySubpart, inPart, inLength);
+		if (theCompResult == 0)
+		{
+			*outIndex = theMiddle;
+			return inNode->fSubnodes[theMiddle];
+		} else if (theCompResult < 0) {
+			theLow = theMiddle + 1;
+		} else {
+			theHigh = theMiddle;
+		}
+	}
+
+	*outIndex = theLow;
+	return NULL;
+}
+
+/**
+ * Create a node.
+ *
+ * @param inKeySubpart	name of the node (not copied).
+ * @param inValue		value or NULL for a directory (not copied).
+ */
+static SNode*
+NewNode(const char* inKeySubpart, const char* inValue)
+{
+	SNode* theNode = (SNode*) ckalloc(sizeof(SNode));
+
+	theNode->fKeySubpart = inKeySubpart;
+	theNode->fValue = inValue;
+	theNode->fRecord = kNoRecord;
+	theNode->fSubnodesCount = 0;
+	theNode->fSubnodesCapacity = 0;
+	theNode->fSubnodes = NULL;
+
+	return theNode;
+}
+
+/**
+ * Insert a subnode in a node.
+ */
+static void
+InsertSubnode(SNode* ioNode, unsigned int inIndex, SNode* inSubnode)
+{
+	if (ioNode->fSubnodesCount == ioNode->fSubnodesCapacity)
+	{
+		ioNode->fSubnodesCapacity =
+			ioNode->fSubnodesCapacity ? 2 * ioNode->fSubnodesCapacity : 4;
+		ioNode->fSubnodes = (SNode**) ckrealloc(
+				(char*) ioNode->fSubnodes,
+				ioNode->fSubnodesCapacity * sizeof(SNode*));
+	}
+	/* Push the pointers after the current node lower. */
+	(void) memmove(
+			&ioNode->fSubnodes[inIndex + 1],
+			&ioNode->fSubnodes[inIndex],
+			(ioNode->fSubnodesCount - inIndex) * sizeof(SNode*));
+	ioNode->fSubnodes[inIndex] = inSubnode;
+	ioNode->fSubnodesCount++;
+}
+
+/**
+ * Read the subnodes of a directory from the database, if that wasn't done yet.
+ *
+ * @return 0 or kCorruptedDB_Err.
+ */
+static int
+Materialize(SFilemapObject* inObject, SNode* ioNode)
+{
+	uint32_t theFirst;
+	uint32_t theCount;
+	uint32_t index;
+	int theErr;
+
+	if (ioNode->fRecord == kNoRecord)
+	{
+		return 0;
+	}
+
+	theErr = GetSubrecords(inObject, ioNode->fRecord, &theFirst, &theCount);
+	if (theErr != 0)
+	{
+		return theErr;
+	}
+
+	ioNode->fSubnodes = (SNode**) ckalloc((theCount ? theCount : 1) * sizeof(SNode*));
+	ioNode->fSubnodesCapacity = theCount;
+	for (index = 0; index < theCount; index++)
+	{
+		const unsigned char* theRecord = GetRecord(inObject, theFirst + index);
+		const char* theKeySubpart = GetString(inObject, ReadUInt32(theRecord));
+		uint32_t theValueOffset = ReadUInt32(theRecord + 4);
+		const char* theValue = NULL;
+		SNode* theSubnode;
+
+		if (theValueOffset != kNoValue)
+		{
+			theValue = GetString(inObject, theValueOffset);
+		}
+		if ((theKeySubpart == NULL)
+			|| ((theValueOffset != kNoValue) && (theValue == NULL)))
+		{
+			theErr = kCorruptedDB_Err;
+			break;
+		}
+
+		theSubnode = NewNode(theKeySubpart, theValue);
+		if (theValue == NULL)
+		{
+			theSubnode->fRecord = theFirst + index;
+		}
+		ioNode->fSubnodes[index] = theSubnode;
+		ioNode->fSubnodesCount++;
+	}
+
+	if (theErr != 0)
+	{
+		for (index = 0; index < ioNode->fSubnodesCount; index++)
+		{
+			ckfree((char*) ioNode->fSubnodes[index]);
+		}
+		ckfree((char*) ioNode->fSubnodes);
+		ioNode->fSubnodes = NULL;
+		ioNode->fSubnodesCount = 0;
+		ioNode->fSubnodesCapacity = 0;
+		return theErr;
+	}
+
+	ioNode->fRecord = kNoRecord;
+	return 0;
+}
+
 /* ========================================================================= **
  * Tree access functions
  * ========================================================================= */
 
 /**
  * Load the database from a file.
- * This function reads the whole file into a buffer, checks the header and then
- * calls LoadNode.
+ * This function maps the file and then reads the journal. Files in the tree
+ * format of previous versions are read completely with LoadLegacyNode.
  *
- * @param inDatabasePath	path to the database file.
- * @param outTree			on output, tree in memory
+ * @param ioObject		the filemap, with fFilemapPath set and no tree.
  */
 int
-Load(
-		const char* inDatabasePath,
-		SNode** outTree)
+Load(SFilemapObject* ioObject)
 {
 	int theErr = 0;
 	char* theFileBuffer = NULL;
 	int theFD = -1;
-	
+
 	do {
 		struct stat theFileInfo;
-		char* theFileCursor;
+		char theHeader[kHeaderSize];
+		ssize_t theHeaderSize;
 		ssize_t theFileSize;
+		void* theMap;
+
+		ioObject->fDatabaseSize = 0;
+		ioObject->fJournalSize = 0;
+		ioObject->fNeedsRewrite = 0;
 
 		/* Open the file for reading, creating it if necessary. */
-		theFD = open(inDatabasePath, O_RDONLY | O_CREAT, 0664);
+		theFD = open(ioObject->fFilemapPath, O_RDONLY | O_CREAT, 0664);
 		if (theFD < 0)
 		{
 			theErr = errno;
@@ -224,54 +756,112 @@ Load(
 			theErr = errno;
 			break;
 		}
-		
+
 		theFileSize = theFileInfo.st_size;
 		if (theFileSize == 0)
 		{
-			Create(outTree);
+			ioObject->fRoot = Create();
+			ioObject->fGeneration = (uint32_t) time(NULL);
 			break;
 		}
-		
+
 		if (theFileSize < (ssize_t) (sizeof(kFilemapSignature) + sizeof(kFilemapVersion)))
 		{
 			theErr = kUnknownVersion_Err;
 			break;
 		}
-		
-		/* allocate a buffer to put the whole file.
-			(note: the tree itself is just as big as the file) */
-		theFileBuffer = (char*) ckalloc(theFileSize);
-		
-		/* read the whole file */
-		if (read(theFD, theFileBuffer, theFileSize) != theFileSize)
+
+		theHeaderSize = read(theFD, theHeader, sizeof(theHeader));
+		if (theHeaderSize < 0)
 		{
 			theErr = errno;
 			break;
 		}
-		
+		if (theHeaderSize < (ssize_t) (sizeof(kFilemapSignature) + sizeof(kFilemapVersion)))
+		{
+			theErr = kEOFWhileLoadingDB_Err;
+			break;
+		}
+
 		/* check the signature */
-		if (memcmp(theFileBuffer, kFilemapSignature, sizeof(kFilemapSignature)) != 0)
+		if (memcmp(theHeader, kFilemapSignature, sizeof(kFilemapSignature)) != 0)
 		{
 			theErr = kSignatureMismatch_Err;
 			break;
 		}
-		
-		theFileCursor = theFileBuffer;
-		theFileCursor += sizeof(kFilemapSignature);
-		theFileSize -= sizeof(kFilemapSignature);
-		
+
 		/* check the version */
-		if (memcmp(theFileCursor, kFilemapVersion, sizeof(kFilemapVersion)) != 0)
+		if (memcmp(theHeader + sizeof(kFilemapSignature), kFilemapLegacyVersion,
+					sizeof(kFilemapLegacyVersion)) == 0)
+		{
+			char* theFileCursor;
+
+			/* read the whole file and build the tree in memory. It will be
+				converted to the current format when it's saved. */
+			theFileBuffer = (char*) ckalloc(theFileSize);
+			if (pread(theFD, theFileBuffer, theFileSize, 0) != theFileSize)
+			{
+				theErr = kEOFWhileLoadingDB_Err;
+				break;
+			}
+
+			theFileCursor = theFileBuffer + sizeof(kFilemapSignature) + sizeof(kFilemapLegacyVersion);
+			theFileSize -= sizeof(kFilemapSignature) + sizeof(kFilemapLegacyVersion);
+			theErr = LoadLegacyNode(ioObject, &theFileCursor, &ioObject->fRoot, &theFileSize);
+			if ((theErr == 0) && (ioObject->fRoot->fValue != NULL))
+			{
+				theErr = kCorruptedDB_Err;
+			}
+			ioObject->fGeneration = (uint32_t) time(NULL);
+			ioObject->fNeedsRewrite = 1;
+			break;
+		}
+		if (memcmp(theHeader + sizeof(kFilemapSignature), kFilemapVersion,
+					sizeof(kFilemapVersion)) != 0)
 		{
 			theErr = kUnknownVersion_Err;
 			break;
 		}
-		
-		theFileCursor += sizeof(kFilemapVersion);
-		theFileSize -= sizeof(kFilemapVersion);
-		
-		/* load the tree recursively */
-		theErr = LoadNode(&theFileCursor, (SHeader**) outTree, &theFileSize);
+		if (theFileSize < (ssize_t) kHeaderSize)
+		{
+			theErr = kEOFWhileLoadingDB_Err;
+			break;
+		}
+
+		ioObject->fGeneration = ReadUInt32((unsigned char*) theHeader + 28);
+		ioObject->fRecordsCount = ReadUInt32((unsigned char*) theHeader + 32);
+		ioObject->fStringsSize = ReadUInt32((unsigned char*) theHeader + 36);
+		if ((ioObject->fRecordsCount == 0)
+			|| (ioObject->fStringsSize == 0)
+			|| ((uint64_t) kHeaderSize + (uint64_t) ioObject->fRecordsCount * kRecordSize
+				+ ioObject->fStringsSize != (uint64_t) theFileSize))
+		{
+			theErr = kEOFWhileLoadingDB_Err;
+			break;
+		}
+
+		/* map the file, the records are only read when they're needed */
+		theMap = mmap(NULL, theFileSize, PROT_READ, MAP_PRIVATE, theFD, 0);
+		if (theMap == MAP_FAILED)
+		{
+			theErr = errno;
+			break;
+		}
+		ioObject->fMap = (const unsigned char*) theMap;
+		ioObject->fMapSize = theFileSize;
+		ioObject->fDatabaseSize = theFileSize;
+
+		/* all strings must be terminated */
+		if (*GetString(ioObject, ioObject->fStringsSize - 1) != '\0')
+		{
+			theErr = kCorruptedDB_Err;
+			break;
+		}
+
+		ioObject->fRoot = Create();
+		ioObject->fRoot->fRecord = 0;
+
+		theErr = LoadJournal(ioObject);
 	} while (0);
 
 	if (theFileBuffer)
@@ -291,22 +881,18 @@ Load(
 /**
  * Create an empty tree in RAM.
  *
- * @param outTree			on output, tree in memory
+ * @return the root of the tree.
  */
-void
-Create(
-		SNode** outTree)
+SNode*
+Create(void)
 {
-	SNode* theRoot = (SNode*) ckalloc(sizeof(SNode) - sizeof(SHeader*));
-	theRoot->fSubnodesCount = 0;
-	theRoot->fHeader.fNodeType = kNode;
-	theRoot->fHeader.fKeySubpart[0] = '\0';
-	*outTree = theRoot;
+	return NewNode("", NULL);
 }
 
 /**
- * Recursive function to load the database from a buffer.
+ * Recursive function to load a database in the tree format from a buffer.
  *
+ * @param ioObject			the filemap, where the strings are stored.
  * @param ioDatabaseBuffer	pointer to the buffer (where the node starts),
  *							updated by this function.
  * @param outNode			on output, a tree in memory.
@@ -314,9 +900,10 @@ Create(
  *							by this function).
  */
 int
-LoadNode(
+LoadLegacyNode(
+		SFilemapObject* ioObject,
 		char** const ioDatabaseBuffer,
-		SHeader** outNode,
+		SNode** outNode,
 		ssize_t* ioBytesLeft)
 {
 	int theErr = 0;
@@ -325,7 +912,9 @@ LoadNode(
 
 	do {
 		char theKind;
-		unsigned int theKeySubpartSize;
+		const char* theKeySubpart;
+		const char* theEnd;
+		size_t theKeySubpartSize;
 
 		/* get the kind (it's one byte) */
 		if (theBytesLeft == 0)
@@ -335,740 +924,929 @@ LoadNode(
 		}
 		theBytesLeft--;
 		theKind = *theDatabaseBuffer++;
-		
-		if ((theKind != kLeaf) && (theKind != kNode))
+
+		/* 0 is a directory, 1 a file */
+		if ((theKind != 0) && (theKind != 1))
 		{
 			theErr = kUnknownNodeKind_Err;
 			break;
 		}
 
-		/* get the key subpart size (it's a null terminated string) */
-		theKeySubpartSize = strlen(theDatabaseBuffer);
-		if (theKeySubpartSize > NAME_MAX)
-		{
-			theErr = kNameTooLong_Err;
-			break;
-		}
-		if (theKeySubpartSize > (unsigned int) theBytesLeft)
+		/* get the key subpart (it's a null terminated string) */
+		theEnd = memchr(theDatabaseBuffer, '\0', theBytesLeft);
+		if (theEnd == NULL)
 		{
-			/* it's not very good to have overrun the buffer. OTOH, we're just reading ... */
 			theErr = kEOFWhileLoadingDB_Err;
 			break;
 		}
-		theBytesLeft -= theKeySubpartSize;
+		theKeySubpartSize = theEnd - theDatabaseBuffer;
+		theKeySubpart = Intern(ioObject, theDatabaseBuffer, theKeySubpartSize);
+		theDatabaseBuffer += theKeySubpartSize + 1;
+		theBytesLeft -= theKeySubpartSize + 1;
 
-		if (theKind == kLeaf)
+		if (theKind == 1)
 		{
-			SLeaf* theLeaf;
-			unsigned int theValueSize;
+			size_t theValueSize;
 
-			/* create the leaf */
-			theLeaf = (SLeaf*) ckalloc(sizeof(SLeaf));
-			
-			theLeaf->fHeader.fNodeType = kLeaf;
-			
-			/* copy the key */
-			(void) memcpy(
-					theLeaf->fHeader.fKeySubpart,
-					theDatabaseBuffer,
-					theKeySubpartSize + 1);
-			theDatabaseBuffer += theKeySubpartSize + 1;
-			
-			/* get the value size */
-			theValueSize = strlen(theDatabaseBuffer);
-			if (theValueSize > NAME_MAX)
-			{
-				theErr = kNameTooLong_Err;
-				break;
-			}
-			if (theValueSize > (unsigned int) theBytesLeft)
+			/* get the value */
+			theEnd = memchr(theDatabaseBuffer, '\0', theBytesLeft);
+			if (theEnd == NULL)
 			{
 				theErr = kEOFWhileLoadingDB_Err;
 				break;
 			}
-			theBytesLeft -= theValueSize;
-			
-			/* copy the value */
-			(void) memcpy(
-					theLeaf->fValue,
-					(const char*) theDatabaseBuffer,
-					theValueSize + 1);
+			theValueSize = theEnd - theDatabaseBuffer;
+			*outNode = NewNode(
+					theKeySubpart,
+					Intern(ioObject, theDatabaseBuffer, theValueSize));
 			theDatabaseBuffer += theValueSize + 1;
-			
-			*outNode = (SHeader*) theLeaf;
+			theBytesLeft -= theValueSize + 1;
 		} else {
 			/* it's a node */
-			char* theKeysubpartPointer = theDatabaseBuffer;
-			
 			unsigned int subnodesCount;
-			SNode* theNode;
-			SHeader** theNodeCursor;
 			unsigned int indexSubnodes;
+			SNode* theNode;
 
-			/* skip to the number of nodes */
-			theDatabaseBuffer += theKeySubpartSize + 1;
-			
 			/* get the number of nodes, it's a 4 bytes integer */
 			if (theBytesLeft < 4)
 			{
 				theErr = kEOFWhileLoadingDB_Err;
 				break;
 			}
-			subnodesCount =
-					(((unsigned char) theDatabaseBuffer[0]) << 24)
-				|	(((unsigned char) theDatabaseBuffer[1]) << 16)
-				|	(((unsigned char) theDatabaseBuffer[2]) << 8)
-				|	(((unsigned char) theDatabaseBuffer[3]));
-		
+			subnodesCount = ReadUInt32((unsigned char*) theDatabaseBuffer);
 			theDatabaseBuffer += 4;
 			theBytesLeft -= 4;
-			
-			/* create the node */
-			theNode = (SNode*) ckalloc(
-				sizeof(SNode) + (subnodesCount - 1) * sizeof(SHeader*));
-			
-			theNode->fHeader.fNodeType = kNode;
 
-			/* copy the key */
-			(void) memcpy(
-					theNode->fHeader.fKeySubpart,
-					theKeysubpartPointer,
-					theKeySubpartSize + 1);
-			
-			/* process the subnodes */
-			theNode->fSubnodesCount = subnodesCount;
-			theNodeCursor = theNode->fSubnodes;
+			/* each subnode takes at least 3 bytes */
+			if (subnodesCount > (size_t) theBytesLeft / 3)
+			{
+				theErr = kEOFWhileLoadingDB_Err;
+				break;
+			}
+
+			/* create the node */
+			theNode = NewNode(theKeySubpart, NULL);
+			theNode->fSubnodes = (SNode**) ckalloc(
+					(subnodesCount ? subnodesCount : 1) * sizeof(SNode*));
+			theNode->fSubnodesCapacity = subnodesCount;
+			*outNode = theNode;
 
 			/* call us recursively. */
 			for (indexSubnodes = 0; indexSubnodes < subnodesCount; indexSubnodes++)
 			{
-				theErr = LoadNode(&theDatabaseBuffer, theNodeCursor, &theBytesLeft);
+				theErr = LoadLegacyNode(
+						ioObject,
+						&theDatabaseBuffer,
+						&theNode->fSubnodes[indexSubnodes],
+						&theBytesLeft);
 				if (theErr != 0)
 				{
 					break;
 				}
-				theNodeCursor++;
+				theNode->fSubnodesCount++;
 			}
 
-			*outNode = (SHeader*) theNode;
+			/* the order of the tree format depended on the locale */
+			qsort(theNode->fSubnodes, theNode->fSubnodesCount,
+					sizeof(SNode*), CompareNodes);
 		}
 	} while (0);
-	
+
 	*ioDatabaseBuffer = theDatabaseBuffer;
 	*ioBytesLeft = theBytesLeft;
-	
+
 	return theErr;
 }
 
 /**
- * Save the database to the file.
- * This function saves the header and then calls SaveNode.
+ * Apply the changes in the journal of the database, if it belongs to the
+ * database.
+ * A truncated change at the end (if saving it was interrupted) is ignored.
  *
- * @param inDatabasePath	file descriptor of the open file (the cursor is reset)
- * @param inTree			tree of the database.
+ * @param ioObject		the filemap, with the database loaded.
  */
 int
-Save(
-		const char* inDatabasePath,
-		SNode* inTree)
+LoadJournal(SFilemapObject* ioObject)
 {
 	int theErr = 0;
+	char* theFileBuffer = NULL;
 	int theFD = -1;
-	char theTempFilePath[PATH_MAX];
-	
+	char theJournalPath[PATH_MAX];
+
 	do {
-		/* Create the temporary file */
-		theTempFilePath[sizeof(theTempFilePath) - 1] = 0;
-		(void) snprintf(
-			theTempFilePath,
-			sizeof(theTempFilePath) - 1,
-			"%s.w",
-			inDatabasePath);
+		struct stat theFileInfo;
+		char* theFileCursor;
+		char* theFileEnd;
 
-		/* Create it. */
-		theFD = open(theTempFilePath, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+		theErr = MakeSiblingPath(theJournalPath, ioObject->fFilemapPath, ".journal");
+		if (theErr != 0)
+		{
+			break;
+		}
+		theFD = open(theJournalPath, O_RDONLY);
 		if (theFD < 0)
 		{
-			theErr = errno;
+			if (errno != ENOENT)
+			{
+				theErr = errno;
+			}
 			break;
 		}
-		
-		/* Write the signature */
-		if (write(theFD, kFilemapSignature, sizeof(kFilemapSignature))
-				!= sizeof(kFilemapSignature))
+		if (fstat(theFD, &theFileInfo) < 0)
 		{
 			theErr = errno;
 			break;
 		}
-		
-		/* Write the version */
-		if (write(theFD, kFilemapVersion, sizeof(kFilemapVersion))
-				!= sizeof(kFilemapVersion))
+		if (theFileInfo.st_size < (off_t) kJournalHeaderSize)
+		{
+			break;
+		}
+
+		theFileBuffer = (char*) ckalloc(theFileInfo.st_size);
+		if (read(theFD, theFileBuffer, theFileInfo.st_size) != theFileInfo.st_size)
+		{
+			theErr = kEOFWhileLoadingDB_Err;
+			break;
+		}
+
+		/* a journal left over from a previous generation is ignored */
+		if ((memcmp(theFileBuffer, kFilemapSignature, sizeof(kFilemapSignature)) != 0)
+			|| (memcmp(theFileBuffer + sizeof(kFilemapSignature), kFilemapJournalVersion,
+					sizeof(kFilemapJournalVersion)) != 0)
+			|| (ReadUInt32((unsigned char*) theFileBuffer + 28) != ioObject->fGeneration))
+		{
+			break;
+		}
+
+		theFileCursor = theFileBuffer + kJournalHeaderSize;
+		theFileEnd = theFileBuffer + theFileInfo.st_size;
+		while (theFileCursor < theFileEnd)
+		{
+			char theKind = *theFileCursor;
+			char* theKey = theFileCursor + 1;
+			char* theValue;
+			char* theKeyEnd;
+			char* theValueEnd;
+
+			if (theKey >= theFileEnd)
+			{
+				break;
+			}
+			theKeyEnd = memchr(theKey, '\0', theFileEnd - theKey);
+			if (theKeyEnd == NULL)
+			{
+				break;
+			}
+			if (theKind == 'S')
+			{
+				theValue = theKeyEnd + 1;
+				theValueEnd = memchr(theValue, '\0', theFileEnd - theValue);
+				if (theValueEnd == NULL)
+				{
+					break;
+				}
+				(void) Set(ioObject, theKey, theValue);
+				theFileCursor = theValueEnd + 1;
+			} else if (theKind == 'U') {
+				(void) Delete(ioObject, theKey);
+				theFileCursor = theKeyEnd + 1;
+			} else {
+				break;
+			}
+		}
+		ioObject->fJournalSize = theFileCursor - theFileBuffer;
+	} while (0);
+
+	if (theFileBuffer)
+	{
+		ckfree(theFileBuffer);
+	}
+
+	if (theFD >= 0)
+	{
+		(void) close(theFD);
+	}
+
+	return theErr;
+}
+
+/**
+ * Save the changes to the database.
+ * Changes are appended to the journal, unless the journal would get too big,
+ * in which case the whole database is rewritten.
+ *
+ * @param ioObject		the filemap.
+ */
+int
+Save(SFilemapObject* ioObject)
+{
+	off_t theJournalSize =
+		ioObject->fJournalSize + Tcl_DStringLength(&ioObject->fChanges);
+
+	if (ioObject->fNeedsRewrite
+		|| (ioObject->fDatabaseSize == 0)
+		|| (theJournalSize > ioObject->fDatabaseSize / kJournalRatio))
+	{
+		return SaveDatabase(ioObject);
+	}
+
+	return SaveJournal(ioObject);
+}
+
+/**
+ * Write the whole tree to the database file.
+ * The file is written next to the database and then swapped with it, and the
+ * journal is removed.
+ *
+ * @param ioObject		the filemap.
+ */
+int
+SaveDatabase(SFilemapObject* ioObject)
+{
+	int theErr = 0;
+	int theFD = -1;
+	char theTempFilePath[PATH_MAX];
+	char theJournalPath[PATH_MAX];
+	/* The nodes to write, breadth first: the subnodes of a directory are
+		added to the queue when the directory is written, so that they are
+		consecutive. Each entry is either an SNode or a record. */
+	SNode** theQueueNodes = NULL;
+	uint32_t* theQueueRecords = NULL;
+	size_t theQueueCount = 0;
+	size_t theQueueCapacity = 1024;
+	size_t theQueueIndex;
+	Tcl_HashTable theStringOffsets;
+	Tcl_DString theRecords;
+	Tcl_DString theStrings;
+	Tcl_DString theHeader;
+	uint32_t theGeneration = ioObject->fGeneration + 1;
+	int isNew;
+
+	Tcl_InitHashTable(&theStringOffsets, TCL_STRING_KEYS);
+	Tcl_DStringInit(&theRecords);
+	Tcl_DStringInit(&theStrings);
+	Tcl_DStringInit(&theHeader);
+
+	theQueueNodes = (SNode**) ckalloc(theQueueCapacity * sizeof(SNode*));
+	theQueueRecords = (uint32_t*) ckalloc(theQueueCapacity * sizeof(uint32_t));
+	theQueueNodes[0] = ioObject->fRoot;
+	theQueueRecords[0] = kNoRecord;
+	theQueueCount = 1;
+
+	/* the empty string is at offset 0 */
+	Tcl_DStringAppend(&theStrings, "", 1);
+	Tcl_SetHashValue(Tcl_CreateHashEntry(&theStringOffsets, "", &isNew), (ClientData) 0);
+
+	do {
+		for (theQueueIndex = 0; theQueueIndex < theQueueCount; theQueueIndex++)
+		{
+			SNode* theNode = theQueueNodes[theQueueIndex];
+			uint32_t theRecord = theQueueRecords[theQueueIndex];
+			const char* theStringsToAdd[2];
+			uint32_t theOffsets[2] = { 0, kNoValue };
+			uint32_t theSubnodesCount;
+			uint32_t theFirst = 0;
+			uint32_t index;
+			int indexStrings;
+
+			/* get the name, value and subnodes */
+			if (theNode != NULL)
+			{
+				theStringsToAdd[0] = theNode->fKeySubpart;
+				theStringsToAdd[1] = theNode->fValue;
+				theRecord = theNode->fRecord;
+			} else {
+				const unsigned char* theRecordBytes = GetRecord(ioObject, theRecord);
+				uint32_t theValueOffset = ReadUInt32(theRecordBytes + 4);
+
+				theStringsToAdd[0] = GetString(ioObject, ReadUInt32(theRecordBytes));
+				theStringsToAdd[1] = NULL;
+				if (theValueOffset != kNoValue)
+				{
+					theStringsToAdd[1] = GetString(ioObject, theValueOffset);
+					if (theStringsToAdd[1] == NULL)
+					{
+						theErr = kCorruptedDB_Err;
+						break;
+					}
+				}
+				if (theStringsToAdd[0] == NULL)
+				{
+					theErr = kCorruptedDB_Err;
+					break;
+				}
+			}
+
+			if (theRecord != kNoRecord)
+			{
+				if ((theNode == NULL) && (theStringsToAdd[1] != NULL))
+				{
+					theSubnodesCount = 0;
+				} else {
+					theErr = GetSubrecords(ioObject, theRecord, &theFirst, &theSubnodesCount);
+					if (theErr != 0)
+					{
+						break;
+					}
+				}
+			} else {
+				theSubnodesCount = theNode->fSubnodesCount;
+			}
+
+			/* add the strings to the string table */
+			for (indexStrings = 0; indexStrings < 2; indexStrings++)
+			{
+				Tcl_HashEntry* theEntry;
+
+				if (theStringsToAdd[indexStrings] == NULL)
+				{
+					continue;
+				}
+				theEntry = Tcl_CreateHashEntry(
+						&theStringOffsets, theStringsToAdd[indexStrings], &isNew);
+				if (isNew)
+				{
+					Tcl_SetHashValue(theEntry,
+						(ClientData) (uintptr_t) Tcl_DStringLength(&theStrings));
+					Tcl_DStringAppend(&theStrings, theStringsToAdd[indexStrings],
+						strlen(theStringsToAdd[indexStrings]) + 1);
+				}
+				theOffsets[indexStrings] = (uint32_t) (uintptr_t) Tcl_GetHashValue(theEntry);
+			}
+
+			/* write the record */
+			AppendUInt32(&theRecords, theOffsets[0]);
+			AppendUInt32(&theRecords, theOffsets[1]);
+			AppendUInt32(&theRecords, theSubnodesCount ? (uint32_t) theQueueCount : 0);
+			AppendUInt32(&theRecords, theSubnodesCount);
+
+			/* queue the subnodes */
+			if (theQueueCount + theSubnodesCount > theQueueCapacity)
+			{
+				while (theQueueCount + theSubnodesCount > theQueueCapacity)
+				{
+					theQueueCapacity *= 2;
+				}
+				theQueueNodes = (SNode**) ckrealloc(
+						(char*) theQueueNodes, theQueueCapacity * sizeof(SNode*));
+				theQueueRecords = (uint32_t*) ckrealloc(
+						(char*) theQueueRecords, theQueueCapacity * sizeof(uint32_t));
+			}
+			for (index = 0; index < theSubnodesCount; index++)
+			{
+				if (theRecord != kNoRecord)
+				{
+					theQueueNodes[theQueueCount] = NULL;
+					theQueueRecords[theQueueCount] = theFirst + index;
+				} else {
+					theQueueNodes[theQueueCount] = theNode->fSubnodes[index];
+					theQueueRecords[theQueueCount] = kNoRecord;
+				}
+				theQueueCount++;
+			}
+		}
+		if (theErr != 0)
+		{
+			break;
+		}
+		if ((theQueueCount >= kNoRecord)
+			|| ((size_t) Tcl_DStringLength(&theStrings) >= kNoValue))
+		{
+			theErr = EFBIG;
+			break;
+		}
+
+		/* build the header */
+		Tcl_DStringAppend(&theHeader, kFilemapSignature, sizeof(kFilemapSignature));
+		Tcl_DStringAppend(&theHeader, kFilemapVersion, sizeof(kFilemapVersion));
+		AppendUInt32(&theHeader, theGeneration);
+		AppendUInt32(&theHeader, (uint32_t) theQueueCount);
+		AppendUInt32(&theHeader, (uint32_t) Tcl_DStringLength(&theStrings));
+
+		/* Create the temporary file */
+		theErr = MakeSiblingPath(theTempFilePath, ioObject->fFilemapPath, ".w");
+		if (theErr == 0)
+		{
+			theErr = MakeSiblingPath(theJournalPath, ioObject->fFilemapPath, ".journal");
+		}
+		if (theErr != 0)
+		{
+			break;
+		}
+		theFD = open(theTempFilePath, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+		if (theFD < 0)
 		{
 			theErr = errno;
 			break;
 		}
-		
-		/* then, write, recursively, the tree */
-		theErr = SaveNode(theFD, (SHeader*) inTree);
+
+		theErr = WriteAll(theFD, Tcl_DStringValue(&theHeader), Tcl_DStringLength(&theHeader));
+		if (theErr == 0)
+		{
+			theErr = WriteAll(theFD, Tcl_DStringValue(&theRecords), Tcl_DStringLength(&theRecords));
+		}
+		if (theErr == 0)
+		{
+			theErr = WriteAll(theFD, Tcl_DStringValue(&theStrings), Tcl_DStringLength(&theStrings));
+		}
 		if (theErr != 0)
 		{
 			break;
 		}
-		
+
 		/* Close the file */
 		(void) close(theFD);
 		theFD = -1;
-		
+
 		/* Atomically swap the temporary file with the new copy */
-		if (rename(theTempFilePath, inDatabasePath) < 0)
+		if (rename(theTempFilePath, ioObject->fFilemapPath) < 0)
 		{
 			theErr = errno;
 			break;
 		}
+
+		/* The journal belongs to the previous generation now. The tree keeps
+			using the previous file, which stays mapped. */
+		(void) unlink(theJournalPath);
+
+		ioObject->fGeneration = theGeneration;
+		ioObject->fDatabaseSize = Tcl_DStringLength(&theHeader)
+			+ Tcl_DStringLength(&theRecords) + Tcl_DStringLength(&theStrings);
+		ioObject->fJournalSize = 0;
+		ioObject->fNeedsRewrite = 0;
+		Tcl_DStringSetLength(&ioObject->fChanges, 0);
 	} while (0);
-	
+
 	/* close the copy if required */
 	if (theFD >= 0)
 	{
 		(void) close(theFD);
+		(void) unlink(theTempFilePath);
 	}
 
+	ckfree((char*) theQueueNodes);
+	ckfree((char*) theQueueRecords);
+	Tcl_DeleteHashTable(&theStringOffsets);
+	Tcl_DStringFree(&theRecords);
+	Tcl_DStringFree(&theStrings);
+	Tcl_DStringFree(&theHeader);
+
 	return theErr;
 }
 
 /**
- * Recursive function to save the database to a file.
+ * Append the changes to the journal of the database.
  *
- * @param inDatabaseFd	file descriptor of the open file.
- * @param inNode		node to save.
+ * @param ioObject		the filemap.
  */
 int
-SaveNode(
-		int inDatabaseFd,
-		SHeader* inNode)
+SaveJournal(SFilemapObject* ioObject)
 {
 	int theErr = 0;
-	
-	do {
-		char theKind = inNode->fNodeType;
-		int theKeySize = strlen(inNode->fKeySubpart) + 1;
+	int theFD = -1;
+	char theJournalPath[PATH_MAX];
 
-		/* write the kind */
-		if (write(inDatabaseFd, &theKind, sizeof(theKind)) != sizeof(theKind))
+	do {
+		theErr = MakeSiblingPath(theJournalPath, ioObject->fFilemapPath, ".journal");
+		if (theErr != 0)
 		{
-			theErr = errno;
 			break;
 		}
-		
-		/* write the key */
-		if (write(inDatabaseFd, inNode->fKeySubpart, theKeySize) != theKeySize)
+		theFD = open(theJournalPath, O_WRONLY | O_CREAT, 0664);
+		if (theFD < 0)
 		{
 			theErr = errno;
 			break;
 		}
-		
-		if (theKind == kLeaf)
-		{
-			/* it's a leaf */
-			SLeaf* theLeaf = (SLeaf*) inNode;
-			int theValueSize = strlen(theLeaf->fValue) + 1;
-
-			if (write(inDatabaseFd, theLeaf->fValue, theValueSize) != theValueSize)
-			{
-				theErr = errno;
-				break;
-			}
-		} else {
-			/* it's a node */
-			SNode* theNode = (SNode*) inNode;
-			unsigned int theSubnodesCount = theNode->fSubnodesCount;
-			SHeader** theSubnodeCursor = theNode->fSubnodes;
-			unsigned char theSubnodesCountAsBytes[4];
-			unsigned int indexSubnodes;
-			
-			theSubnodesCountAsBytes[0] = (theSubnodesCount >> 24) & 0xFF;
-			theSubnodesCountAsBytes[1] = (theSubnodesCount >> 16) & 0xFF;
-			theSubnodesCountAsBytes[2] = (theSubnodesCount >> 8) & 0xFF;
-			theSubnodesCountAsBytes[3] = theSubnodesCount & 0xFF;
-			
-			if (write(inDatabaseFd, theSubnodesCountAsBytes, sizeof(theSubnodesCountAsBytes))
-				!= sizeof(theSubnodesCountAsBytes))
+
+		/* drop whatever isn't part of the journal (a truncated change or a
+			journal of another generation) */
+		if (ftruncate(theFD, ioObject->fJournalSize) < 0
+			|| lseek(theFD, ioObject->fJournalSize, SEEK_SET) < 0)
+		{
+			theErr = errno;
+			break;
+		}
+
+		if (ioObject->fJournalSize == 0)
+		{
+			Tcl_DString theHeader;
+
+			Tcl_DStringInit(&theHeader);
+			Tcl_DStringAppend(&theHeader, kFilemapSignature, sizeof(kFilemapSignature));
+			Tcl_DStringAppend(&theHeader, kFilemapJournalVersion, sizeof(kFilemapJournalVersion));
+			AppendUInt32(&theHeader, ioObject->fGeneration);
+			theErr = WriteAll(theFD, Tcl_DStringValue(&theHeader), Tcl_DStringLength(&theHeader));
+			Tcl_DStringFree(&theHeader);
+			if (theErr != 0)
 			{
-				theErr = errno;
 				break;
 			}
-			
-			/* iterate on the subnodes */
-			for (indexSubnodes = 0; indexSubnodes < theSubnodesCount; indexSubnodes++)
-			{
-				theErr = SaveNode(inDatabaseFd, *theSubnodeCursor);
-				if (theErr != 0)
-				{
-					break;
-				}
-				
-				theSubnodeCursor++;
-			}
+			ioObject->fJournalSize = kJournalHeaderSize;
 		}
+
+		theErr = WriteAll(theFD,
+				Tcl_DStringValue(&ioObject->fChanges),
+				Tcl_DStringLength(&ioObject->fChanges));
+		if (theErr != 0)
+		{
+			break;
+		}
+		ioObject->fJournalSize += Tcl_DStringLength(&ioObject->fChanges);
+		Tcl_DStringSetLength(&ioObject->fChanges, 0);
 	} while (0);
-	
+
+	if (theFD >= 0)
+	{
+		(void) close(theFD);
+	}
+
 	return theErr;
 }
 
 /**
- * Recursive function to dispose the tree.
+ * Dispose the tree and the database of a filemap.
  *
- * @param ioRoot		on input, the tree to free, on output, 0L
+ * @param ioObject		the filemap. On output, it has no tree.
  */
 void
-Free(SNode** ioRoot)
+Free(SFilemapObject* ioObject)
 {
-	SNode* theRoot = *ioRoot;
-	if (theRoot != 0)
+	if (ioObject->fRoot != NULL)
 	{
-		SHeader** theSubnodeCursor = theRoot->fSubnodes;
-		unsigned int nbSubnodes = theRoot->fSubnodesCount;
-		SHeader* theSubnode = NULL;
-		unsigned int indexSubnodes;
-	
-		for (indexSubnodes = 0; indexSubnodes < nbSubnodes; indexSubnodes++)
-		{
-			theSubnode = *theSubnodeCursor;
-			if (theSubnode)
-			{
-				if (theSubnode->fNodeType == kNode)
-				{	
-					Free((SNode**) theSubnodeCursor);
-				} else {
-					ckfree((char*) theSubnode);
-					*theSubnodeCursor = 0;
-				}
-				
-				theSubnodeCursor++;
-			}
-		}
-		
-		ckfree((char*) theRoot);
+		FreeNode(ioObject->fRoot);
+		ioObject->fRoot = NULL;
+	}
+	if (ioObject->fMap != NULL)
+	{
+		(void) munmap((void*) ioObject->fMap, ioObject->fMapSize);
+		ioObject->fMap = NULL;
+		ioObject->fMapSize = 0;
+	}
+	ioObject->fRecordsCount = 0;
+	ioObject->fStringsSize = 0;
+	Tcl_DeleteHashTable(&ioObject->fStrings);
+	Tcl_InitHashTable(&ioObject->fStrings, TCL_STRING_KEYS);
+	Tcl_DStringSetLength(&ioObject->fChanges, 0);
+}
+
+/**
+ * Recursive function to dispose a subtree.
+ *
+ * @param inNode		the subtree to free.
+ */
+void
+FreeNode(SNode* inNode)
+{
+	unsigned int indexSubnodes;
+
+	for (indexSubnodes = 0; indexSubnodes < inNode->fSubnodesCount; indexSubnodes++)
+	{
+		FreeNode(inNode->fSubnodes[indexSubnodes]);
+	}
+	if (inNode->fSubnodes != NULL)
+	{
+		ckfree((char*) inNode->fSubnodes);
 	}
-	*ioRoot = 0;
+	ckfree((char*) inNode);
 }
 
 /**
- * Recursive function to set a value.
+ * Set a value.
  *
- * @param ioRoot		pointer to the current root of the subtree.
- *						Can be modified.
+ * @param ioObject		the filemap.
  * @param inPath		path to the value to set.
  * @param inValue		value to set in the map.
  * @return 0 if everything is fine, an error code otherwise.
  */
 int
-Set(SNode** ioRoot, const char* inPath, const char* inValue)
+Set(SFilemapObject* ioObject, const char* inPath, const char* inValue)
 {
 	int theResult = 0;
-	SNode* theRoot = *ioRoot;
+	SNode* theNode = ioObject->fRoot;
+	const char* theCursor = inPath;
+	const char* thePart;
+	int partLength;
+	int isLast = 0;
 
+	/* check that the path names a file before changing anything */
 	do {
-		const char* beginCursor = inPath;
-		SHeader* theSubnode = NULL;
-		SHeader** theSubnodeCursor = theRoot->fSubnodes;
-		unsigned int nbSubnodes = theRoot->fSubnodesCount;
-		unsigned int indexSubnodes;
-		const char* endCursor;
-		char theCurrentChar;
-		int partLength;
-		
-		/* jump to first non / character in the path */
-		do {
-			theCurrentChar = *beginCursor++;
-		} while (theCurrentChar == '/');
+		thePart = NextPart(&theCursor, &partLength, &isLast);
+	} while ((thePart != NULL) && !isLast);
+	if (thePart == NULL)
+	{
+		/* eek. we've been provided an empty path or a directory. */
+		return EISDIR;
+	}
 
-		/* one char too far */
-		beginCursor--;
-		
-		if (theCurrentChar == '\0')
+	theCursor = inPath;
+	while ((thePart = NextPart(&theCursor, &partLength, &isLast)) != NULL)
+	{
+		SNode* theSubnode;
+		unsigned int theIndex;
+
+		theResult = Materialize(ioObject, theNode);
+		if (theResult != 0)
 		{
-			/* eek. we've been provided an empty path. return an error */
-			theResult = EISDIR;
 			break;
 		}
-		
-		/* find end of path element and determine if we have a file name or a
-			directory name (i.e. if there is a leading / or not) */
-		endCursor = beginCursor;
-
-		do {
-			theCurrentChar = *endCursor++;
-		} while ((theCurrentChar != '/') && (theCurrentChar != '\0'));
-
-		/* one char too far */
-		endCursor--;
-		partLength = endCursor - beginCursor;
 
 		/* do we have a node for this entry? */
-		for (indexSubnodes = 0; indexSubnodes < nbSubnodes; indexSubnodes++)
-		{
-			int theCompResult;
-			theSubnode = *theSubnodeCursor++;
-			theCompResult = strncasecmp(theSubnode->fKeySubpart, beginCursor, partLength);
-			if (theCompResult == 0)
-			{
-				/* first partLength bytes are equal, we need to check that fKeySubpart
-					is not longer */
-				theCompResult = theSubnode->fKeySubpart[partLength];
-			}
-			if (theCompResult == 0)
-			{
-				/* found it. */
-				--theSubnodeCursor;
-				break;
-			} else if (theCompResult > 0) {
-				theSubnode = NULL;
-				break;
-			}
-			
-			theSubnode = NULL;
-		}
-		
+		theSubnode = FindSubnode(theNode, thePart, partLength, &theIndex);
 		if (theSubnode == NULL)
 		{
 			/* not found. We need to create a node for this entry */
-			theRoot =
-				(SNode*) ckrealloc(
-							(char*) theRoot,
-							sizeof(SNode) + (sizeof(SHeader*) * nbSubnodes));
-			*ioRoot = theRoot;
-			/* Push the pointers after the current node lower. */
-			(void) memmove(
-						&theRoot->fSubnodes[indexSubnodes + 1],
-						(const void*) &theRoot->fSubnodes[indexSubnodes],
-						(nbSubnodes - indexSubnodes) * sizeof(SHeader*));
-			nbSubnodes++;
-			theRoot->fSubnodesCount = nbSubnodes;
-
-			if (theCurrentChar == '/')
-			{
-				/* It's a directory node that we need. */
-				theSubnode = (SHeader*) ckalloc(sizeof(SNode) - sizeof(SHeader*));
-				theSubnode->fNodeType = kNode;
-				((SNode*) theSubnode)->fSubnodesCount = 0;
-			} else {
-				theSubnode = (SHeader*) ckalloc(sizeof(SLeaf));
-				theSubnode->fNodeType = kLeaf;
-				((SLeaf*) theSubnode)->fValue[NAME_MAX] = 0;
-			}
-			
-			(void) memcpy(
-					theSubnode->fKeySubpart,
-					beginCursor,
-					partLength);
-			/* add the null terminator */
-			theSubnode->fKeySubpart[partLength] = 0;
-			
-			/* put the node in the parent node */
-			theRoot->fSubnodes[indexSubnodes] = theSubnode;
-			theSubnodeCursor = &theRoot->fSubnodes[indexSubnodes];
-		}
-		
-		if (theCurrentChar == '/')
-		{
-			if (theSubnode->fNodeType != kNode)
-			{
-				theResult = ENOTDIR;
-				break;
-			}
-			
-			/* if it's a directory, call us recursively */
-			theResult = Set((SNode**) theSubnodeCursor, (endCursor + 1), inValue);
-		} else {
-			if (theSubnode->fNodeType != kLeaf)
+			theSubnode = NewNode(Intern(ioObject, thePart, partLength), NULL);
+			InsertSubnode(theNode, theIndex, theSubnode);
+		} else if (isLast) {
+			if (theSubnode->fValue == NULL)
 			{
 				theResult = EISDIR;
 				break;
 			}
+		} else if (theSubnode->fValue != NULL) {
+			theResult = ENOTDIR;
+			break;
+		}
 
+		if (isLast)
+		{
 			/* if it's a file, set the value */
-			strncpy(((SLeaf*) theSubnode)->fValue, inValue, NAME_MAX);
+			theSubnode->fValue = Intern(ioObject, inValue, -1);
 		}
-	} while (0);
-	
+		theNode = theSubnode;
+	}
+
 	return theResult;
 }
 
 /**
- * Recursive function to retrieve a value.
+ * Retrieve a value.
  * This function will return NULL if the value is not in the map.
  * The pointer to the value is valid until the tree is changed.
  *
- * @param inRoot		the current root of the subtree.
+ * @param inObject		the filemap.
  * @param inPath		path to the value to retrieve.
  * @return the value or NULL if it's not in the map.
  */
 const char*
-Get(SNode* inRoot, const char* inPath)
+Get(SFilemapObject* inObject, const char* inPath)
 {
-	const char* theResult = NULL;
-	
-	do {
-		const char* beginCursor = inPath;
-		SHeader* theSubnode = NULL;
-		SHeader** theSubnodeCursor = inRoot->fSubnodes;
-		unsigned int nbSubnodes = inRoot->fSubnodesCount;
-		unsigned int indexSubnodes;
-		const char* endCursor;
-		char theCurrentChar;
-		int partLength;
-		
-		/* jump to first non / character in the path */
-		do {
-			theCurrentChar = *beginCursor++;
-		} while (theCurrentChar == '/');
-
-		/* one char too far */
-		beginCursor--;
-		
-		if (theCurrentChar == '\0')
+	SNode* theNode = inObject->fRoot;
+	uint32_t theRecord = kNoRecord;
+	const char* theCursor = inPath;
+	const char* thePart;
+	int partLength;
+	int isLast = 0;
+
+	while ((thePart = NextPart(&theCursor, &partLength, &isLast)) != NULL)
+	{
+		if ((theNode != NULL) && (theNode->fRecord == kNoRecord))
 		{
-			/* eek. we've been provided an empty path. we return NULL then. */
-			break;
-		}
-		
-		/* find end of path element and determine if we have a file name or a
-			directory name (i.e. if there is a leading / or not) */
-		endCursor = beginCursor;
-
-		do {
-			theCurrentChar = *endCursor++;
-		} while ((theCurrentChar != '/') && (theCurrentChar != '\0'));
+			unsigned int theIndex;
 
-		/* one char too far */
-		endCursor--;
-		partLength = endCursor - beginCursor;
-
-		/* do we have a node for this entry? */
-		for (indexSubnodes = 0; indexSubnodes < nbSubnodes; indexSubnodes++)
-		{
-			int theCompResult;
-			theSubnode = *theSubnodeCursor++;
-			theCompResult = strncasecmp(theSubnode->fKeySubpart, beginCursor, partLength);
-			if (theCompResult == 0)
+			theNode = FindSubnode(theNode, thePart, partLength, &theIndex);
+			if (theNode == NULL)
 			{
-				/* first partLength bytes are equal, we need to check that fKeySubpart
-					is not longer */
-				theCompResult = theSubnode->fKeySubpart[partLength];
+				return NULL;
 			}
-			if (theCompResult == 0)
+			if (isLast)
 			{
-				/* found it. */
-				--theSubnodeCursor;
-				break;
-			} else if (theCompResult > 0) {
-				theSubnode = NULL;
-				break;
+				return theNode->fValue;
 			}
-			
-			theSubnode = NULL;
-		}
-		
-		if (theSubnode == NULL)
-		{
-			/* not found. */
-			break;
-		}
-		
-		if (theCurrentChar == '/')
-		{
-			if (theSubnode->fNodeType != kNode)
+			if (theNode->fValue != NULL)
 			{
-				break;
+				return NULL;
 			}
-			
-			/* if it's a directory, call us recursively */
-			theResult = Get((SNode*) theSubnode, (endCursor + 1));
 		} else {
-			if (theSubnode->fNodeType != kLeaf)
+			/* the rest is in the database */
+			const unsigned char* theRecordBytes;
+			uint32_t theValueOffset;
+
+			if (theNode != NULL)
 			{
-				break;
+				theRecord = theNode->fRecord;
+				theNode = NULL;
+			}
+			theRecord = FindSubrecord(inObject, theRecord, thePart, partLength);
+			if (theRecord == kNoRecord)
+			{
+				return NULL;
+			}
+			theRecordBytes = GetRecord(inObject, theRecord);
+			theValueOffset = ReadUInt32(theRecordBytes + 4);
+			if (isLast)
+			{
+				return (theValueOffset == kNoValue)
+					? NULL : GetString(inObject, theValueOffset);
+			}
+			if (theValueOffset != kNoValue)
+			{
+				return NULL;
 			}
-
-			/* if it's a file, return the value */
-			theResult = ((SLeaf*) theSubnode)->fValue;
 		}
-	} while (0);
-	
-	return theResult;
+	}
+
+	/* eek. we've been provided an empty path or a directory. */
+	return NULL;
 }
 
 /**
  * Return the list of paths for a given value.
  *
- * @param inRoot		the root of the tree.
+ * @param inObject		the filemap.
  * @param inValue		value of the keys to find.
  * @return the list of paths which has value for their value.
  */
 Tcl_Obj*
-List(SNode* inRoot, const char* inValue)
+List(SFilemapObject* inObject, const char* inValue)
 {
 	/* Create the result (a list) */
 	Tcl_Obj* theResult = Tcl_NewListObj(0, NULL);
-	
+	Tcl_DString thePath;
+
 	/* Call the recursive function */
-	ListSubtree((SHeader*) inRoot, inValue, theResult, "", 0);
-	
+	Tcl_DStringInit(&thePath);
+	ListNode(inObject, inObject->fRoot, inValue, theResult, &thePath);
+	Tcl_DStringFree(&thePath);
+
 	return theResult;
 }
 
 /**
  * Recursive function to return the list of paths for a given value.
  *
- * @param inRoot		the current root of the tree.
+ * @param inObject		the filemap.
+ * @param inNode		the current root of the tree.
  * @param inValue		value of the keys to find.
  * @param outList		the list to populate with paths.
- * @param inSubpath		the path of the current root.
- * @param inSubpathLen	the length, without the terminator, of the path.
+ * @param ioPath		the path of the parent of the current root.
  */
 void
-ListSubtree(
-	SHeader* inRoot,
+ListNode(
+	SFilemapObject* inObject,
+	SNode* inNode,
 	const char* inValue,
 	Tcl_Obj* outList,
-	const char* inSubpath,
-	unsigned int inSubpathLen)
+	Tcl_DString* ioPath)
 {
-	if (inRoot->fNodeType == kLeaf)
+	int thePathLen = Tcl_DStringLength(ioPath);
+
+	Tcl_DStringAppend(ioPath, inNode->fKeySubpart, -1);
+	if (inNode->fValue != NULL)
 	{
 		/* it's a leaf. Does the value match? */
-		if (strcasecmp(((SLeaf*) inRoot)->fValue, inValue) == 0)
-		{
-			/* It matches. */
-			char* thePath = ckalloc(inSubpathLen + NAME_MAX + 1);
-			(void) memcpy(thePath, inSubpath, inSubpathLen);
-			(void) strcpy(
-						&thePath[inSubpathLen],
-						(const char*) inRoot->fKeySubpart);
-			
+		if (CompareKeys(inNode->fValue, inValue) == 0)
+		{
 			Tcl_ListObjAppendElement(
 					NULL,
 					outList,
-					Tcl_NewStringObj(thePath, -1) );
-
-			ckfree(thePath);
+					Tcl_NewStringObj(Tcl_DStringValue(ioPath), Tcl_DStringLength(ioPath)));
 		}
+	} else if (inNode->fRecord != kNoRecord) {
+		ListRecord(inObject, inNode->fRecord, inValue, outList, ioPath);
 	} else {
 		/* it's a node. */
-		SNode* theNode = (SNode*) inRoot;
+		unsigned int indexSubnodes;
 
-		unsigned int theKeySubpartLen = strlen(inRoot->fKeySubpart);
-		unsigned int thePathLen = inSubpathLen + theKeySubpartLen + 1;
-		char* thePath = ckalloc(thePathLen + 1);
+		Tcl_DStringAppend(ioPath, "/", 1);
+		for (indexSubnodes = 0; indexSubnodes < inNode->fSubnodesCount; indexSubnodes++)
+		{
+			ListNode(inObject, inNode->fSubnodes[indexSubnodes], inValue, outList, ioPath);
+		}
+	}
+	Tcl_DStringSetLength(ioPath, thePathLen);
+}
 
-		SHeader** theSubnodeCursor = theNode->fSubnodes;
-		unsigned int nbSubnodes = theNode->fSubnodesCount;
-		unsigned int indexSubnodes;
+/**
+ * Recursive function to return the list of paths for a given value in a
+ * directory of the database.
+ *
+ * @param inObject		the filemap.
+ * @param inRecord		the directory.
+ * @param inValue		value of the keys to find.
+ * @param outList		the list to populate with paths.
+ * @param ioPath		the path of the directory, without the final /.
+ */
+void
+ListRecord(
+	SFilemapObject* inObject,
+	uint32_t inRecord,
+	const char* inValue,
+	Tcl_Obj* outList,
+	Tcl_DString* ioPath)
+{
+	int thePathLen;
+	uint32_t theFirst;
+	uint32_t theCount;
+	uint32_t index;
+	/* most files have the same value as their neighbours, so remember the
+		offset of the last value that was checked */
+	uint32_t theLastOffset = kNoValue;
+	int theLastMatched = 0;
+
+	if (GetSubrecords(inObject, inRecord, &theFirst, &theCount) != 0)
+	{
+		return;
+	}
 
-		/* Let's build the path */
-		(void) memcpy(thePath, inSubpath, inSubpathLen);
-		(void) memcpy(
-					&thePath[inSubpathLen],
-					inRoot->fKeySubpart,
-					theKeySubpartLen);
-		inSubpathLen += theKeySubpartLen;
-		thePath[thePathLen - 1] = '/';
-		thePath[thePathLen] = '\0';
+	Tcl_DStringAppend(ioPath, "/", 1);
+	thePathLen = Tcl_DStringLength(ioPath);
+	for (index = theFirst; index < theFirst + theCount; index++)
+	{
+		const unsigned char* theRecordBytes = GetRecord(inObject, index);
+		uint32_t theValueOffset = ReadUInt32(theRecordBytes + 4);
+		const char* theKeySubpart;
+
+		if (theValueOffset == kNoValue)
+		{
+			theKeySubpart = GetString(inObject, ReadUInt32(theRecordBytes));
+			if (theKeySubpart != NULL)
+			{
+				Tcl_DStringAppend(ioPath, theKeySubpart, -1);
+				ListRecord(inObject, index, inValue, outList, ioPath);
+				Tcl_DStringSetLength(ioPath, thePathLen);
+			}
+			continue;
+		}
 
-		/* Iteration on the nodes */
-		for (indexSubnodes = 0; indexSubnodes < nbSubnodes; indexSubnodes++)
+		if (theValueOffset != theLastOffset)
 		{
-			ListSubtree(*theSubnodeCursor, inValue, outList, thePath, thePathLen);
+			const char* theValue = GetString(inObject, theValueOffset);
 
-			theSubnodeCursor++;
+			theLastOffset = theValueOffset;
+			theLastMatched = (theValue != NULL) && (CompareKeys(theValue, inValue) == 0);
+		}
+		if (theLastMatched)
+		{
+			theKeySubpart = GetString(inObject, ReadUInt32(theRecordBytes));
+			if (theKeySubpart != NULL)
+			{
+				Tcl_DStringAppend(ioPath, theKeySubpart, -1);
+				Tcl_ListObjAppendElement(
+						NULL,
+						outList,
+						Tcl_NewStringObj(Tcl_DStringValue(ioPath), Tcl_DStringLength(ioPath)));
+				Tcl_DStringSetLength(ioPath, thePathLen);
+			}
 		}
-		
-		/* clean up */
-		ckfree(thePath);
 	}
+	Tcl_DStringSetLength(ioPath, thePathLen - 1);
 }
 
 /**
- * Recursive function to delete a value.
+ * Delete a value.
  * This function will return an error if the value is not in the map.
  * This function also prunes the tree (i.e. will delete any node with no subnode).
  *
- * @param ioRoot		pointer to the current root of the subtree.
- *						Can be modified.
+ * @param ioObject		the filemap.
  * @param inPath		path to the value to delete.
  * @return an error code if a problem occurred (like the value is not in the
  * tree), 0 otherwise.
  */
 int
-Delete(SNode** ioRoot, const char* inPath)
+Delete(SFilemapObject* ioObject, const char* inPath)
+{
+	return DeleteInNode(ioObject, ioObject->fRoot, inPath);
+}
+
+/**
+ * Recursive function to delete a value.
+ *
+ * @param ioObject		the filemap.
+ * @param ioNode		the current root of the subtree.
+ * @param inPath		path to the value to delete, relative to ioNode.
+ * @return an error code if a problem occurred, 0 otherwise.
+ */
+int
+DeleteInNode(SFilemapObject* ioObject, SNode* ioNode, const char* inPath)
 {
 	int theResult = 0;
-	SNode* theRoot = *ioRoot;
 
 	do {
-		const char* beginCursor = inPath;
-		SHeader* theSubnode = NULL;
-		SHeader** theSubnodeCursor = theRoot->fSubnodes;
-		unsigned int nbSubnodes = theRoot->fSubnodesCount;
-		unsigned int indexSubnodes;
-		const char* endCursor;
-		char theCurrentChar;
+		const char* theCursor = inPath;
+		const char* thePart;
 		int partLength;
-		
-		/* jump to first non / character in the path */
-		do {
-			theCurrentChar = *beginCursor++;
-		} while (theCurrentChar == '/');
+		int isLast;
+		SNode* theSubnode;
+		unsigned int theIndex;
 
-		/* one char too far */
-		beginCursor--;
-		
-		if (theCurrentChar == '\0')
+		thePart = NextPart(&theCursor, &partLength, &isLast);
+		if (thePart == NULL)
 		{
 			/* eek. we've been provided an empty path. return an error */
 			theResult = EISDIR;
 			break;
 		}
-		
-		/* find end of path element and determine if we have a file name or a
-			directory name (i.e. if there is a leading / or not) */
-		endCursor = beginCursor;
 
-		do {
-			theCurrentChar = *endCursor++;
-		} while ((theCurrentChar != '/') && (theCurrentChar != '\0'));
-
-		/* one char too far */
-		endCursor--;
-		partLength = endCursor - beginCursor;
-
-		/* do we have a node for this entry? */
-		for (indexSubnodes = 0; indexSubnodes < nbSubnodes; indexSubnodes++)
+		theResult = Materialize(ioObject, ioNode);
+		if (theResult != 0)
 		{
-			int theCompResult;
-			theSubnode = *theSubnodeCursor++;
-			theCompResult = strncasecmp(theSubnode->fKeySubpart, beginCursor, partLength);
-			if (theCompResult == 0)
-			{
-				/* first partLength bytes are equal, we need to check that fKeySubpart
-					is not longer */
-				theCompResult = theSubnode->fKeySubpart[partLength];
-			}
-			if (theCompResult == 0)
-			{
-				/* found it. */
-				--theSubnodeCursor;
-				break;
-			} else if (theCompResult > 0) {
-				theSubnode = NULL;
-				break;
-			}
-			
-			theSubnode = NULL;
+			break;
 		}
-		
+
+		/* do we have a node for this entry? */
+		theSubnode = FindSubnode(ioNode, thePart, partLength, &theIndex);
 		if (theSubnode == NULL)
 		{
 			/* not found. Return an error */
@@ -1076,39 +1854,36 @@ Delete(SNode** ioRoot, const char* inPath)
 			break;
 		}
 
-		if (theCurrentChar == '/')
+		if (!isLast)
 		{
+			if (theSubnode->fValue != NULL)
+			{
+				theResult = kKeyNotFound_Err;
+				break;
+			}
+
 			/* if it's a directory, call us recursively */
-			SNode* theSubnodePointer = (SNode*) theSubnode;
-			theResult = Delete(&theSubnodePointer, (endCursor + 1));
+			theResult = DeleteInNode(ioObject, theSubnode, theCursor);
 
 			/* Then prune the entry if it's empty */
-			if (theSubnodePointer->fSubnodesCount == 0)
+			if ((theSubnode->fSubnodesCount != 0) || (theSubnode->fRecord != kNoRecord))
 			{
-				ckfree((char*) theSubnodePointer);
-				nbSubnodes--;
-				theRoot->fSubnodesCount = nbSubnodes;
-				(void) memmove(
-					&theRoot->fSubnodes[indexSubnodes],
-					&theRoot->fSubnodes[indexSubnodes+1],
-					(nbSubnodes - indexSubnodes) * sizeof(SHeader*));
-				
-				/* we don't realloc. */
-			} else {
-				*theSubnodeCursor = (SHeader*) theSubnodePointer;
+				break;
 			}
-		} else {
-			/* if it's a file, simply delete the entry */
-			ckfree((char*) theSubnode);
-			nbSubnodes--;
-			theRoot->fSubnodesCount = nbSubnodes;
-			(void) memmove(
-				&theRoot->fSubnodes[indexSubnodes],
-				&theRoot->fSubnodes[indexSubnodes+1],
-				(nbSubnodes - indexSubnodes) * sizeof(SHeader*));
+		} else if (theSubnode->fValue == NULL) {
+			theResult = EISDIR;
+			break;
 		}
+
+		/* simply delete the entry (we don't realloc) */
+		FreeNode(theSubnode);
+		ioNode->fSubnodesCount--;
+		(void) memmove(
+			&ioNode->fSubnodes[theIndex],
+			&ioNode->fSubnodes[theIndex + 1],
+			(ioNode->fSubnodesCount - theIndex) * sizeof(SNode*));
 	} while (0);
-	
+
 	return theResult;
 }
 
@@ -1128,7 +1903,6 @@ FreeFilemapInternalRep(Tcl_Obj* inObjPtr)
 	SFilemapObject* theObject = inObjPtr->internalRep.otherValuePtr;
 	if ((--theObject->fRefCount) == 0)
 	{
-		SNode* theRoot = theObject->fRoot;
 		int theFD = theObject->fLockFD;
 		if (theFD >= 0)
 		{
@@ -1138,7 +1912,10 @@ FreeFilemapInternalRep(Tcl_Obj* inObjPtr)
 		}
 		
 		/* free it */
-		Free(&theRoot);
+		Free(theObject);
+		Tcl_DeleteHashTable(&theObject->fStrings);
+		Tcl_DStringFree(&theObject->fChanges);
+		ckfree((char*) theObject);
 	}
 	
 	inObjPtr->internalRep.otherValuePtr = NULL;
@@ -1239,10 +2016,10 @@ SetResultFromErrorCode(Tcl_Interp* interp, int inErrorCode)
 			theResult = TCL_ERROR;
 			break;
 
-		case kNameTooLong_Err:
+		case kCorruptedDB_Err:
 			Tcl_SetResult(
 				interp,
-				"key subpart or value string too long (the maximum length is NAME_MAX)",
+				"invalid record in database (database is corrupted?)",
 				TCL_STATIC);
 			theResult = TCL_ERROR;
 			break;
@@ -1273,6 +2050,38 @@ SetResultFromErrorCode(Tcl_Interp* interp, int inErrorCode)
 	return theResult;
 }
 
+/**
+ * Create a filemap internal object with an empty tree.
+ *
+ * @return the object, with a ref count of 1.
+ */
+SFilemapObject*
+NewFilemapObject(void)
+{
+	SFilemapObject* theFilemapObject =
+		(SFilemapObject*) ckalloc(sizeof(SFilemapObject));
+
+	theFilemapObject->fRefCount = 1;
+	theFilemapObject->fFilemapPath[0] = '\0';
+	theFilemapObject->fLockFD = -1;
+	theFilemapObject->fRoot = NULL;
+	Tcl_InitHashTable(&theFilemapObject->fStrings, TCL_STRING_KEYS);
+	theFilemapObject->fMap = NULL;
+	theFilemapObject->fMapSize = 0;
+	theFilemapObject->fDatabaseSize = 0;
+	theFilemapObject->fRecordsCount = 0;
+	theFilemapObject->fStringsSize = 0;
+	theFilemapObject->fGeneration = 0;
+	theFilemapObject->fJournalSize = 0;
+	Tcl_DStringInit(&theFilemapObject->fChanges);
+	theFilemapObject->fIsReadOnly = 0;
+	theFilemapObject->fIsDirty = 0;
+	theFilemapObject->fIsRAMOnly = 0;
+	theFilemapObject->fNeedsRewrite = 0;
+
+	return theFilemapObject;
+}
+
 /**
  * Retrieve the filemap internal object from the variable name.
  * If it cannot be found, set the interpreter's result to some error message.
@@ -1341,9 +2150,7 @@ FilemapCloseCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		if (!(theFilemapObject->fIsDirty) || (theFilemapObject->fIsRAMOnly)) {
 			theErr = 0;
 		} else {
-			theErr = Save(
-						theFilemapObject->fFilemapPath,
-						theFilemapObject->fRoot);
+			theErr = Save(theFilemapObject);
 		}
 		
 		/* Return any error. */
@@ -1371,7 +2178,6 @@ FilemapCreateCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 {
 	Tcl_Obj* theObject;
 	SFilemapObject* theFilemapObject;
-	SNode* theRoot = NULL;
 
 	/*	first (second) parameter is the variable name */
 	if (objc != 3) {
@@ -1379,18 +2185,11 @@ FilemapCreateCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		return TCL_ERROR;
 	}	
 
-	/* Create an empty root */
-	Create(&theRoot);
-
-	/* Create the object */
+	/* Create the object, with an empty root */
 	theObject = Tcl_NewObj();
-	theFilemapObject = (SFilemapObject*) ckalloc(sizeof(SFilemapObject));
-	theFilemapObject->fRefCount = 1;
-	theFilemapObject->fLockFD = -1;
-	theFilemapObject->fRoot = theRoot;
-	theFilemapObject->fIsReadOnly = 0;
+	theFilemapObject = NewFilemapObject();
+	theFilemapObject->fRoot = Create();
 	theFilemapObject->fIsRAMOnly = 1;
-	theFilemapObject->fIsDirty = 0;
 	theObject->internalRep.otherValuePtr = theFilemapObject;
 	theObject->typePtr = &tclFilemapType;
 	
@@ -1438,7 +2237,7 @@ FilemapExistsCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		}
 		
 		/* Retrieve the value */
-		theValue = Get(theFilemapObject->fRoot, Tcl_GetString(objv[3]));
+		theValue = Get(theFilemapObject, Tcl_GetString(objv[3]));
 		
 		/* Say if we found it */
 	    Tcl_SetObjResult(interp, Tcl_NewBooleanObj(theValue != NULL));
@@ -1480,7 +2279,7 @@ FilemapGetCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		}
 		
 		/* Retrieve the value */
-		theValue = Get(theFilemapObject->fRoot, Tcl_GetString(objv[3]));
+		theValue = Get(theFilemapObject, Tcl_GetString(objv[3]));
 		
 		/* Return it. */
 		Tcl_SetResult(interp, (char*) theValue, TCL_VOLATILE);
@@ -1559,7 +2358,7 @@ FilemapListCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		}
 
 		/* Build the list */
-		theList = List(theFilemapObject->fRoot, Tcl_GetString(objv[3]));
+		theList = List(theFilemapObject, Tcl_GetString(objv[3]));
 
 		/* Return the list. */
 		Tcl_SetObjResult(interp, theList);
@@ -1604,7 +2403,6 @@ FilemapOpenCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		SFilemapObject* theFilemapObject;
 		int theLockFD = -1;
 		struct flock theLock;
-		SNode* theRoot = NULL;
 		char theLockPath[PATH_MAX];
 	
 		thePath = Tcl_GetString(objv[3]);
@@ -1664,33 +2462,31 @@ FilemapOpenCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 			}
 		}
 		
+		/* Create the object */
+		theFilemapObject = NewFilemapObject();
+		(void) strncpy(
+			theFilemapObject->fFilemapPath,
+			thePath,
+			sizeof(theFilemapObject->fFilemapPath) - 1);
+		theFilemapObject->fFilemapPath[sizeof(theFilemapObject->fFilemapPath) - 1] = '\0';
+
 		/* load the map from the file */
-		theErr = Load(thePath, &theRoot);
+		theErr = Load(theFilemapObject);
 		if (theErr != 0)
 		{
-			if (theRoot)
-			{
-				Free(&theRoot);
-			}
+			Free(theFilemapObject);
+			Tcl_DeleteHashTable(&theFilemapObject->fStrings);
+			Tcl_DStringFree(&theFilemapObject->fChanges);
+			ckfree((char*) theFilemapObject);
 			
 			/* Close the lock */
 			(void) close(theLockFD);
 			break;
 		}
 		
-		/* Create the object */
 		theObject = Tcl_NewObj();
-		theFilemapObject = (SFilemapObject*) ckalloc(sizeof(SFilemapObject));
-		theFilemapObject->fRefCount = 1;
-		(void) strncpy(
-			theFilemapObject->fFilemapPath,
-			thePath,
-			sizeof(theFilemapObject->fFilemapPath));
 		theFilemapObject->fLockFD = theLockFD;
-		theFilemapObject->fRoot = theRoot;
 		theFilemapObject->fIsReadOnly = isReadOnly;
-		theFilemapObject->fIsDirty = 0;
-		theFilemapObject->fIsRAMOnly = 0;
 		theObject->internalRep.otherValuePtr = theFilemapObject;
 		theObject->typePtr = &tclFilemapType;
 		
@@ -1743,11 +2539,17 @@ FilemapRevertCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 			break;			
 		}
 		
-		/* Free the tree */
-		Free(&theFilemapObject->fRoot);
+		/* Free the tree and the changes */
+		Free(theFilemapObject);
 		
 		/* Reload the map from the file */
-		theErr = Load(theFilemapObject->fFilemapPath, &theFilemapObject->fRoot);
+		theErr = Load(theFilemapObject);
+		if (theErr != 0)
+		{
+			/* keep an empty map */
+			Free(theFilemapObject);
+			theFilemapObject->fRoot = Create();
+		}
 		
 		/* The file tree is not dirty */
 		theFilemapObject->fIsDirty = 0;
@@ -1799,10 +2601,8 @@ FilemapSaveCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		/* If the tree is read only, fIsDirty is never set */
 		if (theFilemapObject->fIsDirty)
 		{
-			/* Save the filemap to file */
-			theErr = Save(
-					theFilemapObject->fFilemapPath,
-					theFilemapObject->fRoot);
+			/* Save the changes to file */
+			theErr = Save(theFilemapObject);
 		
 			/* The file tree is not dirty */
 			theFilemapObject->fIsDirty = 0;
@@ -1855,12 +2655,20 @@ FilemapSetCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		{
 			theErr = EPERM;
 		} else {
+			const char* theKey = Tcl_GetString(objv[3]);
+			const char* theValue = Tcl_GetString(objv[4]);
+
 			/* Set the value */
-			theErr = Set(
-							&theFilemapObject->fRoot,
-							Tcl_GetString(objv[3]),
-							Tcl_GetString(objv[4]));
+			theErr = Set(theFilemapObject, theKey, theValue);
 			
+			/* Remember the change for the journal */
+			if ((theErr == 0) && !theFilemapObject->fIsRAMOnly)
+			{
+				Tcl_DStringAppend(&theFilemapObject->fChanges, "S", 1);
+				Tcl_DStringAppend(&theFilemapObject->fChanges, theKey, strlen(theKey) + 1);
+				Tcl_DStringAppend(&theFilemapObject->fChanges, theValue, strlen(theValue) + 1);
+			}
+
 			/* The map is now dirty */
 			theFilemapObject->fIsDirty = 1;
 		}
@@ -1908,9 +2716,18 @@ FilemapUnsetCmd(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[])
 		{
 			theErr = EPERM;
 		} else {
+			const char* theKey = Tcl_GetString(objv[3]);
+
 			/* Delete the value */
-			theErr = Delete(&theFilemapObject->fRoot, Tcl_GetString(objv[3]));
+			theErr = Delete(theFilemapObject, theKey);
 			
+			/* Remember the change for the journal */
+			if ((theErr == 0) && !theFilemapObject->fIsRAMOnly)
+			{
+				Tcl_DStringAppend(&theFilemapObject->fChanges, "U", 1);
+				Tcl_DStringAppend(&theFilemapObject->fChanges, theKey, strlen(theKey) + 1);
+			}
+
 			/* The map is now dirty */
 			theFilemapObject->fIsDirty = 1;
 		}
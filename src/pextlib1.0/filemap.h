@@ -39,9 +39,11 @@
  * filemaps are dictionaries (what Tcl calls arrays) with case unsensitive keys
  * that are file paths and values that are port names.
  * This object is not thread safe (i.e. calls are not synchronous).
- * Get/Set/Unset operations depend on the number of elements in each directory,
- * they are nevertheless very fast.
+ * Get/Set/Unset operations are binary searches in each directory of the path.
  * List is a O(n) operation (the slow operation).
+ * The database is mapped in memory when it's opened and only the parts that
+ * are used are read. Saving appends the changes to a journal next to the
+ * database (filemapPath.journal), which is merged into it from time to time.
  *
  * The syntax is:
  * filemap create filemapVarName
@@ -77,7 +79,7 @@
  *	course).
  *
  * filemap save filemapVarName
- *	save the filemap to disk (without closing it)
+ *	save the changes to disk (without closing the filemap)
  *
  * filemap set filemapVarName path value
  *	set a key,value pair in the database.
@@ -0,0 +1,390 @@
+/*
+ * fs-manifest.c
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/* required for u_short in fts.h on Linux, see fs-traverse.c */
+#define _BSD_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tcl.h>
+
+#include "fs-manifest.h"
+#include "multichecksumcmd.h"
+
+/* Size of the buffer each worker reads files with. */
+#define MANIFEST_BUFSIZE (256 * 1024)
+/* Upper bound for the default number of workers; the work is mostly I/O. */
+#define MANIFEST_MAX_JOBS 16
+
+/* Mach-O magic numbers, spelled out so that the detection also builds where
+ * <mach-o/loader.h> isn't available. */
+#define MANIFEST_MH_MAGIC 0xfeedfaceU
+#define MANIFEST_MH_MAGIC_64 0xfeedfacfU
+#define MANIFEST_ARMAG "!<arch>\n"
+
+typedef struct {
+    /* path as returned by fts */
+    char *path;
+    /* whether the file (or the target of the link) is a regular file */
+    bool regular;
+    /* whether the path itself is a symlink */
+    bool link;
+    bool binary;
+    /* errno value if the file could not be read, 0 otherwise */
+    int error;
+    char digest[33];
+} manifest_entry;
+
+typedef struct {
+    manifest_entry *entries;
+    size_t count;
+    /* next entry to be taken by a worker */
+    size_t next;
+    pthread_mutex_t mutex;
+} manifest_queue;
+
+/*
+ * Determine whether the first bytes of a file are those of a Mach-O binary,
+ * a universal binary or a static archive, the same way fileIsBinary does.
+ */
+static bool is_binary(const unsigned char *buf, size_t len) {
+    uint32_t magic;
+
+    if (len < sizeof(magic)) {
+        return false;
+    }
+    memcpy(&magic, buf, sizeof(magic));
+    if (magic == MANIFEST_MH_MAGIC || magic == MANIFEST_MH_MAGIC_64) {
+        return true;
+    }
+    if (len >= sizeof(MANIFEST_ARMAG) - 1
+            && memcmp(buf, MANIFEST_ARMAG, sizeof(MANIFEST_ARMAG) - 1) == 0) {
+        return true;
+    }
+    /* either universal binary or java class (both 0xcafebabe); the header of
+     * a universal binary is big endian and holds a small number of archs */
+    if (len >= 8 && buf[0] == 0xca && buf[1] == 0xfe && buf[2] == 0xba && buf[3] == 0xbe) {
+        uint32_t archcount = ((uint32_t) buf[4] << 24) | ((uint32_t) buf[5] << 16)
+            | ((uint32_t) buf[6] << 8) | (uint32_t) buf[7];
+        return archcount > 0 && archcount < 20;
+    }
+    return false;
+}
+
+/* Read until buf is full or the end of the file is reached. */
+static ssize_t read_full(int fd, unsigned char *buf, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t got = read(fd, buf + total, size - total);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        total += (size_t) got;
+    }
+    return (ssize_t) total;
+}
+
+/* Compute the digest of a file and classify it from the same read. */
+static void scan_entry(manifest_entry *entry, unsigned char *buf, void *ctx) {
+    bool first = true;
+    int fd = open(entry->path, O_RDONLY);
+
+    if (fd == -1) {
+        entry->error = errno;
+        return;
+    }
+    md5_algo.init(ctx);
+    for (;;) {
+        ssize_t got = read_full(fd, buf, MANIFEST_BUFSIZE);
+        if (got < 0) {
+            entry->error = errno;
+            break;
+        }
+        if (first) {
+            /* fileIsBinary doesn't follow symlinks */
+            entry->binary = !entry->link && is_binary(buf, (size_t) got);
+            first = false;
+        }
+        if (got == 0) {
+            break;
+        }
+        md5_algo.update(ctx, buf, (size_t) got);
+        if ((size_t) got < MANIFEST_BUFSIZE) {
+            break;
+        }
+    }
+    close(fd);
+    if (entry->error == 0) {
+        md5_algo.end(ctx, entry->digest);
+    }
+}
+
+static void *manifest_worker_main(void *arg) {
+    manifest_queue *queue = arg;
+    unsigned char *buf = malloc(MANIFEST_BUFSIZE);
+    void *ctx = malloc(md5_algo.ctx_size);
+
+    for (;;) {
+        manifest_entry *entry;
+
+        pthread_mutex_lock(&queue->mutex);
+        do {
+            entry = queue->next < queue->count ? &queue->entries[queue->next++] : NULL;
+        } while (entry && !entry->regular);
+        pthread_mutex_unlock(&queue->mutex);
+        if (!entry) {
+            break;
+        }
+        if (!buf || !ctx) {
+            entry->error = ENOMEM;
+            continue;
+        }
+        scan_entry(entry, buf, ctx);
+    }
+    free(ctx);
+    free(buf);
+    return NULL;
+}
+
+static int
+do_compare(const FTSENT **a, const FTSENT **b)
+{
+    return strcmp((*a)->fts_name, (*b)->fts_name);
+}
+
+/*
+ * Collect everything below root that isn't a directory, in the order
+ * `fs-traverse -depth` visits it.
+ */
+static int collect_entries(Tcl_Interp *interp, char *root, manifest_queue *queue) {
+    char *targets[2] = {root, NULL};
+    size_t capacity = 0;
+    FTS *root_fts;
+    FTSENT *ent;
+    int rval = TCL_OK;
+
+    root_fts = fts_open(targets, FTS_PHYSICAL | FTS_COMFOLLOW | FTS_NOCHDIR | FTS_XDEV, &do_compare);
+    if (!root_fts) {
+        Tcl_SetErrno(errno);
+        Tcl_ResetResult(interp);
+        Tcl_AppendResult(interp, root, ": ", (char *)Tcl_PosixError(interp), NULL);
+        return TCL_ERROR;
+    }
+    errno = 0;
+    while (rval == TCL_OK && (ent = fts_read(root_fts)) != NULL) {
+        manifest_entry *entry;
+        struct stat st;
+
+        switch (ent->fts_info) {
+            case FTS_F:
+            case FTS_SL:
+            case FTS_SLNONE:
+            case FTS_DEFAULT:
+                if (queue->count == capacity) {
+                    size_t newcapacity = capacity ? capacity * 2 : 1024;
+                    manifest_entry *newentries = realloc(queue->entries, newcapacity * sizeof(*newentries));
+                    if (!newentries) {
+                        Tcl_SetResult(interp, "out of memory", TCL_STATIC);
+                        rval = TCL_ERROR;
+                        break;
+                    }
+                    queue->entries = newentries;
+                    capacity = newcapacity;
+                }
+                entry = &queue->entries[queue->count];
+                memset(entry, 0, sizeof(*entry));
+                entry->path = strdup(ent->fts_path);
+                if (!entry->path) {
+                    Tcl_SetResult(interp, "out of memory", TCL_STATIC);
+                    rval = TCL_ERROR;
+                    break;
+                }
+                queue->count++;
+                entry->link = ent->fts_info == FTS_SL || ent->fts_info == FTS_SLNONE;
+                if (ent->fts_info == FTS_F) {
+                    entry->regular = true;
+                } else if (ent->fts_info == FTS_SL) {
+                    /* like `file isfile`, follow the link */
+                    entry->regular = stat(ent->fts_accpath, &st) == 0 && S_ISREG(st.st_mode);
+                }
+                break;
+            case FTS_DNR:
+            case FTS_ERR:
+            case FTS_NS:
+                Tcl_SetErrno(ent->fts_errno);
+                Tcl_ResetResult(interp);
+                Tcl_AppendResult(interp, ent->fts_path, ": ", (char *)Tcl_PosixError(interp), NULL);
+                rval = TCL_ERROR;
+                break;
+            default:
+                /* directories, cycles */
+                break;
+        }
+    }
+    if (rval == TCL_OK && errno != 0) {
+        Tcl_SetErrno(errno);
+        Tcl_ResetResult(interp);
+        Tcl_AppendResult(interp, root, ": ", (char *)Tcl_PosixError(interp), NULL);
+        rval = TCL_ERROR;
+    }
+    fts_close(root_fts);
+    return rval;
+}
+
+/* fs-manifest ?-jobs count? ?--? path */
+int
+FsManifestCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
+{
+    manifest_queue queue;
+    pthread_t *threads = NULL;
+    Tcl_Obj *result;
+    Tcl_Obj *const *objv_orig = objv;
+    char *root;
+    size_t rootlen, i;
+    int jobs = 0, started = 0, rval;
+
+    /* Adjust arguments to remove command name */
+    ++objv, --objc;
+
+    /* Parse flags */
+    while (objc) {
+        char *arg = Tcl_GetString(*objv);
+        if (!strcmp(arg, "-jobs") && objc > 1) {
+            if (Tcl_GetIntFromObj(interp, objv[1], &jobs) != TCL_OK) {
+                return TCL_ERROR;
+            }
+            objv += 2, objc -= 2;
+            continue;
+        }
+        if (!strcmp(arg, "--")) {
+            ++objv, --objc;
+            break;
+        }
+        break;
+    }
+
+    if (objc != 1) {
+        Tcl_WrongNumArgs(interp, 1, objv_orig, "?-jobs count? ?--? path");
+        return TCL_ERROR;
+    }
+    if (jobs <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = ncpu > 0 ? (int) (ncpu < MANIFEST_MAX_JOBS ? ncpu : MANIFEST_MAX_JOBS) : 1;
+    }
+
+    root = Tcl_GetString(*objv);
+    rootlen = strlen(root);
+    /* paths are returned relative to root */
+    while (rootlen > 1 && root[rootlen - 1] == '/') {
+        rootlen--;
+    }
+
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.mutex, NULL);
+    rval = collect_entries(interp, root, &queue);
+
+    if (rval == TCL_OK) {
+        if ((size_t) jobs > queue.count) {
+            jobs = (int) queue.count;
+        }
+        threads = calloc((size_t) jobs + 1, sizeof(*threads));
+        for (started = 0; threads && started < jobs; started++) {
+            if (pthread_create(&threads[started], NULL, manifest_worker_main, &queue) != 0) {
+                break;
+            }
+        }
+        /* the calling thread works too, which also covers failures to start
+         * any of the threads */
+        manifest_worker_main(&queue);
+        while (started > 0) {
+            pthread_join(threads[--started], NULL);
+        }
+        free(threads);
+    }
+
+    if (rval == TCL_OK) {
+        result = Tcl_NewListObj(0, NULL);
+        for (i = 0; i < queue.count; i++) {
+            manifest_entry *entry = &queue.entries[i];
+            const char *relpath = entry->path;
+            Tcl_Obj *elems[3];
+
+            if (entry->error != 0) {
+                Tcl_DecrRefCount(result);
+                Tcl_SetErrno(entry->error);
+                Tcl_ResetResult(interp);
+                Tcl_AppendResult(interp, entry->path, ": ", (char *)Tcl_PosixError(interp), NULL);
+                rval = TCL_ERROR;
+                break;
+            }
+            if (strncmp(relpath, root, rootlen) == 0) {
+                relpath += rootlen;
+                while (*relpath == '/') {
+                    relpath++;
+                }
+            }
+            elems[0] = Tcl_NewStringObj(relpath, -1);
+            elems[1] = Tcl_NewStringObj(entry->regular ? entry->digest : "", -1);
+            elems[2] = Tcl_NewBooleanObj(entry->binary);
+            Tcl_ListObjAppendElement(NULL, result, Tcl_NewListObj(3, elems));
+        }
+        if (rval == TCL_OK) {
+            Tcl_SetObjResult(interp, result);
+        }
+    }
+
+    for (i = 0; i < queue.count; i++) {
+        free(queue.entries[i].path);
+    }
+    free(queue.entries);
+    pthread_mutex_destroy(&queue.mutex);
+    return rval;
+}
@@ -0,0 +1,53 @@
+/*
+ * fs-manifest.h
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FS_MANIFEST_H
+#define _FS_MANIFEST_H
+
+#include <tcl.h>
+
+/**
+ * A native command to list the contents of a destroot along with what
+ * +CONTENTS records for each file, using several threads.
+ *
+ * The syntax is:
+ * fs-manifest ?-jobs count? ?--? path
+ *      Return a list with an element for everything below path that isn't a
+ *      directory, in the order `fs-traverse -depth` visits them. Each element
+ *      is a list of the path relative to path, the MD5 digest of the file
+ *      (empty if it isn't a regular file or a symlink to one) and whether it
+ *      is a Mach-O binary (see fileIsBinary). Files are read once, by count
+ *      threads (by default, one per CPU).
+ */
+int FsManifestCmd(ClientData, Tcl_Interp *, int, Tcl_Obj *const objv[]);
+
+#endif
+/* _FS_MANIFEST_H */
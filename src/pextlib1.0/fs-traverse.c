@@ -54,25 +54,91 @@
 
 #include "fs-traverse.h"
 
-static int do_traverse(Tcl_Interp *interp, int flags, char * const *targets, Tcl_Obj *varname, Tcl_Obj *body);
+typedef struct {
+    int flags;
+    char * const *targets;
+    Tcl_Obj *varname;
+    Tcl_Obj *body;
+    /* T_* types of the entries passed to body, 0 for all */
+    int types;
+    /* pattern the names of the entries passed to body must match, or NULL */
+    const char *glob;
+    /* number of entries passed to body at once, 0 if not batched */
+    Tcl_Size batch;
+    /* entries collected for the next batch */
+    Tcl_Obj *pending;
+} traverse_state;
+
+static int do_traverse(Tcl_Interp *interp, traverse_state *state);
 
 #define F_DEPTH 0x1
 #define F_IGNORE_ERRORS 0x2
 #define F_TAILS 0x4
+#define F_STAT 0x8
+
+/* file types, named as by file type */
+#define T_FILE 0x1
+#define T_DIRECTORY 0x2
+#define T_LINK 0x4
+#define T_FIFO 0x8
+#define T_CHARACTER_SPECIAL 0x10
+#define T_BLOCK_SPECIAL 0x20
+#define T_SOCKET 0x40
 
-/* fs-traverse ?-depth? ?-ignoreErrors? ?-tails? ?--? varname target-list body */
+static const struct {
+    const char *name;
+    int type;
+} type_names[] = {
+    {"file", T_FILE},
+    {"directory", T_DIRECTORY},
+    {"link", T_LINK},
+    {"fifo", T_FIFO},
+    {"characterSpecial", T_CHARACTER_SPECIAL},
+    {"blockSpecial", T_BLOCK_SPECIAL},
+    {"socket", T_SOCKET},
+    {NULL, 0}
+};
+
+static int
+parse_types(Tcl_Interp *interp, Tcl_Obj *list, int *types)
+{
+    Tcl_Size typec, i;
+    Tcl_Obj **typev;
+
+    if (Tcl_ListObjGetElements(interp, list, &typec, &typev) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    *types = 0;
+    for (i = 0; i < typec; i++) {
+        const char *name = Tcl_GetString(typev[i]);
+        int j;
+        for (j = 0; type_names[j].name != NULL; j++) {
+            if (!strcmp(name, type_names[j].name)) {
+                *types |= type_names[j].type;
+                break;
+            }
+        }
+        if (type_names[j].name == NULL) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("bad file type \"%s\"", name));
+            return TCL_ERROR;
+        }
+    }
+    return TCL_OK;
+}
+
+/* fs-traverse ?-depth? ?-ignoreErrors? ?-tails? ?-type types? ?-glob pattern? ?-stat? ?-batch count? ?--? varname target-list body */
 int
 FsTraverseCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
-    Tcl_Obj *varname;
-    Tcl_Obj *body;
-    int flags = 0;
+    traverse_state state;
     int rval = TCL_OK;
     Tcl_Obj *listPtr;
     Tcl_Obj *const *objv_orig = objv;
     Tcl_Size lobjc;
     Tcl_Obj **lobjv;
 
+    memset(&state, 0, sizeof(state));
+
     /* Adjust arguments to remove command name */
     ++objv, --objc;
 
@@ -80,20 +146,50 @@ FsTraverseCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Ob
     while (objc) {
         char *arg = Tcl_GetString(*objv);
         if (!strcmp(arg, "-depth")) {
-            flags |= F_DEPTH;
+            state.flags |= F_DEPTH;
             ++objv, --objc;
             continue;
         }
         if (!strcmp(arg, "-ignoreErrors")) {
-            flags |= F_IGNORE_ERRORS;
+            state.flags |= F_IGNORE_ERRORS;
             ++objv, --objc;
             continue;
         }
         if (!strcmp(arg, "-tails")) {
-            flags |= F_TAILS;
+            state.flags |= F_TAILS;
+            ++objv, --objc;
+            continue;
+        }
+        if (!strcmp(arg, "-stat")) {
+            state.flags |= F_STAT;
             ++objv, --objc;
             continue;
         }
+        if (!strcmp(arg, "-type") && objc > 1) {
+            if (parse_types(interp, objv[1], &state.types) != TCL_OK) {
+                return TCL_ERROR;
+            }
+            objv += 2, objc -= 2;
+            continue;
+        }
+        if (!strcmp(arg, "-glob") && objc > 1) {
+            state.glob = Tcl_GetString(objv[1]);
+            objv += 2, objc -= 2;
+            continue;
+        }
+        if (!strcmp(arg, "-batch") && objc > 1) {
+            int batch;
+            if (Tcl_GetIntFromObj(interp, objv[1], &batch) != TCL_OK) {
+                return TCL_ERROR;
+            }
+            if (batch < 1) {
+                Tcl_SetResult(interp, "-batch requires a positive count", TCL_STATIC);
+                return TCL_ERROR;
+            }
+            state.batch = batch;
+            objv += 2, objc -= 2;
+            continue;
+        }
         if (!strcmp(arg, "--")) {
             ++objv, --objc;
             break;
@@ -103,23 +199,23 @@ FsTraverseCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Ob
 
     /* Parse remaining args */
     if (objc != 3) {
-        Tcl_WrongNumArgs(interp, 1, objv_orig, "?-depth? ?-ignoreErrors? ?-tails? ?--? varname target-list body");
+        Tcl_WrongNumArgs(interp, 1, objv_orig, "?-depth? ?-ignoreErrors? ?-tails? ?-type types? ?-glob pattern? ?-stat? ?-batch count? ?--? varname target-list body");
         return TCL_ERROR;
     }
 
-    varname = *objv;
+    state.varname = *objv;
     ++objv, --objc;
 
     listPtr = *objv;
     ++objv, --objc;
 
-    body = *objv;
+    state.body = *objv;
 
     if ((rval = Tcl_ListObjGetElements(interp, listPtr, &lobjc, &lobjv)) == TCL_OK) {
         char **entries;
         char **iter;
 
-        if (flags & F_TAILS && lobjc > 1) {
+        if (state.flags & F_TAILS && lobjc > 1) {
             /* result would be ambiguous with multiple paths, so we do not allow this */
             Tcl_SetResult(interp, "-tails cannot be used with multiple paths", TCL_STATIC);
             return TCL_ERROR;
@@ -132,7 +228,11 @@ FsTraverseCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Ob
             --lobjc, ++lobjv;
         }
         *iter = NULL;
-        rval = do_traverse(interp, flags, entries, varname, body);
+        state.targets = entries;
+        state.pending = Tcl_NewListObj(0, NULL);
+        Tcl_IncrRefCount(state.pending);
+        rval = do_traverse(interp, &state);
+        Tcl_DecrRefCount(state.pending);
         free(entries);
     }
     return rval;
@@ -163,71 +263,197 @@ do_compare(const FTSENT **a, const FTSENT **b)
     return strcmp((*a)->fts_name, (*b)->fts_name);
 }
 
+/* The type of an entry, one of the T_* constants */
+static int
+entry_type(const FTSENT *ent)
+{
+    switch (ent->fts_info) {
+        case FTS_D:
+        case FTS_DP:
+            return T_DIRECTORY;
+        case FTS_F:
+            return T_FILE;
+        case FTS_SL:
+        case FTS_SLNONE:
+            return T_LINK;
+        default:
+            break;
+    }
+    switch (ent->fts_statp->st_mode & S_IFMT) {
+        case S_IFIFO:
+            return T_FIFO;
+        case S_IFCHR:
+            return T_CHARACTER_SPECIAL;
+        case S_IFBLK:
+            return T_BLOCK_SPECIAL;
+        case S_IFSOCK:
+            return T_SOCKET;
+        default:
+            return T_FILE;
+    }
+}
+
+static const char *
+type_name(int type)
+{
+    int i;
+    for (i = 0; type_names[i].name != NULL; i++) {
+        if (type_names[i].type == type) {
+            break;
+        }
+    }
+    return type_names[i].name;
+}
+
+/* Match the last component of the path of an entry against a pattern;
+ * fts_name is the whole argument for the targets themselves */
+static int
+entry_name_matches(const FTSENT *ent, const char *pattern)
+{
+    Tcl_DString name;
+    size_t end, start;
+    int match;
+
+    if (ent->fts_level != FTS_ROOTLEVEL) {
+        return Tcl_StringMatch(ent->fts_name, pattern);
+    }
+
+    end = ent->fts_pathlen;
+    while (end > 1 && ent->fts_path[end - 1] == '/') {
+        end--;
+    }
+    start = end;
+    while (start > 0 && ent->fts_path[start - 1] != '/') {
+        start--;
+    }
+    if (start == end) {
+        /* the target is / */
+        start = 0;
+    }
+    Tcl_DStringInit(&name);
+    Tcl_DStringAppend(&name, ent->fts_path + start, (Tcl_Size) (end - start));
+    match = Tcl_StringMatch(Tcl_DStringValue(&name), pattern);
+    Tcl_DStringFree(&name);
+    return match;
+}
+
+/* The value describing an entry: its path, or with -stat a list of its path,
+ * type, size, permissions and modification time */
+static Tcl_Obj *
+entry_value(traverse_state *state, const FTSENT *ent, int type)
+{
+    Tcl_Obj *path;
+    Tcl_Obj *elems[5];
+
+    if (state->flags & F_TAILS) {
+        /* there cannot be multiple targets */
+        const char *xpath = extract_tail(state->targets[0], ent->fts_path);
+        path = Tcl_NewStringObj(xpath, -1);
+    } else {
+        path = Tcl_NewStringObj(ent->fts_path, ent->fts_pathlen);
+    }
+    if (!(state->flags & F_STAT)) {
+        return path;
+    }
+
+    elems[0] = path;
+    elems[1] = Tcl_NewStringObj(type_name(type), -1);
+    elems[2] = Tcl_NewWideIntObj((Tcl_WideInt) ent->fts_statp->st_size);
+    elems[3] = Tcl_NewIntObj(ent->fts_statp->st_mode & 07777);
+    elems[4] = Tcl_NewWideIntObj((Tcl_WideInt) ent->fts_statp->st_mtime);
+    return Tcl_NewListObj(5, elems);
+}
+
+/* Set the variable to value and evaluate the body */
+static int
+run_body(Tcl_Interp *interp, traverse_state *state, Tcl_Obj *value)
+{
+    Tcl_Obj *rpath;
+
+    Tcl_IncrRefCount(value);
+    rpath = Tcl_ObjSetVar2(interp, state->varname, NULL, value, TCL_LEAVE_ERR_MSG);
+    Tcl_DecrRefCount(value);
+    if (rpath == NULL && !(state->flags & F_IGNORE_ERRORS)) {
+        return TCL_ERROR;
+    }
+    return Tcl_EvalObjEx(interp, state->body, 0);
+}
+
+/* Run the body for the entries collected for a batch, if any */
+static int
+flush_batch(Tcl_Interp *interp, traverse_state *state)
+{
+    Tcl_Obj *batch = state->pending;
+    Tcl_Size len;
+    int rval;
+
+    if (Tcl_ListObjLength(NULL, batch, &len) != TCL_OK || len == 0) {
+        return TCL_OK;
+    }
+    state->pending = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(state->pending);
+    rval = run_body(interp, state, batch);
+    Tcl_DecrRefCount(batch);
+    /* there is no single entry to skip in a batch */
+    return rval == TCL_CONTINUE ? TCL_OK : rval;
+}
+
+/* Pass an entry to the body unless it is filtered out. Returns TCL_BREAK to
+ * stop the traversal, and TCL_OK to continue with the next entry. */
 static int
-do_traverse(Tcl_Interp *interp, int flags, char * const *targets, Tcl_Obj *varname, Tcl_Obj *body)
+visit(Tcl_Interp *interp, traverse_state *state, FTS *fts, FTSENT *ent)
+{
+    int type = entry_type(ent);
+    Tcl_Obj *value;
+    Tcl_Size len;
+    int rval;
+
+    if (state->types != 0 && !(state->types & type)) {
+        return TCL_OK;
+    }
+    if (state->glob != NULL && !entry_name_matches(ent, state->glob)) {
+        return TCL_OK;
+    }
+
+    value = entry_value(state, ent, type);
+    if (state->batch > 0) {
+        Tcl_ListObjAppendElement(NULL, state->pending, value);
+        Tcl_ListObjLength(NULL, state->pending, &len);
+        return len < state->batch ? TCL_OK : flush_batch(interp, state);
+    }
+
+    if ((rval = run_body(interp, state, value)) == TCL_CONTINUE) {
+        fts_set(fts, ent, FTS_SKIP); /* probably useless on files/symlinks */
+        rval = TCL_OK;
+    }
+    return rval;
+}
+
+static int
+do_traverse(Tcl_Interp *interp, traverse_state *state)
 {
     int rval = TCL_OK;
+    int flags = state->flags;
     FTS *root_fts;
     FTSENT *ent;
+    int saved_errno;
 
-    root_fts = fts_open(targets, FTS_PHYSICAL | FTS_COMFOLLOW | FTS_NOCHDIR | FTS_XDEV, &do_compare);
+    root_fts = fts_open(state->targets, FTS_PHYSICAL | FTS_COMFOLLOW | FTS_NOCHDIR | FTS_XDEV, &do_compare);
 
     while ((ent = fts_read(root_fts)) != NULL) {
         switch (ent->fts_info) {
             case FTS_D:  /* directory in pre-order */
             case FTS_DP: /* directory in post-order*/
-            {
-                if (!(flags & F_DEPTH) != !(ent->fts_info == FTS_D)) {
-                    Tcl_Obj *rpath, *path;
-                    if (flags & F_TAILS) {
-                        /* there cannot be multiple targets */
-                        const char *xpath = extract_tail(targets[0], ent->fts_path);
-                        path = Tcl_NewStringObj(xpath, -1);
-                    } else {
-                        path = Tcl_NewStringObj(ent->fts_path, ent->fts_pathlen);
-                    }
-                    Tcl_IncrRefCount(path);
-                    rpath = Tcl_ObjSetVar2(interp, varname, NULL, path, TCL_LEAVE_ERR_MSG);
-                    Tcl_DecrRefCount(path);
-                    if (rpath == NULL && !(flags & F_IGNORE_ERRORS)) {
-                        fts_close(root_fts);
-                        return TCL_ERROR;
-                    }
-                    if ((rval = Tcl_EvalObjEx(interp, body, 0)) == TCL_CONTINUE) {
-                        fts_set(root_fts, ent, FTS_SKIP);
-                    } else if (rval == TCL_BREAK) {
-                        fts_close(root_fts);
-                        return TCL_OK;
-                    } else if (rval != TCL_OK) {
-                        fts_close(root_fts);
-                        return rval;
-                    }
+                if (!(flags & F_DEPTH) == !(ent->fts_info == FTS_D)) {
+                    break;
                 }
-                break;
-            }
+                /* fall through */
             case FTS_F:   /* regular file */
             case FTS_SL:  /* symbolic link */
             case FTS_SLNONE: /* symbolic link with non-existent target */
             case FTS_DEFAULT: /* file type not otherwise handled (e.g., fifo) */
             {
-                Tcl_Obj *rpath, *path;
-                if (flags & F_TAILS) {
-                    /* there cannot be multiple targets */
-                    const char *xpath = extract_tail(targets[0], ent->fts_path);
-                    path = Tcl_NewStringObj(xpath, -1);
-                } else {
-                    path = Tcl_NewStringObj(ent->fts_path, ent->fts_pathlen);
-                }
-                Tcl_IncrRefCount(path);
-                rpath = Tcl_ObjSetVar2(interp, varname, NULL, path, TCL_LEAVE_ERR_MSG);
-                Tcl_DecrRefCount(path);
-                if (rpath == NULL && !(flags & F_IGNORE_ERRORS)) {
-                    fts_close(root_fts);
-                    return TCL_ERROR;
-                }
-                if ((rval = Tcl_EvalObjEx(interp, body, 0)) == TCL_CONTINUE) {
-                    fts_set(root_fts, ent, FTS_SKIP); /* probably useless on files/symlinks */
-                } else if (rval == TCL_BREAK) {
+                if ((rval = visit(interp, state, root_fts, ent)) == TCL_BREAK) {
                     fts_close(root_fts);
                     return TCL_OK;
                 } else if (rval != TCL_OK) {
@@ -252,9 +478,15 @@ do_traverse(Tcl_Interp *interp, int flags, char * const *targets, Tcl_Obj *varna
             }
         }
     }
-    /* check errno before calling fts_close in case it sets errno to 0 on success */
-    if (errno != 0) {
-        Tcl_SetErrno(errno);
+    /* check errno before calling fts_close in case it sets errno to 0 on
+     * success, and before the body runs for the last batch */
+    saved_errno = errno;
+    if (saved_errno == 0 && (rval = flush_batch(interp, state)) != TCL_OK) {
+        fts_close(root_fts);
+        return rval == TCL_BREAK ? TCL_OK : rval;
+    }
+    if (saved_errno != 0) {
+        Tcl_SetErrno(saved_errno);
         Tcl_ResetResult(interp);
         Tcl_AppendResult(interp, root_fts->fts_path, ": ", (char *)Tcl_PosixError(interp), NULL);
         fts_close(root_fts);
@@ -43,6 +43,7 @@
 #include <tcl.h>
 
 #include "md5cmd.h"
+#include "multichecksumcmd.h"
 
 #if HAVE_COMMONCRYPTO_COMMONDIGEST_H
 
@@ -68,10 +69,32 @@ CHECKSUMFile(MD5, MD5_CTX)
 CHECKSUMEnd(MD5_, MD5_CTX, MD5_DIGEST_LENGTH)
 CHECKSUMFile(MD5_, MD5_CTX)
 #define MD5File(x,y) MD5_File(x,y)
+#define MD5Init(x) MD5_Init(x)
+#define MD5Update(x,y,z) MD5_Update(x,y,z)
+#define MD5End(x,y) MD5_End(x,y)
 #else
 #error CommonCrypto, libmd or libcrypto required
 #endif
 
+static void md5_init(void *ctx)
+{
+	MD5Init((MD5_CTX *)ctx);
+}
+
+static void md5_update(void *ctx, const unsigned char *data, size_t len)
+{
+	MD5Update((MD5_CTX *)ctx, data, len);
+}
+
+static void md5_end(void *ctx, char *buf)
+{
+	MD5End((MD5_CTX *)ctx, buf);
+}
+
+const checksum_algo md5_algo = {
+	"md5", sizeof(MD5_CTX), md5_init, md5_update, md5_end, 32
+};
+
 int MD5Cmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
 	char *file, *action;
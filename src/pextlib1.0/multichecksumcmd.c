@@ -0,0 +1,348 @@
+/*
+ * multichecksumcmd.c
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/* required for posix_memalign(3) and posix_fadvise(2) on Linux */
+#define _XOPEN_SOURCE 600L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <tcl.h>
+
+#include "multichecksumcmd.h"
+
+/* Size and number of the read buffers. */
+#define CHECKSUM_BUFSIZE (1024 * 1024)
+#define CHECKSUM_NBUFFERS 4
+#define CHECKSUM_ALIGN 4096
+/* Files at least this large are hashed with one thread per algorithm if more
+ * than one digest is requested. */
+#define CHECKSUM_THREAD_THRESHOLD (8 * 1024 * 1024)
+
+static const checksum_algo *const algos[CHECKSUM_MAX_ALGOS + 1] = {
+    &md5_algo, &sha1_algo, &rmd160_algo, &sha256_algo, &blake3_algo, NULL
+};
+
+const checksum_algo *checksum_find_algo(const char *name) {
+    for (int i = 0; algos[i] != NULL; i++) {
+        if (strcmp(algos[i]->name, name) == 0) {
+            return algos[i];
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    /* number of workers that have not hashed this block yet */
+    int pending;
+} checksum_block;
+
+/* Blocks read by the calling thread and hashed by the workers. */
+typedef struct {
+    checksum_block blocks[CHECKSUM_NBUFFERS];
+    pthread_mutex_t mutex;
+    pthread_cond_t filled;
+    pthread_cond_t drained;
+    /* number of blocks read so far */
+    uint64_t produced;
+    bool done;
+} checksum_pipeline;
+
+typedef struct {
+    checksum_pipeline *pipeline;
+    const checksum_algo *algo;
+    void *ctx;
+    pthread_t thread;
+} checksum_worker;
+
+/* Read until buf is full or the end of the file is reached. */
+static ssize_t read_full(int fd, unsigned char *buf, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t got = read(fd, buf + total, size - total);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        total += (size_t) got;
+    }
+    return (ssize_t) total;
+}
+
+static void *checksum_worker_main(void *arg) {
+    checksum_worker *worker = arg;
+    checksum_pipeline *pipeline = worker->pipeline;
+    uint64_t seq = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pipeline->mutex);
+        while (seq >= pipeline->produced && !pipeline->done) {
+            pthread_cond_wait(&pipeline->filled, &pipeline->mutex);
+        }
+        if (seq >= pipeline->produced) {
+            pthread_mutex_unlock(&pipeline->mutex);
+            break;
+        }
+        checksum_block *block = &pipeline->blocks[seq % CHECKSUM_NBUFFERS];
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        worker->algo->update(worker->ctx, block->data, block->len);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        if (--block->pending == 0) {
+            pthread_cond_signal(&pipeline->drained);
+        }
+        pthread_mutex_unlock(&pipeline->mutex);
+        seq++;
+    }
+    return NULL;
+}
+
+/* Hash fd with one worker thread per algorithm. Returns 0 on success, -1 if
+ * the threads could not be started before anything was read, or an errno
+ * value if reading failed. */
+static int checksum_threaded(int fd, const checksum_algo **used, void **ctxs, int nused, uint64_t *size) {
+    checksum_pipeline pipeline;
+    checksum_worker workers[sizeof(algos) / sizeof(algos[0])];
+    int started = 0, result = 0, i;
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    for (i = 0; i < CHECKSUM_NBUFFERS; i++) {
+        if (posix_memalign((void **) &pipeline.blocks[i].data, CHECKSUM_ALIGN, CHECKSUM_BUFSIZE) != 0) {
+            pipeline.blocks[i].data = NULL;
+            result = -1;
+        }
+    }
+    pthread_mutex_init(&pipeline.mutex, NULL);
+    pthread_cond_init(&pipeline.filled, NULL);
+    pthread_cond_init(&pipeline.drained, NULL);
+
+    for (i = 0; i < nused && result == 0; i++) {
+        workers[i].pipeline = &pipeline;
+        workers[i].algo = used[i];
+        workers[i].ctx = ctxs[i];
+        if (pthread_create(&workers[i].thread, NULL, checksum_worker_main, &workers[i]) != 0) {
+            result = -1;
+            break;
+        }
+        started++;
+    }
+
+    *size = 0;
+    while (result == 0) {
+        checksum_block *block = &pipeline.blocks[pipeline.produced % CHECKSUM_NBUFFERS];
+
+        pthread_mutex_lock(&pipeline.mutex);
+        while (block->pending > 0) {
+            pthread_cond_wait(&pipeline.drained, &pipeline.mutex);
+        }
+        pthread_mutex_unlock(&pipeline.mutex);
+
+        ssize_t got = read_full(fd, block->data, CHECKSUM_BUFSIZE);
+        if (got <= 0) {
+            if (got < 0) {
+                result = errno;
+            }
+            break;
+        }
+        *size += (uint64_t) got;
+
+        pthread_mutex_lock(&pipeline.mutex);
+        block->len = (size_t) got;
+        block->pending = nused;
+        pipeline.produced++;
+        pthread_cond_broadcast(&pipeline.filled);
+        pthread_mutex_unlock(&pipeline.mutex);
+    }
+
+    pthread_mutex_lock(&pipeline.mutex);
+    pipeline.done = true;
+    pthread_cond_broadcast(&pipeline.filled);
+    pthread_mutex_unlock(&pipeline.mutex);
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&pipeline.drained);
+    pthread_cond_destroy(&pipeline.filled);
+    pthread_mutex_destroy(&pipeline.mutex);
+    for (i = 0; i < CHECKSUM_NBUFFERS; i++) {
+        free(pipeline.blocks[i].data);
+    }
+    return result;
+}
+
+/* Hash fd in the calling thread. Returns 0 on success or an errno value. */
+static int checksum_serial(int fd, const checksum_algo **used, void **ctxs, int nused, uint64_t *size) {
+    unsigned char *buf;
+    ssize_t got;
+    int i;
+
+    if (posix_memalign((void **) &buf, CHECKSUM_ALIGN, CHECKSUM_BUFSIZE) != 0) {
+        return ENOMEM;
+    }
+    *size = 0;
+    while ((got = read_full(fd, buf, CHECKSUM_BUFSIZE)) > 0) {
+        *size += (uint64_t) got;
+        for (i = 0; i < nused; i++) {
+            used[i]->update(ctxs[i], buf, (size_t) got);
+        }
+    }
+    int result = got < 0 ? errno : 0;
+    free(buf);
+    return result;
+}
+
+int MultichecksumCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
+{
+    const checksum_algo *used[sizeof(algos) / sizeof(algos[0])];
+    void *ctxs[sizeof(algos) / sizeof(algos[0])];
+    char hex[sizeof(algos) / sizeof(algos[0])][2*64 + 1];
+    Tcl_Obj **typev;
+    Tcl_Size typec, t;
+    int nused = 0, i, fd, err;
+    uint64_t size;
+    struct stat st;
+
+    if (objc != 4) {
+        Tcl_WrongNumArgs(interp, 1, objv, "action file types");
+        return TCL_ERROR;
+    }
+    /*
+     * Only the 'file' action is currently supported
+     */
+    if (strcmp(Tcl_GetString(objv[1]), "file") != 0) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("Usage: multichecksum file path types", -1));
+        return TCL_ERROR;
+    }
+    if (Tcl_ListObjGetElements(interp, objv[3], &typec, &typev) != TCL_OK) {
+        return TCL_ERROR;
+    }
+
+    /* collect the distinct algorithms needed */
+    for (t = 0; t < typec; t++) {
+        const char *type = Tcl_GetString(typev[t]);
+        const checksum_algo *algo = checksum_find_algo(type);
+        if (algo == NULL) {
+            if (strcmp(type, "size") == 0) {
+                continue;
+            }
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("unknown checksum type \"%s\"", type));
+            return TCL_ERROR;
+        }
+        for (i = 0; i < nused; i++) {
+            if (used[i] == algo) {
+                break;
+            }
+        }
+        if (i == nused) {
+            used[nused++] = algo;
+        }
+    }
+
+    const char *file = Tcl_GetString(objv[2]);
+    fd = open(file, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        err = errno;
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("Could not open file: %s: %s", file, strerror(err)));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return TCL_ERROR;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    for (i = 0; i < nused; i++) {
+        ctxs[i] = ckalloc(used[i]->ctx_size);
+        used[i]->init(ctxs[i]);
+    }
+    err = -1;
+    if (nused == 0) {
+        /* only the size was requested */
+        err = 0;
+        size = (uint64_t) st.st_size;
+    } else if (nused > 1 && st.st_size >= CHECKSUM_THREAD_THRESHOLD) {
+        err = checksum_threaded(fd, used, ctxs, nused, &size);
+    }
+    if (err == -1) {
+        err = checksum_serial(fd, used, ctxs, nused, &size);
+    }
+    close(fd);
+
+    for (i = 0; i < nused; i++) {
+        if (err == 0) {
+            used[i]->end(ctxs[i], hex[i]);
+        }
+        ckfree(ctxs[i]);
+    }
+    if (err != 0) {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("Could not read file: %s: %s", file, strerror(err)));
+        return TCL_ERROR;
+    }
+
+    Tcl_Obj *result = Tcl_NewListObj(0, NULL);
+    for (t = 0; t < typec; t++) {
+        const char *type = Tcl_GetString(typev[t]);
+        Tcl_ListObjAppendElement(NULL, result, typev[t]);
+        if (strcmp(type, "size") == 0) {
+            Tcl_ListObjAppendElement(NULL, result, Tcl_NewWideIntObj((Tcl_WideInt) size));
+            continue;
+        }
+        for (i = 0; i < nused; i++) {
+            if (strcmp(used[i]->name, type) == 0) {
+                Tcl_ListObjAppendElement(NULL, result, Tcl_NewStringObj(hex[i], (Tcl_Size) used[i]->hex_length));
+                break;
+            }
+        }
+    }
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+}
@@ -0,0 +1,82 @@
+/*
+ * multichecksumcmd.h
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MULTICHECKSUMCMD_H
+#define _MULTICHECKSUMCMD_H
+
+#include <stddef.h>
+
+#include <tcl.h>
+
+/**
+ * Incremental interface to a digest algorithm, provided by the files
+ * implementing the individual checksum commands.
+ */
+typedef struct {
+    const char *name;
+    /* size of the context passed to the functions below */
+    size_t ctx_size;
+    void (*init)(void *ctx);
+    void (*update)(void *ctx, const unsigned char *data, size_t len);
+    /* store the digest as a NUL-terminated hex string in buf */
+    void (*end)(void *ctx, char *buf);
+    /* length of the hex string, without the NUL */
+    size_t hex_length;
+} checksum_algo;
+
+/* number of digest algorithms below */
+#define CHECKSUM_MAX_ALGOS 5
+
+extern const checksum_algo md5_algo;
+extern const checksum_algo sha1_algo;
+extern const checksum_algo rmd160_algo;
+extern const checksum_algo sha256_algo;
+extern const checksum_algo blake3_algo;
+
+/**
+ * Look up one of the algorithms above by its name, returning NULL for
+ * unknown names.
+ */
+const checksum_algo *checksum_find_algo(const char *name);
+
+/**
+ * A native command to compute several checksums of a file while reading it
+ * only once.
+ *
+ * The syntax is:
+ * multichecksum file path types
+ *      Return a list of type/checksum pairs for each type in types, which
+ *      can be md5, sha1, rmd160, sha256, blake3 or size.
+ */
+int MultichecksumCmd(ClientData, Tcl_Interp *, int, Tcl_Obj *const objv[]);
+
+#endif
+/* _MULTICHECKSUMCMD_H */
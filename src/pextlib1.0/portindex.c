@@ -0,0 +1,1183 @@
+/*
+ * portindex.c
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/* required for mkstemp(3) on Linux */
+#define _XOPEN_SOURCE 600L
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tcl.h>
+
+#include "portindex.h"
+
+/*
+ * Layout of the binary PortIndex. It is generated from the text PortIndex and
+ * is only ever used on the host that generated it, so all integers are in
+ * host byte order; an index with a different byte order is rejected like any
+ * other invalid file.
+ *
+ *   header
+ *   fields     nfields pi_field entries, one for each distinct portinfo key
+ *   ports      nports pi_port entries, in text PortIndex order
+ *   values     nports * nfields pi_ref entries; the value of field f for
+ *              port p is entry p * nfields + f
+ *   names      nports port numbers, sorted by lowercase port name
+ *   tokens     for each field, its sorted distinct words (see below)
+ *   postings   for each token, the ascending numbers of the ports whose
+ *              value for the field contains that word
+ *   strtab     NUL-terminated strings referenced by pi_ref
+ *
+ * Words are maximal runs of ASCII letters and digits in the lowercased field
+ * value. Any run of letters and digits in a search pattern that every match
+ * must contain is therefore part of a single word, which lets searches skip
+ * all ports that have no word containing it.
+ */
+#define PI_MAGIC "MPINDEX"
+#define PI_VERSION 1
+#define PI_BYTEORDER 0x01020304
+#define PI_ABSENT UINT32_MAX
+#define PI_ALIGN 8
+
+/* Shorter words are not worth recording in the postings. */
+#define PI_MIN_TOKEN 2
+
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} pi_ref;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    /* identity of the text PortIndex this index was built from */
+    uint64_t text_size;
+    int64_t text_mtime;
+    uint64_t text_ino;
+    uint32_t nports;
+    uint32_t nfields;
+    uint32_t ntokens;
+    uint32_t npostings;
+    uint64_t fields_off;
+    uint64_t ports_off;
+    uint64_t values_off;
+    uint64_t names_off;
+    uint64_t tokens_off;
+    uint64_t postings_off;
+    uint64_t strtab_off;
+    uint64_t strtab_size;
+} pi_header;
+
+typedef struct {
+    pi_ref name;
+    uint32_t tokens_start;
+    uint32_t ntokens;
+} pi_field;
+
+typedef struct {
+    pi_ref name;
+    pi_ref lcname;
+    /* the portinfo as stored in the text PortIndex */
+    pi_ref info;
+} pi_port;
+
+typedef struct {
+    pi_ref token;
+    uint32_t postings_start;
+    uint32_t npostings;
+} pi_token;
+
+/* The "name" field always exists and is always the first one. */
+#define PI_NAME_FIELD 0
+
+enum {
+    kMatchExact,
+    kMatchGlob,
+    kMatchRegexp
+};
+
+static inline bool pi_is_word_char(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/* ------------------------------------------------------------------------- **
+ * Building
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} pi_buf;
+
+typedef struct {
+    uint32_t *ids;
+    uint32_t count;
+    uint32_t cap;
+} pi_postings;
+
+typedef struct {
+    uint32_t port;
+    uint32_t field;
+    pi_ref ref;
+} pi_value;
+
+typedef struct {
+    pi_buf strtab;
+    /* interned strings, mapping to their offset in strtab */
+    Tcl_HashTable strings;
+    pi_buf ports;
+    pi_buf values;
+    /* field name -> field number */
+    Tcl_HashTable fieldnos;
+    /* for each field, word -> pi_postings */
+    Tcl_HashTable **tokens;
+    pi_ref *fieldnames;
+    uint32_t nfields;
+    uint32_t nports;
+    bool overflow;
+} pi_builder;
+
+typedef struct {
+    const char *str;
+    uint32_t id;
+} pi_sortentry;
+
+static void buf_append(pi_buf *buf, const void *data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 4096;
+        while (cap < buf->len + len) {
+            cap *= 2;
+        }
+        buf->data = ckrealloc(buf->data, cap);
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static pi_ref pi_add_string(pi_builder *b, const char *str, size_t len) {
+    pi_ref ref = { PI_ABSENT, 0 };
+    if (b->strtab.len + len + 1 >= PI_ABSENT) {
+        b->overflow = true;
+        return ref;
+    }
+    ref.off = (uint32_t) b->strtab.len;
+    ref.len = (uint32_t) len;
+    buf_append(&b->strtab, str, len);
+    buf_append(&b->strtab, "", 1);
+    return ref;
+}
+
+/* Like pi_add_string, but stores identical strings only once. str must be
+ * NUL-terminated. */
+static pi_ref pi_intern(pi_builder *b, const char *str, size_t len) {
+    int isnew;
+    Tcl_HashEntry *entry = Tcl_CreateHashEntry(&b->strings, str, &isnew);
+    pi_ref ref;
+    if (!isnew) {
+        ref.off = (uint32_t) (uintptr_t) Tcl_GetHashValue(entry);
+        ref.len = (uint32_t) len;
+        return ref;
+    }
+    ref = pi_add_string(b, str, len);
+    Tcl_SetHashValue(entry, (ClientData) (uintptr_t) ref.off);
+    return ref;
+}
+
+static uint32_t pi_field_number(pi_builder *b, const char *name, size_t len) {
+    int isnew;
+    Tcl_HashEntry *entry = Tcl_CreateHashEntry(&b->fieldnos, name, &isnew);
+    if (!isnew) {
+        return (uint32_t) (uintptr_t) Tcl_GetHashValue(entry);
+    }
+    uint32_t fieldno = b->nfields++;
+    Tcl_SetHashValue(entry, (ClientData) (uintptr_t) fieldno);
+    b->fieldnames = (pi_ref *) ckrealloc(b->fieldnames, b->nfields * sizeof(*b->fieldnames));
+    b->fieldnames[fieldno] = pi_intern(b, name, len);
+    b->tokens = (Tcl_HashTable **) ckrealloc(b->tokens, b->nfields * sizeof(*b->tokens));
+    b->tokens[fieldno] = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+    Tcl_InitHashTable(b->tokens[fieldno], TCL_STRING_KEYS);
+    return fieldno;
+}
+
+/* Record portno in the postings of every word in value. */
+static void pi_add_tokens(pi_builder *b, uint32_t fieldno, uint32_t portno, const char *value, Tcl_Size len) {
+    Tcl_DString ds;
+    Tcl_DStringInit(&ds);
+    Tcl_DStringAppend(&ds, value, len);
+    char *lower = Tcl_DStringValue(&ds);
+    Tcl_Size lowerlen = Tcl_UtfToLower(lower);
+
+    Tcl_Size start = 0;
+    while (start < lowerlen) {
+        while (start < lowerlen && !pi_is_word_char((unsigned char) lower[start])) {
+            start++;
+        }
+        Tcl_Size end = start;
+        while (end < lowerlen && pi_is_word_char((unsigned char) lower[end])) {
+            end++;
+        }
+        if (end - start >= PI_MIN_TOKEN) {
+            char saved = lower[end];
+            int isnew;
+            lower[end] = '\0';
+            Tcl_HashEntry *entry = Tcl_CreateHashEntry(b->tokens[fieldno], lower + start, &isnew);
+            lower[end] = saved;
+
+            pi_postings *postings;
+            if (isnew) {
+                postings = (pi_postings *) ckalloc(sizeof(pi_postings));
+                postings->ids = NULL;
+                postings->count = 0;
+                postings->cap = 0;
+                Tcl_SetHashValue(entry, postings);
+            } else {
+                postings = (pi_postings *) Tcl_GetHashValue(entry);
+            }
+            /* ports are added in order, so duplicates are always adjacent */
+            if (postings->count == 0 || postings->ids[postings->count - 1] != portno) {
+                if (postings->count == postings->cap) {
+                    postings->cap = postings->cap ? postings->cap * 2 : 4;
+                    postings->ids = (uint32_t *) ckrealloc(postings->ids, postings->cap * sizeof(uint32_t));
+                }
+                postings->ids[postings->count++] = portno;
+            }
+        }
+        start = end;
+    }
+    Tcl_DStringFree(&ds);
+}
+
+static void pi_builder_init(pi_builder *b) {
+    memset(b, 0, sizeof(*b));
+    Tcl_InitHashTable(&b->strings, TCL_STRING_KEYS);
+    Tcl_InitHashTable(&b->fieldnos, TCL_STRING_KEYS);
+    pi_field_number(b, "name", 4);
+}
+
+static void pi_builder_free(pi_builder *b) {
+    for (uint32_t i = 0; i < b->nfields; i++) {
+        Tcl_HashSearch search;
+        for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(b->tokens[i], &search);
+                entry != NULL; entry = Tcl_NextHashEntry(&search)) {
+            pi_postings *postings = (pi_postings *) Tcl_GetHashValue(entry);
+            ckfree(postings->ids);
+            ckfree(postings);
+        }
+        Tcl_DeleteHashTable(b->tokens[i]);
+        ckfree(b->tokens[i]);
+    }
+    ckfree(b->tokens);
+    ckfree(b->fieldnames);
+    Tcl_DeleteHashTable(&b->fieldnos);
+    Tcl_DeleteHashTable(&b->strings);
+    ckfree(b->strtab.data);
+    ckfree(b->ports.data);
+    ckfree(b->values.data);
+}
+
+/* Add one PortIndex entry. Returns false if info is not a valid dict. */
+static bool pi_add_port(Tcl_Interp *interp, pi_builder *b, Tcl_Obj *nameObj, Tcl_Obj *infoObj) {
+    Tcl_Size namelen, infolen, infoc;
+    Tcl_Obj **infov;
+    const char *name = Tcl_GetStringFromObj(nameObj, &namelen);
+    const char *info = Tcl_GetStringFromObj(infoObj, &infolen);
+    uint32_t portno = b->nports;
+    pi_port port;
+
+    port.name = pi_intern(b, name, namelen);
+    Tcl_DString lcname;
+    Tcl_DStringInit(&lcname);
+    Tcl_DStringAppend(&lcname, name, namelen);
+    Tcl_Size lcnamelen = Tcl_UtfToLower(Tcl_DStringValue(&lcname));
+    port.lcname = pi_intern(b, Tcl_DStringValue(&lcname), lcnamelen);
+    Tcl_DStringFree(&lcname);
+    /* the entry is written with a trailing newline that is not part of it */
+    if (infolen > 0 && info[infolen - 1] == '\n') {
+        infolen--;
+    }
+    port.info = pi_add_string(b, info, infolen);
+
+    if (Tcl_ListObjGetElements(interp, infoObj, &infoc, &infov) != TCL_OK) {
+        return false;
+    }
+    if (infoc % 2 != 0) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("missing value to go with key", -1));
+        return false;
+    }
+
+    pi_add_tokens(b, PI_NAME_FIELD, portno, name, namelen);
+    for (Tcl_Size i = 0; i < infoc; i += 2) {
+        Tcl_Size keylen, vallen;
+        const char *key = Tcl_GetStringFromObj(infov[i], &keylen);
+        const char *val = Tcl_GetStringFromObj(infov[i + 1], &vallen);
+        pi_value value;
+        value.port = portno;
+        value.field = pi_field_number(b, key, keylen);
+        value.ref = pi_intern(b, val, vallen);
+        buf_append(&b->values, &value, sizeof(value));
+        pi_add_tokens(b, value.field, portno, val, vallen);
+    }
+
+    buf_append(&b->ports, &port, sizeof(port));
+    b->nports++;
+    return true;
+}
+
+static int pi_compare_sortentry(const void *a, const void *b) {
+    const pi_sortentry *ea = (const pi_sortentry *) a;
+    const pi_sortentry *eb = (const pi_sortentry *) b;
+    int res = strcmp(ea->str, eb->str);
+    if (res != 0) {
+        return res;
+    }
+    return (ea->id > eb->id) - (ea->id < eb->id);
+}
+
+static bool write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t written = write(fd, p, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        len -= (size_t) written;
+    }
+    return true;
+}
+
+static bool write_section(int fd, uint64_t *offset, const void *data, size_t len) {
+    static const char padding[PI_ALIGN] = { 0 };
+    size_t pad = (PI_ALIGN - (*offset % PI_ALIGN)) % PI_ALIGN;
+    if (pad > 0 && !write_all(fd, padding, pad)) {
+        return false;
+    }
+    *offset += pad;
+    if (len > 0 && !write_all(fd, data, len)) {
+        return false;
+    }
+    *offset += len;
+    return true;
+}
+
+static uint64_t section_start(uint64_t offset) {
+    return offset + (PI_ALIGN - (offset % PI_ALIGN)) % PI_ALIGN;
+}
+
+/* Serialize the collected entries to a temporary file next to path, then
+ * move it into place. */
+static int pi_write(Tcl_Interp *interp, pi_builder *b, const struct stat *textst, const char *path) {
+    pi_header hdr;
+    pi_field *fields = (pi_field *) ckalloc((b->nfields ? b->nfields : 1) * sizeof(pi_field));
+    pi_buf tokens = { NULL, 0, 0 };
+    pi_buf postings = { NULL, 0, 0 };
+    pi_ref *values = NULL;
+    uint32_t *names = NULL;
+    pi_sortentry *sorted = NULL;
+    char *tmppath = NULL;
+    int fd = -1;
+    int result = TCL_ERROR;
+
+    /* token tables, sorted by word for each field */
+    for (uint32_t f = 0; f < b->nfields; f++) {
+        Tcl_HashTable *table = b->tokens[f];
+        Tcl_HashSearch search;
+        uint32_t count = 0;
+
+        fields[f].name = b->fieldnames[f];
+        fields[f].tokens_start = (uint32_t) (tokens.len / sizeof(pi_token));
+        sorted = (pi_sortentry *) ckrealloc(sorted, (table->numEntries ? table->numEntries : 1) * sizeof(pi_sortentry));
+        for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(table, &search);
+                entry != NULL; entry = Tcl_NextHashEntry(&search)) {
+            sorted[count].str = Tcl_GetHashKey(table, entry);
+            sorted[count].id = count;
+            count++;
+        }
+        qsort(sorted, count, sizeof(pi_sortentry), pi_compare_sortentry);
+        for (uint32_t i = 0; i < count; i++) {
+            pi_postings *list = (pi_postings *) Tcl_GetHashValue(Tcl_FindHashEntry(table, sorted[i].str));
+            pi_token token;
+            token.token = pi_intern(b, sorted[i].str, strlen(sorted[i].str));
+            token.postings_start = (uint32_t) (postings.len / sizeof(uint32_t));
+            token.npostings = list->count;
+            buf_append(&tokens, &token, sizeof(token));
+            buf_append(&postings, list->ids, list->count * sizeof(uint32_t));
+        }
+        fields[f].ntokens = count;
+    }
+    if (b->overflow || postings.len / sizeof(uint32_t) >= PI_ABSENT) {
+        Tcl_SetObjResult(interp, Tcl_NewStringObj("PortIndex too large for binary index", -1));
+        goto cleanup;
+    }
+
+    /* dense value matrix; later keys override earlier ones like in a dict */
+    values = (pi_ref *) ckalloc(((size_t) b->nports * b->nfields + 1) * sizeof(pi_ref));
+    for (size_t i = 0; i < (size_t) b->nports * b->nfields; i++) {
+        values[i].off = PI_ABSENT;
+        values[i].len = 0;
+    }
+    for (size_t i = 0; i < b->values.len / sizeof(pi_value); i++) {
+        const pi_value *value = &((const pi_value *) b->values.data)[i];
+        values[(size_t) value->port * b->nfields + value->field] = value->ref;
+    }
+
+    /* name table; the string table does not change anymore from here on */
+    const pi_port *ports = (const pi_port *) b->ports.data;
+    sorted = (pi_sortentry *) ckrealloc(sorted, (b->nports ? b->nports : 1) * sizeof(pi_sortentry));
+    names = (uint32_t *) ckalloc((b->nports ? b->nports : 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < b->nports; i++) {
+        sorted[i].str = b->strtab.data + ports[i].lcname.off;
+        sorted[i].id = i;
+    }
+    qsort(sorted, b->nports, sizeof(pi_sortentry), pi_compare_sortentry);
+    for (uint32_t i = 0; i < b->nports; i++) {
+        names[i] = sorted[i].id;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, PI_MAGIC, sizeof(hdr.magic));
+    hdr.version = PI_VERSION;
+    hdr.byteorder = PI_BYTEORDER;
+    hdr.text_size = (uint64_t) textst->st_size;
+    hdr.text_mtime = (int64_t) textst->st_mtime;
+    hdr.text_ino = (uint64_t) textst->st_ino;
+    hdr.nports = b->nports;
+    hdr.nfields = b->nfields;
+    hdr.ntokens = (uint32_t) (tokens.len / sizeof(pi_token));
+    hdr.npostings = (uint32_t) (postings.len / sizeof(uint32_t));
+    hdr.fields_off = section_start(sizeof(hdr));
+    hdr.ports_off = section_start(hdr.fields_off + b->nfields * sizeof(pi_field));
+    hdr.values_off = section_start(hdr.ports_off + b->ports.len);
+    hdr.names_off = section_start(hdr.values_off + (uint64_t) b->nports * b->nfields * sizeof(pi_ref));
+    hdr.tokens_off = section_start(hdr.names_off + b->nports * sizeof(uint32_t));
+    hdr.postings_off = section_start(hdr.tokens_off + tokens.len);
+    hdr.strtab_off = section_start(hdr.postings_off + postings.len);
+    hdr.strtab_size = b->strtab.len;
+
+    tmppath = ckalloc(strlen(path) + sizeof(".XXXXXX"));
+    strcpy(tmppath, path);
+    strcat(tmppath, ".XXXXXX");
+    fd = mkstemp(tmppath);
+    if (fd < 0) {
+        Tcl_SetErrno(errno);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("mkstemp(%s): %s", tmppath, Tcl_PosixError(interp)));
+        goto cleanup;
+    }
+
+    uint64_t offset = 0;
+    if (!write_section(fd, &offset, &hdr, sizeof(hdr))
+            || !write_section(fd, &offset, fields, b->nfields * sizeof(pi_field))
+            || !write_section(fd, &offset, b->ports.data, b->ports.len)
+            || !write_section(fd, &offset, values, (size_t) b->nports * b->nfields * sizeof(pi_ref))
+            || !write_section(fd, &offset, names, b->nports * sizeof(uint32_t))
+            || !write_section(fd, &offset, tokens.data, tokens.len)
+            || !write_section(fd, &offset, postings.data, postings.len)
+            || !write_section(fd, &offset, b->strtab.data, b->strtab.len)
+            || fchmod(fd, 0644) != 0
+            || close(fd) != 0) {
+        Tcl_SetErrno(errno);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("writing %s: %s", tmppath, Tcl_PosixError(interp)));
+        fd = -1;
+        unlink(tmppath);
+        goto cleanup;
+    }
+    fd = -1;
+    if (rename(tmppath, path) != 0) {
+        Tcl_SetErrno(errno);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("rename(%s, %s): %s", tmppath, path, Tcl_PosixError(interp)));
+        unlink(tmppath);
+        goto cleanup;
+    }
+    result = TCL_OK;
+
+cleanup:
+    if (fd >= 0) {
+        close(fd);
+        unlink(tmppath);
+    }
+    ckfree(tmppath);
+    ckfree(sorted);
+    ckfree(names);
+    ckfree(values);
+    ckfree(tokens.data);
+    ckfree(postings.data);
+    ckfree(fields);
+    return result;
+}
+
+/**
+ * portindex build textindex binindex
+ */
+static int PortindexBuildCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+    if (objc != 4) {
+        Tcl_WrongNumArgs(interp, 2, objv, "textindex binindex");
+        return TCL_ERROR;
+    }
+    const char *textpath = Tcl_GetString(objv[2]);
+    const char *binpath = Tcl_GetString(objv[3]);
+    struct stat st;
+    int result = TCL_OK;
+
+    if (stat(textpath, &st) != 0) {
+        Tcl_SetErrno(errno);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("stat(%s): %s", textpath, Tcl_PosixError(interp)));
+        return TCL_ERROR;
+    }
+    Tcl_Channel chan = Tcl_OpenFileChannel(interp, textpath, "r", 0);
+    if (chan == NULL) {
+        return TCL_ERROR;
+    }
+
+    pi_builder b;
+    pi_builder_init(&b);
+    while (result == TCL_OK) {
+        Tcl_Obj *lineObj = Tcl_NewObj();
+        Tcl_Obj **linev;
+        Tcl_Size linec;
+        Tcl_WideInt len;
+
+        Tcl_IncrRefCount(lineObj);
+        if (Tcl_GetsObj(chan, lineObj) < 0) {
+            if (!Tcl_Eof(chan)) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("error reading %s: %s", textpath, Tcl_PosixError(interp)));
+                result = TCL_ERROR;
+            }
+            Tcl_DecrRefCount(lineObj);
+            break;
+        }
+        /* skip malformed lines, like mports_generate_quickindex does */
+        if (Tcl_ListObjGetElements(NULL, lineObj, &linec, &linev) != TCL_OK || linec != 2) {
+            Tcl_DecrRefCount(lineObj);
+            continue;
+        }
+        if (Tcl_GetWideIntFromObj(NULL, linev[1], &len) != TCL_OK || len < 0) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("PortIndex %s is corrupt: invalid length for %s",
+                        textpath, Tcl_GetString(linev[0])));
+            result = TCL_ERROR;
+        } else {
+            Tcl_Obj *infoObj = Tcl_NewObj();
+            Tcl_IncrRefCount(infoObj);
+            if (Tcl_ReadChars(chan, infoObj, (Tcl_Size) len, 0) != (Tcl_Size) len) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("PortIndex %s is corrupt: truncated entry for %s",
+                            textpath, Tcl_GetString(linev[0])));
+                result = TCL_ERROR;
+            } else if (!pi_add_port(interp, &b, linev[0], infoObj)) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("PortIndex %s is corrupt: invalid entry for %s: %s",
+                            textpath, Tcl_GetString(linev[0]), Tcl_GetString(Tcl_GetObjResult(interp))));
+                result = TCL_ERROR;
+            }
+            Tcl_DecrRefCount(infoObj);
+        }
+        Tcl_DecrRefCount(lineObj);
+    }
+    Tcl_Close(NULL, chan);
+
+    if (result == TCL_OK) {
+        result = pi_write(interp, &b, &st, binpath);
+    }
+    pi_builder_free(&b);
+    return result;
+}
+
+/* ------------------------------------------------------------------------- **
+ * Reading
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+    void *base;
+    size_t size;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    const pi_header *hdr;
+    const pi_field *fields;
+    const pi_port *ports;
+    const pi_ref *values;
+    const uint32_t *names;
+    const pi_token *tokens;
+    const uint32_t *postings;
+    const char *strtab;
+} pi_map;
+
+static void pi_map_free(pi_map *map) {
+    munmap(map->base, map->size);
+    ckfree(map);
+}
+
+static void PortindexDeleteAssocData(ClientData clientData, Tcl_Interp *interp UNUSED) {
+    Tcl_HashTable *maps = (Tcl_HashTable *) clientData;
+    Tcl_HashSearch search;
+    for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(maps, &search);
+            entry != NULL; entry = Tcl_NextHashEntry(&search)) {
+        pi_map_free((pi_map *) Tcl_GetHashValue(entry));
+    }
+    Tcl_DeleteHashTable(maps);
+    ckfree(maps);
+}
+
+static inline const char *pi_str(const pi_map *map, pi_ref ref) {
+    return map->strtab + ref.off;
+}
+
+static bool pi_section_ok(const pi_map *map, uint64_t off, uint64_t count, uint64_t size) {
+    return off % sizeof(uint32_t) == 0 && off <= map->size && count * size <= map->size - off;
+}
+
+static bool pi_ref_ok(const pi_map *map, pi_ref ref, bool optional) {
+    if (ref.off == PI_ABSENT) {
+        return optional;
+    }
+    return (uint64_t) ref.off + ref.len < map->hdr->strtab_size
+        && map->strtab[ref.off + ref.len] == '\0';
+}
+
+/* Check that all offsets in a freshly mapped index stay within bounds, so
+ * they do not have to be checked on every access. */
+static bool pi_map_validate(pi_map *map) {
+    const pi_header *hdr = map->base;
+    if (map->size < sizeof(pi_header)
+            || memcmp(hdr->magic, PI_MAGIC, sizeof(hdr->magic)) != 0
+            || hdr->version != PI_VERSION
+            || hdr->byteorder != PI_BYTEORDER) {
+        return false;
+    }
+    map->hdr = hdr;
+    if (!pi_section_ok(map, hdr->fields_off, hdr->nfields, sizeof(pi_field))
+            || !pi_section_ok(map, hdr->ports_off, hdr->nports, sizeof(pi_port))
+            || !pi_section_ok(map, hdr->values_off, (uint64_t) hdr->nports * hdr->nfields, sizeof(pi_ref))
+            || !pi_section_ok(map, hdr->names_off, hdr->nports, sizeof(uint32_t))
+            || !pi_section_ok(map, hdr->tokens_off, hdr->ntokens, sizeof(pi_token))
+            || !pi_section_ok(map, hdr->postings_off, hdr->npostings, sizeof(uint32_t))
+            || !pi_section_ok(map, hdr->strtab_off, hdr->strtab_size, 1)
+            || hdr->strtab_size == 0
+            || hdr->nfields == 0) {
+        return false;
+    }
+    const char *base = map->base;
+    map->fields = (const pi_field *) (base + hdr->fields_off);
+    map->ports = (const pi_port *) (base + hdr->ports_off);
+    map->values = (const pi_ref *) (base + hdr->values_off);
+    map->names = (const uint32_t *) (base + hdr->names_off);
+    map->tokens = (const pi_token *) (base + hdr->tokens_off);
+    map->postings = (const uint32_t *) (base + hdr->postings_off);
+    map->strtab = base + hdr->strtab_off;
+
+    for (uint32_t i = 0; i < hdr->nfields; i++) {
+        const pi_field *field = &map->fields[i];
+        if (!pi_ref_ok(map, field->name, false)
+                || (uint64_t) field->tokens_start + field->ntokens > hdr->ntokens) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < hdr->nports; i++) {
+        const pi_port *port = &map->ports[i];
+        if (!pi_ref_ok(map, port->name, false)
+                || !pi_ref_ok(map, port->lcname, false)
+                || !pi_ref_ok(map, port->info, false)
+                || map->names[i] >= hdr->nports) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < (uint64_t) hdr->nports * hdr->nfields; i++) {
+        if (!pi_ref_ok(map, map->values[i], true)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < hdr->ntokens; i++) {
+        const pi_token *token = &map->tokens[i];
+        if (!pi_ref_ok(map, token->token, false)
+                || (uint64_t) token->postings_start + token->npostings > hdr->npostings) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < hdr->npostings; i++) {
+        if (map->postings[i] >= hdr->nports) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Return the mapping for the binary index at path, mapping it (again) if it
+ * is not mapped yet or has changed on disk since. */
+static pi_map *pi_get_map(Tcl_Interp *interp, const char *path) {
+    Tcl_HashTable *maps = (Tcl_HashTable *) Tcl_GetAssocData(interp, "pextlib::portindex", NULL);
+    if (maps == NULL) {
+        maps = (Tcl_HashTable *) ckalloc(sizeof(Tcl_HashTable));
+        Tcl_InitHashTable(maps, TCL_STRING_KEYS);
+        Tcl_SetAssocData(interp, "pextlib::portindex", PortindexDeleteAssocData, maps);
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        Tcl_SetErrno(errno);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("%s: %s", path, Tcl_PosixError(interp)));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    int isnew;
+    Tcl_HashEntry *entry = Tcl_CreateHashEntry(maps, path, &isnew);
+    if (!isnew) {
+        pi_map *map = (pi_map *) Tcl_GetHashValue(entry);
+        if (map->dev == st.st_dev && map->ino == st.st_ino
+                && map->size == (size_t) st.st_size && map->mtime == st.st_mtime) {
+            close(fd);
+            return map;
+        }
+        pi_map_free(map);
+    }
+
+    pi_map *map = (pi_map *) ckalloc(sizeof(pi_map));
+    memset(map, 0, sizeof(*map));
+    map->size = (size_t) st.st_size;
+    map->dev = st.st_dev;
+    map->ino = st.st_ino;
+    map->mtime = st.st_mtime;
+    map->base = map->size > 0 ? mmap(NULL, map->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map->base == MAP_FAILED) {
+        Tcl_SetErrno(errno);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("mmap(%s): %s", path, Tcl_PosixError(interp)));
+        ckfree(map);
+        Tcl_DeleteHashEntry(entry);
+        return NULL;
+    }
+    if (!pi_map_validate(map)) {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("%s is not a valid binary PortIndex", path));
+        pi_map_free(map);
+        Tcl_DeleteHashEntry(entry);
+        return NULL;
+    }
+    Tcl_SetHashValue(entry, map);
+    return map;
+}
+
+static int pi_find_field(const pi_map *map, const char *name) {
+    for (uint32_t i = 0; i < map->hdr->nfields; i++) {
+        if (strcmp(pi_str(map, map->fields[i].name), name) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+/* Return the portinfo of a port, with porturl added if a prefix is given. */
+static Tcl_Obj *pi_portinfo(const pi_map *map, uint32_t portno, int portdirno, Tcl_Obj *prefix) {
+    const pi_port *port = &map->ports[portno];
+    Tcl_Obj *info = Tcl_NewStringObj(pi_str(map, port->info), port->info.len);
+
+    if (prefix != NULL && portdirno >= 0) {
+        pi_ref portdir = map->values[(size_t) portno * map->hdr->nfields + portdirno];
+        if (portdir.off != PI_ABSENT) {
+            Tcl_Obj *url = Tcl_DuplicateObj(prefix);
+            Tcl_AppendToObj(url, "/", 1);
+            Tcl_AppendToObj(url, pi_str(map, portdir), portdir.len);
+            /* quote the URL as a list element would be */
+            Tcl_Obj *elem = Tcl_NewListObj(1, &url);
+            Tcl_IncrRefCount(elem);
+            Tcl_AppendToObj(info, " porturl ", -1);
+            Tcl_AppendObjToObj(info, elem);
+            Tcl_DecrRefCount(elem);
+        }
+    }
+    return info;
+}
+
+static void pi_append_port(Tcl_Obj *result, const pi_map *map, uint32_t portno, int portdirno, Tcl_Obj *prefix) {
+    const pi_port *port = &map->ports[portno];
+    Tcl_ListObjAppendElement(NULL, result, Tcl_NewStringObj(pi_str(map, port->name), port->name.len));
+    Tcl_ListObjAppendElement(NULL, result, pi_portinfo(map, portno, portdirno, prefix));
+}
+
+/* Return the closing bracket of the bracket expression starting at p. */
+static const char *pi_skip_bracket(const char *p) {
+    p++;
+    if (*p == '^' || *p == '!') {
+        p++;
+    }
+    /* a ']' right at the start is part of the set */
+    if (*p == ']') {
+        p++;
+    }
+    for (; *p != '\0' && *p != ']'; p++) {
+        /* character classes, collating elements and equivalence classes */
+        if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            char delim = p[1];
+            for (p += 2; *p != '\0' && !(*p == delim && p[1] == ']'); p++)
+                ;
+            if (*p == '\0') {
+                return NULL;
+            }
+            p++;
+        }
+    }
+    return *p == ']' ? p : NULL;
+}
+
+/*
+ * Find the longest run of letters and digits that is contained (ignoring
+ * case) in every string matching pattern, and store it lowercased in out,
+ * which must be as large as pattern. Returns its length, or 0 if there is
+ * none or the pattern is too complex to tell.
+ */
+static size_t pi_required_literal(const char *pattern, int matchstyle, char *out) {
+    size_t best = 0, runlen = 0;
+    const char *run = NULL;
+    int depth = 0;
+    bool regexp = matchstyle == kMatchRegexp;
+
+    /* alternatives, directors and embedded options */
+    if (regexp && (strchr(pattern, '|') != NULL || strncmp(pattern, "***", 3) == 0
+                || strncmp(pattern, "(?", 2) == 0)) {
+        return 0;
+    }
+
+    for (const char *p = pattern;; p++) {
+        unsigned char c = (unsigned char) *p;
+        if (c != '\0' && depth == 0 && pi_is_word_char(c)) {
+            if (runlen == 0) {
+                run = p;
+            }
+            runlen++;
+            continue;
+        }
+        /* in a regexp, a quantifier applies to the last character only */
+        if (regexp && runlen > 0 && (c == '*' || c == '?' || c == '{')) {
+            runlen--;
+        }
+        if (runlen > best) {
+            best = runlen;
+            for (size_t i = 0; i < runlen; i++) {
+                out[i] = (char) ((run[i] >= 'A' && run[i] <= 'Z') ? run[i] - 'A' + 'a' : run[i]);
+            }
+        }
+        runlen = 0;
+        if (c == '\0') {
+            break;
+        }
+        if (matchstyle == kMatchExact) {
+            continue;
+        }
+
+        if (c == '\\') {
+            /* in a regexp, escaped letters and digits can stand for anything */
+            if (p[1] == '\0' || (regexp && pi_is_word_char((unsigned char) p[1]))) {
+                break;
+            }
+            p++;
+        } else if (c == '[') {
+            p = pi_skip_bracket(p);
+            if (p == NULL) {
+                break;
+            }
+        } else if (regexp && c == '{') {
+            p = strchr(p, '}');
+            if (p == NULL) {
+                break;
+            }
+        } else if (regexp && c == '(') {
+            depth++;
+        } else if (regexp && c == ')' && depth > 0) {
+            depth--;
+        }
+    }
+    return best;
+}
+
+static bool pi_contains(const char *haystack, size_t haylen, const char *needle, size_t needlelen) {
+    if (needlelen > haylen) {
+        return false;
+    }
+    for (size_t i = 0; i + needlelen <= haylen; i++) {
+        if (haystack[i] == needle[0] && memcmp(haystack + i, needle, needlelen) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * portindex search binindex pattern case_sensitive matchstyle field ?porturlprefix?
+ */
+static int PortindexSearchCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+    static const char *matchstyles[] = { "exact", "glob", "regexp", NULL };
+    int case_sensitive, matchstyle;
+    Tcl_RegExp re = NULL;
+
+    if (objc != 7 && objc != 8) {
+        Tcl_WrongNumArgs(interp, 2, objv, "binindex pattern case_sensitive matchstyle field ?porturlprefix?");
+        return TCL_ERROR;
+    }
+    if (Tcl_GetBooleanFromObj(interp, objv[4], &case_sensitive) != TCL_OK
+            || Tcl_GetIndexFromObj(interp, objv[5], matchstyles, "matchstyle", 0, &matchstyle) != TCL_OK) {
+        return TCL_ERROR;
+    }
+    pi_map *map = pi_get_map(interp, Tcl_GetString(objv[2]));
+    if (map == NULL) {
+        return TCL_ERROR;
+    }
+    Tcl_Size patlen;
+    const char *pattern = Tcl_GetStringFromObj(objv[3], &patlen);
+    const char *fieldname = Tcl_GetString(objv[6]);
+    Tcl_Obj *prefix = objc == 8 ? objv[7] : NULL;
+    bool byname = strcmp(fieldname, "name") == 0;
+    int fieldno = byname ? PI_NAME_FIELD : pi_find_field(map, fieldname);
+    int portdirno = pi_find_field(map, "portdir");
+    Tcl_Obj *result = Tcl_NewListObj(0, NULL);
+
+    if (fieldno < 0) {
+        /* no port has this field */
+        Tcl_SetObjResult(interp, result);
+        return TCL_OK;
+    }
+    if (matchstyle == kMatchRegexp) {
+        re = Tcl_GetRegExpFromObj(interp, objv[3], TCL_REG_ADVANCED | (case_sensitive ? 0 : TCL_REG_NOCASE));
+        if (re == NULL) {
+            Tcl_DecrRefCount(result);
+            return TCL_ERROR;
+        }
+    }
+    Tcl_Size patchars = case_sensitive ? 0 : Tcl_NumUtfChars(pattern, patlen);
+
+    /* narrow down the candidates using the postings if possible */
+    uint32_t nports = map->hdr->nports;
+    unsigned char *candidates = NULL;
+    char *literal = ckalloc(patlen + 1);
+    size_t litlen = pi_required_literal(pattern, matchstyle, literal);
+    if (litlen >= PI_MIN_TOKEN) {
+        const pi_field *field = &map->fields[fieldno];
+        candidates = (unsigned char *) ckalloc(nports / 8 + 1);
+        memset(candidates, 0, nports / 8 + 1);
+        for (uint32_t t = field->tokens_start; t < field->tokens_start + field->ntokens; t++) {
+            const pi_token *token = &map->tokens[t];
+            if (pi_contains(pi_str(map, token->token), token->token.len, literal, litlen)) {
+                for (uint32_t i = token->postings_start; i < token->postings_start + token->npostings; i++) {
+                    uint32_t portno = map->postings[i];
+                    candidates[portno / 8] |= (unsigned char) (1 << (portno % 8));
+                }
+            }
+        }
+    }
+    ckfree(literal);
+
+    int status = TCL_OK;
+    for (uint32_t p = 0; p < nports && status == TCL_OK; p++) {
+        if (candidates != NULL && !(candidates[p / 8] & (1 << (p % 8)))) {
+            continue;
+        }
+        pi_ref target = byname ? map->ports[p].name : map->values[(size_t) p * map->hdr->nfields + fieldno];
+        if (target.off == PI_ABSENT) {
+            continue;
+        }
+        const char *str = pi_str(map, target);
+        int matches = 0;
+        switch (matchstyle) {
+            case kMatchExact:
+                if (case_sensitive) {
+                    matches = (Tcl_Size) target.len == patlen && memcmp(str, pattern, patlen) == 0;
+                } else {
+                    matches = Tcl_NumUtfChars(str, target.len) == patchars
+                        && Tcl_UtfNcasecmp(str, pattern, patchars) == 0;
+                }
+                break;
+            case kMatchGlob:
+                matches = Tcl_StringCaseMatch(str, pattern, !case_sensitive);
+                break;
+            case kMatchRegexp:
+                matches = Tcl_RegExpExec(interp, re, str, str);
+                if (matches < 0) {
+                    status = TCL_ERROR;
+                }
+                break;
+        }
+        if (matches > 0) {
+            pi_append_port(result, map, p, portdirno, prefix);
+        }
+    }
+    ckfree(candidates);
+
+    if (status != TCL_OK) {
+        Tcl_DecrRefCount(result);
+        return status;
+    }
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+}
+
+/**
+ * portindex lookup binindex name ?porturlprefix?
+ */
+static int PortindexLookupCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+    if (objc != 4 && objc != 5) {
+        Tcl_WrongNumArgs(interp, 2, objv, "binindex name ?porturlprefix?");
+        return TCL_ERROR;
+    }
+    pi_map *map = pi_get_map(interp, Tcl_GetString(objv[2]));
+    if (map == NULL) {
+        return TCL_ERROR;
+    }
+
+    Tcl_Size namelen;
+    const char *name = Tcl_GetStringFromObj(objv[3], &namelen);
+    Tcl_DString lcname;
+    Tcl_DStringInit(&lcname);
+    Tcl_DStringAppend(&lcname, name, namelen);
+    Tcl_UtfToLower(Tcl_DStringValue(&lcname));
+
+    /* find the last entry with this name, as the quick index would */
+    uint32_t lo = 0, hi = map->hdr->nports;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const pi_port *port = &map->ports[map->names[mid]];
+        if (strcmp(pi_str(map, port->lcname), Tcl_DStringValue(&lcname)) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    Tcl_Obj *result = Tcl_NewListObj(0, NULL);
+    if (lo > 0) {
+        uint32_t portno = map->names[lo - 1];
+        if (strcmp(pi_str(map, map->ports[portno].lcname), Tcl_DStringValue(&lcname)) == 0) {
+            pi_append_port(result, map, portno, pi_find_field(map, "portdir"), objc == 5 ? objv[4] : NULL);
+        }
+    }
+    Tcl_DStringFree(&lcname);
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+}
+
+/**
+ * portindex listall binindex ?porturlprefix?
+ */
+static int PortindexListallCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+    if (objc != 3 && objc != 4) {
+        Tcl_WrongNumArgs(interp, 2, objv, "binindex ?porturlprefix?");
+        return TCL_ERROR;
+    }
+    pi_map *map = pi_get_map(interp, Tcl_GetString(objv[2]));
+    if (map == NULL) {
+        return TCL_ERROR;
+    }
+
+    int portdirno = pi_find_field(map, "portdir");
+    Tcl_Obj *result = Tcl_NewListObj(0, NULL);
+    for (uint32_t p = 0; p < map->hdr->nports; p++) {
+        pi_append_port(result, map, p, portdirno, objc == 4 ? objv[3] : NULL);
+    }
+    Tcl_SetObjResult(interp, result);
+    return TCL_OK;
+}
+
+/**
+ * portindex valid binindex textindex
+ */
+static int PortindexValidCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+    if (objc != 4) {
+        Tcl_WrongNumArgs(interp, 2, objv, "binindex textindex");
+        return TCL_ERROR;
+    }
+    struct stat st;
+    int valid = 0;
+    pi_map *map = pi_get_map(interp, Tcl_GetString(objv[2]));
+    if (map != NULL && stat(Tcl_GetString(objv[3]), &st) == 0) {
+        valid = map->hdr->text_size == (uint64_t) st.st_size
+            && map->hdr->text_mtime == (int64_t) st.st_mtime
+            && map->hdr->text_ino == (uint64_t) st.st_ino;
+    }
+    Tcl_SetObjResult(interp, Tcl_NewBooleanObj(valid));
+    return TCL_OK;
+}
+
+int
+PortindexCmd(
+        ClientData clientData UNUSED,
+        Tcl_Interp* interp,
+        int objc,
+        Tcl_Obj* const objv[])
+{
+    typedef enum {
+        kPortindexBuild,
+        kPortindexListall,
+        kPortindexLookup,
+        kPortindexSearch,
+        kPortindexValid
+    } EOption;
+
+    static const char *options[] = {
+        "build", "listall", "lookup", "search", "valid", NULL
+    };
+    EOption theOptionIndex;
+
+    if (objc < 3) {
+        Tcl_WrongNumArgs(interp, 1, objv, "option index ?arg ...?");
+        return TCL_ERROR;
+    }
+    if (Tcl_GetIndexFromObj(interp, objv[1], options, "option", 0, (int*) &theOptionIndex) != TCL_OK) {
+        return TCL_ERROR;
+    }
+
+    switch (theOptionIndex) {
+        case kPortindexBuild:
+            return PortindexBuildCmd(interp, objc, objv);
+        case kPortindexListall:
+            return PortindexListallCmd(interp, objc, objv);
+        case kPortindexLookup:
+            return PortindexLookupCmd(interp, objc, objv);
+        case kPortindexSearch:
+            return PortindexSearchCmd(interp, objc, objv);
+        case kPortindexValid:
+            return PortindexValidCmd(interp, objc, objv);
+    }
+    return TCL_ERROR;
+}
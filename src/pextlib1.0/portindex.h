@@ -0,0 +1,62 @@
+/*
+ * portindex.h
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PORTINDEX_H
+#define _PORTINDEX_H
+
+#include <tcl.h>
+
+/**
+ * A native command to build and query the binary PortIndex.
+ *
+ * The syntax is:
+ * portindex build textindex binindex
+ *      Parse the text PortIndex at textindex and write a binary index for it
+ *      to binindex.
+ * portindex valid binindex textindex
+ *      Return whether binindex is readable and was built from the current
+ *      contents of textindex.
+ * portindex search binindex pattern case_sensitive matchstyle field ?porturlprefix?
+ *      Return name/portinfo pairs of all ports whose field matches pattern,
+ *      with the same semantics as mportsearch.
+ * portindex lookup binindex name ?porturlprefix?
+ *      Return the name/portinfo pair of the port with the given name
+ *      (case-insensitive), or an empty list.
+ * portindex listall binindex ?porturlprefix?
+ *      Return name/portinfo pairs of all ports.
+ *
+ * If porturlprefix is given, a porturl entry pointing to
+ * porturlprefix/portdir is added to each portinfo that has a portdir.
+ */
+int PortindexCmd(ClientData clientData, Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
+
+#endif
+/* _PORTINDEX_H */
@@ -47,6 +47,7 @@
 #include <tcl.h>
 
 #include "rmd160cmd.h"
+#include "multichecksumcmd.h"
 
 #if defined(HAVE_LIBMD) && defined(HAVE_RIPEMD_H)
 #include <sys/types.h>
@@ -73,8 +74,31 @@ CHECKSUMData(RIPEMD160_, RIPEMD160_CTX)
 CHECKSUMEnd(RMD160, RMD160_CTX, RIPEMD160_DIGEST_LENGTH)
 CHECKSUMFile(RMD160, RMD160_CTX)
 CHECKSUMData(RMD160, RMD160_CTX)
+#define RIPEMD160_CTX RMD160_CTX
+#define RIPEMD160_Init(x) RMD160Init(x)
+#define RIPEMD160_Update(x,y,z) RMD160Update(x,y,z)
+#define RIPEMD160_End(x,y) RMD160End(x,y)
 #endif
 
+static void rmd160_init(void *ctx)
+{
+	RIPEMD160_Init((RIPEMD160_CTX *)ctx);
+}
+
+static void rmd160_update(void *ctx, const unsigned char *data, size_t len)
+{
+	RIPEMD160_Update((RIPEMD160_CTX *)ctx, data, len);
+}
+
+static void rmd160_end(void *ctx, char *buf)
+{
+	RIPEMD160_End((RIPEMD160_CTX *)ctx, buf);
+}
+
+const checksum_algo rmd160_algo = {
+	"rmd160", sizeof(RIPEMD160_CTX), rmd160_init, rmd160_update, rmd160_end, 2*RIPEMD160_DIGEST_LENGTH
+};
+
 int RMD160Cmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
 	char *file, *instr, *action;
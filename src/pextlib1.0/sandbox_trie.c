@@ -0,0 +1,301 @@
+/* vim: set et sw=4 ts=4 sts=4: */
+/*
+ * sandbox_trie.c
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sandbox_trie.h"
+
+/*
+ * The compiled trie is a single buffer in native byte order:
+ *  - a sandbox_trie_header_t,
+ *  - node_count sandbox_trie_node_t, in breadth-first order, so the children
+ *    of each node are adjacent and sorted by the first byte of their label,
+ *  - the labels of all nodes.
+ * Node 0 is the root; its label is empty. Each other node's label holds the
+ * bytes of the edge from its parent, with chains of nodes that have no entry
+ * and only a single child merged into one label.
+ */
+
+#define SANDBOX_TRIE_MAGIC (0x44545354u) /* DTST */
+#define SANDBOX_TRIE_NO_ENTRY UINT32_MAX
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t node_count;
+    uint32_t labels;
+} sandbox_trie_header_t;
+
+typedef struct {
+    uint32_t label;
+    uint32_t label_len;
+    uint32_t first_child;
+    uint32_t child_count;
+    /* index of the first sandbox entry ending at this node, or
+     * SANDBOX_TRIE_NO_ENTRY */
+    uint32_t entry;
+    uint32_t action;
+} sandbox_trie_node_t;
+
+/* uncompressed trie with one node per byte, used while compiling */
+typedef struct build_node {
+    struct build_node **children;
+    uint32_t child_count;
+    uint32_t child_capacity;
+    uint32_t entry;
+    char action;
+    char c;
+} build_node_t;
+
+static build_node_t *build_node_new(char c) {
+    build_node_t *node = calloc(1, sizeof(*node));
+    if (node) {
+        node->entry = SANDBOX_TRIE_NO_ENTRY;
+        node->c = c;
+    }
+    return node;
+}
+
+static void build_node_free(build_node_t *node) {
+    for (uint32_t i = 0; i < node->child_count; i++) {
+        build_node_free(node->children[i]);
+    }
+    free(node->children);
+    free(node);
+}
+
+/* return the child of node for byte c, creating it if necessary; children
+ * are kept sorted by byte */
+static build_node_t *build_node_child(build_node_t *node, char c) {
+    uint32_t pos;
+    build_node_t *child;
+
+    for (pos = 0; pos < node->child_count; pos++) {
+        if (node->children[pos]->c == c) {
+            return node->children[pos];
+        }
+        if ((unsigned char) node->children[pos]->c > (unsigned char) c) {
+            break;
+        }
+    }
+
+    if (node->child_count == node->child_capacity) {
+        uint32_t capacity = node->child_capacity ? 2 * node->child_capacity : 4;
+        build_node_t **children = realloc(node->children, capacity * sizeof(*children));
+        if (!children) {
+            return NULL;
+        }
+        node->children = children;
+        node->child_capacity = capacity;
+    }
+    if (!(child = build_node_new(c))) {
+        return NULL;
+    }
+    memmove(node->children + pos + 1, node->children + pos, (node->child_count - pos) * sizeof(*node->children));
+    node->children[pos] = child;
+    node->child_count++;
+    return child;
+}
+
+/* follow the chain of nodes that would be merged into the label starting at
+ * node and return its last node, counting the label length */
+static build_node_t *build_node_chain_end(build_node_t *node, uint32_t *len) {
+    *len = 1;
+    while (node->entry == SANDBOX_TRIE_NO_ENTRY && node->child_count == 1) {
+        node = node->children[0];
+        (*len)++;
+    }
+    return node;
+}
+
+char *sandbox_trie_compile(const char *filemap, uint32_t *size) {
+    build_node_t *root = build_node_new('\0');
+    build_node_t **queue = NULL;
+    sandbox_trie_header_t *header;
+    sandbox_trie_node_t *nodes;
+    char *labels;
+    char *trie = NULL;
+    uint32_t entry = 0;
+    size_t node_count = 1, labels_len = 0, head, tail;
+    const char *path;
+
+    if (!root) {
+        return NULL;
+    }
+
+    for (path = filemap; *path != '\0'; entry++) {
+        size_t len = strlen(path);
+        char action = path[len + 1];
+        build_node_t *node = root;
+
+        /* "/" matches any path, just like "" */
+        if (len > 1 || path[0] != '/') {
+            for (size_t i = 0; i < len; i++) {
+                if (!(node = build_node_child(node, path[i]))) {
+                    goto out;
+                }
+            }
+        }
+        /* the first matching entry wins, so only keep the first one for each
+         * path */
+        if (node->entry == SANDBOX_TRIE_NO_ENTRY) {
+            node->entry = entry;
+            node->action = action;
+        }
+        path += len + 3;
+    }
+
+    /* Count the nodes and label bytes of the compressed trie, storing the
+     * first node of each label in breadth-first order. */
+    if (!(queue = malloc(sizeof(*queue)))) {
+        goto out;
+    }
+    queue[0] = root;
+    for (head = 0, tail = 1; head < tail; head++) {
+        uint32_t len = 0;
+        build_node_t *end = head == 0 ? root : build_node_chain_end(queue[head], &len);
+        build_node_t **newqueue;
+
+        labels_len += len;
+        if (!(newqueue = realloc(queue, (tail + end->child_count) * sizeof(*queue)))) {
+            goto out;
+        }
+        queue = newqueue;
+        for (uint32_t i = 0; i < end->child_count; i++) {
+            queue[tail++] = end->children[i];
+        }
+    }
+    node_count = tail;
+
+    size_t total = sizeof(*header) + node_count * sizeof(*nodes) + labels_len;
+    if (total > UINT32_MAX) {
+        errno = E2BIG;
+        goto out;
+    }
+    if (!(trie = malloc(total))) {
+        goto out;
+    }
+    header = (sandbox_trie_header_t *) trie;
+    nodes = (sandbox_trie_node_t *) (header + 1);
+    labels = (char *) (nodes + node_count);
+    header->magic = SANDBOX_TRIE_MAGIC;
+    header->size = (uint32_t) total;
+    header->node_count = (uint32_t) node_count;
+    header->labels = (uint32_t) (labels - trie);
+
+    /* Write the nodes in the same order; the children of the node at
+     * position i start right after those of all nodes before it. */
+    uint32_t next_child = 1, label_pos = 0;
+    for (size_t i = 0; i < node_count; i++) {
+        build_node_t *node = queue[i], *end = node;
+        uint32_t len = 0;
+
+        if (i > 0) {
+            build_node_t *n = node;
+
+            end = build_node_chain_end(node, &len);
+            for (uint32_t k = 0; k < len; k++) {
+                labels[label_pos + k] = n->c;
+                if (n != end) {
+                    n = n->children[0];
+                }
+            }
+        }
+        nodes[i].label = label_pos;
+        nodes[i].label_len = len;
+        nodes[i].first_child = next_child;
+        nodes[i].child_count = end->child_count;
+        nodes[i].entry = end->entry;
+        nodes[i].action = (unsigned char) end->action;
+        next_child += end->child_count;
+        label_pos += len;
+    }
+    *size = (uint32_t) total;
+
+out:
+    free(queue);
+    build_node_free(root);
+    return trie;
+}
+
+bool sandbox_trie_lookup(const char *trie, const char *path, char *action) {
+    const sandbox_trie_header_t *header = (const sandbox_trie_header_t *) trie;
+    const sandbox_trie_node_t *nodes = (const sandbox_trie_node_t *) (header + 1);
+    const char *labels = trie + header->labels;
+    const sandbox_trie_node_t *node = nodes;
+    uint32_t best = SANDBOX_TRIE_NO_ENTRY;
+
+    /* the root holds the entries that match any path */
+    if (node->entry != SANDBOX_TRIE_NO_ENTRY) {
+        best = node->entry;
+        *action = (char) node->action;
+    }
+
+    for (;;) {
+        const sandbox_trie_node_t *children = nodes + node->first_child;
+        uint32_t lo = 0, hi = node->child_count;
+        unsigned char c = (unsigned char) *path;
+
+        if (c == '\0') {
+            break;
+        }
+
+        /* binary search for the child whose label starts with c */
+        node = NULL;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            unsigned char first = (unsigned char) labels[children[mid].label];
+            if (first == c) {
+                node = &children[mid];
+                break;
+            } else if (first < c) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (!node || strncmp(path, labels + node->label, node->label_len) != 0) {
+            break;
+        }
+        path += node->label_len;
+
+        /* an entry only matches on a path component boundary */
+        if (node->entry < best && (*path == '/' || *path == '\0')) {
+            best = node->entry;
+            *action = (char) node->action;
+        }
+    }
+
+    return best != SANDBOX_TRIE_NO_ENTRY;
+}
@@ -0,0 +1,62 @@
+/* vim: set et sw=4 ts=4 sts=4: */
+/*
+ * sandbox_trie.h
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Compile the sandbox bounds given in the format produced by tracelib
+ * setsandbox, i.e.
+ *  <filemap>       :: (<path> '\0' <action> '\0')* '\0'
+ * where <action> is one of FILEMAP_ALLOW, FILEMAP_ASK and FILEMAP_DENY, into
+ * a compact radix tree that can be sent to darwintrace as a single buffer.
+ *
+ * \param[in] filemap the sandbox bounds
+ * \param[out] size the size of the returned buffer
+ * \return an allocated buffer holding the compiled trie, to be released with
+ *         free(3), or NULL on error (with errno set)
+ */
+char *sandbox_trie_compile(const char *filemap, uint32_t *size);
+
+/**
+ * Find the action for a path in a compiled trie. The result is the same as
+ * that of walking the original sandbox bounds in order and picking the first
+ * entry that is a prefix of the path on a path component level (so /var/tmp
+ * does not match /var/tmpfoo), where "" and "/" match any path. Runs in time
+ * linear in the length of the path.
+ *
+ * \param[in] trie a trie compiled by sandbox_trie_compile
+ * \param[in] path the absolute, normalized path to look up
+ * \param[out] action the action of the matching entry
+ * \return true if an entry matched, false otherwise
+ */
+bool sandbox_trie_lookup(const char *trie, const char *path, char *action);
@@ -0,0 +1,801 @@
+/*
+ * sedfiles.c
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tcl.h>
+
+#include "sedfiles.h"
+
+/* Upper bound of the number of worker threads. */
+#define SEDFILES_MAX_THREADS 64
+/* Size of the stdio buffer of each output file. */
+#define SEDFILES_BUFSIZE (64 * 1024)
+/* Number of subexpressions a replacement can refer to, including \0 / &. */
+#define SEDFILES_NMATCH 10
+
+/* A part of a replacement: a run of literal text if group is negative,
+ * otherwise a reference to a subexpression of the match. */
+typedef struct {
+    int group;
+    size_t off;
+    size_t len;
+} sed_piece;
+
+/* An s command of a script. */
+typedef struct {
+    char *regex;
+    /* literal parts of the replacement */
+    char *text;
+    sed_piece *pieces;
+    size_t npieces;
+    int global;
+    long occurrence;
+    int icase;
+    int maxgroup;
+} sed_subst;
+
+typedef struct {
+    sed_subst *cmds;
+    size_t ncmds;
+    int extended;
+} sed_script;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+} sed_buf;
+
+/* The files of a sedfiles call, handed out to the threads one by one. */
+typedef struct {
+    const sed_script *script;
+    const char **paths;
+    size_t nfiles;
+    int *changed;
+    /* errno of each file, -1 if it was not processed */
+    int *errors;
+    size_t next;
+    pthread_mutex_t mutex;
+} sed_job;
+
+static int buf_append(sed_buf *buf, const char *s, size_t len)
+{
+    if (buf->len + len + 1 > buf->size) {
+        size_t size = buf->size ? buf->size : 256;
+        char *data;
+
+        while (buf->len + len + 1 > size) {
+            size *= 2;
+        }
+        data = realloc(buf->data, size);
+        if (!data) {
+            return 0;
+        }
+        buf->data = data;
+        buf->size = size;
+    }
+    memcpy(buf->data + buf->len, s, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 1;
+}
+
+static void script_free(sed_script *script)
+{
+    size_t i;
+
+    for (i = 0; i < script->ncmds; i++) {
+        free(script->cmds[i].regex);
+        free(script->cmds[i].text);
+        free(script->cmds[i].pieces);
+    }
+    free(script->cmds);
+    script->cmds = NULL;
+    script->ncmds = 0;
+}
+
+/* Whether every sed(1) reads \c in a regular expression delimited by c as
+ * a literal c. */
+static int plain_delimiter(char c)
+{
+    return !strchr("\\.*[]^$+?(){}|<>", c);
+}
+
+/* Whether \c means the same to every sed(1) and to regcomp(3) in a basic
+ * (or extended) regular expression. Other escapes, like \t, \< or \+ in a
+ * basic one, are extensions that only some implementations have. */
+static int portable_escape(char c, int extended)
+{
+    if (c != '\0' && strchr("\\.*[]^$(){}", c)) {
+        return 1;
+    }
+    if (extended) {
+        return c != '\0' && strchr("+?|", c) != NULL;
+    }
+    /* back-references */
+    return c >= '1' && c <= '9';
+}
+
+/* Parse the regular expression of an s command up to the delimiter,
+ * advancing *pp past it. Returns NULL for anything sed(1) implementations
+ * don't agree on, like the delimiter inside a bracket expression or escapes
+ * other than those of POSIX. */
+static char *parse_regex(const char **pp, char delim, int extended)
+{
+    const char *p = *pp;
+    sed_buf out = {NULL, 0, 0};
+
+    for (;;) {
+        char c = *p;
+
+        if (c == '\0' || c == '\n') {
+            goto fail;
+        }
+        if (c == delim) {
+            p++;
+            break;
+        }
+        if (c == '\\') {
+            if (p[1] == '\0' || p[1] == '\n') {
+                goto fail;
+            }
+            if (p[1] == delim) {
+                if (!plain_delimiter(delim) || !buf_append(&out, &delim, 1)) {
+                    goto fail;
+                }
+            } else if (p[1] == 'n') {
+                if (!buf_append(&out, "\n", 1)) {
+                    goto fail;
+                }
+            } else if (!portable_escape(p[1], extended) || !buf_append(&out, p, 2)) {
+                goto fail;
+            }
+            p += 2;
+            continue;
+        }
+        if (c == '[') {
+            /* copy the bracket expression as is */
+            const char *start = p++;
+
+            if (*p == '^') {
+                p++;
+            }
+            if (*p == ']') {
+                p++;
+            }
+            while (*p != ']') {
+                if (*p == '\0' || *p == '\n' || *p == delim) {
+                    goto fail;
+                }
+                if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+                    char end = p[1];
+
+                    for (p += 2; !(p[0] == end && p[1] == ']'); p++) {
+                        if (*p == '\0' || *p == '\n' || *p == delim) {
+                            goto fail;
+                        }
+                    }
+                    p += 2;
+                } else {
+                    p++;
+                }
+            }
+            p++;
+            if (!buf_append(&out, start, (size_t)(p - start))) {
+                goto fail;
+            }
+            continue;
+        }
+        if (!buf_append(&out, p, 1)) {
+            goto fail;
+        }
+        p++;
+    }
+
+    if (out.len == 0) {
+        /* the empty regex means the last one used */
+        goto fail;
+    }
+    *pp = p;
+    return out.data;
+
+fail:
+    free(out.data);
+    return NULL;
+}
+
+static int add_piece(sed_subst *cmd, int group, size_t off, size_t len)
+{
+    sed_piece *pieces;
+
+    if (group < 0 && cmd->npieces > 0 && cmd->pieces[cmd->npieces - 1].group < 0) {
+        /* extend the previous run of text */
+        cmd->pieces[cmd->npieces - 1].len += len;
+        return 1;
+    }
+    pieces = realloc(cmd->pieces, (cmd->npieces + 1) * sizeof(*pieces));
+    if (!pieces) {
+        return 0;
+    }
+    cmd->pieces = pieces;
+    cmd->pieces[cmd->npieces].group = group;
+    cmd->pieces[cmd->npieces].off = off;
+    cmd->pieces[cmd->npieces].len = len;
+    cmd->npieces++;
+    if (group > cmd->maxgroup) {
+        cmd->maxgroup = group;
+    }
+    return 1;
+}
+
+/* Parse the replacement of an s command up to the delimiter, advancing *pp
+ * past it. Escapes other than \\, \&, \n, \<newline>, \<digit> and the
+ * delimiter mean different things to different sed(1)s and are rejected. */
+static int parse_replacement(const char **pp, char delim, sed_subst *cmd)
+{
+    const char *p = *pp;
+    sed_buf text = {NULL, 0, 0};
+
+    /* make sure text is allocated even if the replacement is empty */
+    if (!buf_append(&text, "", 0)) {
+        return 0;
+    }
+    for (;;) {
+        char c = *p;
+        char lit;
+
+        if (c == '\0' || c == '\n') {
+            goto fail;
+        }
+        if (c == delim) {
+            p++;
+            break;
+        }
+        if (c == '&') {
+            if (!add_piece(cmd, 0, 0, 0)) {
+                goto fail;
+            }
+            p++;
+            continue;
+        }
+        if (c == '\\') {
+            char n = p[1];
+
+            if (n >= '0' && n <= '9') {
+                if (!add_piece(cmd, n - '0', 0, 0)) {
+                    goto fail;
+                }
+                p += 2;
+                continue;
+            }
+            if (n == 'n' || n == '\n') {
+                lit = '\n';
+            } else if (n == '\\' || n == '&' || n == delim) {
+                lit = n;
+            } else {
+                goto fail;
+            }
+            p += 2;
+        } else {
+            lit = c;
+            p++;
+        }
+        if (!add_piece(cmd, -1, text.len, 1) || !buf_append(&text, &lit, 1)) {
+            goto fail;
+        }
+    }
+
+    cmd->text = text.data;
+    *pp = p;
+    return 1;
+
+fail:
+    free(text.data);
+    return 0;
+}
+
+/* Parse a script made of s commands. Returns 0 if it is empty or uses any
+ * other syntax. */
+static int script_parse(const char *p, sed_script *script)
+{
+    for (;;) {
+        sed_subst cmd;
+        sed_subst *cmds;
+        char delim;
+
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == ';') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (*p != 's' || p[1] == '\0' || p[1] == '\n' || p[1] == '\\'
+                || isalnum((unsigned char)p[1])) {
+            goto fail;
+        }
+        delim = p[1];
+        p += 2;
+
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.maxgroup = -1;
+        if (!(cmd.regex = parse_regex(&p, delim, script->extended))
+                || !parse_replacement(&p, delim, &cmd)) {
+            goto fail_cmd;
+        }
+        for (;; p++) {
+            if (*p == 'g' && !cmd.global) {
+                cmd.global = 1;
+            } else if ((*p == 'I' || *p == 'i') && !cmd.icase) {
+                cmd.icase = 1;
+            } else if (*p >= '1' && *p <= '9' && cmd.occurrence == 0) {
+                char *end;
+
+                cmd.occurrence = strtol(p, &end, 10);
+                p = end - 1;
+            } else {
+                break;
+            }
+        }
+        if (cmd.occurrence == 0) {
+            cmd.occurrence = 1;
+        }
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p != ';' && *p != '\n' && *p != '\0') {
+            goto fail_cmd;
+        }
+
+        cmds = realloc(script->cmds, (script->ncmds + 1) * sizeof(*cmds));
+        if (!cmds) {
+            goto fail_cmd;
+        }
+        script->cmds = cmds;
+        script->cmds[script->ncmds++] = cmd;
+        continue;
+
+fail_cmd:
+        free(cmd.regex);
+        free(cmd.text);
+        free(cmd.pieces);
+        goto fail;
+    }
+
+    if (script->ncmds > 0) {
+        return 1;
+    }
+
+fail:
+    script_free(script);
+    return 0;
+}
+
+static void script_regfree(regex_t *res, size_t n)
+{
+    while (n > 0) {
+        regfree(&res[--n]);
+    }
+    free(res);
+}
+
+/* Compile the regular expressions of a script, which every thread does for
+ * itself. Returns NULL if one doesn't compile or has fewer subexpressions
+ * than its replacement refers to. */
+static regex_t *script_compile(const sed_script *script)
+{
+    regex_t *res = calloc(script->ncmds, sizeof(*res));
+    size_t i;
+
+    if (!res) {
+        return NULL;
+    }
+    for (i = 0; i < script->ncmds; i++) {
+        const sed_subst *cmd = &script->cmds[i];
+        int cflags = (script->extended ? REG_EXTENDED : 0) | (cmd->icase ? REG_ICASE : 0);
+
+        if (regcomp(&res[i], cmd->regex, cflags) != 0) {
+            script_regfree(res, i);
+            return NULL;
+        }
+        if (cmd->maxgroup >= 0 && (size_t)cmd->maxgroup > res[i].re_nsub) {
+            script_regfree(res, i + 1);
+            return NULL;
+        }
+    }
+    return res;
+}
+
+/* Apply an s command to the line in, writing the result to out. Returns 0
+ * and sets errno on failure. */
+static int subst_line(const sed_subst *cmd, const regex_t *re, const sed_buf *in, sed_buf *out)
+{
+    regmatch_t m[SEDFILES_NMATCH];
+    size_t pos = 0, last_end = 0, i;
+    long count = 0;
+    int rc;
+
+    out->len = 0;
+    while (pos <= in->len) {
+        int eflags = pos > 0 ? REG_NOTBOL : 0;
+        size_t so, eo;
+
+#ifdef REG_STARTEND
+        m[0].rm_so = (regoff_t)pos;
+        m[0].rm_eo = (regoff_t)in->len;
+        rc = regexec(re, in->data, SEDFILES_NMATCH, m, eflags | REG_STARTEND);
+#else
+        rc = regexec(re, in->data + pos, SEDFILES_NMATCH, m, eflags);
+        for (i = 0; rc == 0 && i < SEDFILES_NMATCH; i++) {
+            if (m[i].rm_so != -1) {
+                m[i].rm_so += (regoff_t)pos;
+                m[i].rm_eo += (regoff_t)pos;
+            }
+        }
+#endif
+        if (rc == REG_NOMATCH) {
+            break;
+        } else if (rc != 0) {
+            /* e.g. a byte sequence that is invalid in the locale */
+            errno = EILSEQ;
+            return 0;
+        }
+        so = (size_t)m[0].rm_so;
+        eo = (size_t)m[0].rm_eo;
+
+        if (so == eo && count > 0 && so == last_end) {
+            /* an empty match right after the previous match doesn't count */
+            if (so >= in->len) {
+                break;
+            }
+            if (!buf_append(out, in->data + pos, so + 1 - pos)) {
+                return 0;
+            }
+            pos = so + 1;
+            continue;
+        }
+        count++;
+        last_end = eo;
+        if (!buf_append(out, in->data + pos, so - pos)) {
+            return 0;
+        }
+        if (count >= cmd->occurrence) {
+            for (i = 0; i < cmd->npieces; i++) {
+                const sed_piece *piece = &cmd->pieces[i];
+                int ok;
+
+                if (piece->group < 0) {
+                    ok = buf_append(out, cmd->text + piece->off, piece->len);
+                } else if (m[piece->group].rm_so != -1) {
+                    ok = buf_append(out, in->data + m[piece->group].rm_so,
+                            (size_t)(m[piece->group].rm_eo - m[piece->group].rm_so));
+                } else {
+                    ok = 1;
+                }
+                if (!ok) {
+                    return 0;
+                }
+            }
+        } else if (!buf_append(out, in->data + so, eo - so)) {
+            return 0;
+        }
+        pos = eo;
+        if (count >= cmd->occurrence && !cmd->global) {
+            break;
+        }
+        if (so == eo) {
+            if (so >= in->len) {
+                break;
+            }
+            if (!buf_append(out, in->data + so, 1)) {
+                return 0;
+            }
+            pos = so + 1;
+        }
+    }
+    if (pos < in->len && !buf_append(out, in->data + pos, in->len - pos)) {
+        return 0;
+    }
+    return buf_append(out, "", 0);
+}
+
+/* Read all of fd into a malloc'd buffer, for files that can't be mapped. */
+static char *read_all(int fd, size_t *lenp)
+{
+    sed_buf buf = {NULL, 0, 0};
+    char chunk[SEDFILES_BUFSIZE];
+    ssize_t n;
+
+    while ((n = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(buf.data);
+            return NULL;
+        }
+        if (!buf_append(&buf, chunk, (size_t)n)) {
+            free(buf.data);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    if (!buf.data && !buf_append(&buf, "", 0)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    *lenp = buf.len;
+    return buf.data;
+}
+
+/* Run the script over the file inpath, writing the result to outpath.
+ * Returns 0 or an errno value. */
+static int sed_file(const sed_script *script, const regex_t *res, const char *inpath,
+        const char *outpath, int *changed, sed_buf bufs[2])
+{
+    struct stat st;
+    char *data = NULL;
+    size_t size = 0, start = 0, i;
+    int mapped = 0, err = 0;
+    int fd;
+    FILE *out;
+
+    *changed = 0;
+    fd = open(inpath, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+            && (uint64_t)st.st_size <= SIZE_MAX) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            size = (size_t)st.st_size;
+            mapped = 1;
+        } else {
+            data = NULL;
+        }
+    }
+    if (!data && !(data = read_all(fd, &size))) {
+        err = errno;
+        close(fd);
+        return err;
+    }
+    close(fd);
+
+    out = fopen(outpath, "w");
+    if (!out) {
+        err = errno;
+        goto done;
+    }
+    setvbuf(out, NULL, _IOFBF, SEDFILES_BUFSIZE);
+
+    while (start < size) {
+        const char *nl = memchr(data + start, '\n', size - start);
+        size_t end = nl ? (size_t)(nl - data) : size;
+        sed_buf *line = &bufs[0];
+
+        line->len = 0;
+        if (!buf_append(line, data + start, end - start)) {
+            err = ENOMEM;
+            break;
+        }
+        for (i = 0; i < script->ncmds; i++) {
+            sed_buf tmp;
+
+            if (!subst_line(&script->cmds[i], &res[i], &bufs[0], &bufs[1])) {
+                err = errno;
+                break;
+            }
+            tmp = bufs[0];
+            bufs[0] = bufs[1];
+            bufs[1] = tmp;
+        }
+        if (err) {
+            break;
+        }
+        line = &bufs[0];
+        if (line->len != end - start || memcmp(line->data, data + start, line->len) != 0) {
+            *changed = 1;
+        }
+        /* a missing newline at the end of the file stays missing */
+        if (fwrite(line->data, 1, line->len, out) != line->len || (nl && putc('\n', out) == EOF)) {
+            err = errno;
+            break;
+        }
+        start = end + 1;
+    }
+    if (fclose(out) != 0 && !err) {
+        err = errno;
+    }
+
+done:
+    if (mapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+    return err;
+}
+
+static void *sed_worker(void *arg)
+{
+    sed_job *job = arg;
+    sed_buf bufs[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+    regex_t *res = script_compile(job->script);
+
+    if (!res) {
+        /* the main thread compiled the same script, so this is ENOMEM; the
+         * files are left to the other threads */
+        return NULL;
+    }
+    for (;;) {
+        size_t i;
+
+        pthread_mutex_lock(&job->mutex);
+        i = job->next++;
+        pthread_mutex_unlock(&job->mutex);
+        if (i >= job->nfiles) {
+            break;
+        }
+        job->errors[i] = sed_file(job->script, res, job->paths[2 * i], job->paths[2 * i + 1],
+                &job->changed[i], bufs);
+    }
+    free(bufs[0].data);
+    free(bufs[1].data);
+    script_regfree(res, job->script->ncmds);
+    return NULL;
+}
+
+int SedFilesCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
+{
+    sed_script script = {NULL, 0, 0};
+    sed_job job;
+    pthread_t threads[SEDFILES_MAX_THREADS];
+    regex_t *res;
+    long nthreads = 0, started = 0, t;
+    Tcl_Obj *result;
+    int i = 1, status = TCL_OK;
+    size_t f;
+
+    while (i < objc) {
+        const char *arg = Tcl_GetString(objv[i]);
+
+        if (strcmp(arg, "-E") == 0) {
+            script.extended = 1;
+            i++;
+        } else if (strcmp(arg, "-threads") == 0 && i + 1 < objc) {
+            if (Tcl_GetLongFromObj(interp, objv[i + 1], &nthreads) != TCL_OK) {
+                return TCL_ERROR;
+            }
+            i += 2;
+        } else if (strcmp(arg, "--") == 0) {
+            i++;
+            break;
+        } else {
+            break;
+        }
+    }
+    if (objc - i < 3 || (objc - i - 1) % 2 != 0) {
+        Tcl_WrongNumArgs(interp, 1, objv, "?-E? ?-threads n? script infile outfile ?infile outfile ...?");
+        return TCL_ERROR;
+    }
+
+    /* compile here once to find out if the script is usable at all */
+    if (!script_parse(Tcl_GetString(objv[i]), &script) || !(res = script_compile(&script))) {
+        script_free(&script);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("unsupported sed script: %s", Tcl_GetString(objv[i])));
+        Tcl_SetErrorCode(interp, "SEDFILES", "UNSUPPORTED", NULL);
+        return TCL_ERROR;
+    }
+    script_regfree(res, script.ncmds);
+    i++;
+
+    job.script = &script;
+    job.nfiles = (size_t)(objc - i) / 2;
+    job.next = 0;
+    job.paths = malloc(2 * job.nfiles * sizeof(*job.paths));
+    job.changed = calloc(job.nfiles, sizeof(*job.changed));
+    job.errors = malloc(job.nfiles * sizeof(*job.errors));
+    if (!job.paths || !job.changed || !job.errors) {
+        free(job.paths);
+        free(job.changed);
+        free(job.errors);
+        script_free(&script);
+        Tcl_SetResult(interp, "sedfiles: out of memory", TCL_STATIC);
+        return TCL_ERROR;
+    }
+    for (f = 0; f < job.nfiles; f++) {
+        job.paths[2 * f] = Tcl_GetString(objv[i + 2 * f]);
+        job.paths[2 * f + 1] = Tcl_GetString(objv[i + 2 * f + 1]);
+        job.errors[f] = -1;
+    }
+
+    if (nthreads <= 0) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads > SEDFILES_MAX_THREADS) {
+        nthreads = SEDFILES_MAX_THREADS;
+    }
+    pthread_mutex_init(&job.mutex, NULL);
+    /* the calling thread works on the files, too */
+    for (t = 1; t < nthreads && (size_t)t < job.nfiles; t++) {
+        if (pthread_create(&threads[started], NULL, sed_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    sed_worker(&job);
+    for (t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_mutex_destroy(&job.mutex);
+
+    result = Tcl_NewListObj(0, NULL);
+    for (f = 0; f < job.nfiles; f++) {
+        if (job.errors[f] != 0) {
+            int err = job.errors[f] < 0 ? ENOMEM : job.errors[f];
+
+            Tcl_DecrRefCount(result);
+            errno = err;
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("couldn't process \"%s\": %s",
+                        job.paths[2 * f], strerror(err)));
+            Tcl_SetErrorCode(interp, "POSIX", Tcl_ErrnoId(), Tcl_ErrnoMsg(err), NULL);
+            status = TCL_ERROR;
+            break;
+        }
+        Tcl_ListObjAppendElement(interp, result, Tcl_NewBooleanObj(job.changed[f]));
+    }
+    if (status == TCL_OK) {
+        Tcl_SetObjResult(interp, result);
+    }
+
+    free(job.paths);
+    free(job.changed);
+    free(job.errors);
+    script_free(&script);
+    return status;
+}
@@ -0,0 +1,58 @@
+/*
+ * sedfiles.h
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of The MacPorts Project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SEDFILES_H
+#define _SEDFILES_H
+
+#include <tcl.h>
+
+/**
+ * A native command to run sed substitutions over files without forking
+ * sed(1) for each of them.
+ *
+ * The syntax is:
+ * sedfiles ?-E? ?-threads n? script infile outfile ?infile outfile ...?
+ *      Apply script to each line of every infile and write the result to
+ *      the corresponding outfile, which is truncated first. script is a list
+ *      of s commands separated by semicolons or newlines; each may take the
+ *      g, I and numeric flags. -E selects extended regular expressions. The
+ *      files are processed by up to n threads, which defaults to the number
+ *      of CPUs. Returns a list with a boolean for each infile that is true if
+ *      the output differs from the input.
+ *
+ *      Scripts using anything else, e.g. addresses or other commands, fail
+ *      with the error code SEDFILES UNSUPPORTED so that the caller can run
+ *      sed(1) instead.
+ */
+int SedFilesCmd(ClientData, Tcl_Interp *, int, Tcl_Obj *const objv[]);
+
+#endif
+	/* _SEDFILES_H */
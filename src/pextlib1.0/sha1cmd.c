@@ -44,6 +44,7 @@
 #include <tcl.h>
 
 #include "sha1cmd.h"
+#include "multichecksumcmd.h"
 
 #if HAVE_COMMONCRYPTO_COMMONDIGEST_H
 
@@ -73,6 +74,25 @@ CHECKSUMFile(SHA1_, SHA_CTX)
 #error CommonCrypto, libmd or libcrypto required
 #endif
 
+static void sha1_init(void *ctx)
+{
+	SHA1_Init((SHA_CTX *)ctx);
+}
+
+static void sha1_update(void *ctx, const unsigned char *data, size_t len)
+{
+	SHA1_Update((SHA_CTX *)ctx, data, len);
+}
+
+static void sha1_end(void *ctx, char *buf)
+{
+	SHA1_End((SHA_CTX *)ctx, buf);
+}
+
+const checksum_algo sha1_algo = {
+	"sha1", sizeof(SHA_CTX), sha1_init, sha1_update, sha1_end, 2*SHA_DIGEST_LENGTH
+};
+
 int SHA1Cmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
 	char *file, *action;
@@ -42,6 +42,7 @@
 #include <tcl.h>
 
 #include "sha256cmd.h"
+#include "multichecksumcmd.h"
 
 #if HAVE_COMMONCRYPTO_COMMONDIGEST_H
 
@@ -77,6 +78,25 @@ CHECKSUMEnd(SHA256_, SHA256_CTX, SHA256_DIGEST_LENGTH)
 CHECKSUMFile(SHA256_, SHA256_CTX)
 #endif
 
+static void sha256_init(void *ctx)
+{
+	SHA256_Init((SHA256_CTX *)ctx);
+}
+
+static void sha256_update(void *ctx, const unsigned char *data, size_t len)
+{
+	SHA256_Update((SHA256_CTX *)ctx, data, len);
+}
+
+static void sha256_end(void *ctx, char *buf)
+{
+	SHA256_End((SHA256_CTX *)ctx, buf);
+}
+
+const checksum_algo sha256_algo = {
+	"sha256", sizeof(SHA256_CTX), sha256_init, sha256_update, sha256_end, 2*SHA256_DIGEST_LENGTH
+};
+
 int SHA256Cmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
 	char *file, *action;
@@ -400,9 +400,9 @@ int SystemCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Ob
      * Custom handlers for SIGINT and SIGQUIT to detect aborts
      *
      * system(3) also blocks SIGCHLD during the execution of the program.
-     * However, that would make our wait(2) call more complicated. As we are
-     * not relying on delivery of SIGCHLD anywhere else, we just do not change
-     * the handling here at all.
+     * However, that would make our waitpid(2) call more complicated. As we
+     * are not relying on delivery of SIGCHLD anywhere else, we just do not
+     * change the handling here at all.
      */
     struct sigaction sa, old_sa_int, old_sa_quit;
     memset(&sa, 0, sizeof(sa));
@@ -571,7 +571,7 @@ int SystemCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_Ob
     }
 
     status = TCL_ERROR;
-    if (wait(&ret) == pid && (WIFEXITED(ret) || WIFSIGNALED(ret)) && !read_failed) {
+    if (waitpid(pid, &ret, 0) == pid && (WIFEXITED(ret) || WIFSIGNALED(ret)) && !read_failed) {
         Tcl_Obj *event = NULL;
 
         /* Populate common exit event fields */
@@ -0,0 +1,41 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Benchmark for Pextlib's blake3, comparing sequential hashing with hashing
+# by all CPUs.
+# Requires r/w access to /tmp/ and about 256 MiB of free space.
+# Syntax:
+# tclsh blake3-bench.tcl <Pextlib name> ?size in MiB?
+
+proc throughput {file threads rounds} {
+    # warm the page cache
+    blake3 file $file $threads
+    set usec [lindex [time {blake3 file $file $threads} $rounds] 0]
+    return [expr {[file size $file] / 1048576.0 / ($usec / 1000000.0)}]
+}
+
+proc main {pextlibname {size 256}} {
+    load $pextlibname
+
+    set benchfile "/tmp/macports-pextlib-blake3-bench"
+    set chan [open $benchfile w]
+    fconfigure $chan -translation binary
+    set block [binary format H* [string repeat 00ff7f8031a5 174763]]
+    for {set i 0} {$i < $size} {incr i} {
+        puts -nonewline $chan $block
+    }
+    close $chan
+
+    if {[blake3 file $benchfile 1] ne [blake3 file $benchfile]} {
+        puts "sequential and parallel digests differ"
+        file delete -force $benchfile
+        exit 1
+    }
+    set sequential [throughput $benchfile 1 3]
+    set parallel [throughput $benchfile 0 3]
+    puts [format "blake3 %d MiB: sequential %.1f MiB/s, parallel %.1f MiB/s (%.2fx)" \
+        $size $sequential $parallel [expr {$parallel / $sequential}]]
+
+    file delete -force $benchfile
+}
+
+main {*}$argv
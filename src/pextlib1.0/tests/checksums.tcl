@@ -78,6 +78,54 @@ proc main {pextlibname} {
         exit 1
     }
 
+    # all at once, in the requested order
+    set expected [list sha256 424359e1002a1d117f12f95346a81987037b3fde60a564a7aacb48c65a518fe5 \
+                       size [file size $testfile] \
+                       md5 91d3ef5cd86741957b0b5d8f8911166d \
+                       rmd160 b654ecbdced69aba8a4ea8d6824dd1ac103b3116 \
+                       blake3 756171f6ef52a9255a4d4ef375ace3338f5f175bf1089cdb0db17761f505cec2 \
+                       sha1 a40f8539f217a0032d194c3a8c42cc832b6379cf \
+                       md5 91d3ef5cd86741957b0b5d8f8911166d]
+    if {[multichecksum file $testfile {sha256 size md5 rmd160 blake3 sha1 md5}] ne $expected} {
+        puts {[multichecksum file $testfile {sha256 size md5 rmd160 blake3 sha1 md5}] ne $expected}
+        exit 1
+    }
+    if {[multichecksum file $testfile size] ne [list size [file size $testfile]]} {
+        puts {[multichecksum file $testfile size] ne [list size [file size $testfile]]}
+        exit 1
+    }
+    if {![catch {multichecksum file $testfile {sha256 crc32}}]} {
+        puts {multichecksum file $testfile {sha256 crc32} did not fail}
+        exit 1
+    }
+
+    # large enough to be hashed by several threads
+    set chan [open $largetestfile w]
+    fconfigure $chan -translation binary
+    set block [binary format H* [string repeat 00ff7f8031 1000]]
+    for {set i 0} {$i < 4200} {incr i} {
+        puts -nonewline $chan $block
+    }
+    close $chan
+    set expected [list]
+    foreach type {md5 sha1 rmd160 sha256 blake3} {
+        lappend expected $type [$type file $largetestfile]
+    }
+    lappend expected size [file size $largetestfile]
+    if {[multichecksum file $largetestfile {md5 sha1 rmd160 sha256 blake3 size}] ne $expected} {
+        puts {[multichecksum file $largetestfile {md5 sha1 rmd160 sha256 blake3 size}] ne $expected}
+        exit 1
+    }
+    # the tree-parallel BLAKE3 must agree with the sequential one for any
+    # number of threads
+    set blake3sum [blake3 file $largetestfile 1]
+    foreach threads {2 3 8} {
+        if {[blake3 file $largetestfile $threads] ne $blake3sum} {
+            puts "\[blake3 file \$largetestfile $threads\] ne \[blake3 file \$largetestfile 1\]"
+            exit 1
+        }
+    }
+
     # delete the file.
     file delete -force $testfile
     file delete -force $largetestfile
@@ -0,0 +1,50 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Benchmark for Pextlib's curl fetch --segments, timing a download from the
+# local server in httpd.tcl with each connection limited to a given rate, the
+# way many mirrors limit them.
+# Requires r/w access to /tmp/ and twice the size of the file in free space.
+# Syntax:
+# tclsh curl-bench.tcl <Pextlib name> ?MiB? ?bytes per second and connection?
+
+proc msec {script} {
+    set usec [lindex [uplevel 1 [list time $script]] 0]
+    return [expr {$usec / 1000.0}]
+}
+
+proc main {pextlibname {mib 8} {rate 2097152}} {
+    load $pextlibname
+
+    set root /tmp/macports-pextlib-curl-bench
+    file delete -force $root
+    file mkdir $root
+    set tempfile $root/out
+
+    set fd [open $root/data wb]
+    set block [string repeat [format %1023d 0]\n 1024]
+    for {set i 0} {$i < $mib} {incr i} {
+        puts -nonewline $fd $block
+    }
+    close $fd
+
+    set server [open |[list [info nameofexecutable] \
+        [file join [file dirname [info script]] httpd.tcl] $root $rate] r+]
+    set url http://127.0.0.1:[gets $server]/data
+
+    puts [format "%d MiB at %.1f MiB/s per connection" $mib [expr {$rate / 1048576.0}]]
+    set single [msec {curl fetch $url $tempfile}]
+    puts [format "%-12s %10.1f ms" "1 segment" $single]
+    foreach segments {2 4 8} {
+        set t [msec {curl fetch --segments $segments $url $tempfile}]
+        if {[file size $tempfile] != [file size $root/data]} {
+            puts "download with $segments segments is incomplete"
+            exit 1
+        }
+        puts [format "%-12s %10.1f ms  %5.2fx" "$segments segments" $t [expr {$single / $t}]]
+    }
+
+    close $server
+    file delete -force $root
+}
+
+main {*}$argv
@@ -0,0 +1,57 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Test file for Pextlib's curl probe, against the local server in httpd.tcl.
+# Requires r/w access to /tmp/.
+# Syntax:
+# tclsh curl-probe.tcl <Pextlib name>
+
+proc main {pextlibname} {
+    load $pextlibname
+
+    set root /tmp/macports-pextlib-testcurl-probe
+    file delete -force $root
+    file mkdir $root
+    for {set i 1} {$i <= 20} {incr i} {
+        set fd [open $root/file$i wb]
+        puts -nonewline $fd [string repeat x [expr {$i * 100}]]
+        close $fd
+    }
+
+    set server [open |[list [info nameofexecutable] \
+        [file join [file dirname [info script]] httpd.tcl] $root] r+]
+    set url http://127.0.0.1:[gets $server]
+
+    test "single" {[curl probe $url/file1] eq {100}}
+    test "sizes in order" {[curl probe $url/file2 $url/missing $url/redirect/file3] eq {200 -1 300}}
+
+    # many at once, as for every archive site and signature of a port
+    set probes [list]
+    set expected [list]
+    for {set i 1} {$i <= 20} {incr i} {
+        lappend probes $url/file$i [list --ignore-ssl-cert $url/noranges/file$i]
+        lappend expected [expr {$i * 100}] [expr {$i * 100}]
+    }
+    test "batch" {[curl probe {*}$probes] eq $expected}
+
+    # agrees with getsize
+    test "getsize" {[curl getsize $url/file7] == [lindex [curl probe $url/file7] 0]}
+
+    # unreachable servers only fail their own probes
+    test "unreachable" {[curl probe http://127.0.0.1:1/file1 $url/file1] eq {-1 100}}
+
+    test "unknown option" {[catch {curl probe [list --bogus $url/file1]}]}
+    test "missing parameter" {[catch {curl probe [list $url/file1 -u]}]}
+    test "empty probe" {[catch {curl probe {}}]}
+
+    close $server
+    file delete -force $root
+}
+
+proc test {test_name args} {
+    if {[catch {uplevel 1 expr $args} result] || !$result} {
+        puts "test $test_name failed: [uplevel 1 subst -nocommands $args] == $result"
+        exit 1
+    }
+}
+
+main $argv
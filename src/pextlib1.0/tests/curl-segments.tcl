@@ -0,0 +1,160 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Test file for Pextlib's curl fetch --resume, --segments, --digests,
+# --response-code and --response-headers, against the local server in
+# httpd.tcl.
+# Requires r/w access to /tmp/.
+# Syntax:
+# tclsh curl-segments.tcl <Pextlib name>
+
+proc main {pextlibname} {
+    load $pextlibname
+
+    set root /tmp/macports-pextlib-testcurl-segments
+    file delete -force $root
+    file mkdir $root
+    set tempfile $root/out
+
+    # a few segments' worth of data that doesn't repeat
+    set fd [open $root/data wb]
+    for {set i 0} {$i < 200000} {incr i} {
+        puts -nonewline $fd [format %015d $i]
+    }
+    close $fd
+    file mtime $root/data [clock scan 2020-02-02 -timezone :UTC -format {%Y-%m-%d}]
+    set size [file size $root/data]
+    set sum [md5 file $root/data]
+    set fd [open $root/small wb]
+    puts -nonewline $fd "small file"
+    close $fd
+
+    set server [open |[list [info nameofexecutable] \
+        [file join [file dirname [info script]] httpd.tcl] $root] r+]
+    set url http://127.0.0.1:[gets $server]
+
+    # plain fetch
+    curl fetch $url/data $tempfile
+    test "plain" {[md5 file $tempfile] eq $sum}
+
+    # an interrupted transfer is continued where it stopped
+    file delete $tempfile
+    test "truncated" {[catch {curl fetch $url/truncate/1000000/data $tempfile}]}
+    test "truncated size" {[file size $tempfile] == 1000000}
+    curl fetch --resume $url/data $tempfile
+    test "resume" {[md5 file $tempfile] eq $sum}
+
+    # resuming a complete file leaves it alone
+    curl fetch --resume $url/data $tempfile
+    test "resume complete" {[md5 file $tempfile] eq $sum}
+
+    # a local file longer than the remote one is fetched again
+    set fd [open $tempfile a]
+    puts -nonewline $fd garbage
+    close $fd
+    curl fetch --resume $url/data $tempfile
+    test "resume longer" {[md5 file $tempfile] eq $sum}
+
+    # servers without ranges make it start over
+    truncate $tempfile 1000000
+    curl fetch --resume $url/noranges/data $tempfile
+    test "resume noranges" {[md5 file $tempfile] eq $sum}
+
+    # without --resume, the file is replaced
+    curl fetch $url/small $tempfile
+    test "no resume" {[file size $tempfile] == [file size $root/small]}
+
+    # segmented download, following redirects
+    file delete $tempfile
+    curl fetch --segments 4 --remote-time --effective-url effective \
+        $url/redirect/data $tempfile
+    test "segments" {[md5 file $tempfile] eq $sum}
+    test "segments effective-url" {$effective eq "$url/data"}
+    test "segments remote-time" {[file mtime $tempfile] == [file mtime $root/data]}
+
+    # progress is reported for the whole file, which needs a slow server
+    set slowserver [open |[list [info nameofexecutable] \
+        [file join [file dirname [info script]] httpd.tcl] $root 500000] r+]
+    set slowurl http://127.0.0.1:[gets $slowserver]
+    set ::progress {}
+    curl fetch --segments 4 --progress progress $slowurl/data $tempfile
+    close $slowserver
+    test "segments progress" {[lindex $::progress 0] == $size && [lindex $::progress 1] > 0}
+
+    # segments fall back to a single transfer
+    curl fetch --segments 4 $url/noranges/data $tempfile
+    test "segments noranges" {[md5 file $tempfile] eq $sum}
+    curl fetch --segments 4 $url/small $tempfile
+    test "segments small" {[md5 file $tempfile] eq [md5 file $root/small]}
+    test "segments 404" {[catch {curl fetch --segments 4 $url/missing $tempfile}]}
+
+    # failed segments leave a prefix that can be resumed
+    test "segments truncated" {[catch {curl fetch --segments 2 $url/truncate/100000/data $tempfile}]}
+    test "segments truncated size" {[file size $tempfile] == 100000}
+    curl fetch --resume --segments 2 $url/data $tempfile
+    test "segments resume" {[md5 file $tempfile] eq $sum}
+
+    test "segments invalid" {[catch {curl fetch --segments 0 $url/data $tempfile}]}
+
+    # digests computed while downloading match those of the file
+    set types {sha256 size rmd160}
+    set expected [multichecksum file $root/data $types]
+    file delete $tempfile
+    test "digests" {[curl fetch --digests $types $url/data $tempfile] eq $expected}
+    test "digests resume complete" {[curl fetch --resume --digests $types $url/data $tempfile] eq $expected}
+    set fd [open $tempfile a]
+    puts -nonewline $fd garbage
+    close $fd
+    test "digests resume longer" {[curl fetch --resume --digests $types $url/data $tempfile] eq $expected}
+    truncate $tempfile 1000000
+    test "digests resume" {[curl fetch --resume --digests $types $url/data $tempfile] eq $expected}
+    truncate $tempfile 1000000
+    test "digests resume noranges" {[curl fetch --resume --digests $types $url/noranges/data $tempfile] eq $expected}
+    test "digests segments" {[curl fetch --segments 4 --digests $types $url/data $tempfile] eq $expected}
+    test "no digests" {[curl fetch $url/data $tempfile] eq ""}
+    test "digests invalid" {[catch {curl fetch --digests {sha256 crc} $url/data $tempfile}]}
+
+    # the response of the last request after redirects is reported
+    curl fetch --response-code code --response-headers headers $url/redirect/small $tempfile
+    test "response code" {$code == 200}
+    test "response headers" {[dict get $headers content-length] == [file size $root/small]}
+    test "response headers redirect" {![dict exists $headers location]}
+    set etag [dict get $headers etag]
+    set lastmodified [dict get $headers last-modified]
+
+    # conditional requests for an unchanged file get an empty 304 response
+    curl fetch --response-code code --append-http-header "If-None-Match: $etag" \
+        $url/small $tempfile
+    test "response code not modified" {$code == 304}
+    test "not modified empty" {[file size $tempfile] == 0}
+    curl fetch --response-code code --append-http-header "If-Modified-Since: $lastmodified" \
+        --segments 4 $url/small $tempfile
+    test "response code if-modified-since" {$code == 304}
+    curl fetch --response-code code --append-http-header {If-None-Match: "other"} \
+        $url/small $tempfile
+    test "response code modified" {$code == 200 && [file size $tempfile] == [file size $root/small]}
+
+    close $server
+    file delete -force $root
+}
+
+proc progress {action args} {
+    if {$action eq "update"} {
+        lassign $args type total now speed
+        set ::progress [list $total $now]
+    }
+}
+
+proc truncate {path length} {
+    set fd [open $path r+]
+    chan truncate $fd $length
+    close $fd
+}
+
+proc test {test_name args} {
+    if {[catch {uplevel 1 expr $args} result] || !$result} {
+        puts "test $test_name failed: [uplevel 1 subst -nocommands $args] == $result"
+        exit 1
+    }
+}
+
+main $argv
@@ -0,0 +1,71 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Benchmark for Pextlib's filemap, timing the operations the registry does on
+# a map with many files: opening it, looking up and listing files, and saving
+# a few changes.
+# Requires r/w access to /tmp/ and about 64 MiB of free space.
+# Syntax:
+# tclsh filemap-bench.tcl <Pextlib name> ?number of paths?
+
+proc msec {script {rounds 1}} {
+    set usec [lindex [uplevel 1 [list time $script $rounds]] 0]
+    return [expr {$usec / 1000.0}]
+}
+
+proc main {pextlibname {count 1000000}} {
+    load $pextlibname
+
+    set benchfile "/tmp/macports-pextlib-filemap-bench"
+    file delete -force $benchfile ${benchfile}.journal ${benchfile}.lock
+
+    # ports with 1000 files each, spread over a few directories
+    set ports [expr {max(1, $count / 1000)}]
+    filemap open benchmap $benchfile
+    set fill [msec {
+        for {set i 0} {$i < $count} {incr i} {
+            set port port[expr {$i % $ports}]
+            filemap set benchmap \
+                /opt/local/share/$port/[expr {$i % 7}]/[expr {$i % 31}]/file$i $port
+        }
+    }]
+    set save [msec {filemap save benchmap}]
+    filemap close benchmap
+
+    set open [msec {
+        filemap open benchmap $benchfile readonly
+        filemap close benchmap
+    } 10]
+
+    filemap open benchmap $benchfile readonly
+    set get [msec {
+        set i [expr {int(rand() * $count)}]
+        set port port[expr {$i % $ports}]
+        filemap get benchmap \
+            /opt/local/share/$port/[expr {$i % 7}]/[expr {$i % 31}]/file$i
+    } 100000]
+    set list [msec {filemap list benchmap port1} 10]
+    filemap close benchmap
+
+    filemap open benchmap $benchfile
+    set update [msec {
+        for {set i 0} {$i < 1000} {incr i} {
+            filemap set benchmap /opt/local/bin/new$i newport
+        }
+        filemap save benchmap
+    }]
+    filemap close benchmap
+
+    set reopen [msec {
+        filemap open benchmap $benchfile readonly
+        filemap close benchmap
+    } 10]
+
+    puts [format "filemap %d paths, %d bytes: fill %.0f ms, save %.0f ms" \
+        $count [file size $benchfile] $fill $save]
+    puts [format "open %.2f ms, get %.2f us, list %.1f ms, 1000 changes + save %.1f ms, open with journal %.2f ms" \
+        $open [expr {$get * 1000.0}] $list $update $reopen]
+
+    file delete -force $benchfile ${benchfile}.journal ${benchfile}.lock
+}
+
+main {*}$argv
@@ -215,6 +215,83 @@ proc main {pextlibname} {
     }
     filemap close testmap9
 
+    # changes saved to the journal are read back, and keys are case insensitive.
+    filemap open testmap10 "/tmp/macports-pextlib-testmap"
+    filemap set testmap10 "/journal/a" "journal"
+    filemap set testmap10 "/journal/b" "journal"
+    filemap unset testmap10 "/bar/bar-3"
+    filemap save testmap10
+    filemap unset testmap10 "/journal/a"
+    filemap set testmap10 "/journal/B" "journal-2"
+    filemap close testmap10
+    filemap open testmap11 "/tmp/macports-pextlib-testmap" readonly
+    if {[filemap exists testmap11 "/journal/a"]} {
+        puts {[filemap exists testmap11 "/journal/a"]}
+        exit 1
+    }
+    if {[filemap get testmap11 "/JOURNAL/b"] ne "journal-2"} {
+        puts {[filemap get testmap11 "/JOURNAL/b"] ne "journal-2"}
+        exit 1
+    }
+    if {[filemap list testmap11 "somevalue"] ne {/foo/bar-1 /foo/bar-2}} {
+        puts {[filemap list testmap11 "somevalue"] ne {/foo/bar-1 /foo/bar-2}}
+        exit 1
+    }
+    if {[filemap get testmap11 "/many/bar-999"] ne "foo-999"} {
+        puts {[filemap get testmap11 "/many/bar-999"] ne "foo-999"}
+        exit 1
+    }
+    filemap close testmap11
+
+    # files and directories can't replace each other.
+    filemap open testmap12 "/tmp/macports-pextlib-testmap"
+    if {![catch {filemap set testmap12 "/foo" "foo"}]} {
+        puts {![catch {filemap set testmap12 "/foo" "foo"}]}
+        exit 1
+    }
+    if {![catch {filemap set testmap12 "/foobar/foo" "foo"}]} {
+        puts {![catch {filemap set testmap12 "/foobar/foo" "foo"}]}
+        exit 1
+    }
+    if {![catch {filemap unset testmap12 "/foo/none"}]} {
+        puts {![catch {filemap unset testmap12 "/foo/none"}]}
+        exit 1
+    }
+    # empty directories are removed.
+    filemap unset testmap12 "/journal/b"
+    filemap set testmap12 "/journal" "journal"
+    filemap close testmap12
+
+    file delete -force "/tmp/macports-pextlib-testmap"
+    file delete -force "/tmp/macports-pextlib-testmap.journal"
+
+    # maps in the format of previous versions are converted when saved.
+    set chan [open "/tmp/macports-pextlib-testmap" w]
+    fconfigure $chan -translation binary
+    puts -nonewline $chan [binary format a24a4 "org.darwinports.filemap" "\0\1\0\0"]
+    puts -nonewline $chan [binary format ca*xI 0 "" 2]
+    puts -nonewline $chan [binary format ca*xI 0 "opt" 1]
+    puts -nonewline $chan [binary format ca*xa*x 1 "file" "port"]
+    puts -nonewline $chan [binary format ca*xa*x 1 "other" "port-2"]
+    close $chan
+    filemap open testmap13 "/tmp/macports-pextlib-testmap"
+    if {[filemap list testmap13 "port"] ne {/opt/file}} {
+        puts {[filemap list testmap13 "port"] ne {/opt/file}}
+        exit 1
+    }
+    filemap set testmap13 "/opt/new" "port"
+    filemap close testmap13
+    filemap open testmap14 "/tmp/macports-pextlib-testmap" readonly
+    if {[filemap list testmap14 "port"] ne {/opt/file /opt/new}} {
+        puts {[filemap list testmap14 "port"] ne {/opt/file /opt/new}}
+        exit 1
+    }
+    if {[filemap get testmap14 "/other"] ne "port-2"} {
+        puts {[filemap get testmap14 "/other"] ne "port-2"}
+        exit 1
+    }
+    filemap close testmap14
+
     file delete -force "/tmp/macports-pextlib-testmap"
 
     # delete the lock file as well.
@@ -0,0 +1,77 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Test file for Pextlib's fs-manifest
+# Requires r/w access to /tmp
+# Syntax:
+# tclsh fs-manifest.tcl <Pextlib name>
+
+proc check {what got expected} {
+    if {$got ne $expected} {
+        puts "$what: expected \"$expected\", got \"$got\""
+        exit 1
+    }
+}
+
+proc write_file {path data} {
+    set chan [open $path w]
+    fconfigure $chan -translation binary
+    puts -nonewline $chan $data
+    close $chan
+}
+
+proc main {pextlibname} {
+    load $pextlibname
+
+    set root "/tmp/macports-pextlib-fs-manifest"
+    file delete -force $root
+    file mkdir $root/bin $root/lib/empty $root/share/doc
+
+    # thin Mach-O binary, in host byte order
+    write_file $root/bin/tool [binary format nu2 [list 0xfeedfacf 7]]
+    write_file $root/bin/script "#!/bin/sh\n"
+    write_file $root/lib/libz.a "!<arch>\nobjects"
+    # universal binary; the header is big endian
+    write_file $root/lib/fat.dylib [binary format Iu2 [list 0xcafebabe 2]]
+    # java class, same magic as a universal binary
+    write_file $root/lib/Main.class [binary format Iu2 [list 0xcafebabe 0x32]]
+    write_file $root/share/doc/empty {}
+    write_file $root/+CONTENTS {}
+    file link -symbolic $root/bin/link tool
+    symlink missing $root/bin/dangling
+
+    # same files in the same order as fs-traverse, directories left out
+    set expected [list]
+    fs-traverse -depth fullpath [list $root] {
+        if {[file type $fullpath] ne "directory"} {
+            lappend expected [string range $fullpath [string length $root]+1 end]
+        }
+    }
+    foreach jobs {1 4} {
+        set manifest [fs-manifest -jobs $jobs $root/]
+        check "paths with $jobs jobs" [lmap entry $manifest {lindex $entry 0}] $expected
+        foreach entry $manifest {
+            lassign $entry path checksum binary
+            if {[file isfile $root/$path]} {
+                check "checksum of $path" $checksum [md5 file $root/$path]
+            } else {
+                check "checksum of $path" $checksum {}
+            }
+            dict set binaries $path $binary
+        }
+    }
+    check "binaries" [lsort [dict keys [dict filter $binaries value 1]]] \
+        [list bin/tool lib/fat.dylib lib/libz.a]
+
+    file attributes $root/bin/script -permissions 0
+    if {[catch {open $root/bin/script r} chan] == 0} {
+        # running as root
+        close $chan
+    } else {
+        check "unreadable file" [catch {fs-manifest $root} result] 1
+        check "error" $result "$root/bin/script: permission denied"
+    }
+
+    file delete -force $root
+}
+
+main $argv
@@ -159,6 +159,100 @@ proc main {pextlibname} {
         }
         check_output $output $trees(1)
 
+        # Test -type, which doesn't stop descending into directories
+        set output [list]
+        fs-traverse -type file file [list $root] {
+            lappend output $file
+        }
+        check_output $output [filter_tree $trees(1) file]
+
+        set output [list]
+        fs-traverse -type {directory link} file [list $root] {
+            lappend output $file
+        }
+        check_output $output [filter_tree $trees(1) directory link]
+
+        if {![catch {fs-traverse -type nosuchtype file [list $root] {}}]} {
+            error "fs-traverse did not error with an unknown type"
+        }
+
+        # Test -glob, which matches the last component of the path
+        set output [list]
+        fs-traverse -glob {[cd]} file [list $root] {
+            lappend output $file
+        }
+        set expected [list]
+        foreach {entry typelist} $trees(1) {
+            if {[file tail $entry] in {c d}} {
+                lappend expected $entry $typelist
+            }
+        }
+        check_output $output $expected
+        set output [list]
+        fs-traverse -glob macports-* -type directory file [list $root/] {
+            lappend output $file
+        }
+        if {$output ne [list $root/]} {
+            error "fs-traverse -glob did not match the target itself: `$output'"
+        }
+
+        # Test -stat
+        set fd [open $root/b/c/a w]
+        puts -nonewline $fd 12345
+        close $fd
+        file attributes $root/b/c/a -permissions 0640
+        file mtime $root/b/c/a 1000000000
+        set output [list]
+        fs-traverse -stat entry [list $root] {
+            lassign $entry file type size mode mtime
+            if {$type ne [file type $file]} {
+                error "fs-traverse -stat gave type `$type' for `$file'"
+            }
+            lappend output $file
+            if {$file eq "$root/b/c/a" && ($size != 5 || $mode != 0o640 || $mtime != 1000000000)} {
+                error "fs-traverse -stat gave `$entry'"
+            }
+        }
+        check_output $output $trees(1)
+
+        # Test -batch
+        set output [list]
+        set batches 0
+        fs-traverse -batch 4 files [list $root] {
+            if {[llength $files] > 4} {
+                error "fs-traverse -batch 4 passed [llength $files] entries"
+            }
+            incr batches
+            lappend output {*}$files
+        }
+        check_output $output $trees(1)
+        if {$batches != 7} {
+            error "fs-traverse -batch 4 ran the body $batches times for 25 entries"
+        }
+
+        # Test -batch with filtering and -stat
+        set output [list]
+        fs-traverse -depth -type file -stat -batch 100 entries [list $root] {
+            foreach entry $entries {
+                lappend output [lindex $entry 0]
+            }
+        }
+        check_output $output [filter_tree $trees(2) file]
+
+        # Test cutting a batched traversal short
+        set batches 0
+        fs-traverse -batch 2 files [list $root] {
+            incr batches
+            break
+        }
+        if {$batches != 1} {
+            error "fs-traverse -batch did not stop on break"
+        }
+
+        if {![catch {fs-traverse -batch 0 files [list $root] {}}]} {
+            error "fs-traverse did not error with -batch 0"
+        }
+
         # NOTE: This should be the last test performed, as it modifies the file tree
         # Test to make sure deleting files during traversal works as expected
         set output [list]
@@ -197,6 +291,17 @@ proc check_output {output tree {root ""}} {
     }
 }
 
+# the entries of a tree with one of the given types
+proc filter_tree {tree args} {
+    set result [list]
+    foreach {entry typelist} $tree {
+        if {[lindex $typelist 0] in $args} {
+            lappend result $entry $typelist
+        }
+    }
+    return $result
+}
+
 proc make_root {} {
     global trees
     foreach {entry typelist} $trees(1) {
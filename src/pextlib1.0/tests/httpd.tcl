@@ -0,0 +1,177 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Minimal HTTP/1.1 server for the curl tests, serving the files in a
+# directory on a local port. It answers GET and HEAD, including byte ranges
+# and conditional requests, and closes each connection after one response. Special path prefixes
+# change its behaviour:
+#   /noranges/<file>    ignore Range headers and don't advertise them
+#   /truncate/<n>/<file> close the connection after n bytes of the body
+#   /redirect/<path>    redirect to /<path>
+# The port is printed on stdout; the server exits when stdin is closed.
+# Syntax:
+# tclsh httpd.tcl <directory> ?bytes per second and connection?
+
+proc accept {root rate chan addr port} {
+    fconfigure $chan -translation crlf -buffering line -blocking 0
+    fileevent $chan readable [list request $root $rate $chan]
+    set ::request($chan) {}
+}
+
+proc request {root rate chan} {
+    if {[gets $chan line] < 0} {
+        if {[eof $chan]} {
+            finish $chan
+        }
+        return
+    }
+    if {$line ne ""} {
+        lappend ::request($chan) $line
+        return
+    }
+    fileevent $chan readable {}
+    set lines $::request($chan)
+    unset ::request($chan)
+
+    lassign [lindex $lines 0] method path
+    set range {}
+    set if_none_match {}
+    set if_modified_since {}
+    foreach header [lrange $lines 1 end] {
+        if {[regexp -nocase {^Range:\s*bytes=(\d*)-(\d*)\s*$} $header -> first last]} {
+            set range [list $first $last]
+        } elseif {[regexp -nocase {^If-None-Match:\s*(.*?)\s*$} $header -> if_none_match]} {
+        } elseif {[regexp -nocase {^If-Modified-Since:\s*(.*?)\s*$} $header -> if_modified_since]} {
+        }
+    }
+
+    set ranges 1
+    set limit -1
+    while 1 {
+        if {[regexp {^/noranges(/.*)$} $path -> path]} {
+            set ranges 0
+        } elseif {[regexp {^/truncate/(\d+)(/.*)$} $path -> limit path]} {
+        } elseif {[regexp {^/redirect(/.*)$} $path -> target]} {
+            respond $chan "302 Found" [list Location $target Content-Length 0]
+            finish $chan
+            return
+        } else {
+            break
+        }
+    }
+
+    set file [file join $root [string trimleft $path /]]
+    if {![file isfile $file]} {
+        respond $chan "404 Not Found" {Content-Length 0}
+        finish $chan
+        return
+    }
+    set size [file size $file]
+    set mtime [file mtime $file]
+    set etag "\"$size-$mtime\""
+    set headers [list Last-Modified [clock format $mtime \
+            -format {%a, %d %b %Y %H:%M:%S GMT} -gmt 1] ETag $etag]
+    if {$if_none_match ne {} ? $if_none_match eq $etag
+            : $if_modified_since ne {} && ![catch {clock scan $if_modified_since \
+                -format {%a, %d %b %Y %H:%M:%S GMT} -gmt 1} since] && $mtime <= $since} {
+        respond $chan "304 Not Modified" $headers
+        finish $chan
+        return
+    }
+    if {$ranges} {
+        lappend headers Accept-Ranges bytes
+    }
+
+    set status "200 OK"
+    set offset 0
+    set length $size
+    if {$ranges && $range ne {}} {
+        lassign $range first last
+        if {$first eq ""} {
+            # suffix range
+            set first [expr {max(0, $size - $last)}]
+            set last [expr {$size - 1}]
+        } elseif {$last eq "" || $last >= $size} {
+            set last [expr {$size - 1}]
+        }
+        if {$first >= $size || $first > $last} {
+            # with an error page, like most servers
+            set body "<html><body>416 Range Not Satisfiable</body></html>"
+            respond $chan "416 Range Not Satisfiable" \
+                [list Content-Range "bytes */$size" Content-Length [expr {[string length $body] + 2}]]
+            puts $chan $body
+            finish $chan
+            return
+        }
+        set status "206 Partial Content"
+        set offset $first
+        set length [expr {$last - $first + 1}]
+        lappend headers Content-Range "bytes $first-$last/$size"
+    }
+    lappend headers Content-Length $length
+    respond $chan $status $headers
+    if {$method eq "HEAD"} {
+        finish $chan
+        return
+    }
+
+    if {$limit >= 0 && $limit < $length} {
+        set length $limit
+    }
+    set in [open $file rb]
+    seek $in $offset
+    fconfigure $chan -translation binary -buffering full -blocking 1
+    send $rate $chan $in $length
+}
+
+proc respond {chan status headers} {
+    puts $chan "HTTP/1.1 $status"
+    foreach {name value} $headers {
+        puts $chan "$name: $value"
+    }
+    puts $chan "Connection: close"
+    puts $chan ""
+    flush $chan
+}
+
+# Send the body in tenths of the rate every tenth of a second, or all at once
+# if the rate isn't limited.
+proc send {rate chan in length} {
+    set chunk [expr {$rate > 0 ? max(1, $rate / 10) : $length}]
+    set chunk [expr {min($chunk, $length)}]
+    if {[catch {
+        puts -nonewline $chan [read $in $chunk]
+        flush $chan
+    }]} {
+        set length 0
+    } else {
+        incr length -$chunk
+    }
+    if {$length > 0} {
+        after 100 [list send $rate $chan $in $length]
+    } else {
+        close $in
+        finish $chan
+    }
+}
+
+proc finish {chan} {
+    unset -nocomplain ::request($chan)
+    catch {close $chan}
+}
+
+proc main {root {rate 0}} {
+    set server [socket -server [list accept $root $rate] -myaddr 127.0.0.1 0]
+    puts [lindex [fconfigure $server -sockname] 2]
+    flush stdout
+
+    fconfigure stdin -blocking 0
+    fileevent stdin readable {
+        read stdin
+        if {[eof stdin]} {
+            set done 1
+        }
+    }
+    vwait done
+}
+
+main {*}$argv
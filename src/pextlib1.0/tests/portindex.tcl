@@ -0,0 +1,222 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Test file for Pextlib's portindex.
+# Requires r/w access to /tmp/
+# Syntax:
+# tclsh portindex.tcl <Pextlib name>
+
+# Reference implementation of the search, as done by mportsearch on the text
+# PortIndex.
+proc textsearch {index pattern case_sensitive matchstyle field prefix} {
+    set matches [list]
+    set fd [open $index r]
+    while {[gets $fd line] >= 0} {
+        set name [lindex $line 0]
+        set portinfo [read $fd [lindex $line 1]]
+        if {$field eq "name"} {
+            set target $name
+        } elseif {[dict exists $portinfo $field]} {
+            set target [dict get $portinfo $field]
+        } else {
+            continue
+        }
+        set nocase [expr {$case_sensitive ? {} : {-nocase}}]
+        switch -- $matchstyle {
+            exact {
+                set matchres [expr {[string compare {*}$nocase $pattern $target] == 0}]
+            }
+            glob {
+                set matchres [string match {*}$nocase $pattern $target]
+            }
+            regexp {
+                set matchres [regexp {*}$nocase -- $pattern $target]
+            }
+        }
+        if {$matchres} {
+            if {[dict exists $portinfo portdir]} {
+                dict set portinfo porturl ${prefix}/[dict get $portinfo portdir]
+            }
+            lappend matches $name $portinfo
+        }
+    }
+    close $fd
+    return $matches
+}
+
+# Compare two name/portinfo lists as dicts.
+proc same_results {a b} {
+    if {[llength $a] != [llength $b]} {
+        return 0
+    }
+    foreach {aname ainfo} $a {bname binfo} $b {
+        if {$aname ne $bname || [lsort -stride 2 [dict get $ainfo]] ne [lsort -stride 2 [dict get $binfo]]} {
+            return 0
+        }
+    }
+    return 1
+}
+
+proc main {pextlibname} {
+    load $pextlibname
+
+    set textindex "/tmp/macports-pextlib-testindex"
+    set binindex "${textindex}.bin"
+    file delete -force $textindex $binindex
+
+    set ports [list \
+        [list name gcc12 portdir lang/gcc12 version 12.4.0 categories {lang devel} \
+            maintainers {{foo @foo} openmaintainer} description {The GNU compiler collection}] \
+        [list name python312 portdir lang/python312 version 3.12.7 categories {lang python} \
+            description {An interpreted, object-oriented programming language}] \
+        [list name py312-numpy portdir python/py-numpy version 2.1.2 categories {python math} \
+            description {The core utilities for the scientific library scipy for Python}] \
+        [list name Python-Docs portdir python/python-docs version 1.0 categories python \
+            description {Documentation for Python, now with \{braces\} and "quotes"}] \
+        [list name zlib portdir archivers/zlib version 1.3.1 categories archivers \
+            description {zlib lossless data-compression library} depends_lib {}] \
+        [list name noportdir version 1 description {A port without a portdir}] \
+    ]
+    # the PortIndex is written in the system encoding
+    set unicode [expr {[encoding system] eq "utf-8"}]
+    if {$unicode} {
+        lappend ports [list name ünïcode portdir devel/unicode version 1 categories devel \
+            description "Ünïcödé Tëst with KELVIN \u212a sign"]
+    }
+    set fd [open $textindex w]
+    foreach portinfo $ports {
+        set len [expr {[string length $portinfo] + 1}]
+        puts $fd [list [dict get $portinfo name] $len]
+        puts $fd $portinfo
+    }
+    close $fd
+
+    if {[catch {portindex valid $binindex $textindex} res] || $res} {
+        puts "portindex valid reported a missing binary index as valid"
+        exit 1
+    }
+    portindex build $textindex $binindex
+    if {![portindex valid $binindex $textindex]} {
+        puts "portindex valid did not accept a freshly built index"
+        exit 1
+    }
+
+    set prefix "file:///opt/local/var/ports/sources/some dir"
+    set searches {
+        {gcc12 1 exact name}
+        {GCC12 1 exact name}
+        {GCC12 0 exact name}
+        {python* 1 glob name}
+        {PYTHON* 0 glob name}
+        {*numpy 0 glob name}
+        {\[pz\]*lib* 0 glob name}
+        {py 1 regexp name}
+        {{^py[0-9]+-} 1 regexp name}
+        {{(python|gcc)} 1 regexp name}
+        {{python\d+} 1 regexp name}
+        {NuMpY 0 regexp name}
+        {ünï 0 regexp name}
+        {ÜNÏ 0 glob name}
+        {lang 1 regexp categories}
+        {python 1 regexp description}
+        {PYTHON 0 regexp description}
+        {compress 0 regexp description}
+        {{lib{2}} 0 regexp description}
+        {scienti?fic 0 regexp description}
+        {{\x6bELVIN} 0 regexp description}
+        {kelvin 0 regexp description}
+        {{[[:alpha:]]ython} 0 regexp description}
+        {*braces* 0 glob description}
+        {1.3.1 1 exact version}
+        {foo 0 regexp maintainers}
+        {anything 0 regexp nosuchfield}
+        {{} 1 exact depends_lib}
+        {. 1 regexp portdir}
+        {*port* 0 glob description}
+    }
+    foreach search $searches {
+        lassign $search pattern case_sensitive matchstyle field
+        foreach pfx [list $prefix {}] {
+            set expected [textsearch $textindex $pattern $case_sensitive $matchstyle $field $pfx]
+            if {$pfx eq ""} {
+                set expected [list]
+                foreach {name portinfo} [textsearch $textindex $pattern $case_sensitive $matchstyle $field $pfx] {
+                    lappend expected $name [dict remove $portinfo porturl]
+                }
+                set actual [portindex search $binindex $pattern $case_sensitive $matchstyle $field]
+            } else {
+                set actual [portindex search $binindex $pattern $case_sensitive $matchstyle $field $pfx]
+            }
+            if {![same_results $expected $actual]} {
+                puts "portindex search $pattern $case_sensitive $matchstyle $field:"
+                puts "  expected: $expected"
+                puts "  got:      $actual"
+                exit 1
+            }
+        }
+    }
+
+    if {[catch {portindex search $binindex {(} 1 regexp name}]} {
+        # expected
+    } else {
+        puts "portindex search with an invalid regexp did not fail"
+        exit 1
+    }
+
+    set res [portindex lookup $binindex PYTHON312 $prefix]
+    if {[lindex $res 0] ne "python312"
+            || [dict get [lindex $res 1] porturl] ne "${prefix}/lang/python312"} {
+        puts "portindex lookup PYTHON312: $res"
+        exit 1
+    }
+    if {$unicode && [portindex lookup $binindex ÜNÏCODE] eq ""} {
+        puts "portindex lookup ÜNÏCODE did not find ünïcode"
+        exit 1
+    }
+    if {[portindex lookup $binindex nosuchport] ne ""} {
+        puts "portindex lookup nosuchport returned a result"
+        exit 1
+    }
+    set res [portindex lookup $binindex noportdir $prefix]
+    if {[dict exists [lindex $res 1] porturl]} {
+        puts "portindex lookup noportdir added a porturl"
+        exit 1
+    }
+
+    set all [portindex listall $binindex $prefix]
+    if {![same_results [textsearch $textindex {} 1 glob name $prefix] {}]
+            || ![same_results [textsearch $textindex * 1 glob name $prefix] $all]} {
+        puts "portindex listall: $all"
+        exit 1
+    }
+
+    # changing the text index invalidates the binary index
+    after 1100
+    set fd [open $textindex a]
+    puts $fd [list extra 1]
+    puts $fd {}
+    close $fd
+    if {[portindex valid $binindex $textindex]} {
+        puts "portindex valid accepted an outdated index"
+        exit 1
+    }
+    # an updated binary index replaces the mapped one
+    portindex build $textindex $binindex
+    if {![portindex valid $binindex $textindex]
+            || [llength [portindex listall $binindex]] != [expr {2 * [llength $ports] + 2}]} {
+        puts "portindex did not pick up the rebuilt index"
+        exit 1
+    }
+
+    # garbage is rejected
+    set fd [open $binindex w]
+    puts $fd "not a binary PortIndex"
+    close $fd
+    if {![catch {portindex listall $binindex}] || [portindex valid $binindex $textindex]} {
+        puts "portindex accepted an invalid binary index"
+        exit 1
+    }
+
+    file delete -force $textindex $binindex
+}
+
+main $argv
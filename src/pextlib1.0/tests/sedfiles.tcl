@@ -0,0 +1,89 @@
+# -*- coding: utf-8; mode: tcl; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- vim:fenc=utf-8:ft=tcl:et:sw=4:ts=4:sts=4
+
+# Test file for Pextlib's sedfiles.
+# Requires r/w access to /tmp/
+# Syntax:
+# tclsh sedfiles.tcl <Pextlib name>
+
+proc write_file {path contents} {
+    set fd [open $path w]
+    fconfigure $fd -translation binary
+    puts -nonewline $fd $contents
+    close $fd
+}
+
+proc read_file {path} {
+    set fd [open $path r]
+    fconfigure $fd -translation binary
+    set contents [read $fd]
+    close $fd
+    return $contents
+}
+
+proc test_sed {root args} {
+    set expected [lindex $args end]
+    set input [lindex $args end-1]
+    set cmd [lrange $args 0 end-2]
+    write_file $root/in $input
+    set changed [sedfiles {*}$cmd $root/in $root/out]
+    set output [read_file $root/out]
+    if {$output ne $expected} {
+        error "sedfiles $cmd: got [list $output], expected [list $expected]"
+    }
+    if {$changed != ($output ne $input)} {
+        error "sedfiles $cmd: reported changed $changed"
+    }
+}
+
+proc main {pextlibname} {
+    load $pextlibname
+
+    set root "/tmp/macports-pextlib-sedfiles"
+    file delete -force $root
+    file mkdir $root
+
+    try {
+        test_sed $root {s/foo/bar/} "foo foo\nfoo" "bar foo\nbar"
+        test_sed $root {s/foo/bar/g} "foo foo\n" "bar bar\n"
+        test_sed $root {s/o/0/2} "foo\n" "fo0\n"
+        test_sed $root {s/x*/-/g} "abc\n" "-a-b-c-\n"
+        test_sed $root {s|/usr/bin/perl|/opt/local/bin/perl|} "#!/usr/bin/perl -w\n" "#!/opt/local/bin/perl -w\n"
+        test_sed $root {s/\(a\)\(b\)/[\2&\1]/} "ab\n" "\[baba\]\n"
+        test_sed $root -E {s/(a+)b?/<\1>/g} "aab ab\n" "<aa> <a>\n"
+        test_sed $root {s/a\.\*\(b\)\1/x/} "a.*bb\n" "x\n"
+        test_sed $root -E {s/a\+|b\?/x/g} "a+b?\n" "xx\n"
+        test_sed $root {s/a/b/; s/b/c/} "a\n" "c\n"
+        test_sed $root {s/A/b/I} "a\n" "b\n"
+        test_sed $root {s/^$/empty/} "\n\nx" "empty\nempty\nx"
+        test_sed $root {s/nothing/here/} "unchanged\n" "unchanged\n"
+
+        # several files, spread over threads
+        set args [list -threads 4 s/old/new/]
+        for {set i 0} {$i < 20} {incr i} {
+            write_file $root/in$i "old $i\n"
+            lappend args $root/in$i $root/out$i
+        }
+        if {[lsort -unique [sedfiles {*}$args]] ne "1"} {
+            error "sedfiles didn't change all files"
+        }
+        for {set i 0} {$i < 20} {incr i} {
+            if {[read_file $root/out$i] ne "new $i\n"} {
+                error "sedfiles wrote [list [read_file $root/out$i]] for file $i"
+            }
+        }
+
+        foreach script {{/foo/d} {1s/a/b/} {s/a/b/w file} {s/a/\t/} {s/[/]/x/} {s/a/\1/}
+                {s/\t/x/} {s/a\+/x/} {s/a\|b/x/} {s/\<a/x/}} {
+            if {![catch {sedfiles $script $root/in $root/out}] || $::errorCode ne {SEDFILES UNSUPPORTED}} {
+                error "sedfiles accepted unsupported script $script"
+            }
+        }
+        if {![catch {sedfiles s/a/b/ $root/nonexistent $root/out}] || [lindex $::errorCode 0] ne "POSIX"} {
+            error "sedfiles didn't fail for a missing file"
+        }
+    } finally {
+        file delete -force $root
+    }
+}
+
+main $argv
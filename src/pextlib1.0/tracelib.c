@@ -51,7 +51,9 @@
 #if HAVE_SYS_EVENT_H
 #include <sys/event.h>
 #endif
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/un.h>
@@ -62,6 +64,7 @@
 #include <cregistry/entry.h>
 #include <registry2.0/registry.h>
 #include <darwintracelib1.0/sandbox_actions.h>
+#include <darwintracelib1.0/verdict_cache.h>
 
 #if defined(LOCAL_PEERPID) && defined(HAVE_LIBPROC_H)
 #include <libproc.h>
@@ -71,6 +74,7 @@
 #include "tracelib.h"
 
 #include "Pextlib.h"
+#include "sandbox_trie.h"
 
 #include "strlcat.h"
 #include "strlcpy.h"
@@ -86,8 +90,10 @@ static void peerpid_list_walk(bool (*callback)(int sock, pid_t pid, const char *
 
 
 static char *name = NULL;
-static char *sandbox;
+static char *sandbox = NULL;
 static size_t sandboxLength;
+static char *allowAllSandbox = NULL;
+static size_t allowAllSandboxLength;
 static char **depends = NULL;
 static size_t dependsLength = 0;
 static int sock = -1;
@@ -105,10 +111,34 @@ typedef struct path_cache_value {
 } path_cache_value_t;
 /* Querying the SQLite database is surprisingly expensive. Cache all previous
  * lookups we've done in a hash map to avoid hitting the database multiple
- * times for the same entries. */
-static Tcl_HashTable path_cache;
+ * times for the same entries. Worker threads add their results concurrently,
+ * so the map is split into shards that are locked separately. */
+#define PATH_CACHE_SHARDS (16)
+typedef struct path_cache_shard {
+    pthread_mutex_t mutex;
+    Tcl_HashTable table;
+} path_cache_shard_t;
+static path_cache_shard_t path_cache[PATH_CACHE_SHARDS];
 static bool path_cache_initialized = false;
 
+/* The contents of path_cache are also published to traced processes in
+ * a shared memory mapping of the file verdict_cache_path, so they can skip
+ * the round trip over the socket for paths that have been checked before.
+ * See darwintracelib1.0/verdict_cache.h for the format. The slots and
+ * entries are looked up in private copies, so nothing traced processes can
+ * do to the file affects tracelib. They count hits and misses in the
+ * mapping of verdict_stats_path. */
+static char *verdict_cache_path = NULL;
+static char *verdict_cache = NULL;
+static verdict_cache_slot_t *verdict_slots = NULL;
+static char *verdict_entries = NULL;
+static uint32_t verdict_cache_used;
+static uint32_t verdict_cache_entries;
+static char *verdict_stats_path = NULL;
+static verdict_cache_stats_t *verdict_stats = NULL;
+/* serializes writers of the verdict cache */
+static pthread_mutex_t verdict_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Mutex that shall be acquired to exclusively lock checking and acting upon
  * the value of kq, indicating whether the event loop has started. If it has
@@ -131,14 +161,84 @@ static pthread_mutex_t evloop_mutex = PTHREAD_MUTEX_INITIALIZER;
  */
 static pthread_cond_t evloop_signal = PTHREAD_COND_INITIALIZER;
 
-static void send_file_map(int sock);
-static void dep_check(int sock, char *path);
+#define MAX_SOCKETS (64)
+#define BUFSIZE     (4096)
+
+/**
+ * State of a connection to a traced process. Clients may send several
+ * messages at once (darwintrace buffers messages that do not expect an
+ * answer), so everything available on the socket is read at once, all
+ * complete messages are processed and the answers are sent together.
+ */
+typedef struct tracelib_conn {
+    struct tracelib_conn *next;
+    int sock;
+    /* received data not yet processed, at most one incomplete message */
+    size_t inlen;
+    char inbuf[4 * BUFSIZE];
+    /* answers not yet sent */
+    char *outbuf;
+    size_t outlen;
+    size_t outcap;
+    bool outerror;
+    /* a dep_check request from this connection is being handled by a worker
+     * thread; further messages are processed once it has been answered */
+    bool busy;
+    /* the remote side has closed the connection */
+    bool eof;
+} tracelib_conn_t;
+
+/* all open connections, to free them when the event loop ends */
+static tracelib_conn_t *connections = NULL;
+
+#define MAX_WORKERS (16)
+
+/**
+ * A dep_check request handed to a worker thread. The worker sets the verdict
+ * and moves the job to the list of finished jobs, from where the event loop
+ * sends the verdict to the connection.
+ */
+typedef struct dep_check_job {
+    struct dep_check_job *next;
+    tracelib_conn_t *conn;
+    char verdict;
+    char path[];
+} dep_check_job_t;
+
+/**
+ * A thread answering dep_check requests using its own read-only connection
+ * to the registry, so that requests from many traced processes can be
+ * answered concurrently.
+ */
+typedef struct tracelib_worker {
+    pthread_t thread;
+    reg_registry *reg;
+    mount_cs_cache_t *mount_cs_cache;
+} tracelib_worker_t;
+
+/* number of workers to start in tracelib run, see tracelib setworkers */
+static unsigned int worker_count = 0;
+static tracelib_worker_t workers[MAX_WORKERS];
+static unsigned int workers_running = 0;
+/* protects the job queue, the list of finished jobs and workers_stopping */
+static pthread_mutex_t workers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workers_signal = PTHREAD_COND_INITIALIZER;
+static dep_check_job_t *jobs_head = NULL;
+static dep_check_job_t **jobs_tail = &jobs_head;
+static dep_check_job_t *jobs_done = NULL;
+static bool workers_stopping = false;
+/* workers write a byte to this pipe after finishing a job to wake up the
+ * event loop */
+static int donepipe[2] = {-1, -1};
+
+static void send_file_map(tracelib_conn_t *conn);
+static void dep_check(tracelib_conn_t *conn, char *path);
 
 typedef enum {
     SANDBOX_UNKNOWN,
     SANDBOX_VIOLATION
 } sandbox_violation_t;
-static void sandbox_violation(int sock, const char *path, sandbox_violation_t type);
+static void sandbox_violation(tracelib_conn_t *conn, const char *path, sandbox_violation_t type);
 
 #ifdef HAVE_PEERPID_LIST
 typedef struct _peerpid {
@@ -264,33 +364,158 @@ static void peerpid_list_walk(bool (*callback)(int sock, pid_t pid, const char *
 }
 #endif /* defined(HAVE_PEERPID_LIST) */
 
-#define MAX_SOCKETS (64)
-#define BUFSIZE     (4096)
-
 /**
- * send a buffer \c buf with the given length \c size to the socket \c sock, by
- * using the communication protocol between darwintrace and tracelib (i.e., by
- * prefixing the code with a uint32_t containing the length of the message)
+ * Queue a buffer \c buf with the given length \c size to be sent to the
+ * connection \c conn, by using the communication protocol between darwintrace
+ * and tracelib (i.e., by prefixing the code with a uint32_t containing the
+ * length of the message). Queued answers are sent by \c send_answers.
  *
- * \param[in] sock the socket to send to
+ * \param[in] conn the connection to send to
  * \param[in] buf the buffer to send, should contain at least \c size bytes
  * \param[in] size the number of bytes in \c buf
  */
-static void answer_s(int sock, const char *buf, uint32_t size) {
-    send(sock, &size, sizeof(size), 0);
-    send(sock, buf, size, 0);
+static void answer_s(tracelib_conn_t *conn, const char *buf, uint32_t size) {
+    size_t needed = conn->outlen + sizeof(size) + size;
+
+    if (needed > conn->outcap) {
+        size_t newcap = conn->outcap ? conn->outcap : BUFSIZE;
+        char *newbuf;
+        while (newcap < needed) {
+            newcap *= 2;
+        }
+        if (NULL == (newbuf = realloc(conn->outbuf, newcap))) {
+            fprintf(stderr, "tracelib: out of memory queueing answer on socket %d\n", conn->sock);
+            conn->outerror = true;
+            return;
+        }
+        conn->outbuf = newbuf;
+        conn->outcap = newcap;
+    }
+    memcpy(conn->outbuf + conn->outlen, &size, sizeof(size));
+    memcpy(conn->outbuf + conn->outlen + sizeof(size), buf, size);
+    conn->outlen = needed;
 }
 
 /**
- * send a '\0'-terminated string given in \c buf to the socket \c by using the
- * communication protocol between darwintrace and tracelib. See \c answer_s for
- * details.
+ * Queue a '\0'-terminated string given in \c buf to be sent to the connection
+ * \c conn by using the communication protocol between darwintrace and
+ * tracelib. See \c answer_s for details.
  *
- * \param[in] sock the socket to send to
+ * \param[in] conn the connection to send to
  * \param[in] buf the string to send; must be \0-terminated
  */
-static void answer(int sock, const char *buf) {
-    answer_s(sock, buf, (uint32_t) strlen(buf));
+static void answer(tracelib_conn_t *conn, const char *buf) {
+    answer_s(conn, buf, (uint32_t) strlen(buf));
+}
+
+/**
+ * Send all queued answers to the connection \c conn with as few send(2) calls
+ * as possible.
+ *
+ * \param[in] conn the connection whose answers should be sent
+ * \return 1 on success, 0 if the connection should be closed
+ */
+static int send_answers(tracelib_conn_t *conn) {
+    size_t sent = 0;
+
+    if (conn->outerror) {
+        return 0;
+    }
+    while (sent < conn->outlen) {
+        ssize_t ret = send(conn->sock, conn->outbuf + sent, conn->outlen - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("tracelib: send");
+            return 0;
+        }
+        sent += ret;
+    }
+    conn->outlen = 0;
+    return 1;
+}
+
+/**
+ * Allocate the state for a new connection and add it to the list of
+ * connections.
+ *
+ * \param[in] sock the socket of the connection
+ * \return the new connection, or NULL if memory allocation failed
+ */
+static tracelib_conn_t *conn_new(int sock) {
+    tracelib_conn_t *conn = malloc(sizeof(*conn));
+    if (!conn) {
+        return NULL;
+    }
+    conn->sock = sock;
+    conn->inlen = 0;
+    conn->outbuf = NULL;
+    conn->outlen = 0;
+    conn->outcap = 0;
+    conn->outerror = false;
+    conn->busy = false;
+    conn->eof = false;
+    conn->next = connections;
+    connections = conn;
+    return conn;
+}
+
+/**
+ * Remove a connection from the list of connections and free it. Does not
+ * close its socket.
+ *
+ * \param[in] conn the connection to free
+ */
+static void conn_free(tracelib_conn_t *conn) {
+    tracelib_conn_t **ref = &connections;
+    while (*ref) {
+        if (*ref == conn) {
+            *ref = conn->next;
+            break;
+        }
+        ref = &(*ref)->next;
+    }
+    free(conn->outbuf);
+    free(conn);
+}
+
+/**
+ * Close the socket of a connection and free it. Closing the socket will
+ * automatically remove it from the kqueue.
+ *
+ * \param[in] conn the connection to close
+ */
+static void conn_close(tracelib_conn_t *conn) {
+    int s = conn->sock;
+
+    close(s);
+    conn_free(conn);
+
+#ifdef HAVE_PEERPID_LIST
+    if (peerpid_list_dequeue(s) == (pid_t) -1) {
+        fprintf(stderr, "tracelib: didn't find PID for closed socket %d\n", s);
+    }
+#endif
+}
+
+/**
+ * Enable or disable events for the socket of a connection in the kqueue.
+ * While a worker thread handles a request from a connection, the traced
+ * process waits for the answer and will not send anything else, but the
+ * remote side might still close the socket, which should not wake up the
+ * event loop until the answer is available.
+ *
+ * \param[in] conn the connection
+ * \param[in] enable whether events should be enabled or disabled
+ */
+static void conn_set_enabled(tracelib_conn_t *conn, bool enable) {
+    struct kevent kev;
+
+    EV_SET(&kev, conn->sock, EVFILT_READ, enable ? EV_ENABLE : EV_DISABLE, 0, 0, conn);
+    if (-1 == kevent(kq, &kev, 1, NULL, 0, NULL)) {
+        perror("tracelib: kevent");
+    }
 }
 
 /**
@@ -366,7 +591,8 @@ static int TracelibSetNameCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[
  * \return a Tcl return code
  */
 static int TracelibSetSandboxCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
-    char *src, *dst;
+    char *src, *dst, *filemap, *trie;
+    uint32_t trieLength;
     enum { NORMAL, ACTION, ESCAPE } state = NORMAL;
 
     if (objc != 3) {
@@ -375,13 +601,12 @@ static int TracelibSetSandboxCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const ob
     }
 
     src = Tcl_GetString(objv[2]);
-    sandboxLength = strlen(src) + 2;
-    sandbox = malloc(sandboxLength);
-    if (!sandbox) {
+    filemap = malloc(strlen(src) + 2);
+    if (!filemap) {
         Tcl_SetResult(interp, "memory allocation failed", TCL_STATIC);
         return TCL_ERROR;
     }
-    for (dst = sandbox; *src != '\0'; src++) {
+    for (dst = filemap; *src != '\0'; src++) {
         switch (*src) {
             case '\\':
                 if (state == ESCAPE) {
@@ -405,7 +630,7 @@ static int TracelibSetSandboxCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const ob
                     state = NORMAL;
                 } else {
                     /* unescaped : should never occur in normal state */
-                    free(sandbox);
+                    free(filemap);
                     Tcl_SetResult(interp, "Unexpected colon before action specification.", TCL_STATIC);
                     return TCL_ERROR;
                 }
@@ -445,13 +670,13 @@ static int TracelibSetSandboxCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const ob
             default:
                 if (state == ESCAPE) {
                     /* unknown escape sequence, free buffer and raise an error */
-                    free(sandbox);
+                    free(filemap);
                     Tcl_SetResult(interp, "Unknown escape sequence.", TCL_STATIC);
                     return TCL_ERROR;
                 }
                 if (state == ACTION) {
                     /* unknown control character, free buffer and raise an error */
-                    free(sandbox);
+                    free(filemap);
                     Tcl_SetResult(interp, "Unknown control character. Possible values are +, -, and ?.", TCL_STATIC);
                     return TCL_ERROR;
                 }
@@ -464,57 +689,35 @@ static int TracelibSetSandboxCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const ob
     *dst++ = '\0';
     *dst = '\0';
 
+    /* darwintrace looks up every path it checks in the sandbox, so send it
+     * a prefix tree instead of the list */
+    trie = sandbox_trie_compile(filemap, &trieLength);
+    free(filemap);
+    if (!trie) {
+        Tcl_SetResult(interp, "memory allocation failed", TCL_STATIC);
+        return TCL_ERROR;
+    }
+    free(sandbox);
+    sandbox = trie;
+    sandboxLength = trieLength;
+
     return TCL_OK;
 }
 
 /**
- * Receive line from socket, parse it and send an answer, if necessary. The
- * caller should ensure that data is available for reading from the given
- * socket. This method will block until a complete message has been read.
+ * Parse a single message received from a connection and queue an answer, if
+ * necessary.
  *
- * \param[in] sock the socket to communicate with
- * \return 1, if the communication was successful, 0 in case of errors and/or
- *         when the socket should be closed
+ * \param[in] conn the connection the message was received from
+ * \param[in] buf the message; must be \0-terminated
+ * \return 1, if the message was valid, 0 if the connection should be closed
  */
-static int process_line(int sock) {
+static int process_message(tracelib_conn_t *conn, char *buf) {
     char *f;
-    char buf[BUFSIZE];
-    uint32_t len = 0;
-    ssize_t ret;
-
-    if ((ret = recv(sock, &len, sizeof(len), MSG_WAITALL)) != sizeof(len)) {
-        if (ret < 0) {
-            perror("tracelib: recv");
-        } else if (ret == 0) {
-            /* this usually means the socket was closed by the remote side */
-        } else {
-            fprintf(stderr, "tracelib: partial data received: expected %zu, but got %zd on socket %d\n", sizeof(len), ret, sock);
-        }
-        return 0;
-    }
-
-    if (len > BUFSIZE - 1) {
-        pid_t pid = (pid_t) -1;
-#ifdef HAVE_PEERPID_LIST
-        pid = peerpid_list_get(sock, NULL);
-#endif
-        fprintf(stderr, "tracelib: transfer too large: %" PRIu32 " bytes sent, but buffer holds %d on socket %d from pid %ld\n", len, BUFSIZE - 1, sock, (unsigned long) pid);
-        return 0;
-    }
-
-    if ((ret = recv(sock, buf, len, MSG_WAITALL)) != (ssize_t) len) {
-        if (ret < 0) {
-            perror("tracelib: recv");
-        } else {
-            fprintf(stderr, "tracelib: partial data received: expected %" PRIu32 ", but got %zd on socket %d\n", len, ret, sock);
-        }
-        return 0;
-    }
-    buf[len] = '\0';
 
     f = strchr(buf, '\t');
     if (!f) {
-        fprintf(stderr, "tracelib: malformed command '%s' from socket %d\n", buf, sock);
+        fprintf(stderr, "tracelib: malformed command '%s' from socket %d\n", buf, conn->sock);
         return 0;
     }
 
@@ -524,13 +727,13 @@ static int process_line(int sock) {
     f++;
 
     if (strcmp(buf, "filemap") == 0) {
-        send_file_map(sock);
+        send_file_map(conn);
     } else if (strcmp(buf, "sandbox_unknown") == 0) {
-        sandbox_violation(sock, f, SANDBOX_UNKNOWN);
+        sandbox_violation(conn, f, SANDBOX_UNKNOWN);
     } else if (strcmp(buf, "sandbox_violation") == 0) {
-        sandbox_violation(sock, f, SANDBOX_VIOLATION);
+        sandbox_violation(conn, f, SANDBOX_VIOLATION);
     } else if (strcmp(buf, "dep_check") == 0) {
-        dep_check(sock, f);
+        dep_check(conn, f);
     } else {
         fprintf(stderr, "tracelib: unexpected command %s (%s)\n", buf, f);
         return 0;
@@ -539,18 +742,125 @@ static int process_line(int sock) {
     return 1;
 }
 
+/**
+ * Process the complete messages received from a connection that have not
+ * been processed yet and send the answers to those that need one. Stops
+ * early if a worker thread has to answer a message.
+ *
+ * \param[in] conn the connection to communicate with
+ * \return 1, if the communication was successful, 0 in case of errors and/or
+ *         when the socket should be closed
+ */
+static int process_buffered(tracelib_conn_t *conn) {
+    char buf[BUFSIZE];
+    size_t pos = 0;
+    uint32_t len;
+    int result = 1;
+
+    while (result && !conn->busy && conn->inlen - pos >= sizeof(len)) {
+        memcpy(&len, conn->inbuf + pos, sizeof(len));
+        if (len > BUFSIZE - 1) {
+            pid_t pid = (pid_t) -1;
+#ifdef HAVE_PEERPID_LIST
+            pid = peerpid_list_get(conn->sock, NULL);
+#endif
+            fprintf(stderr, "tracelib: transfer too large: %" PRIu32 " bytes sent, but buffer holds %d on socket %d from pid %ld\n", len, BUFSIZE - 1, conn->sock, (unsigned long) pid);
+            return 0;
+        }
+        if (conn->inlen - pos - sizeof(len) < len) {
+            /* the rest of this message has not arrived yet */
+            break;
+        }
+
+        memcpy(buf, conn->inbuf + pos + sizeof(len), len);
+        buf[len] = '\0';
+        pos += sizeof(len) + len;
+
+        result = process_message(conn, buf);
+    }
+
+    memmove(conn->inbuf, conn->inbuf + pos, conn->inlen - pos);
+    conn->inlen -= pos;
+
+    if (!send_answers(conn)) {
+        return 0;
+    }
+    return result;
+}
+
+/**
+ * Receive the data available on a connection, process all complete messages
+ * in it and send the answers to those that need one. The caller should ensure
+ * that data is available for reading from the connection's socket; this
+ * function will not block waiting for further messages. Must not be called
+ * while a worker thread handles a message from the connection.
+ *
+ * \param[in] conn the connection to communicate with
+ * \return 1, if the communication was successful, 0 in case of errors and/or
+ *         when the socket should be closed
+ */
+static int process_messages(tracelib_conn_t *conn) {
+    ssize_t ret;
+
+    do {
+        ret = recv(conn->sock, conn->inbuf + conn->inlen, sizeof(conn->inbuf) - conn->inlen, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret <= 0) {
+        if (ret < 0) {
+            perror("tracelib: recv");
+        } else if (conn->inlen > 0) {
+            fprintf(stderr, "tracelib: partial data received: %zu bytes left on socket %d\n", conn->inlen, conn->sock);
+        } else {
+            /* this usually means the socket was closed by the remote side */
+        }
+        return 0;
+    }
+    conn->inlen += ret;
+
+    return process_buffered(conn);
+}
+
+/**
+ * Process the messages a connection sent before the remote side closed it
+ * (darwintrace flushes its buffered messages right before closing).
+ *
+ * \param[in] conn the connection that has been closed by the remote side
+ * \return 1, if the connection has to stay open until a worker thread has
+ *         answered one of its messages, 0 if it should be closed now
+ */
+static int process_remaining(tracelib_conn_t *conn) {
+    conn->eof = true;
+    while (!conn->busy) {
+        if (!process_messages(conn)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 /**
  * Construct an in-memory representation of the sandbox file map and send it to
  * the socket indicated by \c sock.
  *
- * \param[in] sock the socket to send the sandbox bounds to
+ * \param[in] conn the connection to send the sandbox bounds to
  */
-static void send_file_map(int sock) {
+static void send_file_map(tracelib_conn_t *conn) {
     if (enable_fence) {
-        answer_s(sock, sandbox, sandboxLength);
+        answer_s(conn, sandbox, sandboxLength);
     } else {
-        char allowAllSandbox[5] = {'/', '\0', FILEMAP_ALLOW, '\0', '\0'};
-        answer_s(sock, allowAllSandbox, sizeof(allowAllSandbox));
+        if (!allowAllSandbox) {
+            char filemap[5] = {'/', '\0', FILEMAP_ALLOW, '\0', '\0'};
+            uint32_t length;
+
+            allowAllSandbox = sandbox_trie_compile(filemap, &length);
+            if (!allowAllSandbox) {
+                fprintf(stderr, "tracelib: failed to compile sandbox for socket %d\n", conn->sock);
+                conn->outerror = true;
+                return;
+            }
+            allowAllSandboxLength = length;
+        }
+        answer_s(conn, allowAllSandbox, allowAllSandboxLength);
     }
 }
 
@@ -558,10 +868,10 @@ static void send_file_map(int sock) {
  * Process a sandbox violation reported by darwintrace. Calls back up to Tcl to
  * run a callback with the reported violation path.
  *
- * \param[in] sock socket reporting the violation; unused.
+ * \param[in] conn connection reporting the violation; unused.
  * \param[in] path the offending path to be passed to the callback
  */
-static void sandbox_violation(int sock UNUSED, const char *path, sandbox_violation_t type) {
+static void sandbox_violation(tracelib_conn_t *conn UNUSED, const char *path, sandbox_violation_t type) {
     Tcl_SetVar(interp, "_sandbox_viol_path", path, 0);
     int retVal = TCL_OK;
     switch (type) {
@@ -580,6 +890,199 @@ static void sandbox_violation(int sock UNUSED, const char *path, sandbox_violati
     Tcl_UnsetVar(interp, "_sandbox_viol_path", 0);
 }
 
+/**
+ * Create a file of the given size and mode next to the socket, map it and
+ * move it into place. The file is set up under a temporary name, so traced
+ * processes never see it uninitialized.
+ *
+ * \param[in] suffix appended to the socket path to form the path of the file
+ * \param[in] size the size of the file
+ * \param[in] mode the permissions of the file
+ * \param[in] init called to initialize the mapping before it is moved into
+ *                 place, or NULL
+ * \param[out] pathPtr the path of the file, to be freed by the caller
+ * \return the writable mapping of the file, or NULL on error
+ */
+static void *verdict_file_create(const char *suffix, size_t size, mode_t mode,
+        void (*init)(void *), char **pathPtr) {
+    size_t pathlen = strlen(name) + strlen(suffix) + 1;
+    char *path = NULL;
+    char *tmppath = NULL;
+    void *map;
+    int fd, errsave;
+
+    if (NULL == (path = malloc(pathlen))
+            || NULL == (tmppath = malloc(pathlen + 7))) {
+        goto error;
+    }
+    snprintf(path, pathlen, "%s%s", name, suffix);
+    snprintf(tmppath, pathlen + 7, "%s.XXXXXX", path);
+
+    if (-1 == (fd = mkstemp(tmppath))) {
+        goto error;
+    }
+    /* Traced processes may run as a different user, see the chmod(2) of
+     * the socket. */
+    if (-1 == fchmod(fd, mode) || -1 == ftruncate(fd, (off_t) size)) {
+        close(fd);
+        goto error_unlink;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        goto error_unlink;
+    }
+    if (init) {
+        init(map);
+    }
+    if (-1 == rename(tmppath, path)) {
+        munmap(map, size);
+        goto error_unlink;
+    }
+
+    free(tmppath);
+    *pathPtr = path;
+    return map;
+
+error_unlink:
+    errsave = errno;
+    unlink(tmppath);
+    errno = errsave;
+error:
+    free(tmppath);
+    free(path);
+    return NULL;
+}
+
+static void verdict_cache_init_header(void *map) {
+    verdict_cache_header_t *header = map;
+
+    header->magic = VERDICT_CACHE_MAGIC;
+    header->version = VERDICT_CACHE_VERSION;
+    header->slots = VERDICT_CACHE_SLOTS;
+    header->entries_size = VERDICT_CACHE_ENTRIES_SIZE;
+}
+
+/**
+ * Create the shared verdict cache and the file for its statistics next to
+ * the socket. Failure is not fatal; traced processes will then ask over the
+ * socket for every path.
+ */
+static void verdict_cache_create(void) {
+    size_t size = verdict_cache_size(VERDICT_CACHE_SLOTS, VERDICT_CACHE_ENTRIES_SIZE);
+
+    /* the private copies are only written to as entries are added */
+    if (NULL == (verdict_slots = calloc(VERDICT_CACHE_SLOTS, sizeof(*verdict_slots)))
+            || NULL == (verdict_entries = malloc(VERDICT_CACHE_ENTRIES_SIZE))) {
+        goto error;
+    }
+    /* only tracelib may change the verdicts */
+    if (NULL == (verdict_cache = verdict_file_create(VERDICT_CACHE_SUFFIX, size, 0644,
+                    verdict_cache_init_header, &verdict_cache_path))) {
+        goto error;
+    }
+    /* offset 0 marks empty slots */
+    verdict_cache_used = 1;
+    verdict_cache_entries = 0;
+
+    /* The cache works without statistics. They are only ever read, so it
+     * doesn't matter what traced processes write to them. */
+    verdict_stats = verdict_file_create(VERDICT_CACHE_STATS_SUFFIX, sizeof(verdict_cache_stats_t),
+            0666, NULL, &verdict_stats_path);
+    return;
+
+error:
+    ui_debug(interp, "tracelib: not using a shared verdict cache: %s", strerror(errno));
+    free(verdict_slots);
+    verdict_slots = NULL;
+    free(verdict_entries);
+    verdict_entries = NULL;
+}
+
+/**
+ * Publish the verdict for a path in the shared verdict cache. Silently does
+ * nothing if the cache is full.
+ *
+ * \param[in] path the path as sent by darwintrace
+ * \param[in] verdict the answer sent for this path
+ */
+static void verdict_cache_insert(const char *path, char verdict) {
+    verdict_cache_slot_t *slots;
+    char *entries;
+    uint32_t hash, mask, i;
+    size_t len;
+
+    if (!verdict_cache) {
+        return;
+    }
+    len = strlen(path) + 2;
+    /* keep the load factor below 1/2 to keep probe sequences short */
+    if (verdict_cache_entries >= VERDICT_CACHE_SLOTS / 2
+            || len > VERDICT_CACHE_ENTRIES_SIZE - verdict_cache_used) {
+        return;
+    }
+
+    hash = verdict_cache_hash(path);
+    mask = VERDICT_CACHE_SLOTS - 1;
+    for (i = hash & mask; verdict_slots[i].offset != 0; i = (i + 1) & mask) {
+        if (verdict_slots[i].hash == hash
+                && strcmp(verdict_entries + verdict_slots[i].offset + 1, path) == 0) {
+            return;
+        }
+    }
+
+    verdict_entries[verdict_cache_used] = verdict;
+    memcpy(verdict_entries + verdict_cache_used + 1, path, len - 1);
+    verdict_slots[i].hash = hash;
+    verdict_slots[i].offset = verdict_cache_used;
+
+    /* publish it, the entry before the slot that references it */
+    slots = (verdict_cache_slot_t *) (verdict_cache + VERDICT_CACHE_HEADER_SIZE);
+    entries = (char *) (slots + VERDICT_CACHE_SLOTS);
+    memcpy(entries + verdict_cache_used, verdict_entries + verdict_cache_used, len);
+    slots[i].hash = hash;
+    VERDICT_CACHE_BARRIER();
+    slots[i].offset = verdict_cache_used;
+
+    verdict_cache_used += (uint32_t) len;
+    verdict_cache_entries++;
+}
+
+/**
+ * Report the hit rate of the shared verdict cache and remove it.
+ */
+static void verdict_cache_destroy(void) {
+    if (verdict_stats) {
+        uint64_t hits = VERDICT_CACHE_COUNTER_GET(verdict_stats->hits);
+        uint64_t misses = VERDICT_CACHE_COUNTER_GET(verdict_stats->misses);
+
+        if (hits + misses > 0) {
+            ui_debug(interp, "tracelib: verdict cache: %" PRIu32 " entries, %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate)",
+                    verdict_cache_entries, hits, misses, 100.0 * hits / (hits + misses));
+        }
+        munmap(verdict_stats, sizeof(verdict_cache_stats_t));
+        verdict_stats = NULL;
+    }
+    if (verdict_stats_path) {
+        unlink(verdict_stats_path);
+        free(verdict_stats_path);
+        verdict_stats_path = NULL;
+    }
+    if (verdict_cache) {
+        munmap(verdict_cache, verdict_cache_size(VERDICT_CACHE_SLOTS, VERDICT_CACHE_ENTRIES_SIZE));
+        verdict_cache = NULL;
+    }
+    if (verdict_cache_path) {
+        unlink(verdict_cache_path);
+        free(verdict_cache_path);
+        verdict_cache_path = NULL;
+    }
+    free(verdict_slots);
+    verdict_slots = NULL;
+    free(verdict_entries);
+    verdict_entries = NULL;
+}
+
 /**
  * Internal helper function to compare two strings.
  */
@@ -588,51 +1091,103 @@ static int pointer_strcasecmp(const char** a, const char** b) {
 }
 
 /**
- * Check whether a path is in the transitive hull of dependencies of the port
- * currently being installed and send the result of the query back to the
- * socket.
+ * Initialize the path cache.
+ */
+static void path_cache_init(void) {
+    for (size_t i = 0; i < PATH_CACHE_SHARDS; ++i) {
+        pthread_mutex_init(&path_cache[i].mutex, NULL);
+        Tcl_InitHashTable(&path_cache[i].table, TCL_STRING_KEYS);
+    }
+    path_cache_initialized = true;
+}
+
+/**
+ * Free the path cache, if it has been initialized.
+ */
+static void path_cache_destroy(void) {
+    if (path_cache_initialized) {
+        for (size_t i = 0; i < PATH_CACHE_SHARDS; ++i) {
+            Tcl_DeleteHashTable(&path_cache[i].table);
+            pthread_mutex_destroy(&path_cache[i].mutex);
+        }
+        path_cache_initialized = false;
+    }
+}
+
+/**
+ * Return the shard of the path cache responsible for a path.
+ */
+static path_cache_shard_t *path_cache_shard(const char *path) {
+    return &path_cache[verdict_cache_hash(path) % PATH_CACHE_SHARDS];
+}
+
+/**
+ * Look up the cached answer to a dep_check request.
  *
- * Sends one of the following characters as return code to the socket:
- *  - #: in case of errors. Not handled by the darwintrace code, which will
- *       lead to an error and the termination of the processing that sent the
- *       request causing this error.
- *  - ?: if the file isn't known to MacPorts (i.e., not registered to any port)
- *  - +: if the file was installed by a dependency and access should be granted
- *  - !: if the file was installed by a MacPorts port which is not in the
- *       transitive hull of dependencies and access should be denied.
+ * \param[in] path the path as sent by darwintrace
+ * \return the cached answer, or '\0' if the path is not in the cache
+ */
+static char path_cache_get(const char *path) {
+    path_cache_shard_t *shard = path_cache_shard(path);
+    Tcl_HashEntry *cache_entry;
+    char verdict = '\0';
+
+    pthread_mutex_lock(&shard->mutex);
+    cache_entry = Tcl_FindHashEntry(&shard->table, path);
+    if (cache_entry) {
+        verdict = (char) (intptr_t) Tcl_GetHashValue(cache_entry);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return verdict;
+}
+
+/**
+ * Cache the answer to a dep_check request, both for this process and for
+ * traced processes. Can be called from any thread.
+ *
+ * \param[in] path the path as sent by darwintrace
+ * \param[in] verdict the answer sent for this path
+ */
+static void path_cache_put(const char *path, char verdict) {
+    path_cache_shard_t *shard = path_cache_shard(path);
+    Tcl_HashEntry *cache_entry;
+    int is_new = 0;
+
+    pthread_mutex_lock(&shard->mutex);
+    cache_entry = Tcl_CreateHashEntry(&shard->table, path, &is_new);
+    Tcl_SetHashValue(cache_entry, (ClientData) (intptr_t) verdict);
+    pthread_mutex_unlock(&shard->mutex);
+
+    pthread_mutex_lock(&verdict_cache_mutex);
+    verdict_cache_insert(path, verdict);
+    pthread_mutex_unlock(&verdict_cache_mutex);
+}
+
+/**
+ * Determine whether a path is in the transitive hull of dependencies of the
+ * port currently being installed by looking up its owner in the registry.
+ * Worker threads call this with their own registry and mount point cache and
+ * without an interpreter.
  *
- * \param[in] sock the socket to answer to
+ * \param[in] interp the interpreter to report errors to, or NULL
+ * \param[in] reg the registry to query
+ * \param[in] cs_cache the cache of file system case-sensitivity to use
  * \param[in] path the path to return the dependency information for
+ * \return the answer to send, see \c dep_check
  */
-static void dep_check(int sock, char *path) {
+static char dep_check_verdict(Tcl_Interp *interp, reg_registry *reg, mount_cs_cache_t *cs_cache, char *path) {
     char *port = 0;
     int fs_cs = -1;
-    int is_new = 0;
-    reg_registry *reg;
+    char verdict;
     reg_entry entry;
     reg_error error;
 
-    Tcl_HashEntry *cache_entry = Tcl_FindHashEntry(&path_cache, path);
-    if (cache_entry) {
-        const char* cache_value = Tcl_GetHashValue(cache_entry);
-        if (cache_value != NULL) {
-            answer(sock, cache_value);
-            return;
-        }
-    }
-
-    if (NULL == (reg = registry_for(interp, reg_attached))) {
-        ui_error(interp, "%s", Tcl_GetStringResult(interp));
-        /* send unexpected output to make the build fail; do not cache */
-        answer(sock, "#");
-    }
-
 #ifdef __APPLE__
-    fs_cs = fs_case_sensitive_darwin(interp, path, mount_cs_cache);
+    fs_cs = fs_case_sensitive_darwin(interp, path, cs_cache);
 #endif /* __APPLE__ */
 
     if (-1 == fs_cs) {
-        fs_cs = fs_case_sensitive_fallback(interp, path, mount_cs_cache);
+        fs_cs = fs_case_sensitive_fallback(interp, path, cs_cache);
     }
 
     if (-1 == fs_cs) {
@@ -648,38 +1203,308 @@ static void dep_check(int sock, char *path) {
     entry.proc = NULL;
     entry.id = reg_entry_owner_id(reg, path, fs_cs);
     if (entry.id == 0) {
-        /* file isn't known to MacPorts, cache this result */
-        Tcl_HashEntry *cache_entry = Tcl_CreateHashEntry(&path_cache, path, &is_new);
-        Tcl_SetHashValue(cache_entry, "?");
-
-        answer(sock, "?");
-        return;
+        /* file isn't known to MacPorts */
+        return '?';
     }
 
     /* find the port's name to compare with out list */
     if (!reg_entry_propget(&entry, "name", &port, &error)) {
-        /* send unexpected output to make the build fail, but do not cache this result */
         ui_error(interp, "%s", error.description);
-        answer(sock, "#");
+        reg_error_destruct(&error);
+        return '#';
     }
 
     /* check our list of dependencies; use binary search on sorted list */
     if (NULL != bsearch(&port, depends, dependsLength, sizeof(*depends),
                         (int (*)(const void*, const void*)) pointer_strcasecmp)) {
-        free(port);
-        /* access granted, cache this result */
-        Tcl_HashEntry *cache_entry = Tcl_CreateHashEntry(&path_cache, path, &is_new);
-        Tcl_SetHashValue(cache_entry, "+");
+        /* access granted */
+        verdict = '+';
+    } else {
+        /* access denied */
+        verdict = '!';
+    }
+    free(port);
+    return verdict;
+}
+
+/**
+ * Hand a dep_check request to the worker threads. The connection will not be
+ * processed further until the answer has been sent.
+ *
+ * \param[in] conn the connection to answer to
+ * \param[in] path the path to return the dependency information for
+ * \return true if a worker will answer the request, false on errors
+ */
+static bool dep_check_enqueue(tracelib_conn_t *conn, const char *path) {
+    size_t len = strlen(path) + 1;
+    dep_check_job_t *job = malloc(sizeof(*job) + len);
+
+    if (!job) {
+        return false;
+    }
+    job->next = NULL;
+    job->conn = conn;
+    job->verdict = '\0';
+    memcpy(job->path, path, len);
+
+    pthread_mutex_lock(&workers_mutex);
+    *jobs_tail = job;
+    jobs_tail = &job->next;
+    pthread_cond_signal(&workers_signal);
+    pthread_mutex_unlock(&workers_mutex);
+
+    conn->busy = true;
+    conn_set_enabled(conn, false);
+    return true;
+}
+
+/**
+ * Main function of the worker threads: answer queued dep_check requests until
+ * the workers are stopped.
+ *
+ * \param[in] arg the tracelib_worker_t of this thread
+ */
+static void *dep_check_worker(void *arg) {
+    tracelib_worker_t *worker = arg;
+    dep_check_job_t *job;
+
+    for (;;) {
+        pthread_mutex_lock(&workers_mutex);
+        while (!jobs_head && !workers_stopping) {
+            pthread_cond_wait(&workers_signal, &workers_mutex);
+        }
+        if (workers_stopping) {
+            pthread_mutex_unlock(&workers_mutex);
+            return NULL;
+        }
+        job = jobs_head;
+        if (!(jobs_head = job->next)) {
+            jobs_tail = &jobs_head;
+        }
+        pthread_mutex_unlock(&workers_mutex);
+
+        job->verdict = dep_check_verdict(NULL, worker->reg, worker->mount_cs_cache, job->path);
+        if (job->verdict != '#') {
+            /* do not cache errors */
+            path_cache_put(job->path, job->verdict);
+        }
+
+        pthread_mutex_lock(&workers_mutex);
+        job->next = jobs_done;
+        jobs_done = job;
+        pthread_mutex_unlock(&workers_mutex);
+        /* The pipe is non-blocking and only full until the event loop
+         * drains it, so retry until the byte is written, unless the event
+         * loop is waiting for the workers to stop instead. */
+        while (write(donepipe[1], "!", 1) < 0) {
+            bool stopping;
+            if (errno != EINTR && errno != EAGAIN) {
+                perror("tracelib: write");
+                break;
+            }
+            pthread_mutex_lock(&workers_mutex);
+            stopping = workers_stopping;
+            pthread_mutex_unlock(&workers_mutex);
+            if (stopping) {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Start the worker threads configured using tracelib setworkers. Failure is
+ * not fatal, dep_check requests are then answered by the event loop.
+ */
+static void workers_start(void) {
+    unsigned int count = worker_count < MAX_WORKERS ? worker_count : MAX_WORKERS;
+    reg_registry *reg;
+    reg_error error;
+    struct kevent kev;
+    int flags;
+
+    if (count == 0) {
+        return;
+    }
+
+    if (NULL == (reg = registry_for(interp, reg_attached))) {
+        ui_debug(interp, "tracelib: not using worker threads: %s", Tcl_GetStringResult(interp));
+        Tcl_ResetResult(interp);
+        return;
+    }
+
+    /* neither the workers nor the event loop should ever block on the pipe */
+    if (-1 == pipe(donepipe)
+            || -1 == (flags = fcntl(donepipe[0], F_GETFL, 0))
+            || -1 == fcntl(donepipe[0], F_SETFL, flags | O_NONBLOCK)
+            || -1 == (flags = fcntl(donepipe[1], F_GETFL, 0))
+            || -1 == fcntl(donepipe[1], F_SETFL, flags | O_NONBLOCK)) {
+        ui_debug(interp, "tracelib: not using worker threads: %s", strerror(errno));
+        pipe_cleanup(donepipe);
+        return;
+    }
+    EV_SET(&kev, donepipe[0], EVFILT_READ, EV_ADD | EV_RECEIPT, 0, 0, NULL);
+    if (1 != kevent(kq, &kev, 1, &kev, 1, NULL) || (kev.flags & EV_ERROR) == 0 || kev.data != 0) {
+        ui_debug(interp, "tracelib: not using worker threads: error adding pipe to kqueue");
+        pipe_cleanup(donepipe);
+        return;
+    }
 
-        answer(sock, "+");
+    for (workers_running = 0; workers_running < count; workers_running++) {
+        tracelib_worker_t *worker = &workers[workers_running];
+
+        if (!reg_open_readonly(&worker->reg, reg, &error)) {
+            ui_debug(interp, "tracelib: opening registry for worker thread: %s", error.description);
+            reg_error_destruct(&error);
+            break;
+        }
+        if (NULL == (worker->mount_cs_cache = new_mount_cs_cache())) {
+            ui_debug(interp, "tracelib: memory allocation failed");
+            reg_close(worker->reg, &error);
+            break;
+        }
+        if (0 != pthread_create(&worker->thread, NULL, dep_check_worker, worker)) {
+            ui_debug(interp, "tracelib: creating worker thread: %s", strerror(errno));
+            free(worker->mount_cs_cache);
+            reg_close(worker->reg, &error);
+            break;
+        }
+    }
+
+    if (workers_running == 0) {
+        pipe_cleanup(donepipe);
     } else {
-        free(port);
-        /* access denied, cache this result */
-        Tcl_HashEntry *cache_entry = Tcl_CreateHashEntry(&path_cache, path, &is_new);
-        Tcl_SetHashValue(cache_entry, "!");
+        ui_debug(interp, "tracelib: using %u worker threads for dependency checks", workers_running);
+    }
+}
+
+/**
+ * Stop the worker threads and drop all requests they have not answered yet.
+ */
+static void workers_stop(void) {
+    reg_error error;
+
+    pthread_mutex_lock(&workers_mutex);
+    workers_stopping = true;
+    pthread_cond_broadcast(&workers_signal);
+    pthread_mutex_unlock(&workers_mutex);
+
+    for (unsigned int i = 0; i < workers_running; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        if (!reg_close(workers[i].reg, &error)) {
+            reg_error_destruct(&error);
+        }
+        reset_mount_cs_cache(workers[i].mount_cs_cache);
+        free(workers[i].mount_cs_cache);
+    }
+    workers_running = 0;
+    workers_stopping = false;
+
+    while (jobs_head) {
+        dep_check_job_t *job = jobs_head;
+        jobs_head = job->next;
+        free(job);
+    }
+    jobs_tail = &jobs_head;
+    while (jobs_done) {
+        dep_check_job_t *job = jobs_done;
+        jobs_done = job->next;
+        free(job);
+    }
+
+    pipe_cleanup(donepipe);
+}
+
+/**
+ * Check whether a path is in the transitive hull of dependencies of the port
+ * currently being installed and send the result of the query back to the
+ * connection. If worker threads are running, the registry lookup is left to
+ * them and the result is sent by \c dep_check_finish.
+ *
+ * Sends one of the following characters as return code to the connection:
+ *  - #: in case of errors. Not handled by the darwintrace code, which will
+ *       lead to an error and the termination of the processing that sent the
+ *       request causing this error.
+ *  - ?: if the file isn't known to MacPorts (i.e., not registered to any port)
+ *  - +: if the file was installed by a dependency and access should be granted
+ *  - !: if the file was installed by a MacPorts port which is not in the
+ *       transitive hull of dependencies and access should be denied.
+ *
+ * \param[in] conn the connection to answer to
+ * \param[in] path the path to return the dependency information for
+ */
+static void dep_check(tracelib_conn_t *conn, char *path) {
+    char verdict[2] = {'\0', '\0'};
+    reg_registry *reg;
+
+    if ((verdict[0] = path_cache_get(path)) != '\0') {
+        answer(conn, verdict);
+        return;
+    }
+
+    if (workers_running > 0 && dep_check_enqueue(conn, path)) {
+        return;
+    }
+
+    if (NULL == (reg = registry_for(interp, reg_attached))) {
+        ui_error(interp, "%s", Tcl_GetStringResult(interp));
+        /* send unexpected output to make the build fail; do not cache */
+        answer(conn, "#");
+        return;
+    }
 
-        answer(sock, "!");
+    verdict[0] = dep_check_verdict(interp, reg, mount_cs_cache, path);
+    if (verdict[0] != '#') {
+        /* do not cache errors */
+        path_cache_put(path, verdict[0]);
     }
+    answer(conn, verdict);
+}
+
+/**
+ * Send the answers computed by the worker threads and continue processing
+ * the connections they were sent to.
+ *
+ * \return the number of connections that have been closed
+ */
+static int dep_check_finish(void) {
+    dep_check_job_t *done;
+    char buf[64];
+    int closed = 0;
+
+    while (read(donepipe[0], buf, sizeof(buf)) > 0) {
+    }
+
+    pthread_mutex_lock(&workers_mutex);
+    done = jobs_done;
+    jobs_done = NULL;
+    pthread_mutex_unlock(&workers_mutex);
+
+    while (done) {
+        dep_check_job_t *job = done;
+        tracelib_conn_t *conn = job->conn;
+        char verdict[2] = {job->verdict, '\0'};
+        bool keep_open;
+
+        done = job->next;
+        free(job);
+
+        conn->busy = false;
+        answer(conn, verdict);
+        keep_open = process_buffered(conn);
+        if (keep_open && !conn->busy) {
+            if (conn->eof) {
+                keep_open = process_remaining(conn);
+            } else {
+                conn_set_enabled(conn, true);
+            }
+        }
+        if (!keep_open) {
+            conn_close(conn);
+            closed++;
+        }
+    }
+    return closed;
 }
 
 static int TracelibOpenSocketCmd(Tcl_Interp *in) {
@@ -768,11 +1593,16 @@ static int TracelibRunCmd(Tcl_Interp *in) {
     }
 
     /* (Re-)initialize path cache */
-    if (path_cache_initialized) {
-        Tcl_DeleteHashTable(&path_cache);
+    path_cache_destroy();
+    path_cache_init();
+
+    /* (Re-)create the shared copy of the path cache; this must happen before
+     * the first filemap request is answered, because darwintrace maps the
+     * cache after receiving the filemap. */
+    verdict_cache_destroy();
+    if (name) {
+        verdict_cache_create();
     }
-    Tcl_InitHashTable(&path_cache, TCL_STRING_KEYS);
-    path_cache_initialized = true;
 
     pthread_mutex_lock(&evloop_mutex);
     /* bring all variables into a defined state so the cleanup code can be
@@ -840,6 +1670,8 @@ static int TracelibRunCmd(Tcl_Interp *in) {
             error2tcl("kevent (selfpipe receipt): ", kev.data, in);
             goto error_locked;
         }
+
+        workers_start();
     }
     pthread_mutex_unlock(&evloop_mutex);
 
@@ -862,24 +1694,24 @@ static int TracelibRunCmd(Tcl_Interp *in) {
                 break_eventloop = true;
                 /* finish processing this batch */
                 continue;
+            } else if (donepipe[0] != -1 && (int) res_kevents[i].ident == donepipe[0]) {
+                /* worker threads have answered dep_check requests */
+                opensockcount -= dep_check_finish();
             } else if ((int) res_kevents[i].ident != sock) {
-                /* if the socket is to be closed, or */
-                if ((res_kevents[i].flags & (EV_EOF | EV_ERROR)) > 0
-                    /* new data is available, and its processing tells us to
-                     * close the socket */
-                    || (!process_line(res_kevents[i].ident))) {
-                        /* an error occurred or process_line suggested closing
+                tracelib_conn_t *conn = (tracelib_conn_t *) res_kevents[i].udata;
+                /* process the new data, unless an error occurred */
+                bool keep_open = (res_kevents[i].flags & EV_ERROR) == 0
+                    && process_messages(conn);
+                if (keep_open && (res_kevents[i].flags & EV_EOF) > 0) {
+                    /* the remote side closed the socket */
+                    keep_open = process_remaining(conn);
+                }
+                if (!keep_open) {
+                        /* an error occurred, the socket was closed by the
+                         * remote side or process_messages suggested closing
                          * this socket */
-                        close(res_kevents[i].ident);
-                        /* closing the socket will automatically remove it from the
-                         * kqueue :) */
+                        conn_close(conn);
                         opensockcount--;
-
-#ifdef HAVE_PEERPID_LIST
-                        if (peerpid_list_dequeue(res_kevents[i].ident) == (pid_t) -1) {
-                            fprintf(stderr, "tracelib: didn't find PID for closed socket %d\n", (int) res_kevents[i].ident);
-                        }
-#endif
                 }
             } else {
                 /* the control socket has activity – we might have a new
@@ -917,11 +1749,19 @@ static int TracelibRunCmd(Tcl_Interp *in) {
                     continue;
                 }
 
+                tracelib_conn_t *conn = conn_new(s);
+                if (!conn) {
+                    ui_warn(interp, "tracelib: memory allocation failed");
+                    close(s);
+                    continue;
+                }
+
                 /* register the new socket in the kqueue */
-                EV_SET(&kev, s, EVFILT_READ, EV_ADD | EV_RECEIPT, 0, 0, NULL);
+                EV_SET(&kev, s, EVFILT_READ, EV_ADD | EV_RECEIPT, 0, 0, conn);
                 if (1 != kevent(kq, &kev, 1, &kev, 1, NULL)) {
                     ui_warn(interp, "tracelib: error adding socket to kqueue");
                     close(s);
+                    conn_free(conn);
                     continue;
                 }
                 /* kevent(2) on EV_RECEIPT: When passed as input, it forces EV_ERROR to
@@ -930,6 +1770,7 @@ static int TracelibRunCmd(Tcl_Interp *in) {
                 if ((kev.flags & EV_ERROR) == 0 || (kev.data != 0)) {
                     ui_warn(interp, "tracelib: error adding socket to kqueue (receipt)");
                     close(s);
+                    conn_free(conn);
                     continue;
                 }
 
@@ -942,6 +1783,7 @@ static int TracelibRunCmd(Tcl_Interp *in) {
                 } else {
                     // Error occurred, process has probably already terminated
                     close(s);
+                    conn_free(conn);
                     continue;
                 }
 #endif
@@ -966,6 +1808,14 @@ error_locked:
 #endif
     }
 
+    // stop the worker threads before freeing the connections they refer to
+    workers_stop();
+
+    // free the state of the remaining connections
+    while (connections) {
+        conn_free(connections);
+    }
+
     // cleanup selfpipe and set it to -1
     pipe_cleanup(selfpipe);
 
@@ -988,10 +1838,8 @@ error_locked:
     }
 
     /* Free path cache. */
-    if (path_cache_initialized) {
-        Tcl_DeleteHashTable(&path_cache);
-        path_cache_initialized = false;
-    }
+    path_cache_destroy();
+    verdict_cache_destroy();
 
     return retval;
 }
@@ -1018,7 +1866,11 @@ static int TracelibCleanCmd(Tcl_Interp *interp UNUSED) {
     safe_free(depends);
     dependsLength = 0;
 
+    safe_free(sandbox);
+    safe_free(allowAllSandbox);
+
     enable_fence = 0;
+    worker_count = 0;
     return TCL_OK;
 
 #undef safe_free
@@ -1104,6 +1956,25 @@ static int TracelibSetDeps(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
     return TCL_OK;
 }
 
+static int TracelibSetWorkersCmd(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+    int count;
+
+    if (objc != 3) {
+        Tcl_WrongNumArgs(interp, 2, objv, "count");
+        return TCL_ERROR;
+    }
+    if (TCL_OK != Tcl_GetIntFromObj(interp, objv[2], &count)) {
+        return TCL_ERROR;
+    }
+    if (count < 0) {
+        Tcl_SetResult(interp, "count must not be negative", TCL_STATIC);
+        return TCL_ERROR;
+    }
+
+    worker_count = (unsigned int) count;
+    return TCL_OK;
+}
+
 static int TracelibEnableFence(Tcl_Interp *interp UNUSED) {
     enable_fence = 1;
     return TCL_OK;
@@ -1120,7 +1991,7 @@ int TracelibCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_
     }
 
 #ifdef HAVE_TRACEMODE_SUPPORT
-    static const char *options[] = {"setname", "opensocket", "run", "clean", "setsandbox", "closesocket", "setdeps", "enablefence", 0};
+    static const char *options[] = {"setname", "opensocket", "run", "clean", "setsandbox", "closesocket", "setdeps", "enablefence", "setworkers", 0};
     typedef enum {
         kSetName,
         kOpenSocket,
@@ -1129,7 +2000,8 @@ int TracelibCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_
         kSetSandbox,
         kCloseSocket,
         kSetDeps,
-        kEnableFence
+        kEnableFence,
+        kSetWorkers
     } EOptions;
     EOptions current_option;
 
@@ -1160,6 +2032,9 @@ int TracelibCmd(ClientData clientData UNUSED, Tcl_Interp *interp, int objc, Tcl_
             case kEnableFence:
                 result = TracelibEnableFence(interp);
                 break;
+            case kSetWorkers:
+                result = TracelibSetWorkersCmd(interp, objc, objv);
+                break;
         }
     }
 #else /* defined(HAVE_TRACEMODE_SUPPORT) */
@@ -57,6 +57,10 @@
  *          - set deps for current port
  *      tracelib enablefence
  *          - enable dep/sandbox checking
+ *      tracelib setworkers count
+ *          - number of threads that look up dependencies in the registry
+ *            during tracelib run; 0 (the default) does the lookups in the
+ *            thread running the event loop
  */
 int TracelibCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]);
 
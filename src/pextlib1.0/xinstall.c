@@ -1086,8 +1086,9 @@ strip(const char *to_name)
 {
 	const char *stripbin;
 	int serrno, status;
+	pid_t pid;
 
-	switch (fork()) {
+	switch (pid = fork()) {
 	case -1:
 		serrno = errno;
 		(void)unlink(to_name);
@@ -1102,7 +1103,7 @@ strip(const char *to_name)
 		return;
 
 	default:
-		if (wait(&status) == -1 || status) {
+		if (waitpid(pid, &status, 0) == -1 || status) {
 			serrno = errno;
 			(void)unlink(to_name);
 			errno = serrno;
@@ -23,10 +23,12 @@ mportinit ui_options global_options
 
 # Standard procedures
 proc print_usage {} {
-    puts "Usage: $::argv0 \[-defx\] \[-o output directory\] \[-p plat_ver_arch\] \[directory\]"
+    puts "Usage: $::argv0 \[-defx\] \[-c changed paths file\] \[-j jobs\] \[-o output directory\] \[-p plat_ver_arch\] \[directory\]"
+    puts "-c:\tOnly update the ports affected by the paths listed in the given file (- for stdin)"
     puts "-d:\tOutput debugging information"
     puts "-e:\tExit code indicates if ports failed to parse"
     puts "-f:\tDo a full re-index instead of updating"
+    puts "-j:\tNumber of ports to parse in parallel"
     puts "-o:\tOutput all files to specified directory"
     puts "-p:\tPretend to be on another platform"
     puts "-q:\tQuiet mode - only output errors and summary"
@@ -34,28 +36,134 @@ proc print_usage {} {
 }
 
 proc _write_index {name len line} {
-    global fd
+    global fd quicklist
+    append quicklist "[string tolower $name] [tell $fd]\n"
     puts $fd [list $name $len]
     puts $fd $line
 }
 
-# Code that runs in worker threads
-set worker_init_script {
+# Read the list of changed paths, relative to the ports tree, one per line,
+# like the output of `git diff --name-only`.
+proc read_changed_paths {filename} {
+    if {$filename eq "-"} {
+        set chan stdin
+    } else {
+        set chan [open $filename r]
+    }
+    set paths [list]
+    while {[gets $chan line] >= 0} {
+        set line [string trim $line]
+        if {[string match ./* $line]} {
+            set line [string range $line 2 end]
+        }
+        if {$line ne {}} {
+            lappend paths $line
+        }
+    }
+    if {$chan ne "stdin"} {
+        close $chan
+    }
+    return $paths
+}
 
-package require macports
-package require Thread
+# Return the PortGroups used by a Portfile or PortGroup file as a list of
+# name and version pairs.
+proc _portgroups_used {filename} {
+    set chan [open $filename r]
+    set contents [read $chan]
+    close $chan
+    set groups [list]
+    foreach {- name version} [regexp -all -inline -line {^\s*PortGroup\s+(\S+)\s+(\S+)} $contents] {
+        lappend groups [list $name $version]
+    }
+    return $groups
+}
 
-proc _read_index {idx} {
-    global qindex oldfd
-    set offset [dict get $qindex $idx]
-    seek $oldfd $offset
-    gets $oldfd in_line
-    lassign $in_line name len
-    set out_line [read $oldfd [expr {$len - 1}]]
+proc _add_if_uses_changed_group {portdir} {
+    global changed_groups changed_portdirs
+    foreach group [_portgroups_used [file join $portdir Portfile]] {
+        if {[dict exists $changed_groups $group]} {
+            dict set changed_portdirs $portdir 1
+            return
+        }
+    }
+}
 
-    return [list $name $len $out_line]
+# Find the port directories affected by changes to the given paths: those
+# containing a changed path, and those using a changed PortGroup, directly or
+# through another PortGroup. Sets changed_portdirs to a dict with the port
+# directories as keys.
+proc find_changed_portdirs {paths} {
+    global directory changed_groups changed_portdirs
+    set changed_portdirs [dict create]
+    set changed_groups [dict create]
+    set groupdir _resources/port1.0/group
+    set group_re {^(.+)-([^-]+)\.tcl$}
+    foreach path $paths {
+        set parts [file split $path]
+        if {[file dirname $path] eq $groupdir && [regexp $group_re [file tail $path] -> name version]} {
+            dict set changed_groups [list $name $version] 1
+        } elseif {[llength $parts] > 2 && [string index [lindex $parts 0] 0] ne "_"} {
+            dict set changed_portdirs [file join {*}[lrange $parts 0 1]] 1
+        }
+    }
+    if {[dict size $changed_groups] == 0} {
+        return
+    }
+
+    set includes [dict create]
+    foreach groupfile [glob -nocomplain -directory [file join $directory $groupdir] *.tcl] {
+        if {[regexp $group_re [file tail $groupfile] -> name version]} {
+            dict set includes [list $name $version] [_portgroups_used $groupfile]
+        }
+    }
+    set grown 1
+    while {$grown} {
+        set grown 0
+        dict for {group used} $includes {
+            if {[dict exists $changed_groups $group]} {
+                continue
+            }
+            foreach usedgroup $used {
+                if {[dict exists $changed_groups $usedgroup]} {
+                    dict set changed_groups $group 1
+                    set grown 1
+                    break
+                }
+            }
+        }
+    }
+
+    mporttraverse _add_if_uses_changed_group $directory
 }
 
+# Copy the entries of the old index that don't belong to one of the changed
+# port directories.
+proc copy_unchanged_entries {} {
+    global oldfd changed_portdirs stats
+    seek $oldfd 0
+    while {[gets $oldfd line] >= 0} {
+        if {[llength $line] != 2} {
+            continue
+        }
+        lassign $line name len
+        set portinfo [string range [read $oldfd $len] 0 end-1]
+        if {[dict exists $portinfo portdir] && [dict exists $changed_portdirs [dict get $portinfo portdir]]} {
+            continue
+        }
+        _write_index $name $len $portinfo
+        dict incr stats skipped
+    }
+}
+
+# Code that runs in worker threads. Each worker parses one port at a time,
+# reusing its port interpreters between ports, and sends back the finished
+# index entry.
+set worker_init_script {
+
+package require macports
+package require Thread
+
 proc _index_from_portinfo {portinfo {is_subport no}} {
     global keepkeys
     set keep_portinfo [dict filter $portinfo script {key val} {
@@ -99,53 +207,16 @@ proc _open_port {portdir absportdir {subport {}}} {
 
 proc pindex {portdir {subport {}}} {
     try {
-        global directory full_reindex oldmtime qindex
+        global directory
 
         set absportdir [file join $directory $portdir]
         set portfile [file join $absportdir Portfile]
-        if {$subport ne ""} {
-            set qname [string tolower $subport]
-            set is_subport 1
-        } else {
-            set qname [string tolower [file tail $portdir]]
-            set is_subport 0
-        }
+        set is_subport [expr {$subport ne ""}]
 
         # Return values
         set subports {}
         set mtime [file mtime $portfile]
 
-        # try to reuse the existing entry if it's still valid
-        if {$full_reindex != 1 && [dict exists $qindex $qname] && $oldmtime >= $mtime} {
-            global ui_options
-            try {
-                lassign [_read_index $qname] name len portinfo
-
-                # reuse entry if it was made from the same portdir
-                if {[dict exists $portinfo portdir] && [dict get $portinfo portdir] eq $portdir} {
-                    set output [list $name $len $portinfo]
-
-                    if {!$is_subport} {
-                        if {[info exists ui_options(ports_debug)]} {
-                            puts "Reusing existing entry for $portdir"
-                        }
-
-                        # report any subports
-                        if {[dict exists $portinfo subports]} {
-                            set subports [dict get $portinfo subports]
-                        }
-                    }
-
-                    return [list -1 $output $subports $mtime]
-                }
-            } on error {} {
-                ui_warn "Failed to open old entry for ${portdir}, making a new one"
-                if {[info exists ui_options(ports_debug)]} {
-                    puts "$::errorInfo"
-                }
-            }
-        }
-
         try {
             set portinfo [_open_port $portdir $absportdir $subport]
             set output [_index_from_portinfo $portinfo $is_subport]
@@ -171,82 +242,145 @@ proc pindex {portdir {subport {}}} {
 }
 # End worker_init_script
 
+proc _read_index {idx} {
+    global qindex oldfd
+    set offset [dict get $qindex $idx]
+    seek $oldfd $offset
+    gets $oldfd in_line
+    lassign $in_line name len
+    set out_line [read $oldfd [expr {$len - 1}]]
+
+    return [list $name $len $out_line]
+}
+
+# Return the result pindex would for a port whose entry in the old index is
+# still valid, or an empty list if the port has to be parsed again. This runs
+# in the main thread, so that unchanged ports don't take a round trip through
+# a worker.
+proc pindex_reuse {portdir {subport {}}} {
+    global directory full_reindex oldmtime qindex ui_options
+    if {$full_reindex == 1} {
+        return {}
+    }
+    if {$subport ne ""} {
+        set qname [string tolower $subport]
+    } else {
+        set qname [string tolower [file tail $portdir]]
+    }
+    if {![dict exists $qindex $qname]
+        || [catch {file mtime [file join $directory $portdir Portfile]} mtime]
+        || $oldmtime < $mtime
+    } then {
+        return {}
+    }
+
+    try {
+        lassign [_read_index $qname] name len portinfo
+
+        # reuse entry if it was made from the same portdir
+        if {[dict exists $portinfo portdir] && [dict get $portinfo portdir] eq $portdir} {
+            set subports {}
+            if {$subport eq ""} {
+                if {[info exists ui_options(ports_debug)]} {
+                    puts "Reusing existing entry for $portdir"
+                }
+
+                # report any subports
+                if {[dict exists $portinfo subports]} {
+                    set subports [dict get $portinfo subports]
+                }
+            }
+            return [list -1 [list $name $len $portinfo] $subports $mtime]
+        }
+    } on error {} {
+        ui_warn "Failed to open old entry for ${portdir}, making a new one"
+        if {[info exists ui_options(ports_debug)]} {
+            puts "$::errorInfo"
+        }
+    }
+    return {}
+}
+
 proc init_threads {} {
-    global worker_init_script qindex keepkeys ui_options \
-           global_options var_overrides directory full_reindex oldfd \
-           oldmtime maxjobs poolid pending_jobs subports_todo
+    global worker_init_script keepkeys ui_options \
+           global_options var_overrides directory \
+           maxjobs poolid pending_jobs subports_todo
     append worker_init_script \
-        [list set qindex $qindex] \n \
         [list set keepkeys $keepkeys] \n \
         [list array set ui_options [array get ui_options]] \n \
         [list array set global_options [array get global_options]] \n \
         [list set directory $directory] \n \
-        [list set full_reindex $full_reindex] \n \
         [list mportinit ui_options global_options]
-    if {[info exists oldfd]} {
-        global outpath
-        append worker_init_script \n \
-            [list set outpath $outpath] \n \
-            {set oldfd [open $outpath r]}
-    }
-    if {[info exists oldmtime]} {
-        append worker_init_script \
-            \n [list set oldmtime $oldmtime]
-    }
     if {$var_overrides ne {}} {
         append worker_init_script \
             \n [list macports::override_vars $var_overrides]
     }
-    set maxjobs [macports::get_parallel_jobs no]
+    if {![info exists maxjobs]} {
+        set maxjobs [macports::get_parallel_jobs no]
+    }
     set poolid [tpool::create -minworkers 1 -maxworkers $maxjobs -initcmd $worker_init_script]
     set pending_jobs [dict create]
     set subports_todo [list]
 }
 
+# Write the index entry for a port or subport given the result of pindex,
+# and make the subports of a port pending.
+proc handle_result {portdir subport result} {
+    global subports_todo stats ui_options
+    lassign $result status output subports mtime
+    # -1 = skipped, 0 = success, 1 = fail
+    if {$status == 1} {
+        dict incr stats failed
+        dict incr stats total
+        puts stderr $output
+    } elseif {$status == 0 || $status == -1} {
+        # queue jobs for subports
+        if {$subport eq {}} {
+            foreach nextsubport $subports {
+                set subport_result [pindex_reuse $portdir $nextsubport]
+                if {$subport_result ne {}} {
+                    handle_result $portdir $nextsubport $subport_result
+                } else {
+                    lappend subports_todo [list $portdir $nextsubport]
+                }
+            }
+        }
+        if {$status == -1} {
+            dict incr stats skipped
+        } else {
+            if {![info exists ui_options(ports_quiet)]} {
+                set port_term [expr {$subport ne {} ? "subport $subport" : "port $portdir"}]
+                puts "Adding $port_term"
+            }
+            global newest
+            dict incr stats total
+            if {$mtime > $newest} {
+                set newest $mtime
+            }
+        }
+        _write_index {*}$output
+    } else {
+        error "Unknown status for ${portdir} $subport: $status"
+    }
+}
+
 proc handle_completed_jobs {} {
-    global poolid pending_jobs maxjobs subports_todo stats ui_options
-    set completed_jobs [tpool::wait $poolid [dict keys $pending_jobs]]
+    global poolid pending_jobs maxjobs subports_todo
+    if {[dict size $pending_jobs] > 0} {
+        set completed_jobs [tpool::wait $poolid [dict keys $pending_jobs]]
+    } else {
+        set completed_jobs {}
+    }
     macports::check_signals
     set subports_done 0
     foreach completed_job $completed_jobs {
         lassign [dict get $pending_jobs $completed_job] portdir subport
         dict unset pending_jobs $completed_job
         if {[catch {tpool::get $poolid $completed_job} result]} {
-            set status 1
             set subportmsg [expr {$subport ne {} ? " with subport '${subport}'" : {}}]
-            set output "Failed to parse file ${portdir}/Portfile${subportmsg}: $result"
-        } else {
-            lassign $result status output subports mtime
-        }
-        # -1 = skipped, 0 = success, 1 = fail
-        if {$status == 1} {
-            dict incr stats failed
-            dict incr stats total
-            puts stderr $output
-        } elseif {$status == 0 || $status == -1} {
-            # queue jobs for subports
-            if {$subport eq {}} {
-                foreach nextsubport $subports {
-                    lappend subports_todo [list $portdir $nextsubport]
-                }
-            }
-            if {$status == -1} {
-                dict incr stats skipped
-            } else {
-                if {![info exists ui_options(ports_quiet)]} {
-                    set port_term [expr {$subport ne {} ? "subport $subport" : "port $portdir"}]
-                    puts "Adding $port_term"
-                }
-                global newest
-                dict incr stats total
-                if {$mtime > $newest} {
-                    set newest $mtime
-                }
-            }
-            _write_index {*}$output
-        } else {
-            error "Unknown status for job $completed_job (${portdir} $subport): $status"
+            set result [list 1 "Failed to parse file ${portdir}/Portfile${subportmsg}: $result" {} 0]
         }
+        handle_result $portdir $subport $result
         if {[llength $subports_todo] > $subports_done} {
             set next_subport_info [lindex $subports_todo $subports_done]
             set jobid [tpool::post $poolid [list pindex {*}$next_subport_info]]
@@ -267,7 +401,15 @@ proc handle_completed_jobs {} {
 
 # post new job to the pool
 proc pindex_queue {portdir} {
-    global pending_jobs maxjobs poolid exit_fail
+    global pending_jobs maxjobs poolid exit_fail subports_todo
+    set result [pindex_reuse $portdir]
+    if {$result ne {}} {
+        handle_result $portdir {} $result
+        if {[llength $subports_todo] == 0} {
+            return
+        }
+    }
+
     # Wait for a free thread
     while {[dict size $pending_jobs] >= $maxjobs} {
         handle_completed_jobs
@@ -277,20 +419,28 @@ proc pindex_queue {portdir} {
     }
 
     # Now queue the new job.
-    set jobid [tpool::post $poolid [list pindex $portdir {}]]
-    dict set pending_jobs $jobid [list $portdir {}]
+    if {$result eq {}} {
+        set jobid [tpool::post $poolid [list pindex $portdir {}]]
+        dict set pending_jobs $jobid [list $portdir {}]
+    }
+    # and any subports of a reused port that have to be parsed
+    while {[llength $subports_todo] > 0 && [dict size $pending_jobs] < $maxjobs} {
+        set subports_todo [lassign $subports_todo next_subport_info]
+        set jobid [tpool::post $poolid [list pindex {*}$next_subport_info]]
+        dict set pending_jobs $jobid $next_subport_info
+    }
 }
 
 proc process_remaining {} {
-    global pending_jobs poolid
+    global pending_jobs poolid subports_todo
     # let remaining jobs finish
-    while {[dict size $pending_jobs] > 0} {
+    while {[dict size $pending_jobs] > 0 || [llength $subports_todo] > 0} {
         handle_completed_jobs
     }
     tpool::release $poolid
 }
 
-if {$argc > 8} {
+if {$argc > 12} {
     print_usage
     exit 1
 }
@@ -300,6 +450,11 @@ proc parse_args {} {
     for {set i 0} {$i < $argc} {incr i} {
         set arg [lindex $argv $i]
         switch -glob -- $arg {
+            -c { # Only update the ports affected by the given paths
+                incr i
+                global changed_paths_file
+                set changed_paths_file [lindex $argv $i]
+            }
             -d { # Turn on debug output
                 global ui_options
                 set ui_options(ports_debug) yes
@@ -312,6 +467,16 @@ proc parse_args {} {
                 global full_reindex
                 set full_reindex 1
             }
+            -j { # Number of worker threads
+                incr i
+                global maxjobs
+                set maxjobs [lindex $argv $i]
+                if {![string is integer -strict $maxjobs] || $maxjobs < 1} {
+                    puts stderr "Number of jobs should be a positive integer"
+                    print_usage
+                    exit 1
+                }
+            }
             -o { # Set output directory
                 incr i
                 global outdir
@@ -409,6 +574,8 @@ if {[info exists outdir]} {
 }
 
 puts "Creating port index in $outdir"
+set phase_start [clock milliseconds]
+set phase_times [dict create]
 set outpath [file join $outdir PortIndex]
 # open old index for comparison
 set qindex ""
@@ -435,7 +602,25 @@ if {[file isfile $outpath]} {
     set oldattrs [list -permissions 00644]
 }
 
+if {[info exists changed_paths_file] && !$full_reindex} {
+    if {$qindex eq ""} {
+        ui_warn "No existing index to update, indexing all ports"
+    } elseif {[catch {read_changed_paths $changed_paths_file} changed_paths]} {
+        puts stderr $changed_paths
+        exit 1
+    } else {
+        find_changed_portdirs $changed_paths
+        # the existing entries of the changed ports are stale even if their
+        # Portfile is older than the index, e.g. if a PortGroup changed
+        set full_reindex 1
+    }
+}
+
+dict set phase_times "Reading old index" [expr {[clock milliseconds] - $phase_start}]
+set phase_start [clock milliseconds]
+
 set fd [file tempfile tempportindex mports.portindex]
+set quicklist {}
 
 # keys for a normal portindex
 set keepkeys [dict create]
@@ -457,8 +642,17 @@ if {$extended_mode} {
 set exit_fail 0
 try {
     init_threads
-    # process list of portdirs
-    mporttraverse pindex_queue $directory
+    if {[info exists changed_portdirs]} {
+        copy_unchanged_entries
+        dict for {portdir -} $changed_portdirs {
+            if {[file isfile [file join $directory $portdir Portfile]]} {
+                pindex_queue $portdir
+            }
+        }
+    } else {
+        # process list of portdirs
+        mporttraverse pindex_queue $directory
+    }
     # handle completed jobs
     process_remaining
 } trap {POSIX SIG SIGINT} {} {
@@ -476,15 +670,28 @@ try {
 if {$exit_fail} {
     exit 1
 }
+dict set phase_times "Indexing ports" [expr {[clock milliseconds] - $phase_start}]
+set phase_start [clock milliseconds]
 
 file rename -force $tempportindex $outpath
 file mtime $outpath $newest
 file attributes $outpath {*}$oldattrs
-mports_generate_quickindex $outpath
+set quickfd [open ${outpath}.quick w]
+puts -nonewline $quickfd $quicklist
+close $quickfd
+if {[catch {mports_generate_binindex $outpath} result]} {
+    ui_warn "Failed to generate binary index: $result"
+}
+dict set phase_times "Writing index files" [expr {[clock milliseconds] - $phase_start}]
+
 puts "\nTotal number of ports parsed:\t[dict get $stats total]\
       \nPorts successfully parsed:\t[expr {[dict get $stats total] - [dict get $stats failed]}]\
       \nPorts failed:\t\t\t[dict get $stats failed]\
       \nUp-to-date ports skipped:\t[dict get $stats skipped]\n"
+dict for {phase ms} $phase_times {
+    puts [format "%-32s%.2fs" "${phase}:" [expr {$ms / 1000.0}]]
+}
+puts ""
 
 if {${permit_error} && [dict get $stats failed] > 0} {
     exit 2
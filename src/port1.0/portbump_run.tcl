@@ -219,9 +219,15 @@ proc bump_main {args} {
                 # Retrieve the list of types/values from the array.
                 set portfile_checksums $checksums_array($distfile)
 
-                # Iterate on this list to check the actual values.
+                # Calculate all checksums for the distfile at once.
+                set types [list]
                 foreach {type sum} $portfile_checksums {
-                    set calculated_sum [portchecksum::calc_$type $fullpath]
+                    lappend types $type
+                }
+                set calculated_sums [portchecksum::calc_checksums $fullpath $types]
+
+                # Iterate on this list to check the actual values.
+                foreach {type sum} $portfile_checksums {calculated_type calculated_sum} $calculated_sums {
                     lappend both_checksums $type $sum $calculated_sum
 
                     if {$sum eq $calculated_sum} {
@@ -177,6 +177,44 @@ proc calc_size {file} {
     return [file size $file]
 }
 
+# calc_checksums
+#
+# Calculate the given types of checksums for the given file, reading it
+# only once.
+# Return a list of type/checksum pairs in the order of types.
+#
+proc calc_checksums {file types} {
+    return [multichecksum file $file $types]
+}
+
+# recorded_checksums
+#
+# Look up the given types of checksums for the given file among those
+# computed while fetching it, if the file hasn't changed since.
+# Return a list of type/checksum pairs in the order of types, or an empty
+# list if they aren't all known.
+#
+proc recorded_checksums {file types} {
+    if {![info exists ::portfetch::fetched_digests]
+            || ![dict exists $::portfetch::fetched_digests $file]
+            || [catch {file stat $file st}]} {
+        return {}
+    }
+    lassign [dict get $::portfetch::fetched_digests $file] size mtime ctime ino digests
+    if {$st(size) != $size || $st(mtime) != $mtime || $st(ctime) != $ctime
+            || $st(ino) != $ino} {
+        return {}
+    }
+    set result [list]
+    foreach type $types {
+        if {![dict exists $digests $type]} {
+            return {}
+        }
+        lappend result $type [dict get $digests $type]
+    }
+    return $result
+}
+
 # checksum_start
 #
 # Target prerun procedure; simply prints a message about what we're doing.
@@ -237,9 +275,20 @@ proc checksum_main {args} {
                 set portfile_checksums $checksums_array($distfile)
                 set calculated_checksums [list]
 
-                # iterate on this list to check the actual values.
+                # calculate all checksums for the distfile at once
+                set types [list]
                 foreach {type sum} $portfile_checksums {
-                    set calculated_sum [calc_$type $fullpath]
+                    lappend types $type
+                }
+                set calculated_sums [recorded_checksums $fullpath $types]
+                if {$calculated_sums ne {}} {
+                    ui_debug "[format [msgcat::mc "Using checksums computed while fetching %s"] $distfile]"
+                } else {
+                    set calculated_sums [calc_checksums $fullpath $types]
+                }
+
+                # iterate on this list to check the actual values.
+                foreach {type sum} $portfile_checksums {calculated_type calculated_sum} $calculated_sums {
                     lappend calculated_checksums $type
                     lappend calculated_checksums $calculated_sum
 
@@ -326,8 +375,8 @@ proc checksum_main {args} {
                         return -code error "$distfile does not exist in $distpath"
                     }
 
-                    foreach type $missing_types {
-                        lappend sums [format "%-8s%s" $type [calc_$type $fullpath]]
+                    foreach {type sum} [calc_checksums $fullpath $missing_types] {
+                        lappend sums [format "%-8s%s" $type $sum]
                     }
                 }
             }
@@ -230,8 +230,8 @@ proc check_warnings {warning_flag} {
 
     set files [list]
 
-    fs-traverse -tails file [list ${workpath}] {
-        if {[file tail $file] in [list config.log CMakeError.log meson-log.txt] && [file isfile [file join ${workpath} $file]]} {
+    fs-traverse -tails -type file file [list ${workpath}] {
+        if {[file tail $file] in [list config.log CMakeError.log meson-log.txt]} {
             # We could do the searching ourselves, but using a tool optimized for this purpose is likely much faster
             # than using Tcl.
             #
@@ -270,8 +270,8 @@ proc check_implicit_function_declarations {} {
     # Map from function name to config.log that used it without declaration
     set undeclared_functions [dict create]
 
-    fs-traverse -tails file [list ${workpath}] {
-        if {[file tail $file] in [list config.log CMakeError.log meson-log.txt] && [file isfile [file join ${workpath} $file]]} {
+    fs-traverse -tails -type file file [list ${workpath}] {
+        if {[file tail $file] in [list config.log CMakeError.log meson-log.txt]} {
             # We could do the searching ourselves, but using a tool optimized for this purpose is likely much faster
             # than using Tcl.
             #
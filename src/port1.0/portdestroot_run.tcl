@@ -191,10 +191,8 @@ proc destroot_finish {args} {
             xinstall -c -m 0644 /dev/null ${path}/.turd_${subport}
         }
     }
-    fs-traverse -depth dir [list ${destroot}] {
-        if {[file type $dir] eq "directory"} {
-            catch {file delete $dir}
-        }
+    fs-traverse -depth -type directory dir [list ${destroot}] {
+        catch {file delete $dir}
     }
 
     if {![file isdirectory ${destroot}]} {
@@ -387,13 +385,15 @@ proc destroot_finish {args} {
         global workpath
         ui_debug "Applying sparse file lseek bug workaround"
         try {
-            fs-traverse -depth fullpath [list $destroot] {
-                if {[file type $fullpath] eq "file" && [fileIsSparse $fullpath]} {
-                    ui_debug "Cloning $fullpath for workaround"
-                    clonefile $fullpath ${workpath}/.macports-sparse-workaround
-                    file delete ${workpath}/.macports-sparse-workaround
-                    if {![fileIsSparse $fullpath]} {
-                        ui_debug "$fullpath is no longer sparse"
+            fs-traverse -type file -batch 256 fullpaths [list $destroot] {
+                foreach fullpath $fullpaths {
+                    if {[fileIsSparse $fullpath]} {
+                        ui_debug "Cloning $fullpath for workaround"
+                        clonefile $fullpath ${workpath}/.macports-sparse-workaround
+                        file delete ${workpath}/.macports-sparse-workaround
+                        if {![fileIsSparse $fullpath]} {
+                            ui_debug "$fullpath is no longer sparse"
+                        }
                     }
                 }
             }
@@ -15,6 +15,10 @@ target_runpkg ${org.macports.fetch} portfetch_run
 
 namespace eval portfetch {
     variable fetch_urls {}
+    # Digests of the files fetched, computed while downloading them. Maps
+    # the path to a list of the file's size, mtime, ctime and inode and a
+    # dict of the digests.
+    variable fetched_digests [dict create]
 }
 
 # define options: distname master_sites
@@ -146,10 +150,9 @@ proc portfetch::fetch_async_start {logid} {
 proc portfetch::_async_cleanup {} {
     variable async_jobs
     if {[info exists async_jobs]} {
-        global distpath
         foreach {distfile jobid} $async_jobs {
+            # Partial downloads are resumed by the next fetch.
             curlwrap_async_cancel $jobid
-            file delete ${distpath}/${distfile}.TMP
         }
         unset async_jobs
     }
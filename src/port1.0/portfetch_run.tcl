@@ -308,12 +308,22 @@ proc hgfetch {args} {
     return 0
 }
 
+# Remember the digests curl computed while fetching a file, for the
+# checksum phase.
+proc record_digests {path digests} {
+    variable fetched_digests
+    if {$digests ne {} && ![catch {file stat $path st}]} {
+        dict set fetched_digests $path \
+            [list $st(size) $st(mtime) $st(ctime) $st(ino) $digests]
+    }
+}
+
 # Perform a standard fetch, assembling fetch urls from
 # the listed url variable and associated distfile
 proc fetchfiles {{async no} args} {
     global distpath UI_PREFIX \
            fetch.user fetch.password fetch.use_epsv fetch.ignore_sslcert fetch.remote_time \
-           fetch.user_agent portverbose
+           fetch.user_agent portverbose fetch_segments checksum.skip
     variable fetch_urls
     variable urlmap
     variable async_jobs
@@ -356,13 +366,12 @@ proc fetchfiles {{async no} args} {
                     } else {
                         ui_debug "Failed to fetch ${distfile}: $result"
                     }
+                    # Keep what was downloaded to resume from next time.
                     set any_failed 1
-                    file delete -force ${distpath}/${distfile}.TMP
                 } elseif {![file exists ${distpath}/${distfile}]} {
                     file rename -force ${distpath}/${distfile}.TMP ${distpath}/${distfile}
+                    record_digests ${distpath}/${distfile} $result
                 }
-            } else {
-                file delete -force ${distpath}/${distfile}.TMP
             }
         }
         if {$any_failed} {
@@ -371,7 +380,8 @@ proc fetchfiles {{async no} args} {
         return 0
     }
 
-    set fetch_options [list]
+    # Continue partial downloads left behind by earlier attempts.
+    set fetch_options [list --resume]
     set credentials {}
     if {[string length ${fetch.user}] || [string length ${fetch.password}]} {
         set credentials ${fetch.user}:${fetch.password}
@@ -389,6 +399,24 @@ proc fetchfiles {{async no} args} {
         lappend fetch_options "--user-agent"
         lappend fetch_options "${fetch.user_agent}"
     }
+    if {$fetch_segments > 1} {
+        lappend fetch_options "--segments"
+        lappend fetch_options $fetch_segments
+    }
+    # Compute the checksums while downloading so the checksum phase doesn't
+    # have to read the files again.
+    if {![tbool checksum.skip]} {
+        set digest_types [list]
+        foreach word [option checksums] {
+            if {$word in $::portchecksum::checksum_types && $word ni $digest_types} {
+                lappend digest_types $word
+            }
+        }
+        if {$digest_types ne {}} {
+            lappend fetch_options "--digests"
+            lappend fetch_options $digest_types
+        }
+    }
     if {!$async} {
         if {$portverbose eq "yes"} {
             lappend fetch_options "--progress"
@@ -421,7 +449,6 @@ proc fetchfiles {{async no} args} {
                 if {[curlwrap_async_file_is_in_progress ${distpath}/${distfile}]} {
                     continue
                 }
-                file delete -force ${distpath}/${distfile}.TMP
                 touch ${distpath}/${distfile}.TMP
                 chownAsRoot ${distpath}/${distfile}.TMP
                 lappend async_jobs $distfile \
@@ -435,15 +462,15 @@ proc fetchfiles {{async no} args} {
                     ui_notice "$UI_PREFIX [format [msgcat::mc "Attempting to fetch %s from %s"] $distfile $site]"
                     set file_url [assemble_url $site $distfile]
                     macports_try -pass_signal {
-                        curlwrap fetch $site $credentials {*}$fetch_options $file_url ${distpath}/${distfile}.TMP
+                        set digests [curlwrap fetch $site $credentials {*}$fetch_options $file_url ${distpath}/${distfile}.TMP]
                         file rename -force "${distpath}/${distfile}.TMP" "${distpath}/${distfile}"
+                        record_digests ${distpath}/${distfile} $digests
                         set fetched 1
                         break
                     } on error {eMessage} {
+                        # The next site continues where this one stopped.
                         ui_debug [msgcat::mc "Fetching distfile failed: %s" $eMessage]
                         set lastError $eMessage
-                    } finally {
-                        file delete -force "${distpath}/${distfile}.TMP"
                     }
                 }
                 if {![info exists fetched]} {
@@ -167,24 +167,19 @@ proc create_archive {location archive.type} {
     variable file_is_binary [dict create]
     # also save the contents for our own use later
     variable installPlist [list]
-    set destpathLen [string length $destpath]
-    fs-traverse -depth fullpath [list $destpath] {
-        if {[file type $fullpath] eq "directory"} {
-            continue
-        }
-
-        set relpath [string range $fullpath $destpathLen+1 end]
+    # checksum and classify all files at once, reading each only once
+    foreach entry [fs-manifest -- $destpath] {
+        lassign $entry relpath checksum is_binary
         if {[string index $relpath 0] ne "+"} {
             puts $fd "$relpath"
             set abspath [file join [file separator] $relpath]
             lappend installPlist $abspath
-            if {[file isfile $fullpath]} {
+            if {$checksum ne ""} {
+                set fullpath [file join $destpath $relpath]
                 ui_debug "checksum file: $fullpath"
-                set checksum [md5 file $fullpath]
                 puts $fd "@comment MD5:$checksum"
                 if {$have_fileIsBinary} {
-                    # test if (mach-o) binary
-                    set is_binary [fileIsBinary $fullpath]
+                    # (mach-o) binary, as determined by fileIsBinary
                     if {$is_binary} {
                         lappend binary_files $fullpath
                     }
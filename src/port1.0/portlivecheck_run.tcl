@@ -180,7 +180,7 @@ proc _livecheck_main {{async no}} {
                 ui_debug "Using CURL options ${curl_options}"
             }
             if {$async} {
-                set async_job [curlwrap_async fetch_file {} $curl_options {} \
+                set async_job [curlwrap_async fetch_cached {} $curl_options {} \
                         [list ${livecheck.url_str}] $tempfilename]
                 append tempfilename .TMP
                 return 0
@@ -248,7 +248,7 @@ proc _livecheck_main {{async no}} {
                 ui_debug "Fetching ${livecheck.url_str}"
             }
             if {$async} {
-                set async_job [curlwrap_async fetch_file {} $curl_options {} \
+                set async_job [curlwrap_async fetch_cached {} $curl_options {} \
                         [list ${livecheck.url_str}] $tempfilename]
                 append tempfilename .TMP
                 return 0
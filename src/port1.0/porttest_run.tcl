@@ -43,10 +43,7 @@ proc test_archs {} {
         set elevated 1
     }
 
-    fs-traverse -depth fullpath [list [option destpath]] {
-        if {[file type $fullpath] ne "file"} {
-            continue
-        }
+    fs-traverse -depth -type file fullpath [list [option destpath]] {
         if {![file readable $fullpath]} {
             ui_debug "Skipping unreadable file: $fullpath"
             continue
@@ -408,7 +408,7 @@ namespace eval porttrace {
     # @param workpath The workpath of this installation
     # @param fifo The Unix socket name to be created
     proc create_slave {workpath fifo} {
-        global prefix developer_dir registry.path
+        global prefix developer_dir registry.path build.jobs
         variable thread
 
         # Create the thread.
@@ -435,6 +435,9 @@ namespace eval porttrace {
 
         # Initialize the slave
         thread::send $thread [list porttrace::slave_init $fifo $workpath]
+        # Answer registry lookups from as many traced processes as there are
+        # build jobs in parallel
+        thread::send $thread [list tracelib setworkers ${build.jobs}]
 
         # Run slave asynchronously
         thread::send -async $thread [list porttrace::slave_run]
@@ -2503,6 +2503,223 @@ proc portutil::_async_cleanup {} {
     portlivecheck::_async_cleanup
 }
 
+# State of the interpreter recorded by _snapshot_state so that
+# _restore_state can return it to that state, which lets macports1.0
+# reuse this interpreter for another Portfile instead of creating and
+# initialising a new one.
+namespace eval portutil::saved_state {
+    # variable name -> {array|scalar|none value traces}
+    variable vars [dict create]
+    # proc name -> {args body}, with defaults in args
+    variable procs [dict create]
+    # namespace -> number of commands in it
+    variable commands [dict create]
+    # command name -> 1
+    variable command_set [dict create]
+    variable namespaces [dict create]
+    variable chans [list]
+    variable packages [dict create]
+    variable loaded [list]
+    variable aliases [list]
+}
+
+# All namespaces whose state is saved, parents before children.
+proc portutil::_saved_namespaces {{ns ::}} {
+    set result [list $ns]
+    foreach child [namespace children $ns] {
+        if {$child ni {::oo ::tcl ::portutil::saved_state}} {
+            lappend result {*}[_saved_namespaces $child]
+        }
+    }
+    return $result
+}
+
+# The state of a variable, read without running its traces.
+proc portutil::_variable_state {var} {
+    set traces [trace info variable $var]
+    foreach t $traces {
+        trace remove variable $var {*}$t
+    }
+    if {[array exists $var]} {
+        set state [list array [array get $var] $traces]
+    } elseif {[info exists $var]} {
+        set state [list scalar [set $var] $traces]
+    } else {
+        set state [list none {} $traces]
+    }
+    foreach t [lreverse $traces] {
+        trace add variable $var {*}$t
+    }
+    return $state
+}
+
+# The arguments, including their defaults, and body of a proc.
+proc portutil::_proc_definition {p} {
+    set arglist [list]
+    foreach arg [info args $p] {
+        if {[info default $p $arg default]} {
+            lappend arglist [list $arg $default]
+        } else {
+            lappend arglist $arg
+        }
+    }
+    return [list $arglist [info body $p]]
+}
+
+# Record the variables, procs, commands, namespaces, channels and
+# packages of the interpreter for _restore_state.
+proc portutil::_snapshot_state {} {
+    namespace upvar saved_state vars vars procs procs commands commands \
+        command_set command_set namespaces namespaces chans chans \
+        packages packages loaded loaded aliases aliases
+    set vars [dict create]
+    set procs [dict create]
+    set commands [dict create]
+    set command_set [dict create]
+    set namespaces [dict create]
+    foreach ns [_saved_namespaces] {
+        set prefix [expr {$ns eq "::" ? "::" : "${ns}::"}]
+        dict set namespaces $ns 1
+        set nscommands [info commands ${prefix}*]
+        dict set commands $ns [llength $nscommands]
+        foreach cmd $nscommands {
+            dict set command_set $cmd 1
+        }
+        foreach var [info vars ${prefix}*] {
+            if {$var ne "::env"} {
+                dict set vars $var [_variable_state $var]
+            }
+        }
+        foreach p [info procs ${prefix}*] {
+            set p ${prefix}[namespace tail $p]
+            dict set procs $p [_proc_definition $p]
+        }
+    }
+    # [info vars] does not list options that have an option_proc but
+    # no value yet, so their traces have to be recorded separately.
+    global option_procs
+    foreach option [array names option_procs] {
+        if {![dict exists $vars ::$option]} {
+            dict set vars ::$option [_variable_state ::$option]
+        }
+    }
+    set chans [chan names]
+    set packages [dict create]
+    foreach pkg [package names] {
+        if {[package provide $pkg] ne ""} {
+            dict set packages $pkg 1
+        }
+    }
+    set loaded [info loaded {}]
+    set aliases [lsort [interp aliases {}]]
+}
+
+# Return the interpreter to the state recorded by _snapshot_state,
+# removing everything a Portfile added and resetting what it changed.
+# Returns 1 on success, or 0 if the interpreter could not be restored
+# (e.g. because a binary extension was loaded or an alias created, or a
+# command that existed in the snapshot and was not a proc was deleted,
+# renamed or replaced by a proc) and should not be reused.
+proc portutil::_restore_state {} {
+    namespace upvar saved_state vars vars procs procs commands commands \
+        command_set command_set namespaces namespaces chans chans \
+        packages packages loaded loaded aliases aliases
+    if {[info loaded {}] ne $loaded || [lsort [interp aliases {}]] ne $aliases} {
+        return 0
+    }
+    foreach ns [dict keys $namespaces] {
+        if {![namespace exists $ns]} {
+            return 0
+        }
+    }
+    foreach id [after info] {
+        after cancel $id
+    }
+    foreach chan [chan names] {
+        if {$chan ni $chans} {
+            catch {close $chan}
+        }
+    }
+    foreach pkg [package names] {
+        if {![dict exists $packages $pkg] && [package provide $pkg] ne ""} {
+            package forget $pkg
+        }
+    }
+
+    set current_namespaces [_saved_namespaces]
+    foreach ns [lreverse $current_namespaces] {
+        if {![dict exists $namespaces $ns]} {
+            namespace delete $ns
+        }
+    }
+    foreach ns $current_namespaces {
+        if {![dict exists $namespaces $ns]} {
+            continue
+        }
+        set prefix [expr {$ns eq "::" ? "::" : "${ns}::"}]
+        foreach cmd [info commands ${prefix}*] {
+            if {![dict exists $command_set $cmd]} {
+                rename $cmd {}
+            }
+        }
+        # Any proc left that was not one in the snapshot has replaced
+        # another command, which can not be brought back.
+        foreach p [info procs ${prefix}*] {
+            if {![dict exists $procs ${prefix}[namespace tail $p]]} {
+                return 0
+            }
+        }
+        foreach var [info vars ${prefix}*] {
+            if {$var ne "::env" && ![dict exists $vars $var]} {
+                foreach t [trace info variable $var] {
+                    trace remove variable $var {*}$t
+                }
+                unset -nocomplain $var
+            }
+        }
+    }
+
+    dict for {var state} $vars {
+        foreach t [trace info variable $var] {
+            trace remove variable $var {*}$t
+        }
+        lassign $state type value traces
+        switch $type {
+            array {
+                unset -nocomplain $var
+                array set $var $value
+            }
+            scalar {
+                if {[array exists $var]} {
+                    unset $var
+                }
+                set $var $value
+            }
+            none {
+                unset -nocomplain $var
+            }
+        }
+        foreach t [lreverse $traces] {
+            trace add variable $var {*}$t
+        }
+    }
+    dict for {p definition} $procs {
+        if {[catch {_proc_definition $p} current] || $current ne $definition} {
+            proc $p {*}$definition
+        }
+    }
+    # With the added commands deleted and the procs recreated, a
+    # namespace with fewer commands than in the snapshot lost one that
+    # was not a proc.
+    dict for {ns count} $commands {
+        set prefix [expr {$ns eq "::" ? "::" : "${ns}::"}]
+        if {[llength [info commands ${prefix}*]] != $count} {
+            return 0
+        }
+    }
+    return 1
+}
+
 proc portutil::_archive_available_ready {} {
     variable archive_available_result
     if {[info exists archive_available_result]} {
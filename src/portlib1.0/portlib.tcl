@@ -1418,19 +1418,19 @@ namespace eval portlib {
             return $newest
         }
 
-        # return the latest mtime of any file at or under the given paths
+        # return the latest mtime of any file at or under the given paths,
+        # skipping entries that cannot be read or vanish during the walk
         proc get_latest_path_mtime {checkpaths} {
             set newest 0
-            fs-traverse fullpath $checkpaths {
-                if {[catch {
-                    if {[file type $fullpath] eq "file"} {
-                        set mtime [file mtime $fullpath]
-                        if {$mtime > $newest} {
-                            set newest $mtime
-                        }
+            fs-traverse -ignoreErrors -type file -batch 256 fullpaths $checkpaths {
+                foreach fullpath $fullpaths {
+                    if {[catch {file mtime $fullpath} mtime]} {
+                        ui_debug "get_latest_path_mtime: $mtime"
+                        continue
+                    }
+                    if {$mtime > $newest} {
+                        set newest $mtime
                     }
-                } result]} {
-                    ui_debug "get_latest_path_mtime: $result"
                 }
             }
             return $newest
@@ -1524,6 +1524,9 @@ namespace eval portlib {
                 set tempdir [file tempdir]
             }
 
+            # pairs of files and the temporary files receiving their new
+            # contents
+            set pairs [list]
             foreach file $files {
                 # if $file is an absolute path already, file join will just return the
                 # absolute path, otherwise it is $dir/$file
@@ -1532,26 +1535,70 @@ namespace eval portlib {
                 if {[catch {set tmpfd [file tempfile tmpfile ${tempdir}/[file tail $file].sed]} error]} {
                     ui_debug $::errorInfo
                     ui_error "reinplace: $error"
+                    foreach {- tmpfile} $pairs {
+                        file delete $tmpfile
+                    }
                     return -code error "reinplace failed"
                 }
+                close $tmpfd
+                lappend pairs $file $tmpfile
+                ui_info "$ui_prefix [format [msgcat::mc "Patching %s: %s"] [file tail $file] $pattern]"
+            }
 
-                set cmdline [list $::portlib::autoconf::sed_command]
+            # Substitute in-process in all files at once if possible, sed(1)
+            # is only needed for -n, -locale and the less common scripts.
+            set changed [list]
+            if {!$suppress && $locale eq ""} {
+                set cmdline [list sedfiles]
                 if {$extended} {
                     lappend cmdline -E
                 }
-                if {$suppress} {
-                    lappend cmdline -n
-                }
-                lappend cmdline $pattern "<$file" ">@$tmpfd"
-                if {$locale ne ""} {
-                    set env(LC_CTYPE) $locale
-                }
-                ui_info "$ui_prefix [format [msgcat::mc "Patching %s: %s"] [file tail $file] $pattern]"
-                ui_debug "Executing reinplace: $cmdline"
-                if {[catch {exec -ignorestderr -- {*}$cmdline} error]} {
+                lappend cmdline -- $pattern {*}$pairs
+                ui_debug "Executing reinplace: sedfiles $pattern"
+                try {
+                    set changed [{*}$cmdline]
+                } trap {SEDFILES UNSUPPORTED} {} {
+                    ui_debug "reinplace: using sed(1) for $pattern"
+                } on error {error} {
                     ui_debug $::errorInfo
                     ui_error "reinplace: $error"
-                    file delete "$tmpfile"
+                    foreach {- tmpfile} $pairs {
+                        file delete $tmpfile
+                    }
+                    return -code error "reinplace failed"
+                }
+            }
+
+            if {$changed eq {}} {
+                foreach {file tmpfile} $pairs {
+                    set cmdline [list $::portlib::autoconf::sed_command]
+                    if {$extended} {
+                        lappend cmdline -E
+                    }
+                    if {$suppress} {
+                        lappend cmdline -n
+                    }
+                    lappend cmdline $pattern "<$file" ">$tmpfile"
+                    if {$locale ne ""} {
+                        set env(LC_CTYPE) $locale
+                    }
+                    ui_debug "Executing reinplace: $cmdline"
+                    if {[catch {exec -ignorestderr -- {*}$cmdline} error]} {
+                        ui_debug $::errorInfo
+                        ui_error "reinplace: $error"
+                        foreach {- tmpfile} $pairs {
+                            file delete $tmpfile
+                        }
+                        if {$locale ne ""} {
+                            if {$oldlocale_exists} {
+                                set env(LC_CTYPE) $oldlocale
+                            } else {
+                                unset env(LC_CTYPE)
+                            }
+                        }
+                        return -code error "reinplace sed(1) failed"
+                    }
+
                     if {$locale ne ""} {
                         if {$oldlocale_exists} {
                             set env(LC_CTYPE) $oldlocale
@@ -1559,20 +1606,12 @@ namespace eval portlib {
                             unset env(LC_CTYPE)
                         }
                     }
-                    close $tmpfd
-                    return -code error "reinplace sed(1) failed"
+                    lappend changed [catch {exec -ignorestderr cmp -s $file $tmpfile}]
                 }
+            }
 
-                if {$locale ne ""} {
-                    if {$oldlocale_exists} {
-                        set env(LC_CTYPE) $oldlocale
-                    } else {
-                        unset env(LC_CTYPE)
-                    }
-                }
-                close $tmpfd
-
-                if {!$quiet && ![catch {exec -ignorestderr cmp -s $file $tmpfile}]} {
+            foreach {file tmpfile} $pairs file_changed $changed {
+                if {!$quiet && !$file_changed} {
                     ui_warn "[format [msgcat::mc "reinplace %1\$s didn't change anything in %2\$s"] $pattern $file]"
                 }
 
@@ -1583,14 +1622,18 @@ namespace eval portlib {
                 if {[catch {file attributes $file -permissions u+w} error]} {
                     ui_debug $::errorInfo
                     ui_error "reinplace: $error"
-                    file delete "$tmpfile"
+                    foreach {- tmpfile} $pairs {
+                        file delete $tmpfile
+                    }
                     return -code error "reinplace permissions failed"
                 }
 
                 if {[catch {file copy -force $tmpfile $file} error]} {
                     ui_debug $::errorInfo
                     ui_error "reinplace: $error"
-                    file delete "$tmpfile"
+                    foreach {- tmpfile} $pairs {
+                        file delete $tmpfile
+                    }
                     return -code error "reinplace copy failed"
                 }
 
@@ -108,6 +108,58 @@ static int entry_obj_prop(Tcl_Interp* interp, reg_entry* entry, int objc,
     }
 }
 
+/*
+ * ${entry} props ?prop ...?
+ *
+ * Returns a dict of the given properties (or all of them) and their values,
+ * read with a single query. Properties that aren't set are left out.
+ */
+static int entry_obj_props(Tcl_Interp* interp, reg_entry* entry, int objc,
+        Tcl_Obj* const objv[]) {
+    reg_registry* reg = registry_for(interp, reg_attached);
+    int key_count = objc > 2 ? objc - 2 : (int)(sizeof(entry_props)
+            / sizeof(entry_props[0]) - 1);
+    char** keys;
+    char** values;
+    reg_error error;
+    int i, index;
+    if (reg == NULL) {
+        return TCL_ERROR;
+    }
+    keys = malloc(key_count * sizeof(char*));
+    if (!keys) {
+        return TCL_ERROR;
+    }
+    for (i = 0; i < key_count; i++) {
+        if (objc > 2) {
+            if (Tcl_GetIndexFromObj(interp, objv[i+2], entry_props, "prop", 0,
+                        &index) != TCL_OK) {
+                free(keys);
+                return TCL_ERROR;
+            }
+        } else {
+            index = i;
+        }
+        keys[i] = (char*)entry_props[index];
+    }
+    if (reg_entry_props(entry, keys, key_count, &values, &error)) {
+        Tcl_Obj* result = Tcl_NewDictObj();
+        for (i = 0; i < key_count; i++) {
+            if (values[i]) {
+                Tcl_DictObjPut(NULL, result, Tcl_NewStringObj(keys[i], -1),
+                        Tcl_NewStringObj(values[i], -1));
+                free(values[i]);
+            }
+        }
+        free(values);
+        free(keys);
+        Tcl_SetObjResult(interp, result);
+        return TCL_OK;
+    }
+    free(keys);
+    return registry_failed(interp, &error);
+}
+
 typedef struct {
     char* name;
     int (*function)(reg_entry* entry, char** files, int file_count,
@@ -432,6 +484,7 @@ static entry_obj_cmd_type entry_cmds[] = {
     { "requested", entry_obj_prop },
     { "cxx_stdlib", entry_obj_prop },
     { "cxx_stdlib_overridden", entry_obj_prop },
+    { "props", entry_obj_props },
     /* filemap */
     { "map", entry_obj_filemap },
     { "unmap", entry_obj_filemap },
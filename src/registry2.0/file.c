@@ -30,11 +30,13 @@
 #include <config.h>
 #endif
 
+#include <limits.h>
 #include <sqlite3.h>
 #include <stdlib.h>
 #include <string.h>
 #include <tcl.h>
 
+#include <cregistry/entry.h>
 #include <cregistry/file.h>
 #include <cregistry/util.h>
 
@@ -270,6 +272,110 @@ static int file_search(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]) {
     }
 }
 
+/*
+ * registry::file owners paths ?cs?
+ *
+ * Finds the ports owning the given paths with a single query. Returns a dict
+ * mapping each path that is owned by an active port to a list of the owning
+ * entry, the path the file is active as, which can differ from the given
+ * path in case if cs is false, and the path of the file in the port's image,
+ * which differs if the file was activated under another name. Paths are compared case-sensitively unless cs
+ * is given and false, like in `registry::entry owner`.
+ */
+static int file_owners(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]) {
+    reg_registry* reg = registry_for(interp, reg_attached);
+    int cs = 1;
+    Tcl_Obj** listv;
+    Tcl_Size listc;
+
+    if ((objc < 3) || (objc > 4)) {
+        Tcl_WrongNumArgs(interp, 2, objv, "paths ?cs?");
+        return TCL_ERROR;
+    }
+    if (objc == 4) {
+        if (Tcl_GetBooleanFromObj(interp, objv[3], &cs) != TCL_OK) {
+            return TCL_ERROR;
+        }
+    }
+    if (Tcl_ListObjGetElements(interp, objv[2], &listc, &listv) != TCL_OK) {
+        return TCL_ERROR;
+    }
+
+    if (reg == NULL) {
+        return TCL_ERROR;
+    } else {
+        char** paths;
+        char** actual_paths;
+        char** image_paths;
+        sqlite_int64* ids;
+        reg_error error;
+        int retval = TCL_ERROR;
+        Tcl_Size i;
+
+        if (listc > INT_MAX) {
+            Tcl_SetResult(interp, "too many paths", TCL_STATIC);
+            return TCL_ERROR;
+        }
+        paths = malloc(listc * sizeof(char*));
+        actual_paths = malloc(listc * sizeof(char*));
+        image_paths = malloc(listc * sizeof(char*));
+        ids = malloc(listc * sizeof(sqlite_int64));
+        if (listc > 0 && (!paths || !actual_paths || !image_paths || !ids)) {
+            free(paths);
+            free(actual_paths);
+            free(image_paths);
+            free(ids);
+            Tcl_SetResult(interp, "memory allocation failed", TCL_STATIC);
+            return TCL_ERROR;
+        }
+        for (i = 0; i < listc; i++) {
+            paths[i] = Tcl_GetString(listv[i]);
+        }
+
+        if (reg_entry_owner_ids(reg, paths, (int)listc, cs, ids, actual_paths,
+                    image_paths, &error)) {
+            Tcl_Obj* result = Tcl_NewDictObj();
+            retval = TCL_OK;
+            for (i = 0; i < listc && retval == TCL_OK; i++) {
+                Tcl_Obj* owner[3];
+                reg_entry* entry;
+                if (ids[i] == 0) {
+                    continue;
+                }
+                if (!(entry = reg_entry_for_id(reg, ids[i]))) {
+                    Tcl_SetResult(interp, "memory allocation failed",
+                            TCL_STATIC);
+                    retval = TCL_ERROR;
+                } else if (!entry_to_obj(interp, &owner[0], entry, NULL,
+                            &error)) {
+                    retval = registry_failed(interp, &error);
+                } else {
+                    owner[1] = Tcl_NewStringObj(actual_paths[i], -1);
+                    owner[2] = Tcl_NewStringObj(image_paths[i], -1);
+                    Tcl_DictObjPut(interp, result, listv[i],
+                            Tcl_NewListObj(3, owner));
+                }
+            }
+            if (retval == TCL_OK) {
+                Tcl_SetObjResult(interp, result);
+            } else {
+                Tcl_DecrRefCount(result);
+            }
+            for (i = 0; i < listc; i++) {
+                free(actual_paths[i]);
+                free(image_paths[i]);
+            }
+        } else {
+            retval = registry_failed(interp, &error);
+        }
+        free(paths);
+        free(actual_paths);
+        free(image_paths);
+        free(ids);
+        return retval;
+    }
+}
+
 typedef struct {
     char* name;
     int (*function)(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
@@ -280,6 +386,7 @@ static file_cmd_type file_cmds[] = {
     { "open", file_open },
     { "close", file_close },
     { "search", file_search },
+    { "owners", file_owners },
     { NULL, NULL }
 };
 
@@ -0,0 +1,376 @@
+/*
+ * image.c
+ * vim:tw=80:expandtab
+ *
+ * Copyright (c) 2026 The MacPorts Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/* required for clonefile(2) on macOS */
+#define _DARWIN_C_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <tcl.h>
+
+#ifdef HAVE_SYS_CLONEFILE_H
+#include <sys/clonefile.h>
+#endif
+
+#include "image.h"
+
+/*
+ * Commands used by portimage.tcl to activate the contents of a port image
+ * without running Tcl code for each of its files, which takes minutes for
+ * ports with 100000 and more files.
+ */
+
+/**
+ * Sets the length of `path` to that of its parent directory, like
+ * `file dirname` does for normalized paths.
+ *
+ * @param [in,out] path a path
+ */
+static void dirname_dstring(Tcl_DString* path) {
+    char* str = Tcl_DStringValue(path);
+    char* slash = strrchr(str, '/');
+    if (slash == NULL) {
+        Tcl_DStringSetLength(path, 0);
+        Tcl_DStringAppend(path, ".", 1);
+    } else if (slash == str) {
+        Tcl_DStringSetLength(path, 1);
+    } else {
+        Tcl_DStringSetLength(path, (Tcl_Size)(slash - str));
+    }
+}
+
+/*
+ * registry::image scan imageroot files
+ *
+ * Checks the files of an image before activating it. Returns a list of three
+ * lists: the files that are missing from the image in imageroot, the files
+ * that already exist in the filesystem, and the parent directories of all
+ * files (including /), in no particular order.
+ */
+static int image_scan(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]) {
+    Tcl_Obj** files;
+    Tcl_Size file_count;
+    Tcl_Size i;
+    Tcl_Size root_length;
+    Tcl_DString src;
+    Tcl_DString dir;
+    Tcl_HashTable seen;
+    Tcl_Obj* result[3];
+    struct stat st;
+
+    if (objc != 4) {
+        Tcl_WrongNumArgs(interp, 2, objv, "imageroot files");
+        return TCL_ERROR;
+    }
+    if (Tcl_ListObjGetElements(interp, objv[3], &file_count, &files)
+            != TCL_OK) {
+        return TCL_ERROR;
+    }
+
+    result[0] = Tcl_NewListObj(0, NULL);
+    result[1] = Tcl_NewListObj(0, NULL);
+    result[2] = Tcl_NewListObj(0, NULL);
+    Tcl_InitHashTable(&seen, TCL_STRING_KEYS);
+    Tcl_DStringInit(&src);
+    Tcl_DStringInit(&dir);
+    Tcl_DStringAppend(&src, Tcl_GetString(objv[2]), -1);
+    root_length = Tcl_DStringLength(&src);
+
+    for (i = 0; i < file_count; i++) {
+        Tcl_Size length;
+        const char* file = Tcl_GetStringFromObj(files[i], &length);
+
+        Tcl_DStringSetLength(&src, root_length);
+        Tcl_DStringAppend(&src, file, length);
+        if (lstat(Tcl_DStringValue(&src), &st) != 0) {
+            Tcl_ListObjAppendElement(interp, result[0], files[i]);
+        }
+        if (lstat(file, &st) == 0) {
+            Tcl_ListObjAppendElement(interp, result[1], files[i]);
+        }
+
+        /* add all parent directories that have not been seen yet; if one
+         * has, so have all of its parents */
+        Tcl_DStringSetLength(&dir, 0);
+        Tcl_DStringAppend(&dir, file, length);
+        for (;;) {
+            int is_new;
+            dirname_dstring(&dir);
+            Tcl_CreateHashEntry(&seen, Tcl_DStringValue(&dir), &is_new);
+            if (!is_new) {
+                break;
+            }
+            Tcl_ListObjAppendElement(interp, result[2], Tcl_NewStringObj(
+                        Tcl_DStringValue(&dir), Tcl_DStringLength(&dir)));
+        }
+    }
+
+    Tcl_DStringFree(&src);
+    Tcl_DStringFree(&dir);
+    Tcl_DeleteHashTable(&seen);
+    Tcl_SetObjResult(interp, Tcl_NewListObj(3, result));
+    return TCL_OK;
+}
+
+static const char* install_modes[] = { "rename", "clone", NULL };
+enum { INSTALL_RENAME, INSTALL_CLONE };
+
+/**
+ * Sets the interpreter result and error code for a failed system call on a
+ * pair of files, in the format used by `file rename`.
+ */
+static int install_failed(Tcl_Interp* interp, const char* operation,
+        const char* src, const char* dst) {
+    Tcl_Obj* msg = Tcl_ObjPrintf("error %s \"%s\" to \"%s\": %s", operation,
+            src, dst, Tcl_PosixError(interp));
+    Tcl_SetObjResult(interp, msg);
+    return TCL_ERROR;
+}
+
+/*
+ * registry::image install srcfiles dstfiles mode rollbackVar ?device?
+ *
+ * Moves (mode rename) or clones (mode clone) each of srcfiles to the
+ * corresponding path in dstfiles, whose parent directories must exist. Files
+ * that are hard links to a file installed earlier are hard linked to it
+ * instead. Existing destination files are skipped; they are files of this
+ * port that differ only in case. Each installed file is appended to the list
+ * in rollbackVar, even if an error occurs later.
+ *
+ * In clone mode, device is the device number of the image directory. Files
+ * whose destination is on a different device, or that cannot be cloned on
+ * this system, are not installed. They are returned as a list of source and
+ * destination pairs, together with all remaining files if a signal arrived,
+ * to be installed by the caller.
+ */
+static int image_install(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]) {
+    Tcl_Obj** srcfiles;
+    Tcl_Obj** dstfiles;
+    Tcl_Size src_count, dst_count;
+    Tcl_Size i;
+    int mode;
+    Tcl_WideInt device = -1;
+    Tcl_Obj* rollback;
+    Tcl_Obj* remaining;
+    Tcl_HashTable hardlinks;
+    Tcl_HashEntry* hash;
+    Tcl_HashSearch search;
+    Tcl_DString dir;
+    Tcl_DString last_dir;
+#ifdef HAVE_CLONEFILE
+    dev_t last_dev = 0;
+#endif
+    int retval = TCL_OK;
+
+    if (objc != 6 && objc != 7) {
+        Tcl_WrongNumArgs(interp, 2, objv,
+                "srcfiles dstfiles mode rollbackVar ?device?");
+        return TCL_ERROR;
+    }
+    if (Tcl_ListObjGetElements(interp, objv[2], &src_count, &srcfiles)
+                != TCL_OK
+            || Tcl_ListObjGetElements(interp, objv[3], &dst_count, &dstfiles)
+                != TCL_OK
+            || Tcl_GetIndexFromObj(interp, objv[4], install_modes, "mode", 0,
+                &mode) != TCL_OK
+            || (objc == 7
+                && Tcl_GetWideIntFromObj(interp, objv[6], &device) != TCL_OK)) {
+        return TCL_ERROR;
+    }
+    if (src_count != dst_count) {
+        Tcl_SetResult(interp, "srcfiles and dstfiles must have the same length",
+                TCL_STATIC);
+        return TCL_ERROR;
+    }
+
+    rollback = Tcl_ObjGetVar2(interp, objv[5], NULL, 0);
+    if (rollback == NULL) {
+        rollback = Tcl_NewListObj(0, NULL);
+    } else if (Tcl_IsShared(rollback)) {
+        rollback = Tcl_DuplicateObj(rollback);
+    }
+    Tcl_IncrRefCount(rollback);
+    remaining = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(remaining);
+    Tcl_InitHashTable(&hardlinks, TCL_STRING_KEYS);
+    Tcl_DStringInit(&dir);
+    Tcl_DStringInit(&last_dir);
+
+    for (i = 0; i < src_count; i++) {
+        const char* src = Tcl_GetString(srcfiles[i]);
+        const char* dst = Tcl_GetString(dstfiles[i]);
+        struct stat st;
+        int hardlinked = 0;
+
+        if (Tcl_AsyncReady()) {
+            /* let the caller handle the rest, after the signal handler ran */
+            for (; i < src_count; i++) {
+                Tcl_ListObjAppendElement(interp, remaining, srcfiles[i]);
+                Tcl_ListObjAppendElement(interp, remaining, dstfiles[i]);
+            }
+            break;
+        }
+
+        if (lstat(dst, &st) == 0) {
+            continue;
+        }
+        if (lstat(src, &st) != 0) {
+            Tcl_Obj* msg = Tcl_ObjPrintf("could not read \"%s\": %s", src,
+                    Tcl_PosixError(interp));
+            Tcl_SetObjResult(interp, msg);
+            retval = TCL_ERROR;
+            break;
+        }
+
+        if (st.st_nlink > 1) {
+            char key[64];
+            int is_new;
+            snprintf(key, sizeof(key), "%llu:%llu",
+                    (unsigned long long)st.st_dev,
+                    (unsigned long long)st.st_ino);
+            hash = Tcl_CreateHashEntry(&hardlinks, key, &is_new);
+            if (is_new) {
+                /* the first link is installed normally, the others are
+                 * linked to it */
+                Tcl_IncrRefCount(dstfiles[i]);
+                Tcl_SetHashValue(hash, dstfiles[i]);
+            } else if (link(Tcl_GetString((Tcl_Obj*)Tcl_GetHashValue(hash)),
+                        dst) == 0) {
+                /* if this fails, e.g. because the destinations are on
+                 * different devices, install the file normally */
+                hardlinked = 1;
+            }
+        }
+
+        if (!hardlinked && mode == INSTALL_CLONE) {
+#ifdef HAVE_CLONEFILE
+            struct stat dir_st;
+            Tcl_DStringSetLength(&dir, 0);
+            Tcl_DStringAppend(&dir, dst, -1);
+            dirname_dstring(&dir);
+            if (strcmp(Tcl_DStringValue(&dir), Tcl_DStringValue(&last_dir))
+                    != 0 || Tcl_DStringLength(&last_dir) == 0) {
+                if (stat(Tcl_DStringValue(&dir), &dir_st) != 0) {
+                    retval = install_failed(interp, "cloning", src, dst);
+                    break;
+                }
+                last_dev = dir_st.st_dev;
+                Tcl_DStringSetLength(&last_dir, 0);
+                Tcl_DStringAppend(&last_dir, Tcl_DStringValue(&dir),
+                        Tcl_DStringLength(&dir));
+            }
+            if ((Tcl_WideInt)last_dev != device) {
+                Tcl_ListObjAppendElement(interp, remaining, srcfiles[i]);
+                Tcl_ListObjAppendElement(interp, remaining, dstfiles[i]);
+                continue;
+            }
+            if (clonefile(src, dst, CLONE_NOFOLLOW) != 0) {
+                retval = install_failed(interp, "cloning", src, dst);
+                break;
+            }
+            /* not all permissions are preserved by clonefile */
+            if (!S_ISLNK(st.st_mode)
+                    && chmod(dst, st.st_mode & 07777) != 0) {
+                Tcl_ListObjAppendElement(interp, rollback, dstfiles[i]);
+                retval = install_failed(interp, "cloning", src, dst);
+                break;
+            }
+#else
+            Tcl_ListObjAppendElement(interp, remaining, srcfiles[i]);
+            Tcl_ListObjAppendElement(interp, remaining, dstfiles[i]);
+            continue;
+#endif /* HAVE_CLONEFILE */
+        } else if (!hardlinked && rename(src, dst) != 0) {
+            retval = install_failed(interp, "renaming", src, dst);
+            break;
+        }
+
+        Tcl_ListObjAppendElement(interp, rollback, dstfiles[i]);
+    }
+
+    for (hash = Tcl_FirstHashEntry(&hardlinks, &search); hash != NULL;
+            hash = Tcl_NextHashEntry(&search)) {
+        Tcl_DecrRefCount((Tcl_Obj*)Tcl_GetHashValue(hash));
+    }
+    Tcl_DeleteHashTable(&hardlinks);
+    Tcl_DStringFree(&dir);
+    Tcl_DStringFree(&last_dir);
+
+    /* record the installed files even on errors, so they can be removed */
+    if (Tcl_ObjSetVar2(interp, objv[5], NULL, rollback, TCL_LEAVE_ERR_MSG)
+            == NULL) {
+        retval = TCL_ERROR;
+    }
+    Tcl_DecrRefCount(rollback);
+
+    if (retval == TCL_OK) {
+        Tcl_SetObjResult(interp, remaining);
+    }
+    Tcl_DecrRefCount(remaining);
+    return retval;
+}
+
+typedef struct {
+    char* name;
+    int (*function)(Tcl_Interp* interp, int objc, Tcl_Obj* const objv[]);
+} image_cmd_type;
+
+static image_cmd_type image_cmds[] = {
+    { "scan", image_scan },
+    { "install", image_install },
+    { NULL, NULL }
+};
+
+/*
+ * registry::image cmd ?arg ...?
+ *
+ * Commands for activating port images.
+ */
+int image_cmd(ClientData clientData UNUSED, Tcl_Interp* interp, int objc,
+        Tcl_Obj* const objv[]) {
+    int cmd_index;
+    if (objc < 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "cmd ?arg ...?");
+        return TCL_ERROR;
+    }
+    if (Tcl_GetIndexFromObjStruct(interp, objv[1], image_cmds,
+                sizeof(image_cmd_type), "cmd", 0, &cmd_index) == TCL_OK) {
+        image_cmd_type* cmd = &image_cmds[cmd_index];
+        return cmd->function(interp, objc, objv);
+    }
+    return TCL_ERROR;
+}
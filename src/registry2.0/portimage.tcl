@@ -336,7 +336,26 @@ proc _activate_files {srcfiles dstfiles imageroot rollback_var} {
     set all_attrs [expr {[getuid] == 0}]
     set hardlinks [dict create]
 
-    foreach srcfile $srcfiles dstfile $dstfiles {
+    # Moving and cloning files is done without running Tcl code for each file;
+    # only the files it leaves over are handled below.
+    if {$use_clone} {
+        set remaining [registry::image install $srcfiles $dstfiles clone rollback_list $imagedev]
+    } elseif {!$keep_imagedir} {
+        set remaining [registry::image install $srcfiles $dstfiles rename rollback_list]
+    } else {
+        set remaining [list]
+        foreach srcfile $srcfiles dstfile $dstfiles {
+            lappend remaining $srcfile $dstfile
+        }
+    }
+    set installed [expr {[llength $srcfiles] - [llength $remaining] / 2}]
+    if {$installed > 0} {
+        ui_debug "activated $installed files from $imageroot"
+        incr progress_step $installed
+        _progress update $progress_step $progress_total_steps
+    }
+
+    foreach {srcfile dstfile} $remaining {
         # this can happen if the archive was built on case-sensitive and we're case-insensitive
         # we know any existing dstfile is ours because we checked for conflicts earlier
         if {![catch {::file type $dstfile}]} {
@@ -629,34 +648,24 @@ proc _progress {args} {
     ui_progress_generic {*}${args}
 }
 
-proc _get_port_conflicts {port} {
-    global registry::tdbc_connection
-    variable conflicts_stmt
-    if {![info exists conflicts_stmt]} {
-        set query {SELECT files.id, files.path, files.actual_path FROM
-                (SELECT path FROM files where id = :thisport_id)
-                AS thisport_files
-                INNER JOIN files ON thisport_files.path = files.actual_path
-                WHERE files.active = 1}
-        set conflicts_stmt [$tdbc_connection prepare $query]
-    }
-
-    set thisport_id [$port id]
-    $tdbc_connection transaction {
-        set results [$conflicts_stmt execute]
-    }
-    set id_to_port [dict create]
+## Find the active files of other ports that conflict with the files of a
+# port, looking up the owners of all the port's files in a single query.
+#
+# @param port The registry entry of the port being activated
+# @param imagefiles The files of the port
+# @param cs Whether paths should be compared case-sensitively
+# @return A list of a dict mapping conflicting paths to the ports owning
+#         them, a dict mapping conflicting ports to lists of {path
+#         actual_path} pairs of their files to move aside, and a dict of
+#         ports replaced by this one that should be deactivated
+proc _get_port_conflicts {port imagefiles cs} {
     set path_to_port [dict create]
     set port_to_paths [dict create]
     set is_replaced [dict create]
     set todeactivate [dict create]
     set thisport_name [$port name]
-    foreach result [$results allrows] {
-        set id [dict get $result id]
-        if {![dict exists $id_to_port $id]} {
-            dict set id_to_port $id [lindex [registry::entry search id $id] 0]
-        }
-        set conflicting_port [dict get $id_to_port $id]
+    dict for {file owner} [registry::file owners $imagefiles $cs] {
+        lassign $owner conflicting_port actual_path path
         if {![dict exists $is_replaced $conflicting_port]} {
             lassign [mportlookup [$conflicting_port name]] _ portinfo
             if {[dict exists $portinfo replaced_by] && [lsearch -exact -nocase [dict get $portinfo replaced_by] $thisport_name] != -1} {
@@ -666,14 +675,11 @@ proc _get_port_conflicts {port} {
                 dict set is_replaced $conflicting_port 0
             }
         }
-        set actual_path [dict get $result actual_path]
-        dict set path_to_port $actual_path $conflicting_port
+        dict set path_to_port $file $conflicting_port
         if {![dict get $is_replaced $conflicting_port]} {
-            set imagepath [dict get $result path]
-            dict lappend port_to_paths $conflicting_port [list $imagepath $actual_path]
+            dict lappend port_to_paths $conflicting_port [list $path $actual_path]
         }
     }
-    $results close
     return [list $path_to_port $port_to_paths $todeactivate]
 }
 
@@ -713,57 +719,62 @@ proc _activate_contents {port {rename_list {}}} {
     }
 
     set backups [list]
-    set seendirs [dict create]
     set confirmed_rename_list [list]
-    # This is big and hairy and probably could be done better.
-    # First, we need to check the source file, make sure it exists.
-    # Then we remove the $location from the path of the file in the contents
-    #  list and check to see if that file exists.
-    # Last, if the file exists and force is set, we rename the file to a
+    # First, we need to check the source files, make sure they exist.
+    # Then we check whether any of the files already exist in the
+    # filesystem. Both checks are done by registry::image scan without
+    # running Tcl code for each file, which also collects the directories
+    # the files are in.
+    # If any file exists and force is set, we rename the file to a
     #  non-conflicting name, and update the activated path in the registry
     #  entry for the current owner (if any) accordingly, which allows
     #  the port now being activated to create and own the file.
     set todeactivate [dict create]
     set reg_forced_renames [list]
     try {
-        registry::read {
-            foreach file $imagefiles {
-                incr progress_step
-                _progress update $progress_step $progress_total_steps
-                set srcfile "${extracted_dir}${file}"
-
-                # To be able to install links, we test if 'file type' errors to
-                # figure out if the source file exists (file exists will return
-                # false for symlinks on files that do not exist)
-                if {[catch {::file type $srcfile}]} {
-                    throw registry::image-error "Image error: Source file $srcfile does not appear to exist.  Unable to activate port ${portname}."
-                }
+        lassign [registry::image scan $extracted_dir $imagefiles] missing existing directories
+        if {[llength $missing] > 0} {
+            set srcfile "${extracted_dir}[lindex $missing 0]"
+            throw registry::image-error "Image error: Source file $srcfile does not appear to exist.  Unable to activate port ${portname}."
+        }
+        # Every directory will need an additional step in the second phase
+        # of activation.
+        incr progress_total_steps [llength $directories]
+        incr progress_step $num_imagefiles
+        _progress update $progress_step $progress_total_steps
 
-                if {![catch {::file type $file}]} {
-                    if {![info exists conflicts_path_to_port]} {
-                        # Check for conflicting ports. 'todeactivate' contains ports replaced by this one,
-                        # which we'll deactivate later, but before activating our files.
-                        lassign [_get_port_conflicts $port] conflicts_path_to_port conflicts_port_to_paths todeactivate
-                        if {!$force && [dict size $conflicts_port_to_paths] > 0} {
-                            set msg "The following ports have active files that conflict with ${portname}'s:\n"
-                            foreach conflicting_port [dict keys $conflicts_port_to_paths] {
-                                append msg "[$conflicting_port name] @[$conflicting_port version]_[$conflicting_port revision][$conflicting_port variants]\n"
-                                set conflicting_paths [dict get $conflicts_port_to_paths $conflicting_port]
-                                set pathcounter 0
-                                set pathtotal [llength $conflicting_paths]
-                                foreach p $conflicting_paths {
-                                    if {$pathcounter >= 3 && $pathtotal > 4} {
-                                        append msg "  (... [expr {$pathtotal - $pathcounter}] more not shown)\n"
-                                        break
-                                    }
-                                    append msg "  [lindex $p 1]\n"
-                                    incr pathcounter
-                                }
+        if {[llength $existing] > 0} {
+            registry::read {
+                # Check for conflicting ports. 'todeactivate' contains ports replaced by this one,
+                # which we'll deactivate later, but before activating our files.
+                set file [lindex $existing 0]
+                if {[catch {fs_case_sensitive $file} cs]} {
+                    ui_debug "Unable to get file system case-sensitivity of file $file, assuming worst case (case-insensitive.)"
+                    set cs 0
+                }
+                lassign [_get_port_conflicts $port $imagefiles $cs] conflicts_path_to_port conflicts_port_to_paths todeactivate
+                if {!$force && [dict size $conflicts_port_to_paths] > 0} {
+                    set msg "The following ports have active files that conflict with ${portname}'s:\n"
+                    foreach conflicting_port [dict keys $conflicts_port_to_paths] {
+                        append msg "[$conflicting_port name] @[$conflicting_port version]_[$conflicting_port revision][$conflicting_port variants]\n"
+                        set conflicting_paths [dict get $conflicts_port_to_paths $conflicting_port]
+                        set pathcounter 0
+                        set pathtotal [llength $conflicting_paths]
+                        foreach p $conflicting_paths {
+                            if {$pathcounter >= 3 && $pathtotal > 4} {
+                                append msg "  (... [expr {$pathtotal - $pathcounter}] more not shown)\n"
+                                break
                             }
-                            append msg "Image error: Conflicting file(s) present. Please deactivate the conflicting port(s) first, or use 'port -f activate $portname' to force the activation."
-                            throw registry::image-error $msg
+                            append msg "  [lindex $p 1]\n"
+                            incr pathcounter
                         }
                     }
+                    append msg "Image error: Conflicting file(s) present. Please deactivate the conflicting port(s) first, or use 'port -f activate $portname' to force the activation."
+                    throw registry::image-error $msg
+                }
+
+                set renamed_owners [dict create]
+                foreach file $existing {
                     set owner [dict getwithdefault $conflicts_path_to_port $file {}]
                     if {$owner eq {} || ![dict exists $todeactivate $owner]} {
                         if {$force} {
@@ -774,6 +785,10 @@ proc _activate_contents {port {rename_list {}}} {
                             # fails. The filesystem part is rolled back in the on error
                             # clause of the outermost try statement.
                             if {$owner ne {}} {
+                                if {[dict exists $renamed_owners $owner]} {
+                                    continue
+                                }
+                                dict set renamed_owners $owner 1
                                 # Rename all conflicting files for this owner.
                                 set owner_deactivate_paths [list]
                                 set owner_activate_paths [list]
@@ -792,8 +807,10 @@ proc _activate_contents {port {rename_list {}}} {
                                     }
                                 }
                                 lappend reg_forced_renames $owner $owner_deactivate_paths $owner_activate_paths $owner_backup_paths
-                            } else {
-                                # Just rename this file.
+                            } elseif {![catch {::file type $file}]} {
+                                # Just rename this file, unless it was a
+                                # case-insensitive match of a file renamed
+                                # above.
                                 set bakfile ${file}${baksuffix}
                                 _progress intermission
                                 ui_warn "File $file already exists.  Moving to: $bakfile."
@@ -808,29 +825,14 @@ proc _activate_contents {port {rename_list {}}} {
                         }
                     }
                 }
+            }
+        }
 
-                # Split out the filename's subpaths and add them to the
-                # imagefile list.
-                # We need directories first to make sure they will be there
-                # before links. However, because file mkdir creates all parent
-                # directories, we don't need to have them sorted from root to
-                # subpaths. We do need, nevertheless, all sub paths to make sure
-                # we'll set the directory attributes properly for all
-                # directories.
-                set directory [::file dirname $file]
-                while {![dict exists $seendirs $directory]} {
-                    dict set seendirs $directory 1
-                    # Any add here will mean an additional step in the second
-                    # phase of activation. We could just update this once after
-                    # this foreach loop is complete, but that could make the
-                    # progress bar jump from 66 % down to 65. Doing it
-                    # incrementally here will hopefully hide the increase in
-                    # noise.
-                    incr progress_total_steps
-                    set directory [::file dirname $directory]
-                }
-
-                # Also add the filename to the normal or renamed list.
+        # Split the files into the normal and renamed lists.
+        if {[dict size $rename_list] == 0} {
+            set files $imagefiles
+        } else {
+            foreach file $imagefiles {
                 if {[dict exists $rename_list $file]} {
                     lappend confirmed_rename_list $file [dict get $rename_list $file]
                 } else {
@@ -838,8 +840,6 @@ proc _activate_contents {port {rename_list {}}} {
                 }
             }
         }
-        set directories [dict keys $seendirs]
-        unset seendirs
 
         # deactivate ports replaced_by this one
         set deactivate_options [dict create ports_nodepcheck 1]
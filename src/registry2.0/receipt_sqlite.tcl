@@ -41,6 +41,21 @@ package require registry_util 2.0
 ##
 namespace eval receipt_sqlite {
 ##
+# Return the fields of a registry entry that #active and #installed report,
+# read with a single query.
+#
+# @param port
+#        The registry entry.
+# @return A list of (name, version, revision, variants, 1 or 0 indicating
+#         whether the port's state is "installed", epoch).
+proc port_summary {port} {
+    set props [dict merge {name {} version {} revision {} variants {} state {} epoch {}} \
+        [$port props name version revision variants state epoch]]
+    dict with props {
+        return [list $name $version $revision $variants [string equal $state "installed"] $epoch]
+    }
+}
+##
 # Return a list of active ports, or the active version of port \a name, if
 # specified.
 #
@@ -58,7 +73,7 @@ proc active {name} {
     }
     set rlist [list]
     foreach port $ports {
-        lappend rlist [list [$port name] [$port version] [$port revision] [$port variants] [string equal [$port state] "installed"] [$port epoch]]
+        lappend rlist [port_summary $port]
         #registry::entry close $port
     }
     return $rlist
@@ -248,7 +263,8 @@ proc installed {{name ""} {version ""}} {
         set ports [list]
         set possible_ports [registry::entry imaged $name]
         foreach p $possible_ports {
-            if {"[$p version]_[$p revision][$p variants]" eq $version || [$p version] eq $version} {
+            lassign [port_summary $p] - p_version p_revision p_variants
+            if {"${p_version}_${p_revision}${p_variants}" eq $version || $p_version eq $version} {
                 lappend ports $p
             } else {
                 #registry::entry close $p
@@ -258,7 +274,7 @@ proc installed {{name ""} {version ""}} {
 
     set rlist [list]
     foreach port $ports {
-        lappend rlist [list [$port name] [$port version] [$port revision] [$port variants] [string equal [$port state] "installed"] [$port epoch]]
+        lappend rlist [port_summary $port]
         #registry::entry close $port
     }
     return $rlist
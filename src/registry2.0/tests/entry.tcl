@@ -55,6 +55,12 @@ proc main {pextlibname} {
         test_equal {[$vim3 version]} 7.1.002
         test_equal {[$zlib revision]} 1
         test_equal {[$pcre variants]} +utf8
+
+        # several properties at once; unset ones are left out
+        test_equal {[$vim3 props name version state]} {name vim version 7.1.002 state installed}
+        test_equal {[dict get [$zlib props] installtype]} direct
+        test_equal {[dict exists [$zlib props] portfile]} 0
+        test {[catch {$zlib props name bogus}]}
     
         # check that imaged and installed give correct results
         test_set {[registry::entry imaged]} {$vim1 $vim2 $vim3 $zlib $pcre}
@@ -130,6 +136,24 @@ proc main {pextlibname} {
         test_equal {[registry::entry owner /opt/local/bin/vimdiff]} {$vim2}
         test_equal {[registry::entry owner /opt/local/bin/vimdiff.0]} {$vim3}
 
+        # look up the owners of many files at once
+        test_equal {[registry::file owners {}]} {}
+        set owners [registry::file owners [list /opt/local/bin/vim \
+            /opt/local/bin/vimdiff /opt/local/bin/vimdiff.0 \
+            /opt/local/bin/emacs]]
+        test_set {[dict keys $owners]} {/opt/local/bin/vim \
+            /opt/local/bin/vimdiff /opt/local/bin/vimdiff.0}
+        test_equal {[dict get $owners /opt/local/bin/vim]} \
+            {$vim3 /opt/local/bin/vim /opt/local/bin/vim}
+        test_equal {[dict get $owners /opt/local/bin/vimdiff]} \
+            {$vim2 /opt/local/bin/vimdiff /opt/local/bin/vimdiff}
+        test_equal {[dict get $owners /opt/local/bin/vimdiff.0]} \
+            {$vim3 /opt/local/bin/vimdiff.0 /opt/local/bin/vimdiff}
+        test_equal {[registry::file owners /OPT/local/bin/VIM]} {}
+        test_equal {[registry::file owners /OPT/local/bin/VIM yes]} {}
+        test_equal {[registry::file owners /OPT/local/bin/VIM no]} \
+            {/OPT/local/bin/VIM {$vim3 /opt/local/bin/vim /opt/local/bin/vim}}
+
         # make sure you can't unmap a file you don't own
         test_throws {$zlib unmap [list /opt/local/bin/vim]} registry::invalid
         test_throws {$zlib unmap [list /opt/local/bin/emacs]} registry::invalid
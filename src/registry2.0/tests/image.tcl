@@ -0,0 +1,73 @@
+# Test file for registry::image
+# Syntax:
+# tclsh image.tcl registry.dylib
+
+proc main {pextlibname} {
+    load $pextlibname
+
+    set root [file normalize image-test]
+    file delete -force $root
+    set image ${root}/image
+    set dest ${root}/dest
+    file mkdir ${image}${dest}/bin ${image}${dest}/share/doc ${dest}/bin
+
+    foreach f {bin/a bin/b share/doc/README} {
+        close [open ${image}${dest}/$f w]
+    }
+    file link -symbolic ${image}${dest}/bin/c a
+    file link -hard ${image}${dest}/bin/d ${image}${dest}/bin/a
+    close [open ${dest}/bin/b w]
+
+    set files [lmap f {bin/a bin/b bin/c bin/d share/doc/README} {
+        string cat $dest/ $f
+    }]
+
+    # check the image before activating it
+    lassign [registry::image scan $image $files] missing existing directories
+    test_equal {$missing} {}
+    test_equal {$existing} {$dest/bin/b}
+    set parents [list $dest/bin $dest/share $dest/share/doc]
+    for {set d $dest} {$d ne "/"} {set d [file dirname $d]} {
+        lappend parents $d
+    }
+    lappend parents /
+    test_set {$directories} {{*}$parents}
+    lassign [registry::image scan $image [list $dest/bin/e]] missing existing
+    test_equal {$missing} {$dest/bin/e}
+    test_equal {$existing} {}
+
+    # cloning is not supported everywhere; what isn't cloned is returned
+    set rollback [list]
+    set remaining [registry::image install [list ${image}${dest}/bin/a] \
+        [list ${dest}/bin/a] clone rollback -1]
+    test_equal {$remaining} {${image}${dest}/bin/a ${dest}/bin/a}
+    test_equal {$rollback} {}
+
+    # move the files, skipping the one that exists
+    file mkdir $dest/share/doc
+    set rollback [list]
+    set remaining [registry::image install \
+        [lmap f $files {string cat $image $f}] $files rename rollback]
+    test_equal {$remaining} {}
+    test_set {$rollback} {$dest/bin/a $dest/bin/c $dest/bin/d \
+        $dest/share/doc/README}
+    test_equal {[file type $dest/bin/c]} {link}
+    test_equal {[file link $dest/bin/c]} {a}
+    test_equal {[file exists ${image}${dest}/bin/a]} 0
+    test_equal {[file exists ${image}${dest}/bin/b]} 1
+    file stat $dest/bin/a st_a
+    file stat $dest/bin/d st_d
+    test_equal {$st_a(ino)} {$st_d(ino)}
+
+    # files installed before an error are still recorded
+    set rollback [list]
+    test {[catch {registry::image install \
+        [list ${image}${dest}/bin/b ${image}/missing] \
+        [list $dest/bin/e $dest/bin/f] rename rollback}]}
+    test_equal {$rollback} {$dest/bin/e}
+
+    file delete -force $root
+}
+
+source tests/common.tcl
+main $argv
@@ -0,0 +1,85 @@
+# Test file for registry::snapshot
+# Syntax:
+# tclsh snapshot.tcl registry.dylib
+
+# number of rows in a table of the registry database
+proc row_count {db table} {
+    return [lindex [$db allrows -as lists "SELECT COUNT(*) FROM $table"] 0 0]
+}
+
+# files stored for a port in a snapshot, sorted
+proc snapshot_files {db snapshot port_name} {
+    set snapshot_id [$snapshot id]
+    return [concat {*}[$db allrows -as lists {
+        SELECT snapshot_fileset_files.path FROM snapshot_fileset_files
+        INNER JOIN snapshot_ports ON snapshot_fileset_files.fileset_id = snapshot_ports.fileset_id
+        WHERE snapshot_ports.port_name = :port_name
+        AND snapshot_ports.snapshots_id = :snapshot_id
+        ORDER BY snapshot_fileset_files.path ASC}]]
+}
+
+proc main {pextlibname} {
+    load $pextlibname
+    package require tdbc::sqlite3
+
+    # totally lame that file delete won't do it
+    exec -ignorestderr rm -f {*}[glob -nocomplain test.db*]
+
+    registry::open test.db
+
+    registry::write {
+        set zlib [registry::entry create zlib 1.2.3 1 {} 0]
+        set pcre [registry::entry create pcre 7.1 1 +utf8 0]
+        $zlib map [list /opt/local/lib/libz.dylib /opt/local/include/zlib.h]
+        $pcre map [list /opt/local/lib/libpcre.dylib]
+        $zlib state installed
+        $pcre state installed
+        $zlib date 1000
+        $pcre date 1000
+        $pcre requested 1
+    }
+    set db [tdbc::sqlite3::connection new test.db]
+
+    # repeated snapshots of the same ports share their file lists
+    registry::write {
+        set snap1 [registry::snapshot create first]
+        set snap2 [registry::snapshot create second]
+    }
+    registry::read {
+        test_equal {[$snap1 note]} first
+        test_set {[$snap1 ports]} {{pcre 1 installed +utf8 {}} {zlib 0 installed {} {}}}
+        test_set {[$snap2 ports]} {{pcre 1 installed +utf8 {}} {zlib 0 installed {} {}}}
+    }
+    test_equal {[row_count $db snapshot_filesets]} 2
+    test_equal {[row_count $db snapshot_fileset_files]} 3
+    test_equal {[snapshot_files $db $snap1 zlib]} {/opt/local/include/zlib.h /opt/local/lib/libz.dylib}
+    test_equal {[snapshot_files $db $snap2 zlib]} {/opt/local/include/zlib.h /opt/local/lib/libz.dylib}
+    test_equal {[snapshot_files $db $snap2 pcre]} /opt/local/lib/libpcre.dylib
+
+    # a newer version of a port gets its own file list
+    registry::write {
+        set pcre2 [registry::entry create pcre 7.2 0 +utf8 0]
+        $pcre2 map [list /opt/local/lib/libpcre.1.dylib]
+        $pcre state imaged
+        $pcre2 state installed
+        $pcre2 date 2000
+        set snap3 [registry::snapshot create third]
+    }
+    registry::read {
+        test_set {[$snap3 ports]} {{pcre 0 installed +utf8 {}} {zlib 0 installed {} {}}}
+        test_set {[$snap1 ports]} {{pcre 1 installed +utf8 {}} {zlib 0 installed {} {}}}
+        test_equal {[[registry::snapshot get_by_id [$snap2 id]] note]} second
+    }
+    test_equal {[row_count $db snapshot_filesets]} 3
+    test_equal {[row_count $db snapshot_fileset_files]} 4
+    test_equal {[snapshot_files $db $snap3 pcre]} /opt/local/lib/libpcre.1.dylib
+    test_equal {[snapshot_files $db $snap3 zlib]} {/opt/local/include/zlib.h /opt/local/lib/libz.dylib}
+    test_equal {[snapshot_files $db $snap1 pcre]} /opt/local/lib/libpcre.dylib
+
+    $db close
+    registry::close
+    file delete -force test.db test.db-shm test.db-wal
+}
+
+source tests/common.tcl
+main $argv
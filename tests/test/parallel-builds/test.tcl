@@ -0,0 +1,41 @@
+package require tcltest 2
+namespace import tcltest::*
+
+source [file dirname $argv0]/../library.tcl
+
+makeFile "" $output_file
+makeDirectory $work_dir
+set path [file dirname [file normalize $argv0]]
+
+# Initial setup, building up to two dependencies at once
+load_variables $path
+set_dir
+set fd [open $portsrc a]
+puts $fd "parallel_builds 2"
+close $fd
+port_index
+port_clean $path
+port_run $path
+
+proc parallel_builds {} {
+    global output_file
+
+    if {[get_line $output_file "error*"] ne "-1"} {
+        return "error in output"
+    }
+    set result [list]
+    foreach dep {parallel-builds-x parallel-builds-y} {
+        lappend result [expr {[get_line $output_file "*building $dep in process*"] ne "-1"}]
+        lappend result [expr {[get_line $output_file "*activating $dep @1_0"] ne "-1"}]
+    }
+    return $result
+}
+
+test parallel-builds {
+    Regression test for building dependencies in parallel.
+} -body {
+    parallel_builds
+} -result "1 1 1 1"
+
+cleanup
+cleanupTests